@@ -0,0 +1,258 @@
+#include <gvk.hpp>
+#include <benchmark/benchmark.h>
+#include <random>
+#include <map>
+
+#include "cpu_kernels.hpp"
+#include "particle_stream_codec.hpp"
+
+// Microbenchmarks of the CPU hot paths in cpu_kernels.hpp and of the particle stream codec.
+// For machine-readable results, run with:
+//   fluid-nightmare-benchmarks.exe --benchmark_format=json --benchmark_out=benchmark_results.json
+
+// Positions which are distributed like the candidates returned by the spawn shader:
+static std::vector<glm::vec4> make_spawn_candidates(size_t aCount)
+{
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> dist(-10.0f, 10.0f);
+	std::vector<glm::vec4> candidates(aCount);
+	for (auto& c : candidates) {
+		c = glm::vec4{ dist(rng), dist(rng), dist(rng), 0.0f };
+	}
+	return candidates;
+}
+
+// Geometry instances which resemble the ones of the water particles:
+static std::vector<avk::geometry_instance> make_geometry_instances(size_t aCount)
+{
+	std::vector<avk::geometry_instance> instances(aCount);
+	for (size_t i = 0; i < aCount; ++i) {
+		instances[i]
+			.set_instance_offset(1)
+			.set_mask(0x80)
+			.set_transform_column_major(particle_transform(glm::vec3{ static_cast<float>(i) }, 0.35f));
+	}
+	return instances;
+}
+
+// Selection of the spawn candidate, as performed after every spawn trace (16x16 candidates in the application):
+static void BM_SelectSpawnCandidate(benchmark::State& aState)
+{
+	const auto candidates = make_spawn_candidates(static_cast<size_t>(aState.range(0)));
+	for (auto _ : aState) {
+		benchmark::DoNotOptimize(select_spawn_candidate(candidates.data(), candidates.size()));
+	}
+	aState.SetItemsProcessed(aState.iterations() * aState.range(0));
+}
+BENCHMARK(BM_SelectSpawnCandidate)->RangeMultiplier(4)->Range(256, 65536);
+
+// Concatenation of triangle mesh instances and particle instances, as performed before every TLAS build:
+static void BM_ConcatenateGeometryInstances(benchmark::State& aState)
+{
+	const auto triangleMeshInstances = make_geometry_instances(64);
+	const auto particleInstances = make_geometry_instances(static_cast<size_t>(aState.range(0)));
+	for (auto _ : aState) {
+		auto result = concatenate_geometry_instances(triangleMeshInstances, particleInstances);
+		benchmark::DoNotOptimize(result.data());
+		benchmark::ClobberMemory();
+	}
+	aState.SetItemsProcessed(aState.iterations() * (aState.range(0) + 64));
+	aState.SetBytesProcessed(aState.iterations() * (aState.range(0) + 64) * static_cast<int64_t>(sizeof(avk::geometry_instance)));
+}
+BENCHMARK(BM_ConcatenateGeometryInstances)->RangeMultiplier(8)->Range(1024, 524288)->Unit(benchmark::kMicrosecond);
+
+// Assembly of the instance's transformation via gvk::matrix_from_transforms, as performed for every spawned particle:
+static void BM_ParticleTransform(benchmark::State& aState)
+{
+	const auto positions = make_spawn_candidates(static_cast<size_t>(aState.range(0)));
+	std::vector<avk::geometry_instance> instances(positions.size());
+	for (auto _ : aState) {
+		for (size_t i = 0; i < positions.size(); ++i) {
+			instances[i].set_transform_column_major(particle_transform(glm::vec3{ positions[i] }, 0.35f));
+		}
+		benchmark::DoNotOptimize(instances.data());
+		benchmark::ClobberMemory();
+	}
+	aState.SetItemsProcessed(aState.iterations() * aState.range(0));
+}
+BENCHMARK(BM_ParticleTransform)->RangeMultiplier(8)->Range(1024, 524288)->Unit(benchmark::kMicrosecond);
+
+// The ray-sphere intersection of rt_aabb.rint, executed on the CPU for a batch of rays against a unit sphere:
+static void BM_RaySphereIntersection(benchmark::State& aState)
+{
+	const auto origins = make_spawn_candidates(static_cast<size_t>(aState.range(0)));
+	for (auto _ : aState) {
+		int hits = 0;
+		for (const auto& o : origins) {
+			const glm::vec3 origin{ o.x, o.y, o.z + 20.0f };
+			hits += hit_sphere(glm::vec3{ 0.0f }, 0.5f, origin, glm::normalize(-origin)) > 0.0f ? 1 : 0;
+		}
+		benchmark::DoNotOptimize(hits);
+	}
+	aState.SetItemsProcessed(aState.iterations() * aState.range(0));
+}
+BENCHMARK(BM_RaySphereIntersection)->RangeMultiplier(8)->Range(1024, 262144);
+
+// Bounds of all particles, as computed for the temporal reprojection whenever the particles are replaced as a whole:
+static void BM_ParticleBounds(benchmark::State& aState)
+{
+	auto particles = make_spawn_candidates(static_cast<size_t>(aState.range(0)));
+	for (auto& p : particles) {
+		p.w = 0.35f;
+	}
+	for (auto _ : aState) {
+		benchmark::DoNotOptimize(compute_particle_bounds(particles.data(), particles.size()));
+	}
+	aState.SetItemsProcessed(aState.iterations() * aState.range(0));
+}
+BENCHMARK(BM_ParticleBounds)->RangeMultiplier(8)->Range(1024, 524288)->Unit(benchmark::kMicrosecond);
+
+// Collection of the dirty tiles for a 1920x1080 image, as performed in frames in which only particles have changed. The
+// argument is the edge length of the changed particles' bounds, in front of the camera:
+static void BM_CollectDirtyTiles(benchmark::State& aState)
+{
+	const float extent = static_cast<float>(aState.range(0));
+	const bounding_box changed{ glm::vec3{ -0.5f * extent, 0.0f, -20.0f }, glm::vec3{ 0.5f * extent, extent, -20.0f + extent } };
+	const bounding_box scene{ glm::vec3{ -100.0f, -10.0f, -100.0f }, glm::vec3{ 100.0f, 50.0f, 100.0f } };
+	const glm::mat4 camera = glm::translate(glm::mat4{ 1.0f }, glm::vec3{ 0.0f, 5.0f, 0.0f });
+	std::vector<uint32_t> tiles;
+	size_t numPixels = 0;
+	for (auto _ : aState) {
+		numPixels = collect_dirty_tiles(changed, 0.5f, glm::normalize(glm::vec3{ 0.3f, 1.0f, 0.2f }), scene, camera, glm::radians(22.5f), glm::uvec2{ 1920u, 1080u }, 16u, tiles);
+		benchmark::DoNotOptimize(tiles.data());
+	}
+	aState.counters["dirty_fraction"] = static_cast<double>(numPixels) / (1920.0 * 1080.0);
+	aState.counters["tiles"] = static_cast<double>(tiles.size());
+}
+BENCHMARK(BM_CollectDirtyTiles)->RangeMultiplier(4)->Range(1, 16)->Unit(benchmark::kMicrosecond);
+
+// Test sequences for the particle stream codec: 60 frames, during which 1/60 of the particles are added per frame.
+// In the "falling" sequence (0), particles fall under gravity and bounce off the ground; in the "settled" sequence (1),
+// they rest and only jitter slightly, like particles which have come to rest in the scene.
+static const std::vector<std::vector<glm::vec4>>& make_particle_sequence(int64_t aSequence, size_t aCount)
+{
+	static std::map<std::pair<int64_t, size_t>, std::vector<std::vector<glm::vec4>>> sCache;
+	auto& frames = sCache[{ aSequence, aCount }];
+	if (!frames.empty()) {
+		return frames;
+	}
+	constexpr int cNumFrames = 60;
+	constexpr float cDeltaTime = 1.0f / 60.0f;
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+	std::normal_distribution<float> jitter(0.0f, 1.0f);
+	std::vector<glm::vec4> particles;
+	std::vector<glm::vec3> velocities;
+	for (int f = 0; f < cNumFrames; ++f) {
+		const size_t target = aCount * (f + 1) / cNumFrames;
+		while (particles.size() < target) {
+			particles.emplace_back(position(rng), 0 == aSequence ? 10.0f + position(rng) : 0.5f * (position(rng) + 10.0f), position(rng), 0.35f);
+			velocities.emplace_back(jitter(rng), 0.0f, jitter(rng));
+		}
+		for (size_t i = 0; i < particles.size(); ++i) {
+			if (0 == aSequence) {
+				velocities[i].y -= 9.81f * cDeltaTime;
+				particles[i] += glm::vec4{ velocities[i] * cDeltaTime, 0.0f };
+				if (particles[i].y < 0.0f) {
+					particles[i].y = -particles[i].y;
+					velocities[i].y *= -0.5f;
+				}
+			}
+			else {
+				particles[i] += glm::vec4{ jitter(rng) * 1e-4f, jitter(rng) * 1e-4f, jitter(rng) * 1e-4f, 0.0f };
+			}
+		}
+		frames.push_back(particles);
+	}
+	return frames;
+}
+
+static std::vector<std::vector<uint8_t>> encode_particle_sequence(const std::vector<std::vector<glm::vec4>>& aFrames)
+{
+	particle_stream_encoder encoder;
+	std::vector<std::vector<uint8_t>> encoded(aFrames.size());
+	for (size_t f = 0; f < aFrames.size(); ++f) {
+		encoder.encode_frame(aFrames[f], encoded[f]);
+	}
+	return encoded;
+}
+
+static void set_particle_stream_counters(benchmark::State& aState, const std::vector<std::vector<glm::vec4>>& aFrames, const std::vector<std::vector<uint8_t>>& aEncoded)
+{
+	int64_t numParticles = 0, encodedBytes = 0;
+	for (size_t f = 0; f < aFrames.size(); ++f) {
+		numParticles += static_cast<int64_t>(aFrames[f].size());
+		encodedBytes += static_cast<int64_t>(aEncoded[f].size());
+	}
+	aState.SetItemsProcessed(aState.iterations() * numParticles);
+	aState.counters["compression_ratio"] = static_cast<double>(numParticles * static_cast<int64_t>(sizeof(glm::vec4))) / static_cast<double>(encodedBytes);
+	aState.counters["bits_per_particle"] = 8.0 * static_cast<double>(encodedBytes) / static_cast<double>(numParticles);
+}
+
+// Encoding of a whole test sequence, as performed while recording a delta-coded simulation cache:
+static void BM_EncodeParticleStream(benchmark::State& aState)
+{
+	const auto& frames = make_particle_sequence(aState.range(0), static_cast<size_t>(aState.range(1)));
+	std::vector<std::vector<uint8_t>> encoded;
+	for (auto _ : aState) {
+		encoded = encode_particle_sequence(frames);
+		benchmark::DoNotOptimize(encoded.data());
+	}
+	set_particle_stream_counters(aState, frames, encoded);
+}
+BENCHMARK(BM_EncodeParticleStream)->ArgsProduct({ { 0, 1 }, { 65536, 524288 } })->Unit(benchmark::kMillisecond);
+
+// Decodes the whole sequence once and checks that every component is within half a quantization step of the source.
+// Returns an empty string on success, or a description of the first mismatch:
+static std::string verify_particle_stream_round_trip(const std::vector<std::vector<glm::vec4>>& aFrames, const std::vector<std::vector<uint8_t>>& aEncoded)
+{
+	const particle_stream_settings settings{};
+	particle_stream_decoder decoder{ settings };
+	std::vector<glm::vec4> decoded;
+	for (size_t f = 0; f < aFrames.size(); ++f) {
+		if (!decoder.decode_frame(aEncoded[f].data(), aEncoded[f].size(), decoded)) {
+			return fmt::format("Frame {} could not be decoded", f);
+		}
+		if (decoded.size() != aFrames[f].size()) {
+			return fmt::format("Frame {} has {} particles instead of {}", f, decoded.size(), aFrames[f].size());
+		}
+		for (size_t i = 0; i < decoded.size(); ++i) {
+			for (glm::length_t c = 0; c < 4; ++c) {
+				const float step = 3 == c ? settings.mRadiusStep : settings.mQuantizationStep;
+				const float source = aFrames[f][i][c];
+				const float tolerance = 0.5f * step + 4.0f * std::numeric_limits<float>::epsilon() * std::max(1.0f, std::abs(source));
+				if (std::abs(decoded[i][c] - source) > tolerance) {
+					return fmt::format("Component {} of particle {} in frame {} is {} instead of {}", c, i, f, decoded[i][c], source);
+				}
+			}
+		}
+	}
+	return {};
+}
+
+// Decoding of a whole test sequence, as performed while playing back a delta-coded simulation cache. The items per
+// second are the decode throughput in particles per second:
+static void BM_DecodeParticleStream(benchmark::State& aState)
+{
+	const auto& frames = make_particle_sequence(aState.range(0), static_cast<size_t>(aState.range(1)));
+	const auto encoded = encode_particle_sequence(frames);
+	// The throughput and the compression ratio are meaningless if the decoded particles don't match:
+	if (const auto error = verify_particle_stream_round_trip(frames, encoded); !error.empty()) {
+		aState.SkipWithError(error.c_str());
+		return;
+	}
+	particle_stream_decoder decoder;
+	std::vector<glm::vec4> decoded;
+	for (auto _ : aState) {
+		decoder.reset();
+		for (const auto& frame : encoded) {
+			decoder.decode_frame(frame.data(), frame.size(), decoded);
+		}
+		benchmark::DoNotOptimize(decoded.data());
+		benchmark::ClobberMemory();
+	}
+	set_particle_stream_counters(aState, frames, encoded);
+}
+BENCHMARK(BM_DecodeParticleStream)->ArgsProduct({ { 0, 1 }, { 65536, 524288 } })->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
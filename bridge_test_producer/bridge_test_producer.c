@@ -0,0 +1,95 @@
+/*
+ * A minimal producer for the particle bridge (see source/particle_bridge.h), which can be used to test the bridge
+ * without an actual simulator. It simulates a fountain: particles are emitted upwards with random velocities, fall
+ * under gravity, and bounce off the ground plane. Run it, then start Fluid Nightmare with "--bridge <name>".
+ *
+ * Usage: fluid-nightmare-bridge-test-producer.exe [number of particles] [shared memory name] [frames per second]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "particle_bridge.h"
+
+typedef struct particle_state
+{
+	float mVelocity[3];
+} particle_state;
+
+static float random_float(float aMin, float aMax)
+{
+	return aMin + (aMax - aMin) * ((float)rand() / (float)RAND_MAX);
+}
+
+static void emit(float* aParticle, particle_state* aState)
+{
+	aParticle[0] = random_float(-0.5f, 0.5f);
+	aParticle[1] = 1.0f;
+	aParticle[2] = random_float(-0.5f, 0.5f);
+	aParticle[3] = random_float(0.1f, 0.3f);
+	aState->mVelocity[0] = random_float(-3.0f, 3.0f);
+	aState->mVelocity[1] = random_float(8.0f, 14.0f);
+	aState->mVelocity[2] = random_float(-3.0f, 3.0f);
+}
+
+int main(int argc, char** argv)
+{
+	const uint32_t numParticles = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : 20000u;
+	const char* name = argc > 2 ? argv[2] : FN_BRIDGE_DEFAULT_NAME;
+	const double framesPerSecond = argc > 3 ? atof(argv[3]) : 60.0;
+	const float deltaTime = (float)(1.0 / framesPerSecond);
+	fn_bridge bridge;
+	float* simulation;
+	particle_state* states;
+	uint32_t alive = 0, i;
+	double time = 0.0;
+	int result;
+
+	result = fn_bridge_create(&bridge, name, numParticles, FN_BRIDGE_MIN_SLOTS);
+	if (FN_BRIDGE_OK != result) {
+		fprintf(stderr, "Unable to create the particle bridge '%s' (error %d).\n", name, result);
+		return 1;
+	}
+
+	/* The simulation state is kept separately, and every frame is written into the bridge as a whole: */
+	simulation = (float*)malloc((size_t)numParticles * 4u * sizeof(float));
+	states = (particle_state*)malloc((size_t)numParticles * sizeof(particle_state));
+	if (NULL == simulation || NULL == states) {
+		fprintf(stderr, "Out of memory.\n");
+		return 1;
+	}
+	printf("Producing %u particles at %.0f fps into '%s'. Press Ctrl+C to stop.\n", numParticles, framesPerSecond, name);
+
+	for (;;) {
+		float* particles;
+
+		/* Emit some particles per frame until all are alive, s.t. the particle count changes, too: */
+		for (i = 0; i < 100u && alive < numParticles; ++i, ++alive) {
+			emit(simulation + 4u * alive, states + alive);
+		}
+		for (i = 0; i < alive; ++i) {
+			float* p = simulation + 4u * i;
+			particle_state* s = states + i;
+			s->mVelocity[1] -= 9.81f * deltaTime;
+			p[0] += s->mVelocity[0] * deltaTime;
+			p[1] += s->mVelocity[1] * deltaTime;
+			p[2] += s->mVelocity[2] * deltaTime;
+			if (p[1] < p[3]) {
+				p[1] = p[3];
+				s->mVelocity[1] = -0.6f * s->mVelocity[1];
+				if (fabsf(s->mVelocity[1]) < 0.5f) {
+					emit(p, s); /* Recycle particles which have come to rest */
+				}
+			}
+		}
+
+		particles = fn_bridge_begin_frame(&bridge);
+		memcpy(particles, simulation, (size_t)alive * 4u * sizeof(float));
+		fn_bridge_end_frame(&bridge, alive, time);
+
+		time += deltaTime;
+		Sleep((DWORD)(1000.0 / framesPerSecond));
+	}
+}
@@ -0,0 +1,31 @@
+// Random numbers and rotations, which are shared by first_hit_closest_hit_shader.rchit (progressive refinement samples)
+// and bake_static_occlusion.rgen (baked occlusion samples).
+
+// Random numbers in [0..1), see https://www.pcg-random.org/:
+uint pcg_hash(uint v)
+{
+	const uint state = v * 747796405u + 2891336453u;
+	const uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+vec3 random_floats(uint seed)
+{
+	const uint a = pcg_hash(seed);
+	const uint b = pcg_hash(a);
+	const uint c = pcg_hash(b);
+	return vec3(a, b, c) * (1.0 / 4294967296.0);
+}
+
+// A uniformly distributed random rotation (Shoemake's method), applied via the quaternion's rotation matrix:
+mat3 random_rotation(vec3 u)
+{
+	const float r1 = sqrt(1.0 - u.x), r2 = sqrt(u.x);
+	const float t1 = 6.28318530718 * u.y, t2 = 6.28318530718 * u.z;
+	const vec4 q = vec4(r1 * sin(t1), r1 * cos(t1), r2 * sin(t2), r2 * cos(t2));
+	return mat3(
+		1.0 - 2.0 * (q.y * q.y + q.z * q.z), 2.0 * (q.x * q.y + q.w * q.z),       2.0 * (q.x * q.z - q.w * q.y),
+		2.0 * (q.x * q.y - q.w * q.z),       1.0 - 2.0 * (q.x * q.x + q.z * q.z), 2.0 * (q.y * q.z + q.w * q.x),
+		2.0 * (q.x * q.z + q.w * q.y),       2.0 * (q.y * q.z - q.w * q.x),       1.0 - 2.0 * (q.x * q.x + q.y * q.y)
+	);
+}
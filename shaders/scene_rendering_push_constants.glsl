@@ -0,0 +1,30 @@
+// The push constants of the scene rendering's ray tracing pipeline (see push_const_data_scene_rendering in cpu_to_gpu_data_types.hpp),
+// which are shared by all of its shaders, and by the launches of the wavefront mode's secondary ray passes.
+
+layout(push_constant) uniform PushConstants {
+    vec4  mAmbientLight;
+    vec4  mLightDir;
+    mat4  mCameraTransform;
+    float mCameraHalfFovAngle;
+	float _padding;
+    bool  mEnableShadows;
+	float mShadowsFactor;
+	vec4  mShadowsColor;
+    bool  mEnableAmbientOcclusion;
+	float mAmbientOcclusionMinDist;
+	float mAmbientOcclusionMaxDist;
+	float mAmbientOcclusionFactor;
+	vec4  mAmbientOcclusionColor;
+	uint  mCullMask;
+	uint  mRenderMode;
+	float mHeatmapMaxCount;
+	uint  mRefinementSample;
+	float mLightAngularRadius;
+	bool  mBakedOcclusion;
+	uint  mSecondaryRayPass;
+	uint  mFirstView;
+	uint  mDisplayedView;
+} pushConstants;
+
+// Only the particles have to be traced against if the occlusion by the triangle mesh geometry is baked (see cParticlesInstanceMask):
+const uint cParticlesInstanceMask = 0x80u;
@@ -0,0 +1,35 @@
+// The G-buffer sample of the wavefront mode, its flags, and the directions of the ambient occlusion rays, which are shared by the
+// scene rendering's shaders and bin_secondary_rays.comp. The buffer itself is declared by the shaders, since its binding differs.
+
+// See secondary_ray_gbuffer_sample in cpu_to_gpu_data_types.hpp:
+struct GBufferSample
+{
+	vec3 mPosition;
+	uint mFlags;
+	uint mColor; // RGBA8
+	uint mBakedOcclusion;
+	uint mOcclusion;
+	uint _padding;
+};
+
+// Flags of the G-buffer samples:
+#define SECONDARY_RAY_VALID               1u // Triangle hit which has been traced in this frame, i.e. it needs secondary rays
+#define SECONDARY_RAY_TRACE_STATIC_SHADOW 2u // The shadow ray must be traced against the triangle mesh geometry, too
+#define SECONDARY_RAY_BAKED               4u // mBakedOcclusion is valid
+
+// Passes of the wavefront mode, see secondary_ray_pass in cpu_to_gpu_data_types.hpp:
+#define SECONDARY_RAY_PASS_SHADOW            2u
+#define SECONDARY_RAY_PASS_AMBIENT_OCCLUSION 3u
+
+// The ambient occlusion rays' directions (which are randomly rotated by the progressive refinement). The wavefront mode
+// traces ray i of a pixel into direction i:
+const vec3 cAmbientOcclusionDirections[8] = {
+	vec3( 1,  1,  1),
+	vec3( 1,  1, -1),
+	vec3( 1, -1,  1),
+	vec3( 1, -1, -1),
+	vec3(-1,  1,  1),
+	vec3(-1,  1, -1),
+	vec3(-1, -1,  1),
+	vec3(-1, -1, -1),
+};
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <gvk.hpp>
+
+#include "preprocessor_defines.hpp"
+#include "fluid_nightmare_main.hpp"
+#include "triangle_mesh_geometry_manager.hpp"
+#include "procedural_geometry_manager.hpp"
+#include "gpu_timestamp_profiler.hpp"
+#include "frame_telemetry.hpp"
+#include "memory_accounting.hpp"
+
+// A benchmark scenario, loaded from a text file. Every line contains one command, lines starting with # are comments.
+// All events are scheduled by frame number (not by time), which makes runs deterministic:
+//
+//   warmup_frames <n>                        Number of frames before the measurement starts
+//   measure_frames <n>                       Number of frames which are measured
+//   report <file path>                       Where to write the JSON report to
+//   camera <frame> <x> <y> <z> <yaw> <pitch> Camera keyframe (position, angles in degrees), interpolated linearly
+//   spawn <frame> on|off                     Start or stop spawning water particles
+//   emitter_origin <frame> <x> <y> <z>       Change the spawn origin
+//   emitter_direction <frame> <x> <y> <z>    Change the spawn direction
+//   emitter_angle <frame> <degrees>          Change the spawn cone angle
+//   emitter_radius <frame> <radius>          Change the radius of newly spawned particles
+//   shadows <frame> on|off                   Enable or disable shadows
+//   ao <frame> on|off                        Enable or disable ambient occlusion
+//   instance <frame> <index> on|off          Show or hide a triangle mesh geometry instance
+//   views <frame> <count> <separation>       Render <count> views, <separation> apart along the camera's x axis
+//   view_launches <frame> single|separate    Trace all views in one launch, or every view in a launch of its own
+struct benchmark_scenario
+{
+	enum struct event_type { spawn, emitter_origin, emitter_direction, emitter_angle, emitter_radius, shadows, ambient_occlusion, instance_visibility, views, view_launches };
+
+	struct event
+	{
+		uint32_t mFrame;
+		event_type mType;
+		glm::vec3 mVector = glm::vec3{ 0.0f };
+		float mValue = 0.0f;
+		size_t mIndex = 0;
+		bool mEnabled = false;
+	};
+
+	struct camera_keyframe
+	{
+		uint32_t mFrame;
+		glm::vec3 mPosition;
+		float mYawDegrees;
+		float mPitchDegrees;
+	};
+
+	uint32_t mWarmupFrames = 120;
+	uint32_t mMeasureFrames = 600;
+	std::string mReportPath = "benchmark_report.json";
+	std::vector<camera_keyframe> mCameraKeyframes;
+	std::vector<event> mEvents;
+
+	static benchmark_scenario load_from_file(const std::string& aFilePath)
+	{
+		std::ifstream file(aFilePath);
+		if (!file.is_open()) {
+			throw gvk::runtime_error(fmt::format("Unable to open benchmark scenario file '{}'", aFilePath));
+		}
+
+		benchmark_scenario result;
+		std::string line;
+		int lineNumber = 0;
+		while (std::getline(file, line)) {
+			++lineNumber;
+			std::istringstream in(line);
+			std::string command;
+			if (!(in >> command) || '#' == command[0]) {
+				continue;
+			}
+
+			auto onOff = [&]() {
+				std::string value;
+				in >> value;
+				if ("on" != value && "off" != value) {
+					throw gvk::runtime_error(fmt::format("Expected 'on' or 'off' in line {} of '{}'", lineNumber, aFilePath));
+				}
+				return "on" == value;
+			};
+
+			event e{};
+			if ("warmup_frames" == command)  { in >> result.mWarmupFrames; }
+			else if ("measure_frames" == command) { in >> result.mMeasureFrames; }
+			else if ("report" == command)    { in >> result.mReportPath; }
+			else if ("camera" == command) {
+				camera_keyframe k{};
+				in >> k.mFrame >> k.mPosition.x >> k.mPosition.y >> k.mPosition.z >> k.mYawDegrees >> k.mPitchDegrees;
+				result.mCameraKeyframes.push_back(k);
+			}
+			else if ("spawn" == command)             { in >> e.mFrame; e.mType = event_type::spawn;             e.mEnabled = onOff(); }
+			else if ("shadows" == command)           { in >> e.mFrame; e.mType = event_type::shadows;           e.mEnabled = onOff(); }
+			else if ("ao" == command)                { in >> e.mFrame; e.mType = event_type::ambient_occlusion; e.mEnabled = onOff(); }
+			else if ("emitter_origin" == command)    { in >> e.mFrame >> e.mVector.x >> e.mVector.y >> e.mVector.z; e.mType = event_type::emitter_origin; }
+			else if ("emitter_direction" == command) { in >> e.mFrame >> e.mVector.x >> e.mVector.y >> e.mVector.z; e.mType = event_type::emitter_direction; }
+			else if ("emitter_angle" == command)     { in >> e.mFrame >> e.mValue; e.mType = event_type::emitter_angle; }
+			else if ("emitter_radius" == command)    { in >> e.mFrame >> e.mValue; e.mType = event_type::emitter_radius; }
+			else if ("instance" == command)          { in >> e.mFrame >> e.mIndex; e.mType = event_type::instance_visibility; e.mEnabled = onOff(); }
+			else if ("views" == command)             { in >> e.mFrame >> e.mIndex >> e.mValue; e.mType = event_type::views; }
+			else if ("view_launches" == command) {
+				std::string launches;
+				in >> e.mFrame >> launches;
+				if ("single" != launches && "separate" != launches) {
+					throw gvk::runtime_error(fmt::format("Expected 'single' or 'separate' in line {} of '{}'", lineNumber, aFilePath));
+				}
+				e.mType = event_type::view_launches;
+				e.mEnabled = "separate" == launches;
+			}
+			else {
+				throw gvk::runtime_error(fmt::format("Unknown command '{}' in line {} of '{}'", command, lineNumber, aFilePath));
+			}
+
+			if (in.fail()) {
+				throw gvk::runtime_error(fmt::format("Malformed command '{}' in line {} of '{}'", command, lineNumber, aFilePath));
+			}
+			if ("camera" != command && "warmup_frames" != command && "measure_frames" != command && "report" != command) {
+				result.mEvents.push_back(e);
+			}
+		}
+
+		std::stable_sort(std::begin(result.mCameraKeyframes), std::end(result.mCameraKeyframes), [](const auto& a, const auto& b) { return a.mFrame < b.mFrame; });
+		std::stable_sort(std::begin(result.mEvents), std::end(result.mEvents), [](const auto& a, const auto& b) { return a.mFrame < b.mFrame; });
+		return result;
+	}
+};
+
+// An invokee which drives the application from a benchmark_scenario instead of user input. After the warm-up
+// frames, it measures a fixed number of frames, writes a JSON report, and stops the composition.
+// If no scenario is given, it does nothing.
+class benchmark_runner : public gvk::invokee
+{
+public: // v== gvk::invokee overrides which will be invoked by the framework ==v
+	benchmark_runner(std::optional<std::string> aScenarioFilePath)
+		: invokee{ -100 } // This invokee must execute BEFORE the geometry managers and the main invokee, s.t. its settings apply to the current frame
+		, mScenarioFilePath{ std::move(aScenarioFilePath) }
+	{}
+
+	void initialize() override
+	{
+		if (!mScenarioFilePath.has_value()) {
+			disable();
+			return;
+		}
+		mScenario = benchmark_scenario::load_from_file(*mScenarioFilePath);
+		LOG_INFO(fmt::format("Running benchmark scenario '{}': {} warm-up frames, {} measured frames.", *mScenarioFilePath, mScenario.mWarmupFrames, mScenario.mMeasureFrames));
+
+		// The camera is entirely controlled by the scenario:
+		auto* mainInvokee = gvk::current_composition()->element_by_type<fluid_nightmare_main>();
+		assert(nullptr != mainInvokee);
+		mainInvokee->camera().disable();
+		// Static stretches of a scenario shall be measured like every other frame, not skipped:
+		mainInvokee->set_idle_frame_mode(fluid_nightmare_main::idle_frame_mode::always_trace);
+	}
+
+	void update() override
+	{
+		auto* mainInvokee = gvk::current_composition()->element_by_type<fluid_nightmare_main>();
+		assert(nullptr != mainInvokee);
+		auto* triMeshGeomMgr = gvk::current_composition()->element_by_type<triangle_mesh_geometry_manager>();
+		assert(nullptr != triMeshGeomMgr);
+		auto* procGeomMgr = gvk::current_composition()->element_by_type<procedural_geometry_manager>();
+		assert(nullptr != procGeomMgr);
+
+		apply_camera_path(mainInvokee->camera());
+
+		// Apply all the events which are scheduled for this frame:
+		while (mNextEvent < mScenario.mEvents.size() && mScenario.mEvents[mNextEvent].mFrame <= mFrame) {
+			const auto& e = mScenario.mEvents[mNextEvent++];
+			switch (e.mType) {
+			case benchmark_scenario::event_type::spawn:             procGeomMgr->set_spawning_enabled(e.mEnabled); break;
+			case benchmark_scenario::event_type::emitter_origin:    procGeomMgr->set_spawn_origin(e.mVector); break;
+			case benchmark_scenario::event_type::emitter_direction: procGeomMgr->set_spawn_direction(e.mVector); break;
+			case benchmark_scenario::event_type::emitter_angle:     procGeomMgr->set_spawn_cone_angle(e.mValue); break;
+			case benchmark_scenario::event_type::emitter_radius:    procGeomMgr->set_radius_of_new_particles(e.mValue); break;
+			case benchmark_scenario::event_type::shadows:           mainInvokee->set_shadows_enabled(e.mEnabled); break;
+			case benchmark_scenario::event_type::ambient_occlusion: mainInvokee->set_ambient_occlusion_enabled(e.mEnabled); break;
+			case benchmark_scenario::event_type::views:             mainInvokee->set_views(static_cast<int>(e.mIndex), e.mValue); break;
+			case benchmark_scenario::event_type::view_launches:     mainInvokee->set_separate_view_launches(e.mEnabled); break;
+			case benchmark_scenario::event_type::instance_visibility:
+				if (e.mIndex < triMeshGeomMgr->max_number_of_geometry_instances()) {
+					triMeshGeomMgr->set_geometry_instance_visible(e.mIndex, e.mEnabled);
+				}
+				else {
+					LOG_WARNING(fmt::format("Benchmark scenario refers to geometry instance {}, but there are only {}.", e.mIndex, triMeshGeomMgr->max_number_of_geometry_instances()));
+				}
+				break;
+			}
+		}
+
+		auto* telemetry = gvk::current_composition()->element_by_type<frame_telemetry>();
+		auto* gpuProfiler = gvk::current_composition()->element_by_type<gpu_timestamp_profiler>();
+
+		if (mFrame == mScenario.mWarmupFrames) {
+			// Warm-up is over => start measuring from scratch:
+			if (nullptr != telemetry) { telemetry->reset(); }
+			mGpuPassSums = {};
+			mGpuPassSamples = 0;
+			mParticlesAtStart = procGeomMgr->number_of_particles();
+		}
+		else if (nullptr != gpuProfiler && mFrame > mScenario.mWarmupFrames + gpuProfiler->readback_latency()) {
+			// The timings lag behind => the first ones of the measurement still belong to warm-up frames:
+			const auto& timings = gpuProfiler->latest_timings();
+			for (size_t p = 0; p < timings.size(); ++p) {
+				mGpuPassSums[p] += timings[p];
+			}
+			++mGpuPassSamples;
+		}
+
+		if (mFrame == mScenario.mWarmupFrames + mScenario.mMeasureFrames) {
+			write_report(mScenario.mReportPath, procGeomMgr->number_of_particles());
+			gvk::current_composition()->stop();
+		}
+
+		++mFrame;
+	}
+
+private:
+	// Sets the camera's position and rotation according to the keyframes, interpolating linearly between them:
+	void apply_camera_path(gvk::quake_camera& aCamera) const
+	{
+		const auto& keys = mScenario.mCameraKeyframes;
+		if (keys.empty()) {
+			return;
+		}
+		auto next = std::find_if(std::begin(keys), std::end(keys), [this](const auto& k) { return k.mFrame > mFrame; });
+		const auto& a = next == std::begin(keys) ? *next : *(next - 1);
+		const auto& b = next == std::end(keys) ? a : *next;
+		const float t = b.mFrame > a.mFrame ? static_cast<float>(mFrame - a.mFrame) / static_cast<float>(b.mFrame - a.mFrame) : 0.0f;
+
+		const auto position = glm::mix(a.mPosition, b.mPosition, t);
+		const auto yaw = glm::radians(glm::mix(a.mYawDegrees, b.mYawDegrees, t));
+		const auto pitch = glm::radians(glm::mix(a.mPitchDegrees, b.mPitchDegrees, t));
+		aCamera.set_translation(position);
+		aCamera.set_rotation(glm::quat(glm::vec3{ 0.0f, yaw, 0.0f }) * glm::quat(glm::vec3{ pitch, 0.0f, 0.0f }));
+	}
+
+	void write_report(const std::string& aFilePath, size_t aParticlesAtEnd) const
+	{
+		std::ofstream file(aFilePath);
+		if (!file.is_open()) {
+			LOG_ERROR(fmt::format("Unable to open '{}' for writing the benchmark report.", aFilePath));
+			return;
+		}
+
+		file << "{\n";
+		auto scenarioPath = *mScenarioFilePath;
+		std::replace(std::begin(scenarioPath), std::end(scenarioPath), '\\', '/'); // No need to escape anything in JSON then
+		file << fmt::format(R"(  "scenario": "{}",)" "\n", scenarioPath);
+		file << fmt::format(R"(  "warmup_frames": {},)" "\n", mScenario.mWarmupFrames);
+		file << fmt::format(R"(  "measured_frames": {},)" "\n", mScenario.mMeasureFrames);
+		file << fmt::format(R"(  "particles": {{ "at_start": {}, "at_end": {} }},)" "\n", mParticlesAtStart, aParticlesAtEnd);
+
+		// Accounted memory per GPU category and host subsystem, at the end of the measurement and at its highest:
+		const auto& memory = memory_accounting();
+		file << R"(  "memory_bytes": {)" "\n" R"(    "gpu": {)";
+		for (size_t c = 0; c < static_cast<size_t>(gpu_memory_category::count); ++c) {
+			const auto& counter = memory.gpu(static_cast<gpu_memory_category>(c));
+			file << fmt::format(R"({} "{}": {{ "current": {}, "high_water_mark": {} }})", c > 0 ? "," : "", gpu_memory_category_names[c], counter.current(), counter.high_water_mark());
+		}
+		file << " },\n" R"(    "host": {)";
+		for (size_t s = 0; s < static_cast<size_t>(host_memory_subsystem::count); ++s) {
+			const auto& counter = memory.host(static_cast<host_memory_subsystem>(s));
+			file << fmt::format(R"({} "{}": {{ "current": {}, "high_water_mark": {} }})", s > 0 ? "," : "", host_memory_subsystem_names[s], counter.current(), counter.high_water_mark());
+		}
+		file << " },\n" << fmt::format(R"(    "gpu_total": {}, "host_total": {})" "\n  }},\n", memory.gpu_total(), memory.host_total());
+
+		// Average GPU time per pass, over the timings which have been read back for measured frames:
+		file << fmt::format(R"(  "gpu_pass_samples": {},)" "\n", mGpuPassSamples);
+		file << R"(  "gpu_pass_average_ms": {)";
+		for (size_t p = 0; p < mGpuPassSums.size(); ++p) {
+			file << fmt::format(R"({} "{}": {:.4f})", p > 0 ? "," : "", gpu_pass_names[p], mGpuPassSums[p] / std::max(1.0, static_cast<double>(mGpuPassSamples)));
+		}
+		file << " },\n";
+
+		// Percentiles of all telemetry metrics:
+		file << R"(  "telemetry": {)" "\n";
+		auto* telemetry = gvk::current_composition()->element_by_type<frame_telemetry>();
+		for (size_t i = 0; nullptr != telemetry && i < static_cast<size_t>(telemetry_metric_id::count); ++i) {
+			const auto& m = telemetry->metric(static_cast<telemetry_metric_id>(i));
+			file << fmt::format(R"(    "{}": {{ "count": {}, "mean_ms": {:.4f}, "p50_ms": {:.4f}, "p95_ms": {:.4f}, "p99_ms": {:.4f}, "max_ms": {:.4f} }})",
+				telemetry_metric_names[i], m.count(), m.mean(), m.p50(), m.p95(), m.p99(), m.max());
+			file << (i + 1 < static_cast<size_t>(telemetry_metric_id::count) ? ",\n" : "\n");
+		}
+		file << "  }\n}\n";
+		LOG_INFO(fmt::format("Wrote benchmark report to '{}'.", aFilePath));
+	}
+
+	std::optional<std::string> mScenarioFilePath;
+	benchmark_scenario mScenario;
+
+	// The current frame, counted from the start of the scenario:
+	uint32_t mFrame = 0;
+
+	// Index of the next event in mScenario.mEvents which has not been applied yet:
+	size_t mNextEvent = 0;
+
+	// Measured values:
+	std::array<double, static_cast<size_t>(gpu_pass::count)> mGpuPassSums{};
+	uint32_t mGpuPassSamples = 0;
+	size_t mParticlesAtStart = 0;
+
+}; // End of benchmark_runner
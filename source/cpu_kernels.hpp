@@ -0,0 +1,201 @@
+#pragma once
+
+#include <gvk.hpp>
+#include <execution>
+
+// CPU-side hot paths which are executed (up to) every frame by the invokees.
+// They are kept free of any invokee state s.t. they can be measured in isolation
+// by the microbenchmarks in benchmarks/.
+
+// Selects the "best" of the spawn candidates. We'll just go for the candidate with minimal y coordinates:
+inline glm::vec4 select_spawn_candidate(const glm::vec4* aCandidates, size_t aNumCandidates)
+{
+	assert(aNumCandidates > 0);
+	glm::vec4 selectedCandidate = aCandidates[0];
+	for (size_t i = 1; i < aNumCandidates; ++i) {
+		if (aCandidates[i].y < selectedCandidate.y) {
+			selectedCandidate = aCandidates[i];
+		}
+	}
+	return selectedCandidate;
+}
+
+// Concatenates two sets of geometry instances (e.g., triangle meshes and water particles) for a TLAS build:
+template <typename T>
+std::vector<T> concatenate_geometry_instances(const std::vector<T>& aFirst, const std::vector<T>& aSecond)
+{
+	std::vector<T> result;
+	result.reserve(aFirst.size() + aSecond.size());
+	result.insert(std::end(result), std::begin(aFirst), std::end(aFirst));
+	result.insert(std::end(result), std::begin(aSecond), std::end(aSecond));
+	return result;
+}
+
+// Packs the transformation of a water particle (offset by its position, not rotated, scaled by its radius) into the TLAS instance format:
+inline auto particle_transform(const glm::vec3& aPosition, float aRadius)
+{
+	return gvk::to_array(gvk::matrix_from_transforms(aPosition, glm::quat(), glm::vec3{ aRadius }));
+}
+
+// CPU implementation of the ray-sphere intersection which is performed in rt_aabb.rint.
+// Returns the distance along the ray, or a negative value if the sphere is missed.
+inline float hit_sphere(const glm::vec3& aCenter, float aRadius, const glm::vec3& aRayOrigin, const glm::vec3& aRayDirection)
+{
+	const glm::vec3 oc = aRayOrigin - aCenter;
+	const float a = glm::dot(aRayDirection, aRayDirection);
+	const float b = 2.0f * glm::dot(oc, aRayDirection);
+	const float c = glm::dot(oc, oc) - aRadius * aRadius;
+	const float discriminant = b * b - 4.0f * a * c;
+	if (discriminant < 0.0f) {
+		return -1.0f;
+	}
+	return (-b - std::sqrt(discriminant)) / (2.0f * a);
+}
+
+// Maps [0..1] to blue -> cyan -> green -> yellow -> red. This is the same mapping as in ray_gen_shader.rgen,
+// s.t. a CPU renderer can produce heatmaps of its traversal step counts which are comparable to the GPU's:
+inline glm::vec3 heatmap_color(float t)
+{
+	t = glm::clamp(t, 0.0f, 1.0f);
+	return glm::clamp(glm::vec3{ 4.0f * t - 2.0f, t < 0.5f ? 4.0f * t : 4.0f - 4.0f * t, 2.0f - 4.0f * t }, 0.0f, 1.0f);
+}
+
+// Axis-aligned bounds, e.g. of all the particles (i.e., spheres) which have changed in a frame, or of the whole scene:
+struct bounding_box
+{
+	glm::vec3 mMin{  std::numeric_limits<float>::max() };
+	glm::vec3 mMax{ -std::numeric_limits<float>::max() };
+
+	[[nodiscard]] bool empty() const { return mMin.x > mMax.x || mMin.y > mMax.y || mMin.z > mMax.z; }
+
+	void add(const glm::vec3& aPoint)
+	{
+		mMin = glm::min(mMin, aPoint);
+		mMax = glm::max(mMax, aPoint);
+	}
+
+	void add(const glm::vec4& aParticle)
+	{
+		mMin = glm::min(mMin, glm::vec3{ aParticle } - aParticle.w);
+		mMax = glm::max(mMax, glm::vec3{ aParticle } + aParticle.w);
+	}
+
+	void add(const bounding_box& aOther)
+	{
+		mMin = glm::min(mMin, aOther.mMin);
+		mMax = glm::max(mMax, aOther.mMax);
+	}
+};
+
+// Computes the bounds of all the given particles in parallel:
+inline bounding_box compute_particle_bounds(const glm::vec4* aParticles, size_t aNumParticles)
+{
+	return std::transform_reduce(std::execution::par, aParticles, aParticles + aNumParticles, bounding_box{},
+		[](bounding_box aFirst, const bounding_box& aSecond) { aFirst.add(aSecond); return aFirst; },
+		[](const glm::vec4& aParticle) { bounding_box bounds; bounds.add(aParticle); return bounds; }
+	);
+}
+
+// Projects the corners of the box into pixel coordinates, the same way as project_to_pixel in ray_gen_shader.rgen does, and
+// returns the rectangle of pixels which it covers (xy = min, zw = max, exclusive), clamped to the resolution. Boxes which are
+// entirely behind the camera cover nothing; boxes which reach behind it have an unbounded projection and cover everything:
+inline glm::ivec4 project_box_to_pixel_rect(const bounding_box& aBox, const glm::mat4& aCameraInverse, float aHalfFovAngle, glm::uvec2 aResolution)
+{
+	const glm::ivec4 everything{ 0, 0, static_cast<int>(aResolution.x), static_cast<int>(aResolution.y) };
+	const float aspectRatio = static_cast<float>(aResolution.x) / static_cast<float>(aResolution.y);
+	const float tanHalfFov = std::tan(aHalfFovAngle);
+	glm::vec2 pixelMin{  std::numeric_limits<float>::max() };
+	glm::vec2 pixelMax{ -std::numeric_limits<float>::max() };
+	int numBehind = 0;
+	for (int i = 0; i < 8; ++i) {
+		const glm::vec3 corner{ (i & 1) ? aBox.mMax.x : aBox.mMin.x, (i & 2) ? aBox.mMax.y : aBox.mMin.y, (i & 4) ? aBox.mMax.z : aBox.mMin.z };
+		const glm::vec3 v{ aCameraInverse * glm::vec4{ corner, 1.0f } };
+		if (v.z >= -1e-3f) {
+			++numBehind;
+			continue;
+		}
+		const float s = -v.z * tanHalfFov;
+		const glm::vec2 pixel = (glm::vec2{ v.x / (s * aspectRatio), -v.y / s } * 0.5f + 0.5f) * glm::vec2{ aResolution };
+		pixelMin = glm::min(pixelMin, pixel);
+		pixelMax = glm::max(pixelMax, pixel);
+	}
+	if (8 == numBehind) {
+		return glm::ivec4{ 0 };
+	}
+	if (numBehind > 0) {
+		return everything;
+	}
+	// Add one pixel on every side, s.t. pixels whose centers are just outside are included, too:
+	const glm::ivec2 first = glm::clamp(glm::ivec2{ glm::floor(pixelMin) } - 1, glm::ivec2{ 0 }, glm::ivec2{ everything.z, everything.w });
+	const glm::ivec2 last = glm::clamp(glm::ivec2{ glm::ceil(pixelMax) } + 1, glm::ivec2{ 0 }, glm::ivec2{ everything.z, everything.w });
+	return glm::ivec4{ first, last };
+}
+
+// Collects the screen-space tiles (packed as x | y << 16) whose pixels might be affected by changes inside of aChangedBox:
+//  - the box itself, expanded by aMargin (e.g., the ambient occlusion rays' reach), for primary visibility and ambient occlusion, and
+//  - if aLightDir is not zero, the region which the box might shadow, i.e., the box swept along -aLightDir until the scene's bounds
+//    are left. The sweep is split into segments, s.t. the tiles follow it closely instead of covering its whole bounding rectangle.
+// Returns the number of pixels which the collected tiles cover within the resolution.
+inline size_t collect_dirty_tiles(const bounding_box& aChangedBox, float aMargin, const glm::vec3& aLightDir, const bounding_box& aSceneBounds,
+	const glm::mat4& aCameraTransform, float aHalfFovAngle, glm::uvec2 aResolution, uint32_t aTileSize, std::vector<uint32_t>& aTiles)
+{
+	constexpr int cNumShadowSegments = 8;
+	const glm::uvec2 numTiles = (aResolution + aTileSize - 1u) / aTileSize;
+	const glm::mat4 cameraInverse = glm::inverse(aCameraTransform);
+	std::vector<uint8_t> dirty(static_cast<size_t>(numTiles.x) * numTiles.y, 0u);
+
+	auto markBox = [&](const bounding_box& aBox) {
+		const glm::ivec4 rect = project_box_to_pixel_rect(aBox, cameraInverse, aHalfFovAngle, aResolution);
+		for (int y = rect.y / static_cast<int>(aTileSize); y * static_cast<int>(aTileSize) < rect.w; ++y) {
+			for (int x = rect.x / static_cast<int>(aTileSize); x * static_cast<int>(aTileSize) < rect.z; ++x) {
+				dirty[static_cast<size_t>(y) * numTiles.x + x] = 1u;
+			}
+		}
+	};
+
+	bounding_box expanded = aChangedBox;
+	expanded.mMin -= aMargin;
+	expanded.mMax += aMargin;
+	markBox(expanded);
+
+	if (glm::dot(aLightDir, aLightDir) > 0.0f && !aSceneBounds.empty()) {
+		// How far the shadow rays' origins can be away from the box: until the sweep leaves the scene's bounds (slab test per corner):
+		const glm::vec3 sweepDir = -glm::normalize(aLightDir);
+		const glm::vec3 invDir = 1.0f / sweepDir;
+		float reach = 0.0f;
+		for (int i = 0; i < 8; ++i) {
+			const glm::vec3 corner{ (i & 1) ? aChangedBox.mMax.x : aChangedBox.mMin.x, (i & 2) ? aChangedBox.mMax.y : aChangedBox.mMin.y, (i & 4) ? aChangedBox.mMax.z : aChangedBox.mMin.z };
+			const glm::vec3 t0 = (aSceneBounds.mMin - corner) * invDir;
+			const glm::vec3 t1 = (aSceneBounds.mMax - corner) * invDir;
+			const glm::vec3 tFar = glm::max(t0, t1);
+			reach = std::max(reach, std::min(std::min(tFar.x, tFar.y), tFar.z));
+		}
+		// Shadow rays are traced up to a distance of 1000 (see first_hit_closest_hit_shader.rchit):
+		reach = std::min(reach, 1000.0f);
+		for (int s = 0; s < cNumShadowSegments; ++s) {
+			bounding_box segment;
+			for (const float t : { reach * static_cast<float>(s) / cNumShadowSegments, reach * static_cast<float>(s + 1) / cNumShadowSegments }) {
+				segment.add(aChangedBox.mMin + sweepDir * t);
+				segment.add(aChangedBox.mMax + sweepDir * t);
+			}
+			// There is nothing to be shadowed outside of the scene's bounds:
+			segment.mMin = glm::max(segment.mMin, aSceneBounds.mMin);
+			segment.mMax = glm::min(segment.mMax, aSceneBounds.mMax);
+			if (!segment.empty()) {
+				markBox(segment);
+			}
+		}
+	}
+
+	aTiles.clear();
+	size_t numPixels = 0;
+	for (uint32_t y = 0; y < numTiles.y; ++y) {
+		for (uint32_t x = 0; x < numTiles.x; ++x) {
+			if (0u != dirty[static_cast<size_t>(y) * numTiles.x + x]) {
+				aTiles.push_back(x | (y << 16u));
+				numPixels += static_cast<size_t>(std::min(aTileSize, aResolution.x - x * aTileSize)) * std::min(aTileSize, aResolution.y - y * aTileSize);
+			}
+		}
+	}
+	return numPixels;
+}
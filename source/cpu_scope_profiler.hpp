@@ -0,0 +1,285 @@
+#pragma once
+
+#include <gvk.hpp>
+
+#include "preprocessor_defines.hpp"
+
+// One recorded CPU scope:
+struct cpu_profiler_event
+{
+	// Must point to a string which outlives the profiler's dump (e.g., a string literal):
+	const char* mName;
+	int64_t mStartNs;
+	int64_t mDurationNs;
+};
+
+// Event buffer of one single thread. Only its owning thread writes into it, hence no locks
+// are required. The number of valid events is published with release semantics.
+class cpu_profiler_thread_buffer
+{
+public:
+	cpu_profiler_thread_buffer(uint32_t aThreadIndex, std::string aThreadName, size_t aCapacity)
+		: mThreadIndex{ aThreadIndex }
+		, mThreadName{ std::move(aThreadName) }
+		, mEvents(aCapacity)
+	{}
+
+	// Invoked by the owning thread only:
+	void push(const cpu_profiler_event& aEvent, uint64_t aCaptureEpoch)
+	{
+		if (aCaptureEpoch != mCaptureEpoch.load(std::memory_order_relaxed)) {
+			// A new capture has been started since the last event => start over:
+			mCount.store(0, std::memory_order_relaxed);
+			mDropped.store(0, std::memory_order_relaxed);
+			mCaptureEpoch.store(aCaptureEpoch, std::memory_order_release);
+		}
+		const auto n = mCount.load(std::memory_order_relaxed);
+		if (n >= mEvents.size()) {
+			mDropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		mEvents[n] = aEvent;
+		mCount.store(n + 1, std::memory_order_release);
+	}
+
+	// May be invoked by any thread. Returns the number of events which can be read safely:
+	[[nodiscard]] size_t count() const { return mCount.load(std::memory_order_acquire); }
+	[[nodiscard]] size_t dropped() const { return mDropped.load(std::memory_order_relaxed); }
+	// The capture which the events belong to. Only reset by the next push, i.e. stale if the thread hasn't recorded anything since:
+	[[nodiscard]] uint64_t capture_epoch() const { return mCaptureEpoch.load(std::memory_order_acquire); }
+	[[nodiscard]] const cpu_profiler_event& event_at(size_t aIndex) const { return mEvents[aIndex]; }
+	[[nodiscard]] uint32_t thread_index() const { return mThreadIndex; }
+	[[nodiscard]] const std::string& thread_name() const { return mThreadName; }
+	void set_thread_name(std::string aThreadName) { mThreadName = std::move(aThreadName); }
+
+private:
+	uint32_t mThreadIndex;
+	std::string mThreadName;
+	std::vector<cpu_profiler_event> mEvents;
+	std::atomic<size_t> mCount = 0;
+	std::atomic<size_t> mDropped = 0;
+	std::atomic<uint64_t> mCaptureEpoch = 0;
+};
+
+// A low-overhead CPU profiler which records scopes into per-thread buffers.
+// Recording can be started and stopped at runtime, and the recorded events
+// can be dumped in the Chrome trace event format (which Perfetto can open, too).
+class cpu_scope_profiler
+{
+public:
+	// Events per thread and capture; further events are dropped:
+	static constexpr size_t cEventsPerThread = 1u << 18;
+
+	cpu_scope_profiler()
+		: mStartTime{ std::chrono::steady_clock::now() }
+	{}
+
+	[[nodiscard]] bool is_recording() const
+	{
+		return mRecording.load(std::memory_order_relaxed);
+	}
+
+	// Starts a new capture, discarding all previously recorded events:
+	void start_recording()
+	{
+		mCaptureEpoch.fetch_add(1, std::memory_order_relaxed);
+		mRecording.store(true, std::memory_order_release);
+	}
+
+	void stop_recording()
+	{
+		mRecording.store(false, std::memory_order_release);
+	}
+
+	// Nanoseconds since the creation of the profiler:
+	[[nodiscard]] int64_t now_ns() const
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mStartTime).count();
+	}
+
+	// Records a finished scope into the calling thread's buffer:
+	void record(const char* aName, int64_t aStartNs, int64_t aDurationNs)
+	{
+		current_thread_buffer().push(cpu_profiler_event{ aName, aStartNs, aDurationNs }, mCaptureEpoch.load(std::memory_order_relaxed));
+	}
+
+	// Give the calling thread a name which is displayed in the trace viewer:
+	void set_current_thread_name(std::string aThreadName)
+	{
+		std::lock_guard<std::mutex> guard(mRegistryMutex);
+		current_thread_buffer_unlocked().set_thread_name(std::move(aThreadName));
+	}
+
+	// Host memory which has been allocated for the per-thread event buffers:
+	[[nodiscard]] size_t allocated_bytes() const
+	{
+		std::lock_guard<std::mutex> guard(mRegistryMutex);
+		return mThreadBuffers.size() * cEventsPerThread * sizeof(cpu_profiler_event);
+	}
+
+	// Writes all events of the current capture in the Chrome trace event format.
+	// Recording should be stopped before, s.t. no events are added concurrently.
+	bool write_chrome_trace(const std::string& aFilePath) const
+	{
+		std::ofstream file(aFilePath);
+		if (!file.is_open()) {
+			LOG_WARNING(fmt::format("Unable to open '{}' for writing the CPU trace.", aFilePath));
+			return false;
+		}
+
+		std::lock_guard<std::mutex> guard(mRegistryMutex);
+		size_t numEvents = 0, numDropped = 0;
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		bool first = true;
+		const auto captureEpoch = mCaptureEpoch.load(std::memory_order_relaxed);
+		for (const auto& buffer : mThreadBuffers) {
+			// Metadata event which names the thread:
+			file << (first ? "" : ",\n") << fmt::format(R"({{"ph":"M","pid":1,"tid":{},"name":"thread_name","args":{{"name":"{}"}}}})", buffer->thread_index(), escaped(buffer->thread_name()));
+			first = false;
+			// Threads which haven't recorded anything during this capture still hold the events of a previous one:
+			if (buffer->capture_epoch() != captureEpoch) {
+				continue;
+			}
+			const auto n = buffer->count();
+			for (size_t i = 0; i < n; ++i) {
+				const auto& e = buffer->event_at(i);
+				// Complete events with timestamps and durations in microseconds:
+				file << fmt::format(",\n" R"({{"ph":"X","pid":1,"tid":{},"name":"{}","ts":{:.3f},"dur":{:.3f}}})", buffer->thread_index(), escaped(e.mName), e.mStartNs * 1e-3, e.mDurationNs * 1e-3);
+			}
+			numEvents += n;
+			numDropped += buffer->dropped();
+		}
+		file << "\n]}\n";
+		LOG_INFO(fmt::format("Wrote {} CPU profiler events ({} dropped) of {} threads to '{}'.", numEvents, numDropped, mThreadBuffers.size(), aFilePath));
+		return true;
+	}
+
+private:
+	// Returns the calling thread's buffer, registering it on first use. Only the
+	// registration takes a lock; recording events into the buffer is lock-free.
+	cpu_profiler_thread_buffer& current_thread_buffer()
+	{
+		thread_local cpu_profiler_thread_buffer* tBuffer = nullptr;
+		if (nullptr == tBuffer) {
+			std::lock_guard<std::mutex> guard(mRegistryMutex);
+			tBuffer = &current_thread_buffer_unlocked();
+		}
+		return *tBuffer;
+	}
+
+	cpu_profiler_thread_buffer& current_thread_buffer_unlocked()
+	{
+		const auto id = std::this_thread::get_id();
+		for (size_t i = 0; i < mThreadIds.size(); ++i) {
+			if (mThreadIds[i] == id) {
+				return *mThreadBuffers[i];
+			}
+		}
+		const auto index = static_cast<uint32_t>(mThreadBuffers.size());
+		mThreadIds.push_back(id);
+		return *mThreadBuffers.emplace_back(std::make_unique<cpu_profiler_thread_buffer>(index, fmt::format("thread {}", index), cEventsPerThread));
+	}
+
+	static std::string escaped(const std::string& aText)
+	{
+		std::string result;
+		result.reserve(aText.size());
+		for (auto c : aText) {
+			if ('"' == c || '\\' == c) {
+				result.push_back('\\');
+			}
+			result.push_back(c);
+		}
+		return result;
+	}
+
+	std::chrono::steady_clock::time_point mStartTime;
+	std::atomic<bool> mRecording = false;
+	std::atomic<uint64_t> mCaptureEpoch = 1;
+
+	mutable std::mutex mRegistryMutex;
+	std::vector<std::thread::id> mThreadIds;
+	std::vector<std::unique_ptr<cpu_profiler_thread_buffer>> mThreadBuffers;
+};
+
+// Access the one and only CPU profiler:
+inline cpu_scope_profiler& cpu_profiler()
+{
+	static cpu_scope_profiler sProfiler;
+	return sProfiler;
+}
+
+// RAII helper which records the time between its construction and destruction:
+class cpu_profiler_scope
+{
+public:
+	explicit cpu_profiler_scope(const char* aName)
+		: mName{ aName }
+		, mStartNs{ cpu_profiler().is_recording() ? cpu_profiler().now_ns() : -1 }
+	{}
+
+	~cpu_profiler_scope()
+	{
+		if (mStartNs >= 0) {
+			cpu_profiler().record(mName, mStartNs, cpu_profiler().now_ns() - mStartNs);
+		}
+	}
+
+	cpu_profiler_scope(const cpu_profiler_scope&) = delete;
+	cpu_profiler_scope& operator=(const cpu_profiler_scope&) = delete;
+
+private:
+	const char* mName;
+	int64_t mStartNs;
+};
+
+#define CPU_PROFILER_CONCAT_IMPL(a, b) a##b
+#define CPU_PROFILER_CONCAT(a, b) CPU_PROFILER_CONCAT_IMPL(a, b)
+
+#if ENABLE_CPU_SCOPE_PROFILER
+// Records the enclosing scope under the given name (which must be a string literal or outlive the profiler's dump):
+#define PROFILE_CPU_SCOPE(aName) cpu_profiler_scope CPU_PROFILER_CONCAT(cpuProfilerScope, __LINE__){ aName }
+#else
+#define PROFILE_CPU_SCOPE(aName)
+#endif
+
+// Records the enclosing function:
+#define PROFILE_CPU_FUNCTION() PROFILE_CPU_SCOPE(__FUNCTION__)
+
+// Wraps an invokee s.t. its initialize(), update(), and render() calls are recorded by the CPU profiler.
+// Use it in place of the invokee type when creating the invokee, e.g.: profiled_invokee<my_invokee>(arguments...)
+template <typename T>
+class profiled_invokee : public T
+{
+public:
+	template <typename... Args>
+	explicit profiled_invokee(Args&&... aArgs)
+		: T(std::forward<Args>(aArgs)...)
+		, mInitializeName{ fmt::format("{}::initialize", typeid(T).name()) }
+		, mUpdateName{ fmt::format("{}::update", typeid(T).name()) }
+		, mRenderName{ fmt::format("{}::render", typeid(T).name()) }
+	{}
+
+	void initialize() override
+	{
+		PROFILE_CPU_SCOPE(mInitializeName.c_str());
+		T::initialize();
+	}
+
+	void update() override
+	{
+		PROFILE_CPU_SCOPE(mUpdateName.c_str());
+		T::update();
+	}
+
+	void render() override
+	{
+		PROFILE_CPU_SCOPE(mRenderName.c_str());
+		T::render();
+	}
+
+private:
+	std::string mInitializeName;
+	std::string mUpdateName;
+	std::string mRenderName;
+};
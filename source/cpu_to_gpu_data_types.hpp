@@ -1,31 +1,172 @@
-#pragma once
-
-#include <gvk.hpp>
-
-// Data to be pushed to the GPU along with a specific draw call:
-struct push_const_data_scene_rendering {
-	glm::vec4  mAmbientLight;
-	glm::vec4  mLightDir;
-	glm::mat4  mCameraTransform;
-	float mCameraHalfFovAngle;
-	float _padding;
-	vk::Bool32  mEnableShadows;
-	float mShadowsFactor;
-	glm::vec4  mShadowsColor;
-	vk::Bool32  mEnableAmbientOcclusion;
-	float mAmbientOcclusionMinDist;
-	float mAmbientOcclusionMaxDist;
-	float mAmbientOcclusionFactor;
-	glm::vec4  mAmbientOcclusionColor;
-};
-
-// Data to be pushed to the GPU along with a ray tracing pipeline invocation
-// for the purpose of spawning further particles:
-struct push_const_data_particle_spawner {
-	// Represents both, offset and rotation for the spawn origin and direction:
-	glm::mat4  mSpawnTransformation;
-	// The spawning angle in radians:
-	float      mSpawnAngleRad;
-	// The new particle's radius:
-	float      mNewParticlesRadius;
-};
+#pragma once
+
+#include <gvk.hpp>
+
+// Instance masks which are assigned to the geometry instances in the TLAS and which are evaluated
+// against the cull mask passed to traceRayEXT. Toggling visibility via the cull mask is for free,
+// because the TLAS does not have to be touched at all:
+//  - Bits 0..5 are assigned to the first triangle mesh geometry instances individually,
+//  - bit 6 is shared by all further triangle mesh geometry instances (their visibility is
+//    toggled by changing the instance's mask and performing an update-only build of the TLAS),
+//  - bit 7 is used by all water particles.
+constexpr uint32_t cNumDedicatedInstanceMaskBits = 6u;
+constexpr uint32_t cSharedTriangleMeshesInstanceMask = 0x40u;
+constexpr uint32_t cParticlesInstanceMask = 0x80u;
+
+// Data to be pushed to the GPU along with a specific draw call:
+struct push_const_data_scene_rendering {
+	glm::vec4  mAmbientLight;
+	glm::vec4  mLightDir;
+	glm::mat4  mCameraTransform;
+	float mCameraHalfFovAngle;
+	float _padding;
+	vk::Bool32  mEnableShadows;
+	float mShadowsFactor;
+	glm::vec4  mShadowsColor;
+	vk::Bool32  mEnableAmbientOcclusion;
+	float mAmbientOcclusionMinDist;
+	float mAmbientOcclusionMaxDist;
+	float mAmbientOcclusionFactor;
+	glm::vec4  mAmbientOcclusionColor;
+	// The cull mask to pass to every traceRayEXT call; geometry instances not matching it are invisible:
+	uint32_t mCullMask;
+	// One of fluid_nightmare_main::render_mode:
+	uint32_t mRenderMode;
+	// The count which is mapped to the hottest color in the heatmap render modes:
+	float mHeatmapMaxCount;
+	// 0 for regular frames. In idle frames, the index of the progressive refinement sample (starting at 1), which
+	// randomizes the ambient occlusion directions and the shadow rays' directions within the light's angular radius:
+	uint32_t mRefinementSample;
+	float mLightAngularRadius;
+	// If set, the occlusion by triangle mesh geometry is read from the baked occlusion buffer (see static_occlusion_baker.hpp),
+	// and only the particles' occlusion is traced:
+	vk::Bool32 mBakedOcclusion;
+	// 0 if the secondary rays are traced recursively from the closest hit shader. Otherwise, the wavefront pass of this launch (see secondary_ray_pass):
+	uint32_t mSecondaryRayPass;
+	// With multiple views: the view of the launch's depth 0 (> 0 if every view is traced in a launch of its own), and the view
+	// which is also written to the offscreen image (see multi_view_data):
+	uint32_t mFirstView;
+	uint32_t mDisplayedView;
+};
+
+// The launches of a frame in the wavefront mode, in which the secondary rays are not traced recursively (see secondary_ray_sorter.hpp):
+enum struct secondary_ray_pass : uint32_t
+{
+	recursive = 0,     // Not in the wavefront mode
+	primary,           // Primary rays, which write the G-buffer
+	shadow,            // Sorted shadow rays
+	ambient_occlusion, // Sorted ambient occlusion rays
+	composite          // Shadows and ambient occlusion are applied to the G-buffer's colors
+};
+
+// Data to be pushed to the GPU along with a ray tracing pipeline invocation
+// for the purpose of spawning further particles:
+struct push_const_data_particle_spawner {
+	// Represents both, offset and rotation for the spawn origin and direction:
+	glm::mat4  mSpawnTransformation;
+	// The spawning angle in radians:
+	float      mSpawnAngleRad;
+	// The new particle's radius:
+	float      mNewParticlesRadius;
+	// The cull mask to use for the spawning rays (s.t. invisible geometry instances are ignored):
+	uint32_t   mCullMask;
+};
+
+// Data which the ray generation shader requires for the temporal reprojection of the previous frame's primary
+// visibility. It is written into the beginning of the reprojection buffer every frame (see the Reprojection
+// buffer in ray_gen_shader.rgen), followed by two layers of per-pixel history samples:
+struct reprojection_frame_data {
+	glm::mat4 mCurrentCameraInverse;
+	glm::mat4 mPreviousCameraTransform;
+	glm::mat4 mPreviousCameraInverse;
+	// Bounds of the particles which have changed since the previous frame (only valid if mParticlesChanged is set):
+	glm::vec4 mChangedParticlesMin;
+	glm::vec4 mChangedParticlesMax;
+	float mPreviousCameraHalfFovAngle;
+	// If not set, all pixels are traced (but the history is written anyway):
+	vk::Bool32 mEnabled;
+	// The layer which contains the previous frame's history; the other one is written:
+	uint32_t mHistoryParity;
+	vk::Bool32 mParticlesChanged;
+	// Every pixel is re-traced every that many frames, s.t. errors of repeated reprojections can't accumulate:
+	uint32_t mRefreshInterval;
+	uint32_t mFrameIndex;
+	// Counters which are cleared by the host and incremented by the shader:
+	uint32_t mRetracedPixels;
+	uint32_t mReusedPixels;
+};
+static_assert(sizeof(reprojection_frame_data) == 256);
+
+// Header of a dirty tiles buffer, which is followed by the tiles (packed as x | y << 16). If enabled, the ray generation shader
+// is launched with (mTileSize, mTileSize, mNumTiles) and traces only the pixels of these tiles:
+struct dirty_tiles_header {
+	vk::Bool32 mEnabled;
+	uint32_t mTileSize;
+	uint32_t mNumTiles;
+	uint32_t _padding;
+};
+
+// The cameras of the multi-view rendering, one buffer per frame in flight. If there is more than one view, ray_gen_shader.rgen
+// uses these instead of mCameraTransform, selects the view by the launch's depth, and writes every view to its own layer:
+static constexpr uint32_t cMaxViews = 8;
+struct multi_view_data {
+	uint32_t mNumViews;
+	uint32_t _padding[3];
+	glm::mat4 mCameraTransforms[cMaxViews];
+};
+
+// Data to be pushed to the GPU along with the bake of one geometry instance's static occlusion:
+struct push_const_data_occlusion_bake {
+	glm::mat4 mInstanceTransform;
+	glm::vec4 mLightDir;
+	// The buffer views of the geometry instance's positions and normals:
+	uint32_t mBufferViewIndex;
+	// Where the geometry instance's vertices start in the baked occlusion buffer:
+	uint32_t mOutputOffset;
+	// The cull mask of all visible triangle mesh geometry instances (i.e., without the particles):
+	uint32_t mCullMask;
+	vk::Bool32 mBakeShadows;
+	vk::Bool32 mBakeAmbientOcclusion;
+	float mAmbientOcclusionMinDist;
+	float mAmbientOcclusionMaxDist;
+	float mLightAngularRadius;
+};
+static_assert(sizeof(push_const_data_occlusion_bake) <= 128);
+
+// One sample of the G-buffer which the primary rays write in the wavefront mode, per pixel:
+struct secondary_ray_gbuffer_sample {
+	glm::vec3 mPosition;      // World space position of the primary ray's hit
+	uint32_t mFlags;          // Only triangle hits of primary rays which have been traced in this frame are valid, see the SECONDARY_RAY_* flags in the shaders
+	uint32_t mColor;          // RGBA8, diffusely lit, but without shadows and ambient occlusion
+	uint32_t mBakedOcclusion; // packHalf2x16(shadowed fraction, ambient occlusion), interpolated from the baked occlusion
+	uint32_t mOcclusion;      // Written by the secondary rays: bit 0 is set if the shadow ray has hit something, the bits above count the ambient occlusion rays' hits
+	uint32_t _padding;
+};
+static_assert(sizeof(secondary_ray_gbuffer_sample) == 32);
+
+// Header of the secondary ray bins buffer, which is followed by one uvec2 per bin (x = number of rays, y = next slot in the sorted rays):
+struct secondary_ray_bins_header {
+	uint32_t mNumRays;
+	uint32_t _padding[3];
+};
+
+// Data to be pushed to the GPU along with the binning of secondary rays:
+struct push_const_data_secondary_ray_binning {
+	// The scene's bounds, which are divided into cells for the Morton codes of the rays' origins:
+	glm::vec4 mSceneMin;
+	glm::vec4 mSceneExtent;
+	glm::vec4 mLightDir;
+	uint32_t mNumPixels;
+	// One of secondary_ray_pass (shadow or ambient_occlusion):
+	uint32_t mRayPass;
+	// 0 to count the rays per bin, 1 to write the rays into their bins' slots:
+	uint32_t mScatter;
+	uint32_t _padding;
+};
+
+// One sample of the primary visibility per pixel, as stored in the reprojection buffer's history layers:
+struct reprojection_history_sample {
+	uint32_t mColor; // RGBA8
+	float mHitT;     // Distance along the primary ray
+	uint32_t mHitId; // 0 for misses
+};
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <gvk.hpp>
+#include <imgui.h>
+#include <imgui_internal.h>
+
+#include "preprocessor_defines.hpp"
+#include "cpu_scope_profiler.hpp"
+#include "gpu_timestamp_profiler.hpp"
+#include "memory_accounting.hpp"
+#include "procedural_geometry_manager.hpp"
+
+// Events which are noted by other invokees and recorded with the frame they happened in (bit flags):
+namespace flight_event
+{
+	static constexpr uint32_t tlas_rebuild           = 1u << 0;
+	static constexpr uint32_t tlas_refit             = 1u << 1;
+	static constexpr uint32_t tlas_reallocation      = 1u << 2;
+	static constexpr uint32_t particle_spawn         = 1u << 3;
+	static constexpr uint32_t particle_capacity_grow = 1u << 4;
+}
+
+// Everything the flight recorder keeps per frame:
+struct flight_frame_record
+{
+	uint64_t mFrame;
+	double mTimeSeconds;
+	float mCpuFrameMs;
+	gpu_timestamp_profiler::pass_timings mGpuPassMs; // As read back in that frame, i.e. with the profiler's latency
+	uint32_t mNumParticles;
+	uint32_t mParticleCapacity;
+	uint32_t mEvents;
+};
+
+// An invokee which keeps the last few seconds of per-frame timings, particle counts, and events in a ring buffer.
+// When a frame exceeds the configured CPU or GPU time threshold, the window is copied and dumped to disk by a
+// background thread, optionally together with a snapshot of all particles, s.t. rare hitches can be analyzed.
+class flight_recorder : public gvk::invokee
+{
+public: // v== gvk::invokee overrides which will be invoked by the framework ==v
+	flight_recorder()
+		: invokee{ std::numeric_limits<int>::max() - 3 } // Execute AFTER all the invokees which note events
+	{}
+
+	void initialize() override
+	{
+		resize_window(mWindowSeconds);
+		mWriterThread = std::thread([this]() { write_dumps(); });
+
+		auto imguiManager = gvk::current_composition()->element_by_type<gvk::imgui_manager>();
+		if (nullptr != imguiManager) {
+			imguiManager->add_callback([this]() {
+				ImGui::Begin("Flight Recorder");
+				ImGui::SetWindowPos(ImVec2(1260.0f, 858.0f), ImGuiCond_FirstUseEver);
+				ImGui::SetWindowSize(ImVec2(300.0f, 200.0f), ImGuiCond_FirstUseEver);
+				ImGui::Checkbox("Dump on Anomalies", &mDumpOnAnomalies);
+				ImGui::SliderFloat("Threshold (ms)", &mThresholdMs, 5.0f, 500.0f, "%.1f");
+				float windowSeconds = mWindowSeconds;
+				if (ImGui::SliderFloat("Window (s)", &windowSeconds, 1.0f, 30.0f, "%.0f")) {
+					resize_window(windowSeconds);
+				}
+				ImGui::Checkbox("Include Particle Snapshot", &mIncludeParticles);
+				if (ImGui::Button("Dump Now")) {
+					mDumpRequested = true;
+				}
+				ImGui::Text("%u dumps written", mNumDumpsWritten.load(std::memory_order_relaxed));
+				ImGui::End();
+			});
+		}
+	}
+
+	void render() override
+	{
+		// Measure CPU frame times between consecutive render() calls:
+		const auto now = std::chrono::steady_clock::now();
+		const float cpuFrameMs = mLastRender.has_value() ? std::chrono::duration<float, std::milli>(now - *mLastRender).count() : 0.0f;
+		mLastRender = now;
+
+		auto& r = mRing[mRingHead];
+		r.mFrame = mFrame++;
+		r.mTimeSeconds = std::chrono::duration<double>(now - mStartTime).count();
+		r.mCpuFrameMs = cpuFrameMs;
+		auto* gpuProfiler = gvk::current_composition()->element_by_type<gpu_timestamp_profiler>();
+		r.mGpuPassMs = nullptr != gpuProfiler ? gpuProfiler->latest_timings() : gpu_timestamp_profiler::pass_timings{};
+		auto* procGeomMgr = gvk::current_composition()->element_by_type<procedural_geometry_manager>();
+		r.mNumParticles = nullptr != procGeomMgr ? static_cast<uint32_t>(procGeomMgr->number_of_particles()) : 0u;
+		r.mParticleCapacity = nullptr != procGeomMgr ? procGeomMgr->max_number_of_geometry_instances() : 0u;
+		if (r.mNumParticles > mPreviousNumParticles) {
+			mPendingEvents |= flight_event::particle_spawn;
+		}
+		if (r.mParticleCapacity > mPreviousParticleCapacity && 0u != mPreviousParticleCapacity) {
+			mPendingEvents |= flight_event::particle_capacity_grow;
+		}
+		r.mEvents = mPendingEvents;
+		mPendingEvents = 0u;
+		mPreviousNumParticles = r.mNumParticles;
+		mPreviousParticleCapacity = r.mParticleCapacity;
+		mRingHead = (mRingHead + 1) % mRing.size();
+		mRingCount = std::min(mRingCount + 1, mRing.size());
+
+		// A hitch is a frame which exceeds the threshold. Don't dump overlapping windows:
+		float gpuFrameMs = 0.0f;
+		for (auto t : r.mGpuPassMs) {
+			gpuFrameMs += t;
+		}
+		const bool isAnomaly = mDumpOnAnomalies && (cpuFrameMs > mThresholdMs || gpuFrameMs > mThresholdMs) && r.mFrame > cWarmupFrames;
+		const bool windowHasPassed = !mLastDumpTime.has_value() || (r.mTimeSeconds - *mLastDumpTime) > static_cast<double>(mWindowSeconds);
+		if (mDumpRequested || (isAnomaly && windowHasPassed)) {
+			dump(fmt::format("flight_recorder_{}", r.mFrame), nullptr != procGeomMgr && mIncludeParticles ? procGeomMgr : nullptr);
+			mLastDumpTime = r.mTimeSeconds;
+			mDumpRequested = false;
+		}
+	}
+
+	void finalize() override
+	{
+		{
+			std::lock_guard<std::mutex> guard(mQueueMutex);
+			mStopRequested = true;
+		}
+		mQueueCondition.notify_one();
+		if (mWriterThread.joinable()) {
+			mWriterThread.join();
+		}
+		memory_accounting().host(host_memory_subsystem::flight_recorder).remove(mRing.size() * sizeof(flight_frame_record));
+	}
+
+	// Notes one or more flight_event flags for the current frame:
+	void note_event(uint32_t aEvents) { mPendingEvents |= aEvents; }
+
+	void set_threshold_ms(float aThresholdMs) { mThresholdMs = aThresholdMs; }
+	void set_particle_snapshots_enabled(bool aEnabled) { mIncludeParticles = aEnabled; }
+
+private:
+	struct dump_job
+	{
+		std::string mBaseName;
+		std::vector<flight_frame_record> mRecords;
+		std::vector<glm::vec4> mParticles;
+	};
+
+	// The ring holds enough frames for the window at up to cMaxFramesPerSecond. Resizing discards its contents.
+	void resize_window(float aWindowSeconds)
+	{
+		memory_accounting().host(host_memory_subsystem::flight_recorder).remove(mRing.size() * sizeof(flight_frame_record));
+		mWindowSeconds = aWindowSeconds;
+		mRing.assign(static_cast<size_t>(std::ceil(aWindowSeconds * cMaxFramesPerSecond)), flight_frame_record{});
+		mRingHead = 0;
+		mRingCount = 0;
+		memory_accounting().host(host_memory_subsystem::flight_recorder).add(mRing.size() * sizeof(flight_frame_record));
+	}
+
+	// Copies the records of the window (and the particles, if requested) and hands them over to the writer thread:
+	void dump(std::string aBaseName, const procedural_geometry_manager* aProcGeomMgr)
+	{
+		PROFILE_CPU_SCOPE("flight recorder dump");
+		dump_job job{ std::move(aBaseName) };
+		const auto newestTime = mRing[(mRingHead + mRing.size() - 1) % mRing.size()].mTimeSeconds;
+		job.mRecords.reserve(mRingCount);
+		for (size_t i = 0; i < mRingCount; ++i) {
+			const auto& r = mRing[(mRingHead + mRing.size() - mRingCount + i) % mRing.size()];
+			if (newestTime - r.mTimeSeconds <= static_cast<double>(mWindowSeconds)) {
+				job.mRecords.push_back(r);
+			}
+		}
+		if (nullptr != aProcGeomMgr) {
+			job.mParticles = aProcGeomMgr->particles();
+		}
+		{
+			std::lock_guard<std::mutex> guard(mQueueMutex);
+			mQueue.push_back(std::move(job));
+		}
+		mQueueCondition.notify_one();
+	}
+
+	// The writer thread's loop:
+	void write_dumps()
+	{
+		cpu_profiler().set_current_thread_name("flight recorder");
+		while (true) {
+			dump_job job;
+			{
+				std::unique_lock<std::mutex> lock(mQueueMutex);
+				mQueueCondition.wait(lock, [this]() { return mStopRequested || !mQueue.empty(); });
+				if (mQueue.empty()) {
+					return; // Stop requested, and everything has been written
+				}
+				job = std::move(mQueue.front());
+				mQueue.pop_front();
+			}
+			PROFILE_CPU_SCOPE("write flight recorder dump");
+			write_records(job.mBaseName + ".json", job.mRecords);
+			if (!job.mParticles.empty()) {
+				write_particles(job.mBaseName + "_particles.bin", job.mParticles);
+			}
+			mNumDumpsWritten.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	static void write_records(const std::string& aFilePath, const std::vector<flight_frame_record>& aRecords)
+	{
+		std::ofstream file(aFilePath);
+		if (!file.is_open()) {
+			LOG_WARNING(fmt::format("Unable to open '{}' for writing the flight recorder dump.", aFilePath));
+			return;
+		}
+		file << "{\n  \"gpu_passes\": [";
+		for (size_t p = 0; p < static_cast<size_t>(gpu_pass::count); ++p) {
+			file << (p > 0 ? ", " : "") << '"' << gpu_pass_names[p] << '"';
+		}
+		file << "],\n  \"frames\": [\n";
+		for (size_t i = 0; i < aRecords.size(); ++i) {
+			const auto& r = aRecords[i];
+			file << fmt::format(R"(    {{ "frame": {}, "time_s": {:.6f}, "cpu_ms": {:.4f}, "gpu_ms": [)", r.mFrame, r.mTimeSeconds, r.mCpuFrameMs);
+			for (size_t p = 0; p < r.mGpuPassMs.size(); ++p) {
+				file << fmt::format("{}{:.4f}", p > 0 ? ", " : "", r.mGpuPassMs[p]);
+			}
+			file << fmt::format(R"(], "particles": {}, "capacity": {}, "events": [)", r.mNumParticles, r.mParticleCapacity);
+			bool first = true;
+			for (const auto& [flag, name] : { std::pair{ flight_event::tlas_rebuild, "tlas_rebuild" }, std::pair{ flight_event::tlas_refit, "tlas_refit" },
+				std::pair{ flight_event::tlas_reallocation, "tlas_reallocation" }, std::pair{ flight_event::particle_spawn, "spawn" },
+				std::pair{ flight_event::particle_capacity_grow, "capacity_grow" } }) {
+				if (0u != (r.mEvents & flag)) {
+					file << (first ? "" : ", ") << '"' << name << '"';
+					first = false;
+				}
+			}
+			file << "] }" << (i + 1 < aRecords.size() ? ",\n" : "\n");
+		}
+		file << "  ]\n}\n";
+		LOG_INFO(fmt::format("Flight recorder dumped {} frames to '{}'.", aRecords.size(), aFilePath));
+	}
+
+	// Particles are written as their count (uint64_t), followed by position (xyz) and radius (w) per particle as floats:
+	static void write_particles(const std::string& aFilePath, const std::vector<glm::vec4>& aParticles)
+	{
+		std::ofstream file(aFilePath, std::ios::binary);
+		if (!file.is_open()) {
+			LOG_WARNING(fmt::format("Unable to open '{}' for writing the particle snapshot.", aFilePath));
+			return;
+		}
+		const uint64_t count = aParticles.size();
+		file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+		file.write(reinterpret_cast<const char*>(aParticles.data()), static_cast<std::streamsize>(aParticles.size() * sizeof(glm::vec4)));
+	}
+
+	// Size the ring for frame rates up to this value:
+	static constexpr float cMaxFramesPerSecond = 480.0f;
+	// The first frames (loading, pipeline creation) are always slow => don't consider them anomalies:
+	static constexpr uint64_t cWarmupFrames = 60;
+
+	// Settings:
+	bool mDumpOnAnomalies = true;
+	float mThresholdMs = 50.0f;
+	float mWindowSeconds = 5.0f;
+	bool mIncludeParticles = false;
+	bool mDumpRequested = false;
+
+	// The ring buffer of the most recent frames; mRingHead points to the oldest entry once it is full:
+	std::vector<flight_frame_record> mRing;
+	size_t mRingHead = 0;
+	size_t mRingCount = 0;
+
+	uint64_t mFrame = 0;
+	std::chrono::steady_clock::time_point mStartTime = std::chrono::steady_clock::now();
+	std::optional<std::chrono::steady_clock::time_point> mLastRender;
+	std::optional<double> mLastDumpTime;
+	uint32_t mPendingEvents = 0u;
+	uint32_t mPreviousNumParticles = 0u;
+	uint32_t mPreviousParticleCapacity = 0u;
+
+	// Dumps which are waiting for the writer thread:
+	std::thread mWriterThread;
+	std::mutex mQueueMutex;
+	std::condition_variable mQueueCondition;
+	std::deque<dump_job> mQueue;
+	bool mStopRequested = false;
+	std::atomic<uint32_t> mNumDumpsWritten = 0u;
+
+}; // End of flight_recorder
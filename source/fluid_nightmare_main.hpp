@@ -1,82 +1,328 @@
-#pragma once
-
-#include <gvk.hpp>
-#include <imgui.h>
-#include <imgui_internal.h>
-
-#include "preprocessor_defines.hpp"
-#include "cpu_to_gpu_data_types.hpp"
-
-// Main invokee of this application:
-class fluid_nightmare_main : public gvk::invokee
-{
-public: // v== gvk::invokee overrides which will be invoked by the framework ==v
-	fluid_nightmare_main(avk::queue& aQueue);
-
-	void initialize() override;
-
-	void update() override;
-
-	void render() override;
-
-	[[nodiscard]] const avk::top_level_acceleration_structure& get_tlas() const;
-
-private: // v== Member variables ==v
-
-	// --------------- Some fundamental stuff -----------------
-
-	// Our only queue where we submit command buffers to:
-	avk::queue* mQueue;
-
-	// Our only descriptor cache which stores reusable descriptor sets:
-	avk::descriptor_cache mDescriptorCache;
-
-	// ------------- Scene and model properties ---------------
-
-	// Ambient light of our scene:
-	glm::vec3 mAmbientLight = { 0.5f, 0.5f, 0.5f };
-
-	// The direction of our single light source, which is a directional light:
-	glm::vec3 mLightDir = { 0.0f, -1.0f, 0.0f };
-
-	// ----------- Resources required for ray tracing -----------
-
-	// We are using one single top-level acceleration structure (TLAS) to keep things simple:
-	//    (We're not duplicating the TLAS per frame in flight. Instead, we
-	//     are using barriers to ensure correct rendering after some data 
-	//     has changed in one or multiple of the acceleration structures.)
-	avk::top_level_acceleration_structure mTlas;
-
-	// We are rendering into one single target offscreen image (Otherwise we would need multiple
-	// TLAS instances, too.) to keep things simple:
-	avk::image_view mOffscreenImageView;
-	// (After blitting this image into one of the window's backbuffers, the GPU can 
-	//  possibly achieve some parallelization of work during presentation.)
-
-	// The ray tracing pipeline that renders everything into the mOffscreenImageView:
-	avk::ray_tracing_pipeline mPipeline;
-
-	// ----------------- Further invokees --------------------
-
-	// A camera to navigate our scene, which provides us with the view matrix:
-	gvk::quake_camera mQuakeCam;
-
-	// ------------------- UI settings -----------------------
-
-	float mFieldOfViewForRayTracing = 45.0f;
-	bool mEnableShadows = true;
-	float mShadowsFactor = 0.5f;
-	glm::vec3 mShadowsColor = glm::vec3{ 0.0f, 0.0f, 0.0f };
-	bool mEnableAmbientOcclusion = true;
-	float mAmbientOcclusionMinDist = 0.05f;
-	float mAmbientOcclusionMaxDist = 0.25f;
-	float mAmbientOcclusionFactor = 0.5f;
-	glm::vec3 mAmbientOcclusionColor = glm::vec3{ 0.0f, 0.0f, 0.0f };
-
-	// One boolean per geometry instance to tell if it shall be included in the
-	// generation of the TLAS or not:
-	std::vector<bool> mGeometryInstanceActive;
-
-	bool mTlasUpdateRequired = false;
-
-}; // End of fluid_nightmare_main
+#pragma once
+
+#include <gvk.hpp>
+#include <imgui.h>
+#include <imgui_internal.h>
+
+#include "preprocessor_defines.hpp"
+#include "cpu_to_gpu_data_types.hpp"
+#include "cpu_kernels.hpp"
+#include "secondary_ray_sorter.hpp"
+
+// Main invokee of this application:
+class fluid_nightmare_main : public gvk::invokee
+{
+public: // v== gvk::invokee overrides which will be invoked by the framework ==v
+	// The scene can either be rendered shaded, or the traversal cost per pixel can be visualized as a heatmap:
+	enum struct render_mode : uint32_t
+	{
+		shaded = 0,
+		intersections_heatmap, // Number of intersection shader invocations per pixel
+		rays_heatmap           // Number of rays traced per pixel
+	};
+
+	// What to do in idle frames, i.e., when nothing which influences the traced image has changed since the previous frame:
+	enum struct idle_frame_mode : uint32_t
+	{
+		always_trace = 0,      // Trace every frame anyway
+		skip_tracing,          // Don't trace, but present the last image again
+		progressive_refinement // Spend idle frames on refining ambient occlusion and soft shadows, then skip tracing once converged
+	};
+
+	// How many frames have been traced, skipped, spent on progressive refinement, and traced only in the dirty tiles:
+	struct idle_frame_statistics
+	{
+		uint64_t mTracedFrames = 0;
+		uint64_t mSkippedFrames = 0;
+		uint64_t mRefinementFrames = 0;
+		uint64_t mDirtyTileFrames = 0;
+	};
+
+	// All the settings which can be changed via the UI (e.g., recorded and replayed by the replay_recorder).
+	// Only 4-byte members, s.t. there is no padding and instances can be compared and serialized bytewise:
+	struct render_settings
+	{
+		glm::vec3 mAmbientLight;
+		glm::vec3 mLightDir;
+		float mFieldOfView;
+		uint32_t mEnableShadows;
+		float mShadowsFactor;
+		glm::vec3 mShadowsColor;
+		uint32_t mEnableAmbientOcclusion;
+		float mAmbientOcclusionMinDist;
+		float mAmbientOcclusionMaxDist;
+		float mAmbientOcclusionFactor;
+		glm::vec3 mAmbientOcclusionColor;
+		uint32_t mRenderMode;
+		float mHeatmapMaxCount;
+		uint32_t mEnableBakedOcclusion;
+		float mLightAngularRadiusDegrees;
+	};
+
+	fluid_nightmare_main(avk::queue& aQueue);
+
+	void initialize() override;
+
+	void update() override;
+
+	void render() override;
+
+	[[nodiscard]] const avk::top_level_acceleration_structure& get_tlas() const;
+
+	// Returns the cull mask which must be passed to traceRayEXT in order to only hit visible geometry instances:
+	[[nodiscard]] uint32_t get_cull_mask() const;
+
+	// Accessors which allow to control the rendering without the UI (e.g., used by the benchmark_runner):
+	[[nodiscard]] gvk::quake_camera& camera() { return mQuakeCam; }
+	void set_shadows_enabled(bool aEnabled) { mEnableShadows = aEnabled; }
+	void set_ambient_occlusion_enabled(bool aEnabled) { mEnableAmbientOcclusion = aEnabled; }
+	void set_render_mode(render_mode aMode) { mRenderMode = aMode; }
+	void set_reprojection_enabled(bool aEnabled) { mEnableReprojection = aEnabled; }
+	void set_idle_frame_mode(idle_frame_mode aMode) { mIdleFrameMode = aMode; }
+	void set_dirty_tiles_enabled(bool aEnabled) { mEnableDirtyTiles = aEnabled; }
+	void set_baked_occlusion_enabled(bool aEnabled) { mEnableBakedOcclusion = aEnabled; }
+	[[nodiscard]] bool baked_occlusion_enabled() const { return mEnableBakedOcclusion; }
+	void set_wavefront_enabled(bool aEnabled) { mEnableWavefront = aEnabled; }
+	void set_views(int aNumViews, float aSeparation) { mNumViews = aNumViews; mViewSeparation = aSeparation; }
+	void set_separate_view_launches(bool aEnabled) { mSeparateViewLaunches = aEnabled; }
+	[[nodiscard]] float light_angular_radius() const { return glm::radians(mLightAngularRadiusDegrees); }
+	// Incremented with every build of the TLAS, i.e. 0 until the TLAS has been built for the first time:
+	[[nodiscard]] uint64_t tlas_version() const { return mTlasVersion; }
+	[[nodiscard]] const idle_frame_statistics& idle_frame_stats() const { return mIdleFrameStatistics; }
+	// The fraction of the pixels which have been traced (instead of reprojected) in the frame which has been read back most recently:
+	[[nodiscard]] float retraced_pixel_fraction() const { return mRetracedPixelFraction; }
+	[[nodiscard]] render_settings get_render_settings() const;
+	void set_render_settings(const render_settings& aSettings);
+
+private:
+	// avk's mapping of a buffer's memory, which keeps it mapped for as long as the mapping object exists:
+	using buffer_mapping = decltype(std::declval<avk::buffer_t&>().map_memory(avk::mapping_access::write));
+
+	// (Re-)creates the TLAS, sized for all the triangle mesh geometry instances plus the current particle capacity:
+	void create_tlas();
+
+	// Creates the scene rendering pipeline. Its ray generation shaders are the one for the primary rays, followed by the
+	// ones for the wavefront mode's secondary rays and for their composition:
+	[[nodiscard]] avk::ray_tracing_pipeline create_scene_rendering_pipeline(uint32_t aMaxRecursionDepth);
+
+	// Accounts the current offscreen image, unless that has happened already. The updater replaces it when the window is resized,
+	// possibly several times before the old ones are destroyed:
+	void account_offscreen_image();
+
+	// (Re-)creates the layered image of the multiple views, with one layer per view:
+	void create_view_image(glm::uvec2 aResolution, uint32_t aNumLayers);
+
+	// Creates the persistently mapped buffers with the views' cameras (multi_view_data), one per frame in flight:
+	void create_multi_view_buffers();
+
+	// The cameras of all views (only the camera itself if there is only one view):
+	[[nodiscard]] std::vector<glm::mat4> view_transforms() const;
+
+	// (Re-)creates the traversal counters buffer for the current resolution:
+	void create_traversal_counters_buffer();
+
+	// (Re-)creates the reprojection buffer (reprojection_frame_data, followed by two history layers) for the current resolution:
+	void create_reprojection_buffer();
+
+	// (Re-)creates the buffer which the progressive refinement samples are accumulated in, for the current resolution:
+	void create_accumulation_buffer();
+
+	// (Re-)creates the persistently mapped dirty tiles buffers (one per frame in flight), sized for all tiles of the current resolution:
+	void create_dirty_tiles_buffers();
+	void destroy_dirty_tiles_buffers();
+
+	// Decides if the previous frame's primary visibility may be reused in this frame, and records the update of the reprojection_frame_data.
+	// Frames which only trace the dirty tiles update the most recently written history layer in place:
+	void record_reprojection_frame_data(avk::command_buffer_t& aCommandBuffer, size_t aInFlightIndex, bool aAllowReuse, bool aDirtyTilesOnly);
+
+	// How much of the image has to be traced in a frame:
+	enum struct trace_extent
+	{
+		nothing,     // Nothing has changed => the offscreen image is still up to date
+		dirty_tiles, // Only particles have changed => trace the tiles in mDirtyTiles
+		whole_image
+	};
+
+	// Compares everything which influences the traced image with the previously traced frame. If the frame shall be spent
+	// on progressive refinement, the refinement sample is set in aPushConstants. If only the tiles which are affected by
+	// changed particles have to be traced, they are collected in mDirtyTiles. aViewTransforms is empty for a single view:
+	[[nodiscard]] trace_extent evaluate_frame_changes(push_const_data_scene_rendering& aPushConstants, const std::vector<glm::mat4>& aViewTransforms);
+
+	// Edge length of the screen-space tiles in pixels:
+	static constexpr uint32_t cDirtyTileSize = 16;
+
+	// The fraction of the available device memory budget which the particles' TLAS may use up:
+	static constexpr double cParticlesMemoryBudgetFraction = 0.5;
+
+private: // v== Member variables ==v
+
+	// --------------- Some fundamental stuff -----------------
+
+	// Our only queue where we submit command buffers to:
+	avk::queue* mQueue;
+
+	// Our only descriptor cache which stores reusable descriptor sets:
+	avk::descriptor_cache mDescriptorCache;
+
+	// ------------- Scene and model properties ---------------
+
+	// Ambient light of our scene:
+	glm::vec3 mAmbientLight = { 0.5f, 0.5f, 0.5f };
+
+	// The direction of our single light source, which is a directional light:
+	glm::vec3 mLightDir = { 0.0f, -1.0f, 0.0f };
+
+	// ----------- Resources required for ray tracing -----------
+
+	// We are using one single top-level acceleration structure (TLAS) to keep things simple:
+	//    (We're not duplicating the TLAS per frame in flight. Instead, we
+	//     are using barriers to ensure correct rendering after some data 
+	//     has changed in one or multiple of the acceleration structures.)
+	avk::top_level_acceleration_structure mTlas;
+
+	// We are rendering into one single target offscreen image (Otherwise we would need multiple
+	// TLAS instances, too.) to keep things simple:
+	avk::image_view mOffscreenImageView;
+	// (After blitting this image into one of the window's backbuffers, the GPU can 
+	//  possibly achieve some parallelization of work during presentation.)
+	// The offscreen images which are accounted in memory_accounting(), with their sizes, until they are destroyed:
+	std::vector<std::pair<vk::Image, uint64_t>> mAccountedOffscreenImages;
+
+	// The ray tracing pipeline that renders everything into the mOffscreenImageView:
+	avk::ray_tracing_pipeline mPipeline;
+
+	// The same pipeline with a max. recursion depth of 1, for the wavefront mode, in which secondary rays are traced in separate launches:
+	avk::ray_tracing_pipeline mWavefrontPipeline;
+
+	// The wavefront mode's G-buffer, and the sorting of its secondary rays:
+	secondary_ray_sorter mSecondaryRaySorter;
+
+	// With multiple views, every view is rendered into its own layer of this image (and the displayed one into mOffscreenImageView, too):
+	avk::image_view mViewImageView;
+	uint32_t mViewImageLayers = 0;
+	glm::uvec2 mViewImageResolution{ 0u, 0u };
+
+	// Host-coherent, persistently mapped views' cameras (multi_view_data), one buffer per frame in flight:
+	std::vector<avk::buffer> mMultiViewBuffers;
+	std::vector<buffer_mapping> mMultiViewMappings;
+	std::vector<multi_view_data*> mMultiViewMapped;
+
+	// Traversal cost counters (scene-wide totals, followed by two counters per pixel), which
+	// are written by the shaders in the heatmap render modes. Sized for this resolution:
+	avk::buffer mTraversalCountersBuffer;
+	glm::uvec2 mTraversalCountersResolution;
+
+	// Host-visible copies of the scene-wide totals, one slot per frame in flight, and the host memory they are read into:
+	avk::buffer mTraversalTotalsReadbackBuffer;
+	std::vector<uint32_t> mTraversalTotals;
+
+	// Temporal reprojection of the primary visibility: reprojection_frame_data, followed by two layers of per-pixel
+	// history samples, which are written and read in turns. Sized for this resolution:
+	avk::buffer mReprojectionBuffer;
+	glm::uvec2 mReprojectionResolution;
+
+	// Host-visible copies of the re-traced and reused pixel counters, one slot per frame in flight, and the host memory they are read into:
+	avk::buffer mReprojectionCountersReadbackBuffer;
+	std::vector<uint32_t> mReprojectionCounters;
+
+	// Sums of the progressive refinement samples per pixel (same resolution as the reprojection history):
+	avk::buffer mAccumulationBuffer;
+
+	// Host-coherent, persistently mapped dirty tiles (dirty_tiles_header, followed by the tiles), one buffer per frame in flight:
+	std::vector<avk::buffer> mDirtyTilesBuffers;
+	std::vector<buffer_mapping> mDirtyTilesMappings;
+	std::vector<dirty_tiles_header*> mDirtyTilesMapped;
+	glm::uvec2 mDirtyTilesResolution;
+
+	// ----------------- Further invokees --------------------
+
+	// A camera to navigate our scene, which provides us with the view matrix:
+	gvk::quake_camera mQuakeCam;
+
+	// ------------------- UI settings -----------------------
+
+	float mFieldOfViewForRayTracing = 45.0f;
+	bool mEnableShadows = true;
+	float mShadowsFactor = 0.5f;
+	glm::vec3 mShadowsColor = glm::vec3{ 0.0f, 0.0f, 0.0f };
+	bool mEnableAmbientOcclusion = true;
+	float mAmbientOcclusionMinDist = 0.05f;
+	float mAmbientOcclusionMaxDist = 0.25f;
+	float mAmbientOcclusionFactor = 0.5f;
+	glm::vec3 mAmbientOcclusionColor = glm::vec3{ 0.0f, 0.0f, 0.0f };
+	render_mode mRenderMode = render_mode::shaded;
+	float mHeatmapMaxCount = 64.0f;
+
+	// Scene-wide traversal cost totals of the frame which has been read back most recently:
+	uint32_t mTotalIntersectionInvocations = 0;
+	uint32_t mTotalRays = 0;
+
+	// Temporal reprojection settings. If the camera moves faster than this per frame, all pixels are traced:
+	bool mEnableReprojection = false;
+	float mReprojectionMaxTranslation = 0.05f;
+	float mReprojectionMaxRotationDegrees = 0.5f;
+	int mReprojectionRefreshInterval = 16;
+
+	// Everything the previous frame has been rendered with, s.t. changes can be detected:
+	bool mReprojectionHistoryValid = false;
+	glm::mat4 mPreviousCameraTransform{ 1.0f };
+	render_settings mPreviousRenderSettings{};
+	uint32_t mPreviousCullMask = 0;
+	uint64_t mPreviousOcclusionBakes = 0;
+	uint32_t mReprojectionFrameIndex = 0;
+
+	// What has changed in the TLAS since the previous frame:
+	bool mTriangleMeshGeometryChanged = false;
+	bounding_box mChangedParticleBounds;
+
+	// Idle frame settings (off by default, i.e. every frame is traced). Progressive refinement stops after that many samples:
+	idle_frame_mode mIdleFrameMode = idle_frame_mode::always_trace;
+	int mMaxRefinementSamples = 64;
+	float mLightAngularRadiusDegrees = 1.0f;
+
+	// Everything which the most recently traced frame depends on (except for the refinement sample), s.t. idle frames can be detected:
+	push_const_data_scene_rendering mLastTracedPushConstants{};
+	uint64_t mTlasVersion = 0;
+	uint64_t mLastTracedTlasVersion = std::numeric_limits<uint64_t>::max();
+	vk::ImageView mLastTracedImageView;
+	vk::Pipeline mLastTracedPipeline;
+	std::vector<glm::mat4> mLastTracedViewTransforms;
+	uint32_t mRefinementSample = 0;
+	idle_frame_statistics mIdleFrameStatistics;
+
+	// If enabled, the occlusion by triangle mesh geometry is baked per vertex by the static_occlusion_baker:
+	bool mEnableBakedOcclusion = false;
+
+	// If enabled, the shaded render mode's secondary rays are sorted and traced in separate launches (see secondary_ray_sorter):
+	bool mEnableWavefront = false;
+
+	// Multi-view settings. The views are spread along the camera's x axis; they are traced in one launch unless mSeparateViewLaunches:
+	int mNumViews = 1;
+	float mViewSeparation = 0.065f;
+	int mDisplayedView = 0;
+	bool mSeparateViewLaunches = false;
+	// Whether the most recent frame has actually rendered multiple views (see render()):
+	bool mMultiViewActive = false;
+
+	// Dirty tiles settings. If the tiles affected by changed particles cover more than that fraction of the image, it is traced as a whole:
+	bool mEnableDirtyTiles = false;
+	float mDirtyTilesMaxFraction = 0.5f;
+
+	// The tiles (packed as x | y << 16) which are traced in this frame, and the fraction of the image which they cover:
+	std::vector<uint32_t> mDirtyTiles;
+	size_t mNumDirtyPixels = 0;
+	float mDirtyPixelFraction = 0.0f;
+
+	// Statistics of the frame which has been read back most recently, and of the past frames:
+	bool mReprojectionFellBack = false;
+	float mRetracedPixelFraction = 1.0f;
+	std::array<float, 128> mRetracedPixelFractionHistory{};
+	size_t mRetracedPixelFractionHistoryOffset = 0;
+
+	// One boolean per geometry instance to tell if it shall be included in the
+	// generation of the TLAS or not:
+	std::vector<bool> mGeometryInstanceActive;
+
+	bool mTlasUpdateRequired = false;
+
+}; // End of fluid_nightmare_main
@@ -0,0 +1,385 @@
+#pragma once
+
+#include <gvk.hpp>
+#include <imgui.h>
+#include <imgui_internal.h>
+#include <filesystem>
+#include <cstdio>
+
+#include "preprocessor_defines.hpp"
+#include "cpu_scope_profiler.hpp"
+#include "memory_accounting.hpp"
+#include "gpu_timestamp_profiler.hpp"
+
+// (Implemented in stb_image_write.cpp:)
+#include <stb_image_write.h>
+
+// What the frame_capture does with the captured frames:
+enum struct frame_capture_format : int
+{
+	raw = 0,      // The pixels as they are, one file per frame, described by capture_info.txt
+	png,          // One PNG file per frame
+	encoder_pipe  // Piped into the standard input of an encoder process, e.g. ffmpeg
+};
+
+// An invokee which captures the rendered frames without ever stalling the render thread. The main invokee calls
+// record_copy() after trace_rays, which records a copy of the offscreen image into one slot of a ring of persistently
+// mapped host-visible buffers. Only after all frames in flight have been rendered (i.e., after the framework has
+// waited for the frame's fence anyway), the slot is handed to a background thread, which writes it and returns the
+// slot. If no slot is free, the frame is dropped instead of waiting.
+class frame_capture : public gvk::invokee
+{
+public: // v== gvk::invokee overrides which will be invoked by the framework ==v
+	frame_capture(std::optional<std::string> aDirectory)
+		: invokee{ std::numeric_limits<int>::max() - 3 }
+	{
+		if (aDirectory.has_value()) {
+			std::snprintf(mDirectory.data(), mDirectory.size(), "%s", aDirectory->c_str());
+			mCapturing = true;
+		}
+	}
+
+	void initialize() override
+	{
+		// Copies which have been submitted this many frames ago have completed for sure:
+		mReadbackLatency = static_cast<uint32_t>(gvk::context().main_window()->number_of_frames_in_flight()) + 1u;
+		mWriterThread = std::thread([this]() { write_frames(); });
+
+		auto imguiManager = gvk::current_composition()->element_by_type<gvk::imgui_manager>();
+		if (nullptr != imguiManager) {
+			imguiManager->add_callback([this]() {
+				ImGui::Begin("Frame Capture");
+				ImGui::SetWindowPos(ImVec2(1260.0f, 408.0f), ImGuiCond_FirstUseEver);
+				ImGui::SetWindowSize(ImVec2(420.0f, 200.0f), ImGuiCond_FirstUseEver);
+				bool capturing = mCapturing;
+				if (ImGui::Checkbox("Capture", &capturing)) {
+					set_capturing(capturing);
+				}
+				static const char* const formatNames[] = { "Raw", "PNG", "Encoder Pipe" };
+				int format = static_cast<int>(mFormat);
+				if (ImGui::Combo("Format", &format, formatNames, static_cast<int>(std::size(formatNames)))) {
+					mFormat = static_cast<frame_capture_format>(format);
+				}
+				if (frame_capture_format::encoder_pipe == mFormat) {
+					ImGui::InputText("Command", mEncoderCommand.data(), mEncoderCommand.size());
+					ImGui::TextDisabled("{width}, {height}, {pixel_format}, and {directory} are replaced.");
+				}
+				ImGui::InputText("Directory", mDirectory.data(), mDirectory.size());
+				ImGui::Text("%u written, %u dropped, %u in flight", mNumWritten.load(std::memory_order_relaxed), mNumDropped, static_cast<uint32_t>(mSlots.size() - free_slot_count()));
+				ImGui::Text("Writer: %.1f MB/s", mWriterMegabytesPerSecond.load(std::memory_order_relaxed));
+				ImGui::End();
+			});
+		}
+	}
+
+	void finalize() override
+	{
+		// Hand over the copies which are still in flight, s.t. the end of the sequence is written, too:
+		gvk::context().device().waitIdle();
+		hand_over_completed_copies(std::numeric_limits<uint64_t>::max());
+		{
+			std::lock_guard<std::mutex> guard(mMutex);
+			mStopRequested = true;
+		}
+		mCondition.notify_one();
+		if (mWriterThread.joinable()) {
+			mWriterThread.join();
+		}
+		destroy_slots();
+	}
+
+	// Records a copy of the given image (which must be in general layout, and must have been written by previous
+	// commands in aCommandBuffer, with a barrier to transfer reads) into a free slot of the readback ring:
+	void record_copy(avk::command_buffer_t& aCommandBuffer, const avk::image_t& aImage)
+	{
+		const auto frame = ++mFrame;
+		hand_over_completed_copies(frame);
+		if (!mCapturing) {
+			return;
+		}
+
+		// The ring is sized for one resolution and format. Recreate it once none of its slots are in use anymore:
+		const vk::Extent2D extent{ aImage.width(), aImage.height() };
+		if (extent != mExtent || aImage.format() != mFormatOfImage) {
+			if (free_slot_count() != mSlots.size()) {
+				++mNumDropped;
+				return;
+			}
+			if (!create_slots(extent, aImage.format())) {
+				set_capturing(false);
+				return;
+			}
+		}
+
+		std::optional<uint32_t> slotIndex;
+		{
+			std::lock_guard<std::mutex> guard(mMutex);
+			if (!mFreeSlots.empty()) {
+				slotIndex = mFreeSlots.front();
+				mFreeSlots.pop_front();
+			}
+		}
+		if (!slotIndex.has_value()) {
+			++mNumDropped;
+			return;
+		}
+
+		auto* gpuProfiler = gvk::current_composition()->element_by_type<gpu_timestamp_profiler>();
+		if (nullptr != gpuProfiler) { gpuProfiler->begin_pass(aCommandBuffer, gpu_pass::frame_capture); }
+		auto& slot = mSlots[*slotIndex];
+		aCommandBuffer.handle().copyImageToBuffer(aImage.handle(), vk::ImageLayout::eGeneral, slot.mBuffer->handle(), vk::BufferImageCopy{}
+			.setImageSubresource(vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, 0u, 0u, 1u })
+			.setImageExtent(vk::Extent3D{ extent.width, extent.height, 1u })
+		);
+		aCommandBuffer.establish_global_memory_barrier(
+			avk::pipeline_stage::transfer, avk::pipeline_stage::host,
+			avk::memory_access::transfer_write_access, avk::memory_access::host_read_access
+		);
+		if (nullptr != gpuProfiler) { gpuProfiler->end_pass(aCommandBuffer, gpu_pass::frame_capture); }
+
+		slot.mSubmittedFrame = frame;
+		slot.mSession = mSession;
+		slot.mIndexInSession = mNumCapturedInSession++;
+		slot.mFormat = mFormat;
+		slot.mDirectory = std::string(mDirectory.data());
+		slot.mEncoderCommand = std::string(mEncoderCommand.data());
+		mCopiesInFlight.push_back(*slotIndex);
+	}
+
+	void set_capturing(bool aEnabled)
+	{
+		if (aEnabled && !mCapturing) {
+			++mSession;
+			mNumCapturedInSession = 0;
+		}
+		mCapturing = aEnabled;
+		mActiveSession.store(aEnabled ? mSession : 0u, std::memory_order_relaxed);
+	}
+
+private:
+	// avk's mapping of a buffer's memory, which lasts as long as the mapping object:
+	using buffer_mapping = decltype(std::declval<avk::buffer_t&>().map_memory(avk::mapping_access::read));
+
+	struct capture_slot
+	{
+		avk::buffer mBuffer;
+		std::optional<buffer_mapping> mMapping;
+		const uint8_t* mMapped = nullptr;
+		uint64_t mSubmittedFrame = 0;
+		uint32_t mSession = 0;
+		uint64_t mIndexInSession = 0;
+		frame_capture_format mFormat = frame_capture_format::png;
+		std::string mDirectory;
+		std::string mEncoderCommand;
+	};
+
+	// Hands the slots whose copies have completed over to the writer thread:
+	void hand_over_completed_copies(uint64_t aCurrentFrame)
+	{
+		bool handedOver = false;
+		while (!mCopiesInFlight.empty() && mSlots[mCopiesInFlight.front()].mSubmittedFrame + mReadbackLatency <= aCurrentFrame) {
+			std::lock_guard<std::mutex> guard(mMutex);
+			mCompletedSlots.push_back(mCopiesInFlight.front());
+			mCopiesInFlight.pop_front();
+			handedOver = true;
+		}
+		if (handedOver) {
+			mCondition.notify_one();
+		}
+	}
+
+	[[nodiscard]] size_t free_slot_count()
+	{
+		std::lock_guard<std::mutex> guard(mMutex);
+		return mFreeSlots.size();
+	}
+
+	// Creates the readback ring for images of the given extent and format. Only 4-byte RGBA/BGRA formats are supported.
+	bool create_slots(vk::Extent2D aExtent, vk::Format aFormat)
+	{
+		const bool bgra = vk::Format::eB8G8R8A8Unorm == aFormat || vk::Format::eB8G8R8A8Srgb == aFormat;
+		const bool rgba = vk::Format::eR8G8B8A8Unorm == aFormat || vk::Format::eR8G8B8A8Srgb == aFormat;
+		if (!bgra && !rgba) {
+			LOG_WARNING(fmt::format("Frame capture doesn't support the offscreen image's format {}.", vk::to_string(aFormat)));
+			return false;
+		}
+		destroy_slots();
+		mExtent = aExtent;
+		mFormatOfImage = aFormat;
+		mBgra.store(bgra, std::memory_order_relaxed);
+		const size_t size = static_cast<size_t>(aExtent.width) * aExtent.height * 4u;
+		mSlots.resize(cNumSlots);
+		for (uint32_t i = 0; i < cNumSlots; ++i) {
+			mSlots[i].mBuffer = gvk::context().create_buffer(
+				avk::memory_usage::host_coherent, vk::BufferUsageFlagBits::eTransferDst,
+				avk::generic_buffer_meta::create_from_size(size)
+			);
+			// Mapped once, for the ring's whole lifetime:
+			mSlots[i].mMapping.emplace(mSlots[i].mBuffer->map_memory(avk::mapping_access::read));
+			mSlots[i].mMapped = static_cast<const uint8_t*>(mSlots[i].mMapping->get());
+			memory_accounting().add(gpu_memory_category::readback_buffers, *mSlots[i].mBuffer);
+			std::lock_guard<std::mutex> guard(mMutex);
+			mFreeSlots.push_back(i);
+		}
+		return true;
+	}
+
+	// Must only be invoked while all slots are free:
+	void destroy_slots()
+	{
+		for (auto& slot : mSlots) {
+			memory_accounting().gpu(gpu_memory_category::readback_buffers).remove(memory_accountant::memory_size_of(*slot.mBuffer));
+			slot.mMapped = nullptr;
+			slot.mMapping.reset();
+		}
+		mSlots.clear();
+		std::lock_guard<std::mutex> guard(mMutex);
+		mFreeSlots.clear();
+		mExtent = vk::Extent2D{ 0u, 0u };
+	}
+
+	// The writer thread's loop:
+	void write_frames()
+	{
+		cpu_profiler().set_current_thread_name("frame capture writer");
+		FILE* pipe = nullptr;
+		uint32_t pipeSession = 0;
+		std::vector<uint8_t> rgba;
+		double bytesWritten = 0.0;
+		auto throughputStart = std::chrono::steady_clock::now();
+		while (true) {
+			std::optional<uint32_t> slotIndex;
+			bool stop = false;
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				mCondition.wait_for(lock, std::chrono::milliseconds(100), [this]() { return mStopRequested || !mCompletedSlots.empty(); });
+				if (!mCompletedSlots.empty()) {
+					slotIndex = mCompletedSlots.front();
+					mCompletedSlots.pop_front();
+				}
+				stop = mStopRequested && !slotIndex.has_value();
+			}
+
+			// Finish the encoder's stream once its capture session has ended (and all of its frames have been written):
+			if (nullptr != pipe && !slotIndex.has_value() && (stop || pipeSession != mActiveSession.load(std::memory_order_relaxed))) {
+				_pclose(pipe);
+				pipe = nullptr;
+			}
+			if (stop) {
+				return;
+			}
+			if (!slotIndex.has_value()) {
+				continue;
+			}
+
+			{
+				PROFILE_CPU_SCOPE("write captured frame");
+				const auto& slot = mSlots[*slotIndex];
+				const auto width = mExtent.width, height = mExtent.height;
+				const size_t size = static_cast<size_t>(width) * height * 4u;
+				const bool bgra = mBgra.load(std::memory_order_relaxed);
+				std::error_code error;
+				std::filesystem::create_directories(slot.mDirectory, error);
+				const auto basePath = (std::filesystem::path(slot.mDirectory) / fmt::format("frame_{:06}", slot.mIndexInSession)).string();
+				switch (slot.mFormat) {
+				case frame_capture_format::raw:
+					if (0 == slot.mIndexInSession) {
+						std::ofstream info(std::filesystem::path(slot.mDirectory) / "capture_info.txt");
+						info << "width " << width << "\nheight " << height << "\npixel_format " << (bgra ? "bgra" : "rgba") << "\n";
+					}
+					std::ofstream(basePath + ".raw", std::ios::binary).write(reinterpret_cast<const char*>(slot.mMapped), static_cast<std::streamsize>(size));
+					break;
+				case frame_capture_format::png:
+					// PNG needs RGBA, and the alpha channel of the offscreen image is not meaningful:
+					rgba.resize(size);
+					for (size_t i = 0; i < size; i += 4) {
+						rgba[i + 0] = slot.mMapped[i + (bgra ? 2 : 0)];
+						rgba[i + 1] = slot.mMapped[i + 1];
+						rgba[i + 2] = slot.mMapped[i + (bgra ? 0 : 2)];
+						rgba[i + 3] = 255u;
+					}
+					if (0 == stbi_write_png((basePath + ".png").c_str(), static_cast<int>(width), static_cast<int>(height), 4, rgba.data(), static_cast<int>(width * 4u))) {
+						LOG_WARNING(fmt::format("Unable to write '{}.png'.", basePath));
+					}
+					break;
+				case frame_capture_format::encoder_pipe:
+					if (nullptr != pipe && pipeSession != slot.mSession) {
+						_pclose(pipe);
+						pipe = nullptr;
+					}
+					if (nullptr == pipe) {
+						auto command = slot.mEncoderCommand;
+						replace_all(command, "{width}", std::to_string(width));
+						replace_all(command, "{height}", std::to_string(height));
+						replace_all(command, "{pixel_format}", bgra ? "bgra" : "rgba");
+						replace_all(command, "{directory}", slot.mDirectory);
+						pipe = _popen(command.c_str(), "wb");
+						pipeSession = slot.mSession;
+						if (nullptr == pipe) {
+							LOG_WARNING(fmt::format("Unable to start the encoder '{}'.", command));
+						}
+					}
+					if (nullptr != pipe) {
+						std::fwrite(slot.mMapped, 1, size, pipe);
+					}
+					break;
+				}
+				bytesWritten += static_cast<double>(size);
+			}
+
+			const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - throughputStart).count();
+			if (elapsed >= 1.0) {
+				mWriterMegabytesPerSecond.store(static_cast<float>(bytesWritten / elapsed / (1024.0 * 1024.0)), std::memory_order_relaxed);
+				bytesWritten = 0.0;
+				throughputStart = std::chrono::steady_clock::now();
+			}
+			mNumWritten.fetch_add(1u, std::memory_order_relaxed);
+			{
+				std::lock_guard<std::mutex> guard(mMutex);
+				mFreeSlots.push_back(*slotIndex);
+			}
+		}
+	}
+
+	static void replace_all(std::string& aText, const std::string& aPattern, const std::string& aReplacement)
+	{
+		for (auto pos = aText.find(aPattern); std::string::npos != pos; pos = aText.find(aPattern, pos + aReplacement.size())) {
+			aText.replace(pos, aPattern.size(), aReplacement);
+		}
+	}
+
+	// Enough slots for all frames in flight, plus a few which the writer thread can work on meanwhile:
+	static constexpr uint32_t cNumSlots = 8;
+
+	// Settings:
+	bool mCapturing = false;
+	frame_capture_format mFormat = frame_capture_format::png;
+	std::array<char, 260> mDirectory{ "capture" };
+	std::array<char, 512> mEncoderCommand{ "ffmpeg -y -loglevel error -f rawvideo -pix_fmt {pixel_format} -s {width}x{height} -r 60 -i - -c:v libx264 -pix_fmt yuv420p {directory}/capture.mp4" };
+
+	// The readback ring, which is only (re)created and destroyed by the render thread while no slot is in use:
+	std::vector<capture_slot> mSlots;
+	vk::Extent2D mExtent{ 0u, 0u };
+	vk::Format mFormatOfImage = vk::Format::eUndefined;
+	std::atomic<bool> mBgra = false;
+	uint32_t mReadbackLatency = 4;
+	uint64_t mFrame = 0;
+	uint32_t mSession = 0;
+	std::atomic<uint32_t> mActiveSession = 0;
+	uint64_t mNumCapturedInSession = 0;
+	std::deque<uint32_t> mCopiesInFlight; // Only accessed by the render thread
+
+	// Slots are passed between the render thread and the writer thread via these queues:
+	std::thread mWriterThread;
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	std::deque<uint32_t> mFreeSlots;
+	std::deque<uint32_t> mCompletedSlots;
+	bool mStopRequested = false;
+
+	// Statistics:
+	std::atomic<uint32_t> mNumWritten = 0;
+	uint32_t mNumDropped = 0;
+	std::atomic<float> mWriterMegabytesPerSecond = 0.0f;
+
+}; // End of frame_capture
@@ -0,0 +1,419 @@
+#pragma once
+
+#include <gvk.hpp>
+#include <imgui.h>
+#include <imgui_internal.h>
+
+#include "preprocessor_defines.hpp"
+#include "gpu_timestamp_profiler.hpp"
+#include "ray_statistics.hpp"
+#include "memory_accounting.hpp"
+#include "fluid_nightmare_main.hpp"
+
+// A fixed-capacity ring buffer which keeps the most recent N values. There is one single writer;
+// readers can use the write count (published with release semantics) to find the newest values.
+template <typename T, size_t N>
+class telemetry_ring_buffer
+{
+public:
+	void push(const T& aValue)
+	{
+		const auto n = mWriteCount.load(std::memory_order_relaxed);
+		mValues[n % N] = aValue;
+		mWriteCount.store(n + 1, std::memory_order_release);
+	}
+
+	// Must only be invoked by the writer:
+	void clear()
+	{
+		mWriteCount.store(0, std::memory_order_release);
+	}
+
+	[[nodiscard]] static constexpr size_t capacity() { return N; }
+	[[nodiscard]] size_t size() const { return static_cast<size_t>(std::min<uint64_t>(mWriteCount.load(std::memory_order_acquire), N)); }
+	[[nodiscard]] uint64_t write_count() const { return mWriteCount.load(std::memory_order_acquire); }
+
+	// Index of the oldest value within data(), s.t. data()[(offset() + i) % capacity()] is the i-th oldest value:
+	[[nodiscard]] size_t offset() const { return mWriteCount.load(std::memory_order_acquire) < N ? 0 : static_cast<size_t>(mWriteCount.load(std::memory_order_acquire) % N); }
+	[[nodiscard]] const T* data() const { return mValues.data(); }
+
+	// Returns the i-th newest value, i.e. newest(0) is the most recently pushed one:
+	[[nodiscard]] T newest(size_t aIndex = 0) const
+	{
+		const auto n = mWriteCount.load(std::memory_order_acquire);
+		assert(aIndex < std::min<uint64_t>(n, N));
+		return mValues[(n - 1 - aIndex) % N];
+	}
+
+private:
+	std::array<T, N> mValues{};
+	std::atomic<uint64_t> mWriteCount = 0;
+};
+
+// Streaming estimation of one quantile with constant memory, using the P-square
+// algorithm by Jain and Chlamtac (1985). No values have to be stored or sorted.
+class p2_quantile_estimator
+{
+public:
+	explicit p2_quantile_estimator(double aQuantile)
+		: mQuantile{ aQuantile }
+		, mDesiredIncrements{ 0.0, aQuantile / 2.0, aQuantile, (1.0 + aQuantile) / 2.0, 1.0 }
+		, mDesiredPositions{ 0.0, 2.0 * aQuantile, 4.0 * aQuantile, 2.0 + 2.0 * aQuantile, 4.0 }
+	{}
+
+	void add(double aValue)
+	{
+		if (mCount < 5) {
+			mHeights[mCount++] = aValue;
+			if (5 == mCount) {
+				std::sort(std::begin(mHeights), std::end(mHeights));
+			}
+			return;
+		}
+
+		// Find the cell k which contains the new value, and adapt the extreme markers if necessary:
+		int k;
+		if (aValue < mHeights[0]) {
+			mHeights[0] = aValue;
+			k = 0;
+		}
+		else if (aValue < mHeights[1]) { k = 0; }
+		else if (aValue < mHeights[2]) { k = 1; }
+		else if (aValue < mHeights[3]) { k = 2; }
+		else if (aValue <= mHeights[4]) { k = 3; }
+		else {
+			mHeights[4] = aValue;
+			k = 3;
+		}
+
+		for (int i = k + 1; i < 5; ++i) {
+			mPositions[i] += 1.0;
+		}
+		for (int i = 0; i < 5; ++i) {
+			mDesiredPositions[i] += mDesiredIncrements[i];
+		}
+
+		// Adjust the heights of the three middle markers if they are off from their desired positions:
+		for (int i = 1; i <= 3; ++i) {
+			const double d = mDesiredPositions[i] - mPositions[i];
+			if ((d >= 1.0 && mPositions[i + 1] - mPositions[i] > 1.0) || (d <= -1.0 && mPositions[i - 1] - mPositions[i] < -1.0)) {
+				const int s = d >= 0.0 ? 1 : -1;
+				const double candidate = parabolic(i, s);
+				mHeights[i] = (mHeights[i - 1] < candidate && candidate < mHeights[i + 1]) ? candidate : linear(i, s);
+				mPositions[i] += s;
+			}
+		}
+		++mCount;
+	}
+
+	// Returns the current estimate of the quantile:
+	[[nodiscard]] double value() const
+	{
+		if (mCount >= 5) {
+			return mHeights[2];
+		}
+		if (0 == mCount) {
+			return 0.0;
+		}
+		// Not enough values for the estimation, yet => compute it exactly:
+		std::array<double, 5> sorted = mHeights;
+		std::sort(sorted.begin(), sorted.begin() + mCount);
+		return sorted[std::min(static_cast<size_t>(mQuantile * mCount), mCount - 1)];
+	}
+
+	[[nodiscard]] size_t count() const { return mCount; }
+
+private:
+	[[nodiscard]] double parabolic(int i, int d) const
+	{
+		return mHeights[i] + d / (mPositions[i + 1] - mPositions[i - 1]) * (
+			(mPositions[i] - mPositions[i - 1] + d) * (mHeights[i + 1] - mHeights[i]) / (mPositions[i + 1] - mPositions[i]) +
+			(mPositions[i + 1] - mPositions[i] - d) * (mHeights[i] - mHeights[i - 1]) / (mPositions[i] - mPositions[i - 1])
+		);
+	}
+
+	[[nodiscard]] double linear(int i, int d) const
+	{
+		return mHeights[i] + d * (mHeights[i + d] - mHeights[i]) / (mPositions[i + d] - mPositions[i]);
+	}
+
+	double mQuantile;
+	size_t mCount = 0;
+	std::array<double, 5> mHeights{};
+	std::array<double, 5> mPositions{ 0.0, 1.0, 2.0, 3.0, 4.0 };
+	std::array<double, 5> mDesiredIncrements;
+	std::array<double, 5> mDesiredPositions;
+};
+
+// A histogram with equally sized bins in the range [min, max). Values outside are clamped into the first or last bin:
+class telemetry_histogram
+{
+public:
+	static constexpr size_t cNumBins = 64;
+
+	telemetry_histogram(float aMin, float aMax)
+		: mMin{ aMin }
+		, mMax{ aMax }
+	{}
+
+	void clear()
+	{
+		mBins.fill(0.0f);
+	}
+
+	void add(float aValue)
+	{
+		const auto t = (aValue - mMin) / (mMax - mMin);
+		const auto bin = static_cast<size_t>(std::clamp(t * static_cast<float>(cNumBins), 0.0f, static_cast<float>(cNumBins - 1)));
+		mBins[bin] += 1.0f;
+	}
+
+	[[nodiscard]] const std::array<float, cNumBins>& bins() const { return mBins; }
+	[[nodiscard]] float min() const { return mMin; }
+	[[nodiscard]] float max() const { return mMax; }
+	[[nodiscard]] float bin_width() const { return (mMax - mMin) / static_cast<float>(cNumBins); }
+
+private:
+	float mMin;
+	float mMax;
+	std::array<float, cNumBins> mBins{};
+};
+
+// All the metrics which are tracked by the telemetry:
+enum struct telemetry_metric_id : uint32_t
+{
+	cpu_frame = 0,
+	gpu_frame,
+	spawn,
+	as_build,
+	scene_trace,
+	count
+};
+
+// Human-readable names of the telemetry_metric_id entries, in the same order:
+static const char* const telemetry_metric_names[] = {
+	"CPU Frame",
+	"GPU Frame",
+	"Spawn",
+	"AS Build",
+	"Scene Trace"
+};
+static_assert(std::size(telemetry_metric_names) == static_cast<size_t>(telemetry_metric_id::count));
+
+// One metric (all values in milliseconds), with its recent history, streaming percentiles, and a histogram:
+class telemetry_metric
+{
+public:
+	static constexpr size_t cHistoryLength = 1000;
+
+	telemetry_metric(float aHistogramMin, float aHistogramMax)
+		: mHistogram{ aHistogramMin, aHistogramMax }
+	{}
+
+	void add(float aValueMs)
+	{
+		mHistory.push(aValueMs);
+		mP50.add(aValueMs);
+		mP95.add(aValueMs);
+		mP99.add(aValueMs);
+		mHistogram.add(aValueMs);
+		mMax = std::max(mMax, aValueMs);
+		mSum += aValueMs;
+		++mCount;
+	}
+
+	// Discards all the values gathered so far:
+	void reset()
+	{
+		mHistory.clear();
+		mP50 = p2_quantile_estimator{ 0.50 };
+		mP95 = p2_quantile_estimator{ 0.95 };
+		mP99 = p2_quantile_estimator{ 0.99 };
+		mHistogram.clear();
+		mMax = 0.0f;
+		mSum = 0.0;
+		mCount = 0;
+	}
+
+	[[nodiscard]] const auto& history() const { return mHistory; }
+	[[nodiscard]] const telemetry_histogram& histogram() const { return mHistogram; }
+	[[nodiscard]] uint64_t count() const { return mCount; }
+	[[nodiscard]] float mean() const { return mCount > 0 ? static_cast<float>(mSum / static_cast<double>(mCount)) : 0.0f; }
+	[[nodiscard]] float p50() const { return static_cast<float>(mP50.value()); }
+	[[nodiscard]] float p95() const { return static_cast<float>(mP95.value()); }
+	[[nodiscard]] float p99() const { return static_cast<float>(mP99.value()); }
+	[[nodiscard]] float max() const { return mMax; }
+
+private:
+	telemetry_ring_buffer<float, cHistoryLength> mHistory;
+	p2_quantile_estimator mP50{ 0.50 };
+	p2_quantile_estimator mP95{ 0.95 };
+	p2_quantile_estimator mP99{ 0.99 };
+	telemetry_histogram mHistogram;
+	float mMax = 0.0f;
+	double mSum = 0.0;
+	uint64_t mCount = 0;
+};
+
+// An invokee which gathers the per-frame telemetry, displays it in the UI and dumps a summary when the application exits.
+// CPU frame times are measured between consecutive update() calls, all other times come from the gpu_timestamp_profiler.
+class frame_telemetry : public gvk::invokee
+{
+public: // v== gvk::invokee overrides which will be invoked by the framework ==v
+	frame_telemetry()
+		: invokee{ std::numeric_limits<int>::max() - 1 } // Execute after all the others (but before the gpu_timestamp_profiler)
+	{}
+
+	void initialize() override
+	{
+		// All the histories are stored in place:
+		memory_accounting().host(host_memory_subsystem::telemetry).set(sizeof(*this));
+
+		auto imguiManager = gvk::current_composition()->element_by_type<gvk::imgui_manager>();
+		if (nullptr != imguiManager) {
+			imguiManager->add_callback([this]() {
+				ImGui::Begin("Telemetry");
+				ImGui::SetWindowPos(ImVec2(830.0f, 306.0f), ImGuiCond_FirstUseEver);
+				ImGui::SetWindowSize(ImVec2(420.0f, 330.0f), ImGuiCond_FirstUseEver);
+
+				ImGui::Text("%-10s %8s %8s %8s %8s %8s", "[ms]", "mean", "p50", "p95", "p99", "max");
+				for (size_t i = 0; i < mMetrics.size(); ++i) {
+					const auto& m = mMetrics[i];
+					ImGui::Text("%-10s %8.3f %8.3f %8.3f %8.3f %8.3f", telemetry_metric_names[i], m.mean(), m.p50(), m.p95(), m.p99(), m.max());
+				}
+
+				ImGui::Combo("Histogram", &mSelectedHistogram, telemetry_metric_names, static_cast<int>(std::size(telemetry_metric_names)));
+				const auto& selected = mMetrics[static_cast<size_t>(mSelectedHistogram)].histogram();
+				ImGui::PlotHistogram("##histogram", selected.bins().data(), static_cast<int>(selected.bins().size()), 0,
+					fmt::format("{:.1f}..{:.1f} ms", selected.min(), selected.max()).c_str(), 0.0f, FLT_MAX, ImVec2(0.0f, 80.0f));
+
+				// Idle frames which have not been traced save the GPU time of the scene trace (an estimate of the saved power):
+				auto* mainInvokee = gvk::current_composition()->element_by_type<fluid_nightmare_main>();
+				if (nullptr != mainInvokee) {
+					const auto& idle = mainInvokee->idle_frame_stats();
+					ImGui::Text("Frames traced: %llu, refined: %llu, skipped: %llu, dirty tiles: %llu", idle.mTracedFrames, idle.mRefinementFrames, idle.mSkippedFrames, idle.mDirtyTileFrames);
+					ImGui::Text("Est. GPU time saved: %.1f ms", estimated_saved_gpu_time(idle));
+				}
+
+				if (ImGui::Button("Dump Summary")) {
+					dump_summary("telemetry_summary.json");
+				}
+
+				ImGui::End();
+			});
+		}
+	}
+
+	void update() override
+	{
+		// Measure CPU frame times between consecutive updates:
+		const auto now = std::chrono::steady_clock::now();
+		if (mLastUpdate.has_value()) {
+			metric(telemetry_metric_id::cpu_frame).add(std::chrono::duration<float, std::milli>(now - *mLastUpdate).count());
+		}
+		mLastUpdate = now;
+
+		// Gather the latest GPU timings which have been read back (with some latency):
+		auto* gpuProfiler = gvk::current_composition()->element_by_type<gpu_timestamp_profiler>();
+		if (nullptr != gpuProfiler) {
+			const auto& timings = gpuProfiler->latest_timings();
+			float gpuFrame = 0.0f;
+			for (auto t : timings) {
+				gpuFrame += t;
+			}
+			if (gpuFrame > 0.0f) {
+				metric(telemetry_metric_id::gpu_frame).add(gpuFrame);
+			}
+			// Spawning and AS builds do not happen every frame => only record them when they did:
+			if (timings[static_cast<size_t>(gpu_pass::spawn_trace)] > 0.0f) {
+				metric(telemetry_metric_id::spawn).add(timings[static_cast<size_t>(gpu_pass::spawn_trace)]);
+			}
+			if (timings[static_cast<size_t>(gpu_pass::tlas_build)] > 0.0f) {
+				metric(telemetry_metric_id::as_build).add(timings[static_cast<size_t>(gpu_pass::tlas_build)]);
+			}
+			// ...and the same goes for the scene trace, which is skipped in idle frames:
+			if (timings[static_cast<size_t>(gpu_pass::scene_trace_rays)] > 0.0f) {
+				metric(telemetry_metric_id::scene_trace).add(timings[static_cast<size_t>(gpu_pass::scene_trace_rays)]);
+			}
+		}
+	}
+
+	void finalize() override
+	{
+		dump_summary("telemetry_summary.json");
+	}
+
+	// Discards all the values of all metrics gathered so far (e.g., after a warm-up phase):
+	void reset()
+	{
+		for (auto& m : mMetrics) {
+			m.reset();
+		}
+	}
+
+	[[nodiscard]] telemetry_metric& metric(telemetry_metric_id aId) { return mMetrics[static_cast<size_t>(aId)]; }
+	[[nodiscard]] const telemetry_metric& metric(telemetry_metric_id aId) const { return mMetrics[static_cast<size_t>(aId)]; }
+
+	// GPU time which the skipped idle frames would have spent on tracing, based on the mean scene trace time:
+	[[nodiscard]] float estimated_saved_gpu_time(const fluid_nightmare_main::idle_frame_statistics& aIdleFrames) const
+	{
+		return static_cast<float>(aIdleFrames.mSkippedFrames) * metric(telemetry_metric_id::scene_trace).mean();
+	}
+
+	// Writes count, mean, percentiles, max, and the histogram of every metric into a JSON file:
+	void dump_summary(const std::string& aFilePath) const
+	{
+		std::ofstream file(aFilePath);
+		if (!file.is_open()) {
+			LOG_WARNING(fmt::format("Unable to open '{}' for writing the telemetry summary.", aFilePath));
+			return;
+		}
+		file << "{\n";
+		for (size_t i = 0; i < mMetrics.size(); ++i) {
+			const auto& m = mMetrics[i];
+			file << fmt::format(R"(  "{}": {{ "count": {}, "mean_ms": {:.4f}, "p50_ms": {:.4f}, "p95_ms": {:.4f}, "p99_ms": {:.4f}, "max_ms": {:.4f}, )",
+				telemetry_metric_names[i], m.count(), m.mean(), m.p50(), m.p95(), m.p99(), m.max());
+			file << fmt::format(R"("histogram": {{ "min_ms": {}, "max_ms": {}, "bins": [)", m.histogram().min(), m.histogram().max());
+			for (size_t b = 0; b < m.histogram().bins().size(); ++b) {
+				file << (b > 0 ? "," : "") << static_cast<uint64_t>(m.histogram().bins()[b]);
+			}
+			file << "] } }" << (i + 1 < mMetrics.size() ? ",\n" : "");
+		}
+
+		// Add the rays per second of the most recent interval, if there are ray statistics:
+		auto* rayStatistics = gvk::current_composition()->element_by_type<ray_statistics>();
+		if (nullptr != rayStatistics) {
+			file << fmt::format(",\n  \"Ray Statistics\": {{ \"interval_s\": {:.4f}", rayStatistics->interval_seconds());
+			for (size_t c = 0; c < static_cast<size_t>(ray_counter::count); ++c) {
+				file << fmt::format(R"(, "{}": {{ "count": {}, "per_second": {:.1f} }})", ray_counter_names[c], rayStatistics->latest()[c], rayStatistics->per_second(static_cast<ray_counter>(c)));
+			}
+			file << fmt::format(R"(, "Total Rays": {{ "per_second": {:.1f} }} }})", rayStatistics->total_rays_per_second());
+		}
+
+		// Add how many frames have been skipped or spent on progressive refinement because nothing has changed:
+		auto* mainInvokee = gvk::current_composition()->element_by_type<fluid_nightmare_main>();
+		if (nullptr != mainInvokee) {
+			const auto& idle = mainInvokee->idle_frame_stats();
+			file << fmt::format(R"(,
+  "Idle Frames": {{ "traced": {}, "refined": {}, "skipped": {}, "dirty_tiles": {}, "estimated_saved_gpu_ms": {:.1f} }})",
+				idle.mTracedFrames, idle.mRefinementFrames, idle.mSkippedFrames, idle.mDirtyTileFrames, estimated_saved_gpu_time(idle));
+		}
+		file << "\n}\n";
+		LOG_INFO(fmt::format("Wrote telemetry summary to '{}'.", aFilePath));
+	}
+
+private:
+	// One entry per telemetry_metric_id, each with a histogram range suitable for its typical values:
+	std::array<telemetry_metric, static_cast<size_t>(telemetry_metric_id::count)> mMetrics{
+		telemetry_metric{ 0.0f, 50.0f }, // cpu_frame
+		telemetry_metric{ 0.0f, 50.0f }, // gpu_frame
+		telemetry_metric{ 0.0f,  2.0f }, // spawn
+		telemetry_metric{ 0.0f, 10.0f }, // as_build
+		telemetry_metric{ 0.0f, 50.0f }  // scene_trace
+	};
+
+	std::optional<std::chrono::steady_clock::time_point> mLastUpdate;
+
+	int mSelectedHistogram = 0;
+
+}; // End of frame_telemetry
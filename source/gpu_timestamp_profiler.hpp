@@ -0,0 +1,269 @@
+#pragma once
+
+#include <gvk.hpp>
+#include <imgui.h>
+#include <imgui_internal.h>
+
+#include "preprocessor_defines.hpp"
+
+// All the GPU passes which are measured via timestamp queries:
+enum struct gpu_pass : uint32_t
+{
+	spawn_trace = 0,
+	tlas_build,
+	occlusion_bake,
+	scene_trace_rays,
+	secondary_rays,
+	image_copy,
+	frame_capture,
+	imgui,
+	count
+};
+
+// Human-readable names of the gpu_pass entries, in the same order:
+static const char* const gpu_pass_names[] = {
+	"Spawn Trace",
+	"TLAS Build",
+	"Occlusion Bake",
+	"Scene trace_rays",
+	"Secondary Rays",
+	"Image Copy",
+	"Frame Capture",
+	"ImGui"
+};
+static_assert(std::size(gpu_pass_names) == static_cast<size_t>(gpu_pass::count));
+
+// An invokee which measures the GPU times of all the passes listed in gpu_pass.
+// It uses one timestamp query pool per frame in flight (plus one), and reads back
+// the results only after the GPU has completed the frame, i.e. without stalling.
+class gpu_timestamp_profiler : public gvk::invokee
+{
+public: // v== gvk::invokee overrides which will be invoked by the framework ==v
+	gpu_timestamp_profiler(avk::queue& aQueue)
+		: invokee{ std::numeric_limits<int>::max() } // This invokee must execute AFTER all the others, in particular after the imgui_manager
+		, mQueue{ &aQueue }
+	{}
+
+	void initialize() override
+	{
+		// Convert timestamp ticks into milliseconds:
+		mMillisecondsPerTick = static_cast<double>(gvk::context().physical_device().getProperties().limits.timestampPeriod) * 1e-6;
+
+		// Results of a frame can be read back safely after all the frames in flight have been rendered:
+		mReadbackLatency = static_cast<uint32_t>(gvk::context().main_window()->number_of_frames_in_flight()) + 1u;
+		for (uint32_t i = 0; i < mReadbackLatency; ++i) {
+			mQueryPools.push_back(gvk::context().device().createQueryPoolUnique(
+				vk::QueryPoolCreateInfo{}
+					.setQueryType(vk::QueryType::eTimestamp)
+					.setQueryCount(cNumQueries)
+			));
+			// Requires VkPhysicalDeviceVulkan12Features::hostQueryReset:
+			gvk::context().device().resetQueryPool(mQueryPools.back().get(), 0u, cNumQueries);
+		}
+
+		mHistory.resize(cHistoryLength, pass_timings{});
+
+		auto imguiManager = gvk::current_composition()->element_by_type<gvk::imgui_manager>();
+		if (nullptr != imguiManager) {
+			imguiManager->add_callback([this]() {
+				ImGui::Begin("GPU Profiler");
+				ImGui::SetWindowPos(ImVec2(830.0f, 2.0f), ImGuiCond_FirstUseEver);
+				ImGui::SetWindowSize(ImVec2(420.0f, 300.0f), ImGuiCond_FirstUseEver);
+
+				ImGui::Text("Results are read back with a latency of %u frames.", mReadbackLatency);
+
+				// Show the rolling averages of every pass, colored the same as in the timeline:
+				const auto averages = rolling_averages();
+				float total = 0.0f;
+				for (size_t p = 0; p < static_cast<size_t>(gpu_pass::count); ++p) {
+					ImGui::TextColored(ImGui::ColorConvertU32ToFloat4(pass_color(p)), "%-18s %7.3f ms", gpu_pass_names[p], averages[p]);
+					total += averages[p];
+				}
+				ImGui::Text("%-18s %7.3f ms", "Total", total);
+
+				// Draw a stacked timeline of the per-pass timings, one column per frame:
+				ImGui::DragFloat("Timeline Max. (ms)", &mTimelineMaxMs, 0.1f, 0.1f, 100.0f);
+				const ImVec2 size{ ImGui::GetContentRegionAvail().x, 100.0f };
+				const ImVec2 topLeft = ImGui::GetCursorScreenPos();
+				auto* drawList = ImGui::GetWindowDrawList();
+				drawList->AddRectFilled(topLeft, ImVec2(topLeft.x + size.x, topLeft.y + size.y), IM_COL32(20, 20, 20, 255));
+				const float columnWidth = size.x / static_cast<float>(cHistoryLength);
+				for (size_t i = 0; i < cHistoryLength; ++i) {
+					const auto& timings = mHistory[(mHistoryHead + i) % cHistoryLength];
+					const float x = topLeft.x + static_cast<float>(i) * columnWidth;
+					float y = topLeft.y + size.y;
+					for (size_t p = 0; p < static_cast<size_t>(gpu_pass::count); ++p) {
+						const float h = std::min(timings[p] / mTimelineMaxMs, 1.0f) * size.y;
+						drawList->AddRectFilled(ImVec2(x, y - h), ImVec2(x + std::max(columnWidth, 1.0f), y), pass_color(p));
+						y -= h;
+					}
+				}
+				ImGui::Dummy(size);
+
+				if (ImGui::Button("Export CSV")) {
+					export_csv("gpu_timings.csv");
+				}
+
+				ImGui::End();
+			});
+		}
+	}
+
+	void render() override
+	{
+		// The ImGui pass has been recorded by the imgui_manager by now => write its end timestamp:
+		auto& commandPool = gvk::context().get_command_pool_for_single_use_command_buffers(*mQueue);
+		auto cmdbfr = commandPool->alloc_command_buffer(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+		cmdbfr->begin_recording();
+		end_pass(*cmdbfr, gpu_pass::imgui);
+		cmdbfr->end_recording();
+		mQueue->submit(avk::referenced(cmdbfr));
+		gvk::context().main_window()->handle_lifetime(avk::owned(cmdbfr));
+
+		// Advance to the next frame's query pool. The GPU has completed the frame which used it last,
+		// because the framework has already waited for it before rendering the current frame:
+		++mFrameIndex;
+		read_back_results(current_query_pool());
+		gvk::context().device().resetQueryPool(current_query_pool(), 0u, cNumQueries);
+	}
+
+	// Write the begin timestamp of the given pass into the given command buffer:
+	void begin_pass(avk::command_buffer_t& aCommandBuffer, gpu_pass aPass)
+	{
+		aCommandBuffer.handle().writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, current_query_pool(), 2u * static_cast<uint32_t>(aPass));
+	}
+
+	// Write the end timestamp of the given pass into the given command buffer:
+	void end_pass(avk::command_buffer_t& aCommandBuffer, gpu_pass aPass)
+	{
+		aCommandBuffer.handle().writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, current_query_pool(), 2u * static_cast<uint32_t>(aPass) + 1u);
+	}
+
+	// Per-pass timings in milliseconds:
+	using pass_timings = std::array<float, static_cast<size_t>(gpu_pass::count)>;
+
+	// Number of frames by which the read back timings lag behind the frame which is being rendered:
+	[[nodiscard]] uint32_t readback_latency() const { return mReadbackLatency; }
+
+	// Returns the most recent timings which have been read back:
+	[[nodiscard]] const pass_timings& latest_timings() const
+	{
+		return mHistory[(mHistoryHead + cHistoryLength - 1) % cHistoryLength];
+	}
+
+	// Returns the average of each pass over the whole history:
+	[[nodiscard]] pass_timings rolling_averages() const
+	{
+		pass_timings sums{};
+		for (const auto& timings : mHistory) {
+			for (size_t p = 0; p < sums.size(); ++p) {
+				sums[p] += timings[p];
+			}
+		}
+		for (auto& s : sums) {
+			s /= static_cast<float>(cHistoryLength);
+		}
+		return sums;
+	}
+
+	// Writes the whole history into a CSV file, one line per frame, one column per pass:
+	void export_csv(const std::string& aFilePath) const
+	{
+		std::ofstream file(aFilePath);
+		if (!file.is_open()) {
+			LOG_WARNING(fmt::format("Unable to open '{}' for writing GPU timings.", aFilePath));
+			return;
+		}
+		file << "frame";
+		for (const auto* name : gpu_pass_names) {
+			file << "," << name;
+		}
+		file << "\n";
+		const auto firstFrame = mFrameIndex > cHistoryLength + mReadbackLatency ? mFrameIndex - cHistoryLength - mReadbackLatency : 0;
+		for (size_t i = 0; i < cHistoryLength; ++i) {
+			const auto& timings = mHistory[(mHistoryHead + i) % cHistoryLength];
+			file << (firstFrame + i);
+			for (auto t : timings) {
+				file << "," << t;
+			}
+			file << "\n";
+		}
+		LOG_INFO(fmt::format("Exported GPU timings of {} frames to '{}'.", cHistoryLength, aFilePath));
+	}
+
+private:
+	[[nodiscard]] vk::QueryPool current_query_pool() const
+	{
+		return mQueryPools[mFrameIndex % mQueryPools.size()].get();
+	}
+
+	// Colors of the passes in the UI:
+	[[nodiscard]] static ImU32 pass_color(size_t aPassIndex)
+	{
+		static const ImU32 colors[] = {
+			IM_COL32(230, 120,  40, 255),
+			IM_COL32(220, 200,  50, 255),
+			IM_COL32( 60, 160, 230, 255),
+			IM_COL32(120, 200, 100, 255),
+			IM_COL32(200, 200, 200, 255),
+			IM_COL32(190, 110, 210, 255)
+		};
+		return colors[aPassIndex % std::size(colors)];
+	}
+
+	// Reads back the timestamps of a query pool without waiting. Passes which have not been
+	// executed in that frame (i.e. their timestamps are unavailable) are counted as 0 ms.
+	void read_back_results(vk::QueryPool aQueryPool)
+	{
+		// Each query consists of the timestamp value, followed by its availability:
+		std::array<uint64_t, 2 * cNumQueries> results{};
+		auto result = gvk::context().device().getQueryPoolResults(
+			aQueryPool, 0u, cNumQueries,
+			sizeof(results), results.data(), 2 * sizeof(uint64_t),
+			vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability
+		);
+		if (vk::Result::eSuccess != result && vk::Result::eNotReady != result) {
+			return;
+		}
+
+		pass_timings timings{};
+		for (size_t p = 0; p < timings.size(); ++p) {
+			const auto beginAvailable = 0 != results[4 * p + 1];
+			const auto endAvailable   = 0 != results[4 * p + 3];
+			if (beginAvailable && endAvailable && results[4 * p + 2] >= results[4 * p]) {
+				timings[p] = static_cast<float>(static_cast<double>(results[4 * p + 2] - results[4 * p]) * mMillisecondsPerTick);
+			}
+		}
+		mHistory[mHistoryHead] = timings;
+		mHistoryHead = (mHistoryHead + 1) % cHistoryLength;
+	}
+
+	// Two timestamps (begin and end) per pass:
+	static constexpr uint32_t cNumQueries = 2u * static_cast<uint32_t>(gpu_pass::count);
+
+	// How many frames are kept in the history:
+	static constexpr size_t cHistoryLength = 240;
+
+	// The queue where the ImGui pass' end timestamp is submitted to:
+	avk::queue* mQueue;
+
+	// One query pool per frame in flight, plus one:
+	std::vector<vk::UniqueQueryPool> mQueryPools;
+
+	// After how many frames the results of a frame are being read back:
+	uint32_t mReadbackLatency = 0;
+
+	// Counts the frames, used to select the current query pool:
+	uint64_t mFrameIndex = 0;
+
+	// Conversion factor from timestamp ticks to milliseconds:
+	double mMillisecondsPerTick = 1e-6;
+
+	// Ring buffer of per-frame timings, mHistoryHead points to the oldest entry:
+	std::vector<pass_timings> mHistory;
+	size_t mHistoryHead = 0;
+
+	// The value which corresponds to the timeline's full height:
+	float mTimelineMaxMs = 16.0f;
+
+}; // End of gpu_timestamp_profiler
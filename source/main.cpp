@@ -1,375 +1,1260 @@
-#include <gvk.hpp>
-#include <imgui.h>
-#include <imgui_internal.h>
-
-#include "preprocessor_defines.hpp"
-#include "cpu_to_gpu_data_types.hpp"
-#include "fluid_nightmare_main.hpp"
-#include "triangle_mesh_geometry_manager.hpp"
-#include "procedural_geometry_manager.hpp"
-
-fluid_nightmare_main::fluid_nightmare_main(avk::queue& aQueue)
-	: mQueue{ &aQueue }
-{}
-
-void fluid_nightmare_main::initialize()
-{
-	// Create a descriptor cache that helps us to conveniently create descriptor sets,
-	// which describe where shaders can find resources like buffers or images:
-	mDescriptorCache = gvk::context().create_descriptor_cache();
-
-	// Set the direction towards the light:
-	mLightDir = { 0.8f, 1.0f, 0.0f };
-
-	// Get a pointer to the main window:		
-	auto* mainWnd = gvk::context().main_window();
-
-	// Create an offscreen image to ray-trace into. It is accessed via an image view:
-	const auto wdth = gvk::context().main_window()->resolution().x;
-	const auto hght = gvk::context().main_window()->resolution().y;
-	const auto frmt = gvk::format_from_window_color_buffer(mainWnd);
-	auto offscreenImage = gvk::context().create_image(wdth, hght, frmt, 1, avk::memory_usage::device, avk::image_usage::general_storage_image);
-	offscreenImage->transition_to_layout();
-	mOffscreenImageView = gvk::context().create_image_view(avk::owned(offscreenImage));
-
-	// Both, triangle_mesh_geometry_manager and procedural_geometry_manager, have lower execution orders.
-	// Therefore, we can assume that they already contain the data that we require:
-	auto* triMeshGeomMgr = gvk::current_composition()->element_by_type<triangle_mesh_geometry_manager>();
-	assert(nullptr != triMeshGeomMgr);
-	auto* procMeshGeomMgr = gvk::current_composition()->element_by_type<procedural_geometry_manager>();
-	assert(nullptr != procMeshGeomMgr);
-
-	// Initialize the TLAS (but don't build it yet)
-	mTlas = gvk::context().create_top_level_acceleration_structure(
-		triMeshGeomMgr->max_number_of_geometry_instances() + procMeshGeomMgr->max_number_of_geometry_instances(), // <-- Specify how many geometry instances there are expected to be at most
-		true               // <-- Allow updates since we want to have the opportunity to enable/disable some of them via the UI (triangle meshes), or add new ones (procedural geometry).
-	);
-
-	// Create our ray tracing pipeline with the required configuration:
-	mPipeline = gvk::context().create_ray_tracing_pipeline_for(
-		// Specify all the shaders which participate in rendering in a shader binding table (the order matters):
-		// In contrast to the ray_query_in_ray_tracing_shaders example, we have multiple closest hit and also
-		// multiple miss shaders. When we send out the secondary rays (in first_hit_closest_hit_shader.rchit),
-		// we will need to specify the offsets into this table accordingly in order to use the right shaders.
-		avk::define_shader_table(
-			avk::ray_generation_shader("shaders/scene_rendering/ray_gen_shader.rgen"),
-			avk::triangles_hit_group::create_with_rchit_only("shaders/scene_rendering/first_hit_closest_hit_shader.rchit"),
-			avk::procedural_hit_group::create_with_rint_and_rchit("shaders/rt_aabb.rint", "shaders/scene_rendering/rt_aabb.rchit"),
-			avk::triangles_hit_group::create_with_rchit_only("shaders/scene_rendering/shadow_closest_hit_shader.rchit"),
-			avk::triangles_hit_group::create_with_rchit_only("shaders/scene_rendering/ao_closest_hit_shader.rchit"),
-			avk::miss_shader("shaders/scene_rendering/first_hit_miss_shader.rmiss"),
-			avk::miss_shader("shaders/empty_miss_shader.rmiss")
-		),
-		// We won't need the maximum recursion depth, but why not:
-		gvk::context().get_max_ray_tracing_recursion_depth(),
-		// Define push constants and descriptor bindings:
-		avk::push_constant_binding_data{ avk::shader_type::ray_generation | avk::shader_type::closest_hit, 0, sizeof(push_const_data_scene_rendering) },
-		avk::descriptor_binding(0, 0, triMeshGeomMgr->image_samplers()),
-		avk::descriptor_binding(0, 1, triMeshGeomMgr->material_buffer()),
-		avk::descriptor_binding(0, 2, avk::as_uniform_texel_buffer_views(triMeshGeomMgr->index_buffer_views())),
-		avk::descriptor_binding(0, 3, avk::as_uniform_texel_buffer_views(triMeshGeomMgr->tex_coords_buffer_views())),
-		avk::descriptor_binding(0, 4, avk::as_uniform_texel_buffer_views(triMeshGeomMgr->normals_buffer_views())),
-		avk::descriptor_binding(1, 0, mOffscreenImageView->as_storage_image()), // Bind the offscreen image to render into as storage image
-		avk::descriptor_binding(2, 0, mTlas)                                    // Bind the TLAS, s.t. we can trace rays against it
-	);
-
-	// Print the structure of our shader binding table, also displaying the offsets:
-	mPipeline->print_shader_binding_table_groups();
-
-#if ENABLE_SHADER_HOT_RELOADING_FOR_RAY_TRACING_PIPELINE || ENABLE_RESIZABLE_WINDOW
-	// Create an updater:
-	mUpdater.emplace();
-	mPipeline.enable_shared_ownership(); // The updater needs to hold a reference to it, so we need to enable shared ownership.
-
-#if ENABLE_SHADER_HOT_RELOADING_FOR_RAY_TRACING_PIPELINE
-	mUpdater->on(gvk::shader_files_changed_event(mPipeline))
-	            .update(mPipeline);
-#endif
-	
-#if ENABLE_RESIZABLE_WINDOW
-	mOffscreenImageView.enable_shared_ownership(); // The updater needs to hold a reference to it, so we need to enable shared ownership.
-	mUpdater->on(gvk::swapchain_resized_event(gvk::context().main_window()))
-		        .update(mOffscreenImageView, mPipeline)
-		     .then_on(gvk::destroying_image_view_event()) // Make sure that our descriptor cache stays cleaned up:
-		        .invoke([this](const avk::image_view& aImageViewToBeDestroyed) {
-					auto numRemoved = mDescriptorCache.remove_sets_with_handle(aImageViewToBeDestroyed->handle());
-			    });
-#endif
-#endif
-	
-	// Add the camera to the composition (and let it handle the updates)
-	mQuakeCam.set_translation({ 0.0f, 10.0f, 45.0f });
-	mQuakeCam.set_perspective_projection(glm::radians(60.0f), gvk::context().main_window()->aspect_ratio(), 0.5f, 100.0f);
-	gvk::current_composition()->add_element(mQuakeCam);
-
-	// Add an "ImGui Manager" which handles the UI:
-	auto imguiManager = gvk::current_composition()->element_by_type<gvk::imgui_manager>();
-	if (nullptr != imguiManager) {
-		imguiManager->add_callback([this]() {
-			ImGui::Begin("Info & Settings");
-			ImGui::SetWindowPos(ImVec2(3.0f, 3.0f), ImGuiCond_FirstUseEver);
-			ImGui::SetWindowSize(ImVec2(410.0f, 468.0f), ImGuiCond_FirstUseEver);
-
-			ImGui::Text("%.3f ms/frame", 1000.0f / ImGui::GetIO().Framerate);
-			ImGui::Text("%.1f FPS", ImGui::GetIO().Framerate);
-
-			static std::vector<float> values;
-			values.push_back(1000.0f / ImGui::GetIO().Framerate);
-			if (values.size() > 1000) {
-				values.erase(values.begin());
-			}
-			ImGui::PlotLines("ms/frame", values.data(), values.size(), 0, nullptr, 0.0f, FLT_MAX, ImVec2(0.0f, 100.0f));
-
-			ImGui::TextColored(ImVec4(0.f, .6f, .8f, 1.f), "[F1]: Toggle input-mode");
-			ImGui::TextColored(ImVec4(0.f, .6f, .8f, 1.f), " (UI vs. scene navigation)");
-
-			// Let the user change the ambient color:
-			ImGui::DragFloat3("Ambient Light", glm::value_ptr(mAmbientLight), 0.001f, 0.0f, 1.0f);
-
-			// Let the user change the light's direction, which also influences shadows:
-			ImGui::DragFloat3("Light Direction", glm::value_ptr(mLightDir), 0.005f, -1.0f, 1.0f);
-			mLightDir = glm::normalize(mLightDir);
-
-			// Let the user change the field of view, and evaluate in the ray generation shader:
-			ImGui::DragFloat("Field of View", &mFieldOfViewForRayTracing, 1, 10.0f, 160.0f);
-
-			ImGui::Separator();
-			// Let the user change shadow parameters:
-			ImGui::Checkbox("Enable Shadows", &mEnableShadows);
-			if (mEnableShadows) {
-				ImGui::SliderFloat("Shadows Intensity", &mShadowsFactor, 0.0f, 1.0f);
-				ImGui::ColorEdit3("Shadows Color", glm::value_ptr(mShadowsColor));
-			}
-
-			ImGui::Separator();
-			// Let the user change ambient occlusion parameters:
-			ImGui::Checkbox("Enable Ambient Occlusion", &mEnableAmbientOcclusion);
-			if (mEnableAmbientOcclusion) {
-				ImGui::DragFloat("AO Rays Min. Length", &mAmbientOcclusionMinDist, 0.001f, 0.000001f, 1.0f);
-				ImGui::DragFloat("AO Rays Max. Length", &mAmbientOcclusionMaxDist, 0.01f,  0.001f,    1000.0f);
-				ImGui::SliderFloat("AO Intensity", &mAmbientOcclusionFactor, 0.0f, 1.0f);
-				ImGui::ColorEdit3("AO Color", glm::value_ptr(mAmbientOcclusionColor));
-			}
-
-			ImGui::End();
-		});
-	}
-}
-
-void fluid_nightmare_main::update()
-{
-	auto* triMeshGeomMgr = gvk::current_composition()->element_by_type<triangle_mesh_geometry_manager>();
-	assert(nullptr != triMeshGeomMgr);
-	auto* procMeshGeomMgr = gvk::current_composition()->element_by_type<procedural_geometry_manager>();
-	assert(nullptr != procMeshGeomMgr);
-	if (triMeshGeomMgr->has_updated_geometry_for_tlas() || procMeshGeomMgr->has_updated_geometry_for_tlas())
-	{
-		// Getometry selection has changed => rebuild the TLAS:
-
-		std::vector<avk::geometry_instance> activeGeometryInstances = triMeshGeomMgr->get_active_geometry_instances_for_tlas_build();
-		// And add all the water particles to it:
-		activeGeometryInstances.insert(std::end(activeGeometryInstances), std::begin(procMeshGeomMgr->get_geometry_instances_buffer()), std::end(procMeshGeomMgr->get_geometry_instances_buffer()));
-		
-		if (!activeGeometryInstances.empty()) {
-			auto& commandPool = gvk::context().get_command_pool_for_single_use_command_buffers(*mQueue);
-			auto cmdbfr = commandPool->alloc_command_buffer(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-			cmdbfr->begin_recording();
-
-			// We're using only one TLAS for all frames in flight. Therefore, we need to set up a barrier
-			// affecting the whole queue which waits until all previous ray tracing work has completed:
-			cmdbfr->establish_execution_barrier(
-				avk::pipeline_stage::ray_tracing_shaders, /* -> */ avk::pipeline_stage::acceleration_structure_build
-			);
-
-			// ...then we can safely update the TLAS with new data:
-			mTlas->build(                // We're not updating existing geometry, but we are changing the geometry => therefore, we need to perform a full rebuild (not just an update-build).
-				activeGeometryInstances, // Build only with all the active geometry instances, be it a reference to a triangle mesh, or an AABB => just everything mixed
-				{},                      // Let the scratch buffer be created internally
-				avk::sync::with_barriers_into_existing_command_buffer(*cmdbfr, {}, {})
-			);
-
-			// ...and we need to ensure that the TLAS update-build has completed (also in terms of memory
-			// access--not only execution) before we may continue ray tracing with that TLAS:
-			cmdbfr->establish_global_memory_barrier(
-				avk::pipeline_stage::acceleration_structure_build,       /* -> */ avk::pipeline_stage::ray_tracing_shaders,
-				avk::memory_access::acceleration_structure_write_access, /* -> */ avk::memory_access::acceleration_structure_read_access
-			);
-
-			cmdbfr->end_recording();
-			mQueue->submit(avk::referenced(cmdbfr));
-			gvk::context().main_window()->handle_lifetime(avk::owned(cmdbfr));
-		}
-
-		gvk::context().device().waitIdle();
-
-		triMeshGeomMgr->reset_update_required_flag(); // We have re-built the TLAS with triangle_mesh_geometry_manager's most up to date data => safe to reset its flag.
-		procMeshGeomMgr->reset_update_required_flag(); // We have re-built the TLAS with procedural_geometry_manager's most up to date data => safe to reset its flag.
-		mTlasUpdateRequired = false;
-	}
-
-	if (gvk::input().key_pressed(gvk::key_code::space)) {
-		// Print the current camera position
-		auto pos = mQuakeCam.translation();
-		LOG_INFO(fmt::format("Current camera position: {}", gvk::to_string(pos)));
-	}
-	if (gvk::input().key_pressed(gvk::key_code::escape)) {
-		// Stop the current composition:
-		gvk::current_composition()->stop();
-	}
-	if (gvk::input().key_pressed(gvk::key_code::f1)) {
-		auto imguiManager = gvk::current_composition()->element_by_type<gvk::imgui_manager>();
-		if (mQuakeCam.is_enabled()) {
-			mQuakeCam.disable();
-			if (nullptr != imguiManager) { imguiManager->enable_user_interaction(true); }
-		}
-		else {
-			mQuakeCam.enable();
-			if (nullptr != imguiManager) { imguiManager->enable_user_interaction(false); }
-		}
-	}
-}
-
-void fluid_nightmare_main::render()
-{
-	auto mainWnd = gvk::context().main_window();
-	auto inFlightIndex = mainWnd->in_flight_index_for_frame();
-
-	auto& commandPool = gvk::context().get_command_pool_for_single_use_command_buffers(*mQueue);
-	auto cmdbfr = commandPool->alloc_command_buffer(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-	cmdbfr->begin_recording();
-
-	// The triangle_mesh_geometry_manager has some of the data we require:
-	auto* triMeshGeomMgr = gvk::current_composition()->element_by_type<triangle_mesh_geometry_manager>();
-
-	cmdbfr->bind_pipeline(avk::const_referenced(mPipeline));
-	cmdbfr->bind_descriptors(mPipeline->layout(), mDescriptorCache.get_or_create_descriptor_sets({
-		avk::descriptor_binding(0, 0, triMeshGeomMgr->image_samplers()),
-		avk::descriptor_binding(0, 1, triMeshGeomMgr->material_buffer()),
-		avk::descriptor_binding(0, 2, avk::as_uniform_texel_buffer_views(triMeshGeomMgr->index_buffer_views())),
-		avk::descriptor_binding(0, 3, avk::as_uniform_texel_buffer_views(triMeshGeomMgr->tex_coords_buffer_views())),
-		avk::descriptor_binding(0, 4, avk::as_uniform_texel_buffer_views(triMeshGeomMgr->normals_buffer_views())),
-		avk::descriptor_binding(1, 0, mOffscreenImageView->as_storage_image()),
-		avk::descriptor_binding(2, 0, mTlas)
-		}));
-
-	// Set the push constants:
-	auto pushConstantsForThisDrawCall = push_const_data_scene_rendering{
-		glm::vec4{mAmbientLight, 0.0f},
-		glm::vec4{mLightDir, 0.0f},
-		mQuakeCam.global_transformation_matrix(),
-		glm::radians(mFieldOfViewForRayTracing) * 0.5f,
-		0.0f, // padding
-		mEnableShadows ? vk::Bool32{VK_TRUE} : vk::Bool32{VK_FALSE},
-		mShadowsFactor,
-		glm::vec4{ mShadowsColor, 1.0f },
-		mEnableAmbientOcclusion ? vk::Bool32{VK_TRUE} : vk::Bool32{VK_FALSE},
-		mAmbientOcclusionMinDist,
-		mAmbientOcclusionMaxDist,
-		mAmbientOcclusionFactor,
-		glm::vec4{ mAmbientOcclusionColor, 1.0f }
-	};
-	cmdbfr->handle().pushConstants(mPipeline->layout_handle(), vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eClosestHitKHR, 0, sizeof(pushConstantsForThisDrawCall), &pushConstantsForThisDrawCall);
-
-	// Do it:
-	cmdbfr->trace_rays(
-		gvk::for_each_pixel(mainWnd),
-		mPipeline->shader_binding_table(),
-		avk::using_raygen_group_at_index(0),
-		avk::using_miss_group_at_index(0),
-		avk::using_hit_group_at_index(0)
-	);
-
-	// Sync ray tracing with transfer:
-	cmdbfr->establish_global_memory_barrier(
-		avk::pipeline_stage::ray_tracing_shaders, avk::pipeline_stage::transfer,
-		avk::memory_access::shader_buffers_and_images_write_access, avk::memory_access::transfer_read_access
-	);
-
-	avk::copy_image_to_another(
-		mOffscreenImageView->get_image(),
-		mainWnd->current_backbuffer()->image_at(0),
-		avk::sync::with_barriers_into_existing_command_buffer(*cmdbfr, {}, {})
-	);
-
-	// Make sure to properly sync with ImGui manager which comes afterwards (it uses a graphics pipeline):
-	cmdbfr->establish_global_memory_barrier(
-		avk::pipeline_stage::transfer, avk::pipeline_stage::color_attachment_output,
-		avk::memory_access::transfer_write_access, avk::memory_access::color_attachment_write_access
-	);
-
-	cmdbfr->end_recording();
-
-	// The swap chain provides us with an "image available semaphore" for the current frame.
-	// Only after the swapchain image has become available, we may start rendering into it.
-	auto imageAvailableSemaphore = mainWnd->consume_current_image_available_semaphore();
-
-	// Submit the draw call and take care of the command buffer's lifetime:
-	mQueue->submit(cmdbfr, imageAvailableSemaphore);
-	mainWnd->handle_lifetime(avk::owned(cmdbfr));
-}
-
-[[nodiscard]] const avk::top_level_acceleration_structure& fluid_nightmare_main::get_tlas() const
-{
-	return mTlas;
-}
-
-int main() // <== Starting point ==
-{
-	try {
-		// Create a window and open it:
-		auto mainWnd = gvk::context().create_window("Fluid Nightmare - Main Window");
-		mainWnd->set_resolution({ 1920, 1080 });
-		mainWnd->enable_resizing(true);
-		mainWnd->set_presentaton_mode(gvk::presentation_mode::mailbox);
-		mainWnd->set_number_of_concurrent_frames(3u);
-		mainWnd->open();
-
-		// Create one single queue to submit command buffers to:
-		auto& singleQueue = gvk::context().create_queue({}, avk::queue_selection_preference::versatile_queue, mainWnd);
-		mainWnd->add_queue_family_ownership(singleQueue);
-		mainWnd->set_present_queue(singleQueue);
-		// ... pass the queue to the constructors of the invokees:
-		
-		// Create an instance of our main invokee:
-		auto mainInvokee = fluid_nightmare_main(singleQueue);
-		// Create an instance of the invokee that handles our triangle mesh geometry:
-		auto triMeshGeomMgrInvokee = triangle_mesh_geometry_manager();
-		// Create an instance of the invokee that handles our procedural geometry (the water particles):
-		auto procGeomMgrInvokee = procedural_geometry_manager(singleQueue);
-		// Create another element for drawing the UI with ImGui
-		auto imguiManagerInvokee = gvk::imgui_manager(singleQueue);
-
-		// Launch the render loop in 5.. 4.. 3.. 2.. 1.. 
-		gvk::start(
-			gvk::application_name("Fluid Nightmare"),
-			gvk::required_device_extensions()
-				// We need several extensions for ray tracing:
-				.add_extension(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME)
-				.add_extension(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME)
-				.add_extension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)
-				.add_extension(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME)
-				.add_extension(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME)
-				.add_extension(VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME),
-			[](vk::PhysicalDeviceVulkan12Features& aVulkan12Featues) {
-				// Also this Vulkan 1.2 feature is required for ray tracing:
-				aVulkan12Featues.setBufferDeviceAddress(VK_TRUE);
-			},
-			[](vk::PhysicalDeviceRayTracingPipelineFeaturesKHR& aRayTracingFeatures) {
-				// Enabling the extensions is not enough, we need to activate ray tracing features explicitly here:
-				aRayTracingFeatures.setRayTracingPipeline(VK_TRUE);
-			},
-			[](vk::PhysicalDeviceAccelerationStructureFeaturesKHR& aAccelerationStructureFeatures) {
-				// ...and here:
-				aAccelerationStructureFeatures.setAccelerationStructure(VK_TRUE);
-			},
-			// Pass our main window to render into its frame buffers:
-			mainWnd,
-			// Pass the invokees that shall be invoked every frame:
-			mainInvokee, triMeshGeomMgrInvokee, procGeomMgrInvokee, imguiManagerInvokee
-			);
-	}
-	catch (gvk::logic_error& e)    { LOG_ERROR(std::string("Caught gvk::logic_error in main(): ")   + e.what()); }
-	catch (gvk::runtime_error& e)  { LOG_ERROR(std::string("Caught gvk::runtime_error in main(): ") + e.what()); }
-	catch (avk::logic_error& e)    { LOG_ERROR(std::string("Caught avk::logic_error in main(): ")   + e.what()); }
-	catch (avk::runtime_error& e)  { LOG_ERROR(std::string("Caught avk::runtime_error in main(): ") + e.what()); }
-}
+#include <gvk.hpp>
+#include <imgui.h>
+#include <imgui_internal.h>
+#include <charconv>
+
+#include "preprocessor_defines.hpp"
+#include "cpu_to_gpu_data_types.hpp"
+#include "fluid_nightmare_main.hpp"
+#include "triangle_mesh_geometry_manager.hpp"
+#include "procedural_geometry_manager.hpp"
+#include "gpu_timestamp_profiler.hpp"
+#include "cpu_scope_profiler.hpp"
+#include "frame_telemetry.hpp"
+#include "benchmark_runner.hpp"
+#include "replay_recorder.hpp"
+#include "metrics_endpoint.hpp"
+#include "flight_recorder.hpp"
+#include "simulation_cache.hpp"
+#include "particle_exporter.hpp"
+#include "cpu_kernels.hpp"
+#include "memory_accounting.hpp"
+#include "ray_statistics.hpp"
+#include "frame_capture.hpp"
+#include "static_occlusion_baker.hpp"
+
+fluid_nightmare_main::fluid_nightmare_main(avk::queue& aQueue)
+	: mQueue{ &aQueue }
+{}
+
+void fluid_nightmare_main::initialize()
+{
+	// Create a descriptor cache that helps us to conveniently create descriptor sets,
+	// which describe where shaders can find resources like buffers or images:
+	mDescriptorCache = gvk::context().create_descriptor_cache();
+
+	// Set the direction towards the light:
+	mLightDir = { 0.8f, 1.0f, 0.0f };
+
+	// Get a pointer to the main window:		
+	auto* mainWnd = gvk::context().main_window();
+
+	// Create an offscreen image to ray-trace into. It is accessed via an image view:
+	const auto wdth = gvk::context().main_window()->resolution().x;
+	const auto hght = gvk::context().main_window()->resolution().y;
+	const auto frmt = gvk::format_from_window_color_buffer(mainWnd);
+	auto offscreenImage = gvk::context().create_image(wdth, hght, frmt, 1, avk::memory_usage::device, avk::image_usage::general_storage_image);
+	offscreenImage->transition_to_layout();
+	mOffscreenImageView = gvk::context().create_image_view(avk::owned(offscreenImage));
+	account_offscreen_image();
+
+	// Create the layered image which multiple views are rendered into (minimal while there is only one view, see update()), and
+	// the buffers with the views' cameras:
+	create_view_image(glm::uvec2{ 1u, 1u }, 1u);
+	create_multi_view_buffers();
+
+	// Create the buffers which the traversal cost counters are written into (in the heatmap render modes):
+	create_traversal_counters_buffer();
+	mTraversalTotalsReadbackBuffer = gvk::context().create_buffer(
+		avk::memory_usage::host_coherent, vk::BufferUsageFlagBits::eTransferDst,
+		avk::generic_buffer_meta::create_from_size(mainWnd->number_of_frames_in_flight() * 2 * sizeof(uint32_t))
+	);
+	memory_accounting().add(gpu_memory_category::readback_buffers, *mTraversalTotalsReadbackBuffer);
+	mTraversalTotals.resize(2 * mainWnd->number_of_frames_in_flight(), 0u);
+
+	// Create the buffers for the temporal reprojection of the primary visibility, and for the progressive refinement:
+	create_reprojection_buffer();
+	create_accumulation_buffer();
+	// ...and for the tiles which are traced if only particles have changed:
+	create_dirty_tiles_buffers();
+	mReprojectionCountersReadbackBuffer = gvk::context().create_buffer(
+		avk::memory_usage::host_coherent, vk::BufferUsageFlagBits::eTransferDst,
+		avk::generic_buffer_meta::create_from_size(mainWnd->number_of_frames_in_flight() * 2 * sizeof(uint32_t))
+	);
+	memory_accounting().add(gpu_memory_category::readback_buffers, *mReprojectionCountersReadbackBuffer);
+	mReprojectionCounters.resize(2 * mainWnd->number_of_frames_in_flight(), 0u);
+
+	// The ray statistics' counters buffer has been created already, since that invokee has a lower execution order:
+	auto* rayStatistics = gvk::current_composition()->element_by_type<ray_statistics>();
+	assert(nullptr != rayStatistics);
+
+	// The baked occlusion buffer has been created already, too:
+	auto* occlusionBaker = gvk::current_composition()->element_by_type<static_occlusion_baker>();
+	assert(nullptr != occlusionBaker);
+
+	// Both, triangle_mesh_geometry_manager and procedural_geometry_manager, have lower execution orders.
+	// Therefore, we can assume that they already contain the data that we require:
+	auto* triMeshGeomMgr = gvk::current_composition()->element_by_type<triangle_mesh_geometry_manager>();
+	assert(nullptr != triMeshGeomMgr);
+	auto* procMeshGeomMgr = gvk::current_composition()->element_by_type<procedural_geometry_manager>();
+	assert(nullptr != procMeshGeomMgr);
+
+	// The particle capacity grows on demand. Limit it s.t. the TLAS fits into a fraction of the device memory budget which
+	// is still available after the scene has been loaded. (While growing, the old and the new TLAS coexist for a moment.)
+	const auto availableBudget = static_cast<uint64_t>(static_cast<double>(query_device_memory_budget().available()) * cParticlesMemoryBudgetFraction);
+	const auto particleCapacityLimit = max_tlas_instances_within_budget(triMeshGeomMgr->max_number_of_geometry_instances(), procMeshGeomMgr->max_number_of_geometry_instances(), availableBudget);
+	procMeshGeomMgr->set_particle_capacity_limit(particleCapacityLimit);
+	LOG_INFO(fmt::format("Particle capacity limit derived from the memory budget: {} particles", particleCapacityLimit));
+	auto* memoryMonitor = gvk::current_composition()->element_by_type<memory_monitor>();
+	if (nullptr != memoryMonitor) {
+		memoryMonitor->check_projected_gpu_memory(fmt::format("A TLAS for {} geometry instances", triMeshGeomMgr->max_number_of_geometry_instances() + particleCapacityLimit),
+			estimate_tlas_memory_requirements(triMeshGeomMgr->max_number_of_geometry_instances() + particleCapacityLimit));
+	}
+
+	// Initialize the TLAS for the initial particle capacity (but don't build it yet)
+	create_tlas();
+
+	// The wavefront mode's G-buffer and sorted secondary rays are only sized for the resolution while it is enabled (see update()):
+	mSecondaryRaySorter.initialize(glm::uvec2{ 1u, 1u });
+
+	// Create our ray tracing pipelines with the required configuration. They only differ in their max. recursion depth,
+	// which is only 1 if the secondary rays are traced in separate launches:
+	mPipeline = create_scene_rendering_pipeline(gvk::context().get_max_ray_tracing_recursion_depth());
+	mWavefrontPipeline = create_scene_rendering_pipeline(1u);
+
+	// Print the structure of our shader binding table, also displaying the offsets:
+	mPipeline->print_shader_binding_table_groups();
+
+#if ENABLE_SHADER_HOT_RELOADING_FOR_RAY_TRACING_PIPELINE || ENABLE_RESIZABLE_WINDOW
+	// Create an updater:
+	mUpdater.emplace();
+	mPipeline.enable_shared_ownership(); // The updater needs to hold a reference to it, so we need to enable shared ownership.
+	mWavefrontPipeline.enable_shared_ownership();
+
+#if ENABLE_SHADER_HOT_RELOADING_FOR_RAY_TRACING_PIPELINE
+	mUpdater->on(gvk::shader_files_changed_event(mPipeline))
+	            .update(mPipeline);
+	mUpdater->on(gvk::shader_files_changed_event(mWavefrontPipeline))
+	            .update(mWavefrontPipeline);
+#endif
+	
+#if ENABLE_RESIZABLE_WINDOW
+	mOffscreenImageView.enable_shared_ownership(); // The updater needs to hold a reference to it, so we need to enable shared ownership.
+	mUpdater->on(gvk::swapchain_resized_event(gvk::context().main_window()))
+		        .update(mOffscreenImageView, mPipeline, mWavefrontPipeline)
+		     .then_on(gvk::destroying_image_view_event()) // Make sure that our descriptor cache stays cleaned up:
+		        .invoke([this](const avk::image_view& aImageViewToBeDestroyed) {
+					auto numRemoved = mDescriptorCache.remove_sets_with_handle(aImageViewToBeDestroyed->handle());
+					// The offscreen image has been replaced by one with the new resolution (which is accounted in update()):
+					const auto image = aImageViewToBeDestroyed->get_image().handle();
+					auto it = std::find_if(std::begin(mAccountedOffscreenImages), std::end(mAccountedOffscreenImages), [image](const auto& aEntry) { return aEntry.first == image; });
+					if (it != std::end(mAccountedOffscreenImages)) {
+						memory_accounting().gpu(gpu_memory_category::render_targets).remove(it->second);
+						mAccountedOffscreenImages.erase(it);
+					}
+			    });
+#endif
+#endif
+	
+	// Add the camera to the composition (and let it handle the updates)
+	mQuakeCam.set_translation({ 0.0f, 10.0f, 45.0f });
+	mQuakeCam.set_perspective_projection(glm::radians(60.0f), gvk::context().main_window()->aspect_ratio(), 0.5f, 100.0f);
+	gvk::current_composition()->add_element(mQuakeCam);
+
+	// Add an "ImGui Manager" which handles the UI:
+	auto imguiManager = gvk::current_composition()->element_by_type<gvk::imgui_manager>();
+	if (nullptr != imguiManager) {
+		imguiManager->add_callback([this]() {
+			ImGui::Begin("Info & Settings");
+			ImGui::SetWindowPos(ImVec2(3.0f, 3.0f), ImGuiCond_FirstUseEver);
+			ImGui::SetWindowSize(ImVec2(410.0f, 468.0f), ImGuiCond_FirstUseEver);
+
+			ImGui::Text("%.3f ms/frame", 1000.0f / ImGui::GetIO().Framerate);
+			ImGui::Text("%.1f FPS", ImGui::GetIO().Framerate);
+
+			// Show the CPU frame times' percentiles and their history, which is stored in a ring buffer by the telemetry:
+			auto* telemetry = gvk::current_composition()->element_by_type<frame_telemetry>();
+			if (nullptr != telemetry) {
+				const auto& cpuFrame = telemetry->metric(telemetry_metric_id::cpu_frame);
+				ImGui::Text("p50 %.2f | p95 %.2f | p99 %.2f | max %.2f ms", cpuFrame.p50(), cpuFrame.p95(), cpuFrame.p99(), cpuFrame.max());
+				const auto& history = cpuFrame.history();
+				ImGui::PlotLines("ms/frame", history.data(), static_cast<int>(history.size()), static_cast<int>(history.offset()), nullptr, 0.0f, FLT_MAX, ImVec2(0.0f, 100.0f));
+			}
+
+			// Let the user record CPU profiles at runtime:
+			bool recordCpuProfile = cpu_profiler().is_recording();
+			if (ImGui::Checkbox("Record CPU Profile", &recordCpuProfile)) {
+				if (recordCpuProfile) {
+					cpu_profiler().start_recording();
+				}
+				else {
+					cpu_profiler().stop_recording();
+				}
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Dump Chrome Trace")) {
+				cpu_profiler().stop_recording();
+				cpu_profiler().write_chrome_trace("cpu_trace.json");
+			}
+
+			ImGui::TextColored(ImVec4(0.f, .6f, .8f, 1.f), "[F1]: Toggle input-mode");
+			ImGui::TextColored(ImVec4(0.f, .6f, .8f, 1.f), " (UI vs. scene navigation)");
+
+			// Let the user change the ambient color:
+			ImGui::DragFloat3("Ambient Light", glm::value_ptr(mAmbientLight), 0.001f, 0.0f, 1.0f);
+
+			// Let the user change the light's direction, which also influences shadows:
+			ImGui::DragFloat3("Light Direction", glm::value_ptr(mLightDir), 0.005f, -1.0f, 1.0f);
+			mLightDir = glm::normalize(mLightDir);
+
+			// Let the user change the field of view, and evaluate in the ray generation shader:
+			ImGui::DragFloat("Field of View", &mFieldOfViewForRayTracing, 1, 10.0f, 160.0f);
+
+			ImGui::Separator();
+			// Let the user change shadow parameters:
+			ImGui::Checkbox("Enable Shadows", &mEnableShadows);
+			if (mEnableShadows) {
+				ImGui::SliderFloat("Shadows Intensity", &mShadowsFactor, 0.0f, 1.0f);
+				ImGui::ColorEdit3("Shadows Color", glm::value_ptr(mShadowsColor));
+			}
+
+			ImGui::Separator();
+			// Let the user change ambient occlusion parameters:
+			ImGui::Checkbox("Enable Ambient Occlusion", &mEnableAmbientOcclusion);
+			if (mEnableAmbientOcclusion) {
+				ImGui::DragFloat("AO Rays Min. Length", &mAmbientOcclusionMinDist, 0.001f, 0.000001f, 1.0f);
+				ImGui::DragFloat("AO Rays Max. Length", &mAmbientOcclusionMaxDist, 0.01f,  0.001f,    1000.0f);
+				ImGui::SliderFloat("AO Intensity", &mAmbientOcclusionFactor, 0.0f, 1.0f);
+				ImGui::ColorEdit3("AO Color", glm::value_ptr(mAmbientOcclusionColor));
+			}
+
+			// Let the user bake the occlusion by the static triangle mesh geometry, s.t. only the particles' occlusion is traced:
+			if (mEnableShadows || mEnableAmbientOcclusion) {
+				ImGui::Checkbox("Baked Occlusion", &mEnableBakedOcclusion);
+				auto* occlusionBaker = gvk::current_composition()->element_by_type<static_occlusion_baker>();
+				if (mEnableBakedOcclusion && nullptr != occlusionBaker) {
+					ImGui::Text("%u vertices, baked %llu (shadows) and %llu (AO) times", occlusionBaker->number_of_vertices(), occlusionBaker->number_of_shadow_bakes(), occlusionBaker->number_of_ambient_occlusion_bakes());
+				}
+			}
+
+			// Let the user trace the secondary rays sorted, in separate launches:
+			if (mEnableShadows || mEnableAmbientOcclusion) {
+				ImGui::Checkbox("Wavefront Secondary Rays", &mEnableWavefront);
+				if (mEnableWavefront) {
+					ImGui::TextDisabled("(Shaded mode only, without dirty tiles and refinement)");
+				}
+			}
+
+			ImGui::Separator();
+			// Let the user render multiple views, e.g. a stereo pair, spread along the camera's x axis:
+			ImGui::SliderInt("Views", &mNumViews, 1, static_cast<int>(cMaxViews));
+			if (mNumViews > 1) {
+				ImGui::DragFloat("View Separation", &mViewSeparation, 0.001f, 0.0f, 10.0f);
+				ImGui::SliderInt("Displayed View", &mDisplayedView, 0, mNumViews - 1);
+				ImGui::Checkbox("Separate Launches per View", &mSeparateViewLaunches);
+				auto* gpuProfiler = gvk::current_composition()->element_by_type<gpu_timestamp_profiler>();
+				// The views are only rendered if the current render mode and features allow it (see render()):
+				if (nullptr != gpuProfiler && mMultiViewActive) {
+					ImGui::Text("trace_rays per view: %.3f ms", gpuProfiler->rolling_averages()[static_cast<size_t>(gpu_pass::scene_trace_rays)] / static_cast<float>(mNumViews));
+				}
+				ImGui::TextDisabled("(Shaded mode only, without reprojection, dirty tiles, refinement and wavefront)");
+			}
+
+			ImGui::Separator();
+			// Let the user visualize the traversal cost per pixel:
+			static const char* const renderModeNames[] = { "Shaded", "Heatmap: Intersection Shader Invocations", "Heatmap: Rays Traced" };
+			int renderMode = static_cast<int>(mRenderMode);
+			if (ImGui::Combo("Render Mode", &renderMode, renderModeNames, static_cast<int>(std::size(renderModeNames)))) {
+				mRenderMode = static_cast<render_mode>(renderMode);
+			}
+			if (render_mode::shaded != mRenderMode) {
+				ImGui::DragFloat("Heatmap Max. Count", &mHeatmapMaxCount, 1.0f, 1.0f, 10000.0f);
+				ImGui::Text("Intersection shader invocations: %u", mTotalIntersectionInvocations);
+				ImGui::Text("Rays traced: %u", mTotalRays);
+			}
+
+			ImGui::Separator();
+			// Let the user reuse the previous frame's primary visibility where possible:
+			ImGui::Checkbox("Temporal Reprojection", &mEnableReprojection);
+			if (mEnableReprojection) {
+				ImGui::DragFloat("Max. Camera Translation", &mReprojectionMaxTranslation, 0.001f, 0.0f, 1.0f);
+				ImGui::DragFloat("Max. Camera Rotation (deg)", &mReprojectionMaxRotationDegrees, 0.01f, 0.0f, 10.0f);
+				ImGui::SliderInt("Refresh Interval (frames)", &mReprojectionRefreshInterval, 2, 64);
+				ImGui::Text("Re-traced pixels: %.1f%%%s", mRetracedPixelFraction * 100.0f, mReprojectionFellBack ? " (full trace)" : "");
+				ImGui::PlotLines("Re-traced", mRetracedPixelFractionHistory.data(), static_cast<int>(mRetracedPixelFractionHistory.size()), static_cast<int>(mRetracedPixelFractionHistoryOffset), nullptr, 0.0f, 1.0f, ImVec2(0.0f, 60.0f));
+			}
+
+			// Let the user trace only the tiles which are affected by changed particles while the camera is static:
+			ImGui::Checkbox("Dirty Tiles", &mEnableDirtyTiles);
+			if (mEnableDirtyTiles) {
+				ImGui::SliderFloat("Max. Dirty Fraction", &mDirtyTilesMaxFraction, 0.0f, 1.0f);
+				ImGui::Text("Dirty pixels: %.1f%% (%zu tiles)", mDirtyPixelFraction * 100.0f, mDirtyTiles.size());
+			}
+
+			ImGui::Separator();
+			// Let the user choose what happens while nothing changes:
+			static const char* const idleFrameModeNames[] = { "Always Trace", "Skip Tracing", "Progressive Refinement" };
+			int idleFrameMode = static_cast<int>(mIdleFrameMode);
+			if (ImGui::Combo("Idle Frames", &idleFrameMode, idleFrameModeNames, static_cast<int>(std::size(idleFrameModeNames)))) {
+				mIdleFrameMode = static_cast<idle_frame_mode>(idleFrameMode);
+			}
+			if (idle_frame_mode::progressive_refinement == mIdleFrameMode) {
+				ImGui::SliderInt("Max. Refinement Samples", &mMaxRefinementSamples, 1, 1024);
+				ImGui::DragFloat("Light Angular Radius (deg)", &mLightAngularRadiusDegrees, 0.01f, 0.0f, 10.0f);
+				ImGui::Text("Refinement samples: %u", mRefinementSample);
+			}
+
+			ImGui::End();
+		});
+	}
+}
+
+void fluid_nightmare_main::update()
+{
+	auto* triMeshGeomMgr = gvk::current_composition()->element_by_type<triangle_mesh_geometry_manager>();
+	assert(nullptr != triMeshGeomMgr);
+	auto* procMeshGeomMgr = gvk::current_composition()->element_by_type<procedural_geometry_manager>();
+	assert(nullptr != procMeshGeomMgr);
+	auto* gpuProfiler = gvk::current_composition()->element_by_type<gpu_timestamp_profiler>();
+	auto* flightRecorder = gvk::current_composition()->element_by_type<flight_recorder>();
+
+	// Visibility changes of triangle mesh geometry instances are mostly handled via the cull mask (i.e., for free). Only
+	// if instances without a dedicated mask bit have changed their visibility, an update-only build (a refit) is required:
+	const bool rebuildRequired = triMeshGeomMgr->has_updated_geometry_for_tlas() || procMeshGeomMgr->has_updated_geometry_for_tlas();
+	const bool refitRequired = !rebuildRequired && triMeshGeomMgr->has_updated_instance_masks_for_tlas();
+	if (rebuildRequired || refitRequired)
+	{
+		// Getometry or instance masks have changed => rebuild or refit the TLAS:
+
+		// Remember what has changed, s.t. the temporal reprojection knows what it must not reuse:
+		mTriangleMeshGeometryChanged = mTriangleMeshGeometryChanged || triMeshGeomMgr->has_updated_geometry_for_tlas() || refitRequired;
+		mChangedParticleBounds.add(procMeshGeomMgr->changed_particle_bounds());
+
+		// If the particle capacity has grown, the TLAS must be reallocated before the build. The old one might still
+		// be in use by frames in flight => keep it alive until after the device has become idle below:
+		std::optional<avk::top_level_acceleration_structure> retiredTlas;
+		if (procMeshGeomMgr->has_grown_particle_capacity()) {
+			PROFILE_CPU_SCOPE("reallocate TLAS");
+			memory_accounting().gpu(gpu_memory_category::tlas).remove(mTlas->required_acceleration_structure_size());
+			retiredTlas = std::move(mTlas);
+			create_tlas();
+			if (nullptr != flightRecorder) { flightRecorder->note_event(flight_event::tlas_reallocation); }
+		}
+
+		std::vector<avk::geometry_instance> activeGeometryInstances;
+		{
+			PROFILE_CPU_SCOPE("assemble TLAS geometry instances");
+			// All the triangle mesh geometry instances, and all the water particles:
+			activeGeometryInstances = concatenate_geometry_instances(triMeshGeomMgr->get_geometry_instances_for_tlas_build(), procMeshGeomMgr->get_geometry_instances_buffer());
+		}
+		
+		if (!activeGeometryInstances.empty()) {
+			auto& commandPool = gvk::context().get_command_pool_for_single_use_command_buffers(*mQueue);
+			auto cmdbfr = commandPool->alloc_command_buffer(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+			cmdbfr->begin_recording();
+
+			// We're using only one TLAS for all frames in flight. Therefore, we need to set up a barrier
+			// affecting the whole queue which waits until all previous ray tracing work has completed:
+			cmdbfr->establish_execution_barrier(
+				avk::pipeline_stage::ray_tracing_shaders, /* -> */ avk::pipeline_stage::acceleration_structure_build
+			);
+
+			if (nullptr != gpuProfiler) { gpuProfiler->begin_pass(*cmdbfr, gpu_pass::tlas_build); }
+			++mTlasVersion;
+
+			// ...then we can safely update the TLAS with new data:
+			if (rebuildRequired) {
+				mTlas->build(                // We're not updating existing geometry, but we are changing the geometry => therefore, we need to perform a full rebuild (not just an update-build).
+					activeGeometryInstances, // Build with all the geometry instances, be it a reference to a triangle mesh, or an AABB => just everything mixed
+					{},                      // Let the scratch buffer be created internally
+					avk::sync::with_barriers_into_existing_command_buffer(*cmdbfr, {}, {})
+				);
+			}
+			else {
+				mTlas->update(               // The number of geometry instances is the same, only some of their instance masks have changed => an update-build is sufficient.
+					activeGeometryInstances,
+					{},                      // Let the scratch buffer be created internally
+					avk::sync::with_barriers_into_existing_command_buffer(*cmdbfr, {}, {})
+				);
+			}
+
+			if (nullptr != gpuProfiler) { gpuProfiler->end_pass(*cmdbfr, gpu_pass::tlas_build); }
+			if (nullptr != flightRecorder) { flightRecorder->note_event(rebuildRequired ? flight_event::tlas_rebuild : flight_event::tlas_refit); }
+
+			// The instances buffer lives as long as the TLAS is built from it, the scratch buffer only during the build:
+			memory_accounting().gpu(gpu_memory_category::tlas_instances).set(activeGeometryInstances.size() * sizeof(VkAccelerationStructureInstanceKHR));
+			memory_accounting().gpu(gpu_memory_category::acceleration_structure_scratch).record_transient(
+				rebuildRequired ? mTlas->required_scratch_buffer_build_size() : mTlas->required_scratch_buffer_update_size()
+			);
+
+			// ...and we need to ensure that the TLAS update-build has completed (also in terms of memory
+			// access--not only execution) before we may continue ray tracing with that TLAS:
+			cmdbfr->establish_global_memory_barrier(
+				avk::pipeline_stage::acceleration_structure_build,       /* -> */ avk::pipeline_stage::ray_tracing_shaders,
+				avk::memory_access::acceleration_structure_write_access, /* -> */ avk::memory_access::acceleration_structure_read_access
+			);
+
+			cmdbfr->end_recording();
+			mQueue->submit(avk::referenced(cmdbfr));
+			gvk::context().main_window()->handle_lifetime(avk::owned(cmdbfr));
+		}
+
+		{
+			PROFILE_CPU_SCOPE("wait idle after TLAS build");
+			gvk::context().device().waitIdle();
+		}
+
+		if (retiredTlas.has_value()) {
+			// Nobody uses the old TLAS anymore => get rid of all the descriptor sets which refer to it, then destroy it:
+			mDescriptorCache.remove_sets_with_handle((*retiredTlas)->acceleration_structure_handle());
+			procMeshGeomMgr->remove_descriptor_sets_with_tlas(*(*retiredTlas));
+			auto* occlusionBaker = gvk::current_composition()->element_by_type<static_occlusion_baker>();
+			assert(nullptr != occlusionBaker);
+			occlusionBaker->remove_descriptor_sets_with_tlas(*(*retiredTlas));
+			retiredTlas.reset();
+		}
+
+		triMeshGeomMgr->reset_update_required_flag(); // We have re-built the TLAS with triangle_mesh_geometry_manager's most up to date data => safe to reset its flag.
+		procMeshGeomMgr->reset_update_required_flag(); // We have re-built the TLAS with procedural_geometry_manager's most up to date data => safe to reset its flag.
+		mTlasUpdateRequired = false;
+	}
+
+	// The updater recreates the offscreen image when the window is resized:
+	account_offscreen_image();
+
+	// The traversal counters must cover every pixel => recreate them if the resolution has changed:
+	if (mTraversalCountersResolution != gvk::context().main_window()->resolution()) {
+		gvk::context().device().waitIdle();
+		mDescriptorCache.remove_sets_with_handle(mTraversalCountersBuffer->handle());
+		memory_accounting().gpu(gpu_memory_category::render_targets).remove(memory_accountant::memory_size_of(*mTraversalCountersBuffer));
+		create_traversal_counters_buffer();
+	}
+
+	// The same goes for the reprojection history:
+	if (mReprojectionResolution != gvk::context().main_window()->resolution()) {
+		gvk::context().device().waitIdle();
+		mDescriptorCache.remove_sets_with_handle(mReprojectionBuffer->handle());
+		memory_accounting().gpu(gpu_memory_category::render_targets).remove(memory_accountant::memory_size_of(*mReprojectionBuffer));
+		create_reprojection_buffer();
+		mDescriptorCache.remove_sets_with_handle(mAccumulationBuffer->handle());
+		memory_accounting().gpu(gpu_memory_category::render_targets).remove(memory_accountant::memory_size_of(*mAccumulationBuffer));
+		create_accumulation_buffer();
+		destroy_dirty_tiles_buffers();
+		create_dirty_tiles_buffers();
+	}
+
+	// The wavefront mode's buffers cover every pixel while it is enabled, and are minimal otherwise:
+	const auto wavefrontResolution = mEnableWavefront ? gvk::context().main_window()->resolution() : glm::uvec2{ 1u, 1u };
+	if (mSecondaryRaySorter.resolution() != wavefrontResolution) {
+		gvk::context().device().waitIdle();
+		mDescriptorCache.remove_sets_with_handle(mSecondaryRaySorter.gbuffer()->handle());
+		mDescriptorCache.remove_sets_with_handle(mSecondaryRaySorter.bins_buffer()->handle());
+		mDescriptorCache.remove_sets_with_handle(mSecondaryRaySorter.sorted_rays_buffer()->handle());
+		mSecondaryRaySorter.create_buffers(wavefrontResolution);
+	}
+
+	// The same goes for the layered image of multiple views, which has one layer per view:
+	const auto numViewLayers = static_cast<uint32_t>(std::clamp(mNumViews, 1, static_cast<int>(cMaxViews)));
+	const auto viewImageResolution = numViewLayers > 1 ? gvk::context().main_window()->resolution() : glm::uvec2{ 1u, 1u };
+	if (mViewImageLayers != numViewLayers || mViewImageResolution != viewImageResolution) {
+		gvk::context().device().waitIdle();
+		mDescriptorCache.remove_sets_with_handle(mViewImageView->handle());
+		memory_accounting().gpu(gpu_memory_category::render_targets).remove(memory_accountant::memory_size_of(mViewImageView->get_image().handle()));
+		create_view_image(viewImageResolution, numViewLayers);
+	}
+
+	if (gvk::input().key_pressed(gvk::key_code::space)) {
+		// Print the current camera position
+		auto pos = mQuakeCam.translation();
+		LOG_INFO(fmt::format("Current camera position: {}", gvk::to_string(pos)));
+	}
+	if (gvk::input().key_pressed(gvk::key_code::escape)) {
+		// Stop the current composition:
+		gvk::current_composition()->stop();
+	}
+	if (gvk::input().key_pressed(gvk::key_code::f1)) {
+		auto imguiManager = gvk::current_composition()->element_by_type<gvk::imgui_manager>();
+		if (mQuakeCam.is_enabled()) {
+			mQuakeCam.disable();
+			if (nullptr != imguiManager) { imguiManager->enable_user_interaction(true); }
+		}
+		else {
+			mQuakeCam.enable();
+			if (nullptr != imguiManager) { imguiManager->enable_user_interaction(false); }
+		}
+	}
+}
+
+void fluid_nightmare_main::render()
+{
+	auto mainWnd = gvk::context().main_window();
+	auto inFlightIndex = mainWnd->in_flight_index_for_frame();
+
+	auto& commandPool = gvk::context().get_command_pool_for_single_use_command_buffers(*mQueue);
+	auto cmdbfr = commandPool->alloc_command_buffer(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+	cmdbfr->begin_recording();
+
+	// The triangle_mesh_geometry_manager has some of the data we require:
+	auto* triMeshGeomMgr = gvk::current_composition()->element_by_type<triangle_mesh_geometry_manager>();
+	// The shaders count rays and hits into the ray statistics' buffer:
+	auto* rayStatistics = gvk::current_composition()->element_by_type<ray_statistics>();
+	assert(nullptr != rayStatistics);
+	// The profiler measures the GPU time of each pass (if there is one):
+	auto* gpuProfiler = gvk::current_composition()->element_by_type<gpu_timestamp_profiler>();
+	// The baker has rendered before this invokee, i.e. the baked occlusion is up to date if it is complete:
+	auto* occlusionBaker = gvk::current_composition()->element_by_type<static_occlusion_baker>();
+	assert(nullptr != occlusionBaker);
+
+	const bool heatmapMode = render_mode::shaded != mRenderMode;
+	// Multiple views are rendered in one launch, whose depth is the number of views. (The layered image is resized in update(), i.e. they take effect one frame after being enabled.):
+	const auto viewTransforms = view_transforms();
+	const auto numViews = static_cast<uint32_t>(viewTransforms.size());
+	const bool multiView = numViews > 1 && !heatmapMode && mViewImageLayers == numViews && mViewImageResolution == mainWnd->resolution();
+	mMultiViewActive = multiView;
+	// The wavefront mode only pays off if there are secondary rays. (Its buffers are resized in update(), too):
+	const bool wavefront = mEnableWavefront && !heatmapMode && !multiView && (mEnableShadows || mEnableAmbientOcclusion) && mSecondaryRaySorter.resolution() == mainWnd->resolution();
+
+	// Assemble the push constants first, s.t. they can be compared with the ones of the previously traced frame:
+	auto pushConstantsForThisDrawCall = push_const_data_scene_rendering{
+		glm::vec4{mAmbientLight, 0.0f},
+		glm::vec4{mLightDir, 0.0f},
+		mQuakeCam.global_transformation_matrix(),
+		glm::radians(mFieldOfViewForRayTracing) * 0.5f,
+		0.0f, // padding
+		mEnableShadows ? vk::Bool32{VK_TRUE} : vk::Bool32{VK_FALSE},
+		mShadowsFactor,
+		glm::vec4{ mShadowsColor, 1.0f },
+		mEnableAmbientOcclusion ? vk::Bool32{VK_TRUE} : vk::Bool32{VK_FALSE},
+		mAmbientOcclusionMinDist,
+		mAmbientOcclusionMaxDist,
+		mAmbientOcclusionFactor,
+		glm::vec4{ mAmbientOcclusionColor, 1.0f },
+		get_cull_mask(),
+		static_cast<uint32_t>(mRenderMode),
+		mHeatmapMaxCount,
+		0u, // refinement sample, set by evaluate_frame_changes
+		glm::radians(mLightAngularRadiusDegrees),
+		mEnableBakedOcclusion && occlusionBaker->has_baked_occlusion() ? vk::Bool32{VK_TRUE} : vk::Bool32{VK_FALSE},
+		static_cast<uint32_t>(wavefront ? secondary_ray_pass::primary : secondary_ray_pass::recursive),
+		0u, // first view, set per launch
+		multiView ? static_cast<uint32_t>(std::clamp(mDisplayedView, 0, static_cast<int>(numViews) - 1)) : 0u
+	};
+	auto& pipeline = wavefront ? mWavefrontPipeline : mPipeline;
+
+	// If nothing has changed since the previously traced frame, the offscreen image still contains this frame's image. If only
+	// particles have changed, only the tiles which they might affect are traced, and all others still contain this frame's image:
+	const auto traceExtent = evaluate_frame_changes(pushConstantsForThisDrawCall, multiView ? viewTransforms : std::vector<glm::mat4>{});
+	const bool dirtyTilesOnly = trace_extent::dirty_tiles == traceExtent;
+	if (trace_extent::nothing != traceExtent) {
+		if (heatmapMode) {
+			// This frame in flight's slot of the readback buffer has last been written when the same in-flight index has been
+			// rendered, and the framework has waited for that frame to complete => read the totals without stalling:
+			mTraversalTotalsReadbackBuffer->read(mTraversalTotals.data(), 0, avk::sync::not_required());
+			mTotalIntersectionInvocations = mTraversalTotals[2 * inFlightIndex];
+			mTotalRays                    = mTraversalTotals[2 * inFlightIndex + 1];
+
+			// Clear all the counters before the shaders start counting:
+			cmdbfr->handle().fillBuffer(mTraversalCountersBuffer->handle(), 0, VK_WHOLE_SIZE, 0u);
+			cmdbfr->establish_global_memory_barrier(
+				avk::pipeline_stage::transfer, avk::pipeline_stage::ray_tracing_shaders,
+				avk::memory_access::transfer_write_access, avk::memory_access::shader_buffers_and_images_read_access | avk::memory_access::shader_buffers_and_images_write_access
+			);
+		}
+
+		// Progressive refinement accumulates fully traced frames => no reuse of the previous frame's samples while refining. Neither
+		// with multiple views, whose history has been written from the displayed view's camera instead of the one it is compared with:
+		record_reprojection_frame_data(*cmdbfr, inFlightIndex, 0u == pushConstantsForThisDrawCall.mRefinementSample && !multiView, dirtyTilesOnly);
+		if (multiView) {
+			mReprojectionHistoryValid = false;
+		}
+
+		// This frame in flight's views buffer has last been read when the same in-flight index has been rendered:
+		auto* views = mMultiViewMapped[inFlightIndex];
+		views->mNumViews = multiView ? numViews : 1u;
+		std::copy(std::begin(viewTransforms), std::end(viewTransforms), views->mCameraTransforms);
+
+		// This frame in flight's dirty tiles buffer has last been read when the same in-flight index has been rendered:
+		auto* dirtyTiles = mDirtyTilesMapped[inFlightIndex];
+		dirtyTiles->mEnabled = dirtyTilesOnly ? VK_TRUE : VK_FALSE;
+		dirtyTiles->mNumTiles = static_cast<uint32_t>(mDirtyTiles.size());
+		std::copy(std::begin(mDirtyTiles), std::end(mDirtyTiles), reinterpret_cast<uint32_t*>(dirtyTiles + 1));
+
+		cmdbfr->bind_pipeline(avk::const_referenced(pipeline));
+		{
+			PROFILE_CPU_SCOPE("descriptor cache lookup");
+			cmdbfr->bind_descriptors(pipeline->layout(), mDescriptorCache.get_or_create_descriptor_sets({
+				avk::descriptor_binding(0, 0, triMeshGeomMgr->image_samplers()),
+				avk::descriptor_binding(0, 1, triMeshGeomMgr->material_buffer()),
+				avk::descriptor_binding(0, 2, avk::as_uniform_texel_buffer_views(triMeshGeomMgr->index_buffer_views())),
+				avk::descriptor_binding(0, 3, avk::as_uniform_texel_buffer_views(triMeshGeomMgr->tex_coords_buffer_views())),
+				avk::descriptor_binding(0, 4, avk::as_uniform_texel_buffer_views(triMeshGeomMgr->normals_buffer_views())),
+				avk::descriptor_binding(1, 0, mOffscreenImageView->as_storage_image()),
+				avk::descriptor_binding(1, 1, mViewImageView->as_storage_image()),
+				avk::descriptor_binding(2, 0, mTlas),
+				avk::descriptor_binding(3, 0, mTraversalCountersBuffer->as_storage_buffer()),
+				avk::descriptor_binding(3, 1, rayStatistics->counters_buffer()->as_storage_buffer()),
+				avk::descriptor_binding(3, 2, mReprojectionBuffer->as_storage_buffer()),
+				avk::descriptor_binding(3, 3, mAccumulationBuffer->as_storage_buffer()),
+				avk::descriptor_binding(3, 4, mDirtyTilesBuffers[inFlightIndex]->as_storage_buffer()),
+				avk::descriptor_binding(3, 5, occlusionBaker->baked_occlusion_buffer()->as_storage_buffer()),
+				avk::descriptor_binding(3, 6, mSecondaryRaySorter.gbuffer()->as_storage_buffer()),
+				avk::descriptor_binding(3, 7, mSecondaryRaySorter.bins_buffer()->as_storage_buffer()),
+				avk::descriptor_binding(3, 8, mSecondaryRaySorter.sorted_rays_buffer()->as_storage_buffer()),
+				avk::descriptor_binding(3, 9, mMultiViewBuffers[inFlightIndex]->as_storage_buffer())
+				}));
+		}
+
+		const auto pushConstantsStages = vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eClosestHitKHR | vk::ShaderStageFlagBits::eIntersectionKHR;
+		cmdbfr->handle().pushConstants(pipeline->layout_handle(), pushConstantsStages, 0, sizeof(pushConstantsForThisDrawCall), &pushConstantsForThisDrawCall);
+
+		// Do it (either for each pixel, or for each pixel of each dirty tile, or for each pixel of each view):
+		if (nullptr != gpuProfiler) { gpuProfiler->begin_pass(*cmdbfr, gpu_pass::scene_trace_rays); }
+		if (multiView && mSeparateViewLaunches) {
+			// For comparison: the same views, but in one launch per view:
+			for (uint32_t view = 0; view < numViews; ++view) {
+				pushConstantsForThisDrawCall.mFirstView = view;
+				cmdbfr->handle().pushConstants(pipeline->layout_handle(), pushConstantsStages, 0, sizeof(pushConstantsForThisDrawCall), &pushConstantsForThisDrawCall);
+				cmdbfr->trace_rays(
+					gvk::for_each_pixel(mainWnd),
+					pipeline->shader_binding_table(),
+					avk::using_raygen_group_at_index(0),
+					avk::using_miss_group_at_index(0),
+					avk::using_hit_group_at_index(0)
+				);
+			}
+		}
+		else {
+			const auto extent = dirtyTilesOnly ? vk::Extent3D{ cDirtyTileSize, cDirtyTileSize, static_cast<uint32_t>(mDirtyTiles.size()) }
+				: multiView ? vk::Extent3D{ mainWnd->resolution().x, mainWnd->resolution().y, numViews }
+				: gvk::for_each_pixel(mainWnd);
+			cmdbfr->trace_rays(
+				extent,
+				pipeline->shader_binding_table(),
+				avk::using_raygen_group_at_index(0),
+				avk::using_miss_group_at_index(0),
+				avk::using_hit_group_at_index(0)
+			);
+		}
+		if (nullptr != gpuProfiler) { gpuProfiler->end_pass(*cmdbfr, gpu_pass::scene_trace_rays); }
+
+		if (wavefront) {
+			// The G-buffer is complete => sort and trace the shadow rays, then the ambient occlusion rays. The compute pipelines
+			// which sort them leave the ray tracing pipeline and its descriptor sets bound, but not the push constants:
+			if (nullptr != gpuProfiler) { gpuProfiler->begin_pass(*cmdbfr, gpu_pass::secondary_rays); }
+			const uint32_t numPixels = mainWnd->resolution().x * mainWnd->resolution().y;
+			for (auto rayPass : { secondary_ray_pass::shadow, secondary_ray_pass::ambient_occlusion }) {
+				if (!(secondary_ray_pass::shadow == rayPass ? mEnableShadows : mEnableAmbientOcclusion)) {
+					continue;
+				}
+				mSecondaryRaySorter.record_sort(*cmdbfr, rayPass, mLightDir, triMeshGeomMgr->scene_bounds());
+				pushConstantsForThisDrawCall.mSecondaryRayPass = static_cast<uint32_t>(rayPass);
+				cmdbfr->handle().pushConstants(pipeline->layout_handle(), pushConstantsStages, 0, sizeof(pushConstantsForThisDrawCall), &pushConstantsForThisDrawCall);
+				cmdbfr->trace_rays(
+					vk::Extent3D{ numPixels, secondary_ray_sorter::rays_per_pixel(rayPass), 1u },
+					pipeline->shader_binding_table(),
+					avk::using_raygen_group_at_index(1),
+					avk::using_miss_group_at_index(0),
+					avk::using_hit_group_at_index(0)
+				);
+			}
+
+			// Apply the secondary rays' results to the G-buffer's colors:
+			cmdbfr->establish_global_memory_barrier(
+				avk::pipeline_stage::ray_tracing_shaders, /* -> */ avk::pipeline_stage::ray_tracing_shaders,
+				avk::memory_access::shader_buffers_and_images_write_access, /* -> */ avk::memory_access::shader_buffers_and_images_read_access | avk::memory_access::shader_buffers_and_images_write_access
+			);
+			pushConstantsForThisDrawCall.mSecondaryRayPass = static_cast<uint32_t>(secondary_ray_pass::composite);
+			cmdbfr->handle().pushConstants(pipeline->layout_handle(), pushConstantsStages, 0, sizeof(pushConstantsForThisDrawCall), &pushConstantsForThisDrawCall);
+			cmdbfr->trace_rays(
+				gvk::for_each_pixel(mainWnd),
+				pipeline->shader_binding_table(),
+				avk::using_raygen_group_at_index(2),
+				avk::using_miss_group_at_index(0),
+				avk::using_hit_group_at_index(0)
+			);
+			if (nullptr != gpuProfiler) { gpuProfiler->end_pass(*cmdbfr, gpu_pass::secondary_rays); }
+		}
+
+		// Sync ray tracing with transfer:
+		cmdbfr->establish_global_memory_barrier(
+			avk::pipeline_stage::ray_tracing_shaders, avk::pipeline_stage::transfer,
+			avk::memory_access::shader_buffers_and_images_write_access, avk::memory_access::transfer_read_access
+		);
+
+		if (heatmapMode) {
+			// Copy the scene-wide totals into this frame in flight's slot of the readback buffer:
+			cmdbfr->handle().copyBuffer(mTraversalCountersBuffer->handle(), mTraversalTotalsReadbackBuffer->handle(), vk::BufferCopy{ 0, 2 * sizeof(uint32_t) * inFlightIndex, 2 * sizeof(uint32_t) });
+		}
+		// ...and the reprojection counters into this frame in flight's slot of their readback buffer:
+		cmdbfr->handle().copyBuffer(mReprojectionBuffer->handle(), mReprojectionCountersReadbackBuffer->handle(), vk::BufferCopy{ offsetof(reprojection_frame_data, mRetracedPixels), 2 * sizeof(uint32_t) * inFlightIndex, 2 * sizeof(uint32_t) });
+		cmdbfr->establish_global_memory_barrier(
+			avk::pipeline_stage::transfer, avk::pipeline_stage::host,
+			avk::memory_access::transfer_write_access, avk::memory_access::host_read_access
+		);
+	}
+
+	// Copy the traced image into the frame capture's readback ring (only while it is capturing):
+	auto* frameCapture = gvk::current_composition()->element_by_type<frame_capture>();
+	if (nullptr != frameCapture) {
+		frameCapture->record_copy(*cmdbfr, mOffscreenImageView->get_image());
+	}
+
+	if (nullptr != gpuProfiler) { gpuProfiler->begin_pass(*cmdbfr, gpu_pass::image_copy); }
+	avk::copy_image_to_another(
+		mOffscreenImageView->get_image(),
+		mainWnd->current_backbuffer()->image_at(0),
+		avk::sync::with_barriers_into_existing_command_buffer(*cmdbfr, {}, {})
+	);
+	if (nullptr != gpuProfiler) { gpuProfiler->end_pass(*cmdbfr, gpu_pass::image_copy); }
+
+	// Make sure to properly sync with ImGui manager which comes afterwards (it uses a graphics pipeline):
+	cmdbfr->establish_global_memory_barrier(
+		avk::pipeline_stage::transfer, avk::pipeline_stage::color_attachment_output,
+		avk::memory_access::transfer_write_access, avk::memory_access::color_attachment_write_access
+	);
+
+	// Everything that follows on the queue until the profiler's end timestamp is the ImGui pass:
+	if (nullptr != gpuProfiler) { gpuProfiler->begin_pass(*cmdbfr, gpu_pass::imgui); }
+
+	cmdbfr->end_recording();
+
+	// The swap chain provides us with an "image available semaphore" for the current frame.
+	// Only after the swapchain image has become available, we may start rendering into it.
+	auto imageAvailableSemaphore = mainWnd->consume_current_image_available_semaphore();
+
+	// Submit the draw call and take care of the command buffer's lifetime:
+	mQueue->submit(cmdbfr, imageAvailableSemaphore);
+	mainWnd->handle_lifetime(avk::owned(cmdbfr));
+}
+
+[[nodiscard]] const avk::top_level_acceleration_structure& fluid_nightmare_main::get_tlas() const
+{
+	return mTlas;
+}
+
+fluid_nightmare_main::render_settings fluid_nightmare_main::get_render_settings() const
+{
+	return render_settings{
+		mAmbientLight,
+		mLightDir,
+		mFieldOfViewForRayTracing,
+		mEnableShadows ? 1u : 0u,
+		mShadowsFactor,
+		mShadowsColor,
+		mEnableAmbientOcclusion ? 1u : 0u,
+		mAmbientOcclusionMinDist,
+		mAmbientOcclusionMaxDist,
+		mAmbientOcclusionFactor,
+		mAmbientOcclusionColor,
+		static_cast<uint32_t>(mRenderMode),
+		mHeatmapMaxCount,
+		mEnableBakedOcclusion ? 1u : 0u,
+		mLightAngularRadiusDegrees
+	};
+}
+
+void fluid_nightmare_main::set_render_settings(const render_settings& aSettings)
+{
+	mAmbientLight = aSettings.mAmbientLight;
+	mLightDir = aSettings.mLightDir;
+	mFieldOfViewForRayTracing = aSettings.mFieldOfView;
+	mEnableShadows = 0u != aSettings.mEnableShadows;
+	mShadowsFactor = aSettings.mShadowsFactor;
+	mShadowsColor = aSettings.mShadowsColor;
+	mEnableAmbientOcclusion = 0u != aSettings.mEnableAmbientOcclusion;
+	mAmbientOcclusionMinDist = aSettings.mAmbientOcclusionMinDist;
+	mAmbientOcclusionMaxDist = aSettings.mAmbientOcclusionMaxDist;
+	mAmbientOcclusionFactor = aSettings.mAmbientOcclusionFactor;
+	mAmbientOcclusionColor = aSettings.mAmbientOcclusionColor;
+	mRenderMode = static_cast<render_mode>(aSettings.mRenderMode);
+	mHeatmapMaxCount = aSettings.mHeatmapMaxCount;
+	mEnableBakedOcclusion = 0u != aSettings.mEnableBakedOcclusion;
+	mLightAngularRadiusDegrees = aSettings.mLightAngularRadiusDegrees;
+}
+
+void fluid_nightmare_main::create_tlas()
+{
+	auto* triMeshGeomMgr = gvk::current_composition()->element_by_type<triangle_mesh_geometry_manager>();
+	assert(nullptr != triMeshGeomMgr);
+	auto* procMeshGeomMgr = gvk::current_composition()->element_by_type<procedural_geometry_manager>();
+	assert(nullptr != procMeshGeomMgr);
+
+	mTlas = gvk::context().create_top_level_acceleration_structure(
+		triMeshGeomMgr->max_number_of_geometry_instances() + procMeshGeomMgr->max_number_of_geometry_instances(), // <-- Specify how many geometry instances there are expected to be at most
+		true               // <-- Allow updates since we want to have the opportunity to enable/disable some of them via the UI (triangle meshes), or add new ones (procedural geometry).
+	);
+	memory_accounting().gpu(gpu_memory_category::tlas).add(mTlas->required_acceleration_structure_size());
+}
+
+void fluid_nightmare_main::create_traversal_counters_buffer()
+{
+	// Two uints for the scene-wide totals plus padding, followed by two uints per pixel:
+	mTraversalCountersResolution = gvk::context().main_window()->resolution();
+	const size_t numPixels = static_cast<size_t>(mTraversalCountersResolution.x) * mTraversalCountersResolution.y;
+	mTraversalCountersBuffer = gvk::context().create_buffer(
+		avk::memory_usage::device, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc,
+		avk::storage_buffer_meta::create_from_size(4 * sizeof(uint32_t) + numPixels * 2 * sizeof(uint32_t))
+	);
+	memory_accounting().add(gpu_memory_category::render_targets, *mTraversalCountersBuffer);
+}
+
+void fluid_nightmare_main::create_reprojection_buffer()
+{
+	mReprojectionResolution = gvk::context().main_window()->resolution();
+	const size_t numPixels = static_cast<size_t>(mReprojectionResolution.x) * mReprojectionResolution.y;
+	mReprojectionBuffer = gvk::context().create_buffer(
+		avk::memory_usage::device, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc,
+		avk::storage_buffer_meta::create_from_size(sizeof(reprojection_frame_data) + 2 * numPixels * sizeof(reprojection_history_sample))
+	);
+	memory_accounting().add(gpu_memory_category::render_targets, *mReprojectionBuffer);
+	mReprojectionHistoryValid = false;
+}
+
+void fluid_nightmare_main::create_accumulation_buffer()
+{
+	const auto resolution = gvk::context().main_window()->resolution();
+	const size_t numPixels = static_cast<size_t>(resolution.x) * resolution.y;
+	mAccumulationBuffer = gvk::context().create_buffer(
+		avk::memory_usage::device, {},
+		avk::storage_buffer_meta::create_from_size(numPixels * sizeof(glm::vec4))
+	);
+	memory_accounting().add(gpu_memory_category::render_targets, *mAccumulationBuffer);
+	// The sums are reset by the first refinement sample => start over:
+	mRefinementSample = 0;
+}
+
+void fluid_nightmare_main::create_dirty_tiles_buffers()
+{
+	mDirtyTilesResolution = gvk::context().main_window()->resolution();
+	const size_t numTiles = static_cast<size_t>((mDirtyTilesResolution.x + cDirtyTileSize - 1) / cDirtyTileSize) * ((mDirtyTilesResolution.y + cDirtyTileSize - 1) / cDirtyTileSize);
+	const auto numFramesInFlight = gvk::context().main_window()->number_of_frames_in_flight();
+	for (decltype(numFramesInFlight) i = 0; i < numFramesInFlight; ++i) {
+		auto& buffer = mDirtyTilesBuffers.emplace_back(gvk::context().create_buffer(
+			avk::memory_usage::host_coherent, {},
+			avk::storage_buffer_meta::create_from_size(sizeof(dirty_tiles_header) + numTiles * sizeof(uint32_t))
+		));
+		memory_accounting().add(gpu_memory_category::render_targets, *buffer);
+		// The tiles are written every frame in which they are traced => keep the buffer mapped:
+		auto& mapping = mDirtyTilesMappings.emplace_back(buffer->map_memory(avk::mapping_access::write));
+		auto* mapped = static_cast<dirty_tiles_header*>(mapping.get());
+		*mapped = dirty_tiles_header{ VK_FALSE, cDirtyTileSize, 0u, 0u };
+		mDirtyTilesMapped.push_back(mapped);
+	}
+}
+
+void fluid_nightmare_main::destroy_dirty_tiles_buffers()
+{
+	mDirtyTilesMapped.clear();
+	mDirtyTilesMappings.clear();
+	for (auto& buffer : mDirtyTilesBuffers) {
+		mDescriptorCache.remove_sets_with_handle(buffer->handle());
+		memory_accounting().gpu(gpu_memory_category::render_targets).remove(memory_accountant::memory_size_of(*buffer));
+	}
+	mDirtyTilesBuffers.clear();
+}
+
+void fluid_nightmare_main::account_offscreen_image()
+{
+	const auto image = mOffscreenImageView->get_image().handle();
+	if (std::none_of(std::begin(mAccountedOffscreenImages), std::end(mAccountedOffscreenImages), [image](const auto& aEntry) { return aEntry.first == image; })) {
+		const auto size = memory_accountant::memory_size_of(image);
+		memory_accounting().gpu(gpu_memory_category::render_targets).add(size);
+		mAccountedOffscreenImages.emplace_back(image, size);
+	}
+}
+
+void fluid_nightmare_main::create_view_image(glm::uvec2 aResolution, uint32_t aNumLayers)
+{
+	mViewImageResolution = aResolution;
+	mViewImageLayers = aNumLayers;
+	auto viewImage = gvk::context().create_image(aResolution.x, aResolution.y, gvk::format_from_window_color_buffer(gvk::context().main_window()), static_cast<int>(aNumLayers), avk::memory_usage::device, avk::image_usage::general_storage_image);
+	viewImage->transition_to_layout();
+	memory_accounting().add(gpu_memory_category::render_targets, *viewImage);
+	// All the layers are accessed as one image2DArray:
+	mViewImageView = gvk::context().create_image_view(avk::owned(viewImage), {}, {}, [aNumLayers](avk::image_view_t& aImageView) {
+		aImageView.config().setViewType(vk::ImageViewType::e2DArray);
+		aImageView.config().subresourceRange.setLayerCount(aNumLayers);
+	});
+}
+
+void fluid_nightmare_main::create_multi_view_buffers()
+{
+	const auto numFramesInFlight = gvk::context().main_window()->number_of_frames_in_flight();
+	for (decltype(numFramesInFlight) i = 0; i < numFramesInFlight; ++i) {
+		auto& buffer = mMultiViewBuffers.emplace_back(gvk::context().create_buffer(
+			avk::memory_usage::host_coherent, {},
+			avk::storage_buffer_meta::create_from_size(sizeof(multi_view_data))
+		));
+		memory_accounting().add(gpu_memory_category::render_targets, *buffer);
+		// The views are written every traced frame => keep the buffer mapped:
+		auto& mapping = mMultiViewMappings.emplace_back(buffer->map_memory(avk::mapping_access::write));
+		auto* mapped = static_cast<multi_view_data*>(mapping.get());
+		*mapped = multi_view_data{ 1u };
+		mMultiViewMapped.push_back(mapped);
+	}
+}
+
+std::vector<glm::mat4> fluid_nightmare_main::view_transforms() const
+{
+	// The views are spread evenly along the camera's x axis, mViewSeparation apart, e.g. the eyes of a stereo pair for two views:
+	const glm::mat4 cameraTransform = mQuakeCam.global_transformation_matrix();
+	const auto numViews = std::clamp(mNumViews, 1, static_cast<int>(cMaxViews));
+	std::vector<glm::mat4> result;
+	result.reserve(numViews);
+	for (int i = 0; i < numViews; ++i) {
+		const float offset = (static_cast<float>(i) - 0.5f * static_cast<float>(numViews - 1)) * mViewSeparation;
+		result.push_back(glm::translate(cameraTransform, glm::vec3{ offset, 0.0f, 0.0f }));
+	}
+	return result;
+}
+
+avk::ray_tracing_pipeline fluid_nightmare_main::create_scene_rendering_pipeline(uint32_t aMaxRecursionDepth)
+{
+	auto* rayStatistics = gvk::current_composition()->element_by_type<ray_statistics>();
+	assert(nullptr != rayStatistics);
+	auto* occlusionBaker = gvk::current_composition()->element_by_type<static_occlusion_baker>();
+	assert(nullptr != occlusionBaker);
+	auto* triMeshGeomMgr = gvk::current_composition()->element_by_type<triangle_mesh_geometry_manager>();
+
+	return gvk::context().create_ray_tracing_pipeline_for(
+		// Specify all the shaders which participate in rendering in a shader binding table (the order matters):
+		// In contrast to the ray_query_in_ray_tracing_shaders example, we have multiple closest hit and also
+		// multiple miss shaders. When we send out the secondary rays (in first_hit_closest_hit_shader.rchit),
+		// we will need to specify the offsets into this table accordingly in order to use the right shaders.
+		// Every kind of ray has a hit group for triangles, followed by one for the particles (instance offset 1):
+		avk::define_shader_table(
+			avk::ray_generation_shader("shaders/scene_rendering/ray_gen_shader.rgen"),
+			avk::ray_generation_shader("shaders/scene_rendering/trace_secondary_rays.rgen"),     // Wavefront mode only
+			avk::ray_generation_shader("shaders/scene_rendering/composite_secondary_rays.rgen"), // Wavefront mode only
+			avk::triangles_hit_group::create_with_rchit_only("shaders/scene_rendering/first_hit_closest_hit_shader.rchit"),
+			avk::procedural_hit_group::create_with_rint_and_rchit("shaders/scene_rendering/rt_aabb_with_counters.rint", "shaders/scene_rendering/rt_aabb.rchit"),
+			avk::triangles_hit_group::create_with_rchit_only("shaders/scene_rendering/shadow_closest_hit_shader.rchit"),
+			avk::procedural_hit_group::create_with_rint_and_rchit("shaders/scene_rendering/rt_aabb_with_counters.rint", "shaders/scene_rendering/shadow_closest_hit_shader.rchit"),
+			avk::triangles_hit_group::create_with_rchit_only("shaders/scene_rendering/ao_closest_hit_shader.rchit"),
+			avk::procedural_hit_group::create_with_rint_and_rchit("shaders/scene_rendering/rt_aabb_with_counters.rint", "shaders/scene_rendering/ao_closest_hit_shader.rchit"),
+			avk::miss_shader("shaders/scene_rendering/first_hit_miss_shader.rmiss"),
+			avk::miss_shader("shaders/empty_miss_shader.rmiss")
+		),
+		// Primary rays trace secondary rays from their closest hit shader, unless the secondary rays are traced in separate launches:
+		aMaxRecursionDepth,
+		// Define push constants and descriptor bindings:
+		avk::push_constant_binding_data{ avk::shader_type::ray_generation | avk::shader_type::closest_hit | avk::shader_type::intersection, 0, sizeof(push_const_data_scene_rendering) },
+		avk::descriptor_binding(0, 0, triMeshGeomMgr->image_samplers()),
+		avk::descriptor_binding(0, 1, triMeshGeomMgr->material_buffer()),
+		avk::descriptor_binding(0, 2, avk::as_uniform_texel_buffer_views(triMeshGeomMgr->index_buffer_views())),
+		avk::descriptor_binding(0, 3, avk::as_uniform_texel_buffer_views(triMeshGeomMgr->tex_coords_buffer_views())),
+		avk::descriptor_binding(0, 4, avk::as_uniform_texel_buffer_views(triMeshGeomMgr->normals_buffer_views())),
+		avk::descriptor_binding(1, 0, mOffscreenImageView->as_storage_image()), // Bind the offscreen image to render into as storage image
+		avk::descriptor_binding(1, 1, mViewImageView->as_storage_image()),      // ...and the layered image for multiple views
+		avk::descriptor_binding(2, 0, mTlas),                                   // Bind the TLAS, s.t. we can trace rays against it
+		avk::descriptor_binding(3, 0, mTraversalCountersBuffer->as_storage_buffer()), // Bind the traversal cost counters
+		avk::descriptor_binding(3, 1, rayStatistics->counters_buffer()->as_storage_buffer()), // Bind the ray statistics counters
+		avk::descriptor_binding(3, 2, mReprojectionBuffer->as_storage_buffer()), // Bind the reprojection data and history
+		avk::descriptor_binding(3, 3, mAccumulationBuffer->as_storage_buffer()), // Bind the progressive refinement sums
+		avk::descriptor_binding(3, 4, mDirtyTilesBuffers[0]->as_storage_buffer()), // Bind the tiles to be traced (one buffer per frame in flight)
+		avk::descriptor_binding(3, 5, occlusionBaker->baked_occlusion_buffer()->as_storage_buffer()), // Bind the baked occlusion of the triangle mesh geometry
+		avk::descriptor_binding(3, 6, mSecondaryRaySorter.gbuffer()->as_storage_buffer()), // Bind the wavefront mode's G-buffer...
+		avk::descriptor_binding(3, 7, mSecondaryRaySorter.bins_buffer()->as_storage_buffer()), // ...the number of its sorted secondary rays...
+		avk::descriptor_binding(3, 8, mSecondaryRaySorter.sorted_rays_buffer()->as_storage_buffer()), // ...and the sorted secondary rays
+		avk::descriptor_binding(3, 9, mMultiViewBuffers[0]->as_storage_buffer()) // Bind the views' cameras (one buffer per frame in flight)
+	);
+}
+
+fluid_nightmare_main::trace_extent fluid_nightmare_main::evaluate_frame_changes(push_const_data_scene_rendering& aPushConstants, const std::vector<glm::mat4>& aViewTransforms)
+{
+	// Everything which influences the traced image is either part of the push constants, or of the views' cameras, or of the TLAS,
+	// or it is the offscreen image and the pipeline themselves (which are replaced on resize and on shader hot reloading). Material
+	// changes of triangle mesh geometry are tracked for the temporal reprojection anyway:
+	const vk::ImageView imageView = mOffscreenImageView->handle();
+	const vk::Pipeline pipeline = (static_cast<uint32_t>(secondary_ray_pass::recursive) == aPushConstants.mSecondaryRayPass ? mPipeline : mWavefrontPipeline)->handle();
+	const bool unchangedExceptTlas = imageView == mLastTracedImageView && pipeline == mLastTracedPipeline
+		&& !mTriangleMeshGeometryChanged && aViewTransforms == mLastTracedViewTransforms
+		&& 0 == std::memcmp(&aPushConstants, &mLastTracedPushConstants, sizeof(push_const_data_scene_rendering));
+	const bool idle = unchangedExceptTlas && mTlasVersion == mLastTracedTlasVersion;
+
+	if (!idle || idle_frame_mode::always_trace == mIdleFrameMode) {
+		mLastTracedPushConstants = aPushConstants;
+		mLastTracedTlasVersion = mTlasVersion;
+		mLastTracedImageView = imageView;
+		mLastTracedPipeline = pipeline;
+		mLastTracedViewTransforms = aViewTransforms;
+		mRefinementSample = 0;
+
+		// If only particles have changed, only the tiles which they might affect have to be traced. (Refinement samples
+		// have been accumulated for the whole image, and are discarded anyway. Heatmaps require every pixel to be traced,
+		// and so does the wavefront mode, whose secondary ray launches cover the whole G-buffer. Multiple views use the launch's depth.):
+		const bool wavefront = static_cast<uint32_t>(secondary_ray_pass::recursive) != aPushConstants.mSecondaryRayPass;
+		const bool multiView = !aViewTransforms.empty();
+		mDirtyTiles.clear();
+		mDirtyPixelFraction = 1.0f;
+		if (mEnableDirtyTiles && unchangedExceptTlas && !mChangedParticleBounds.empty() && render_mode::shaded == mRenderMode && !wavefront && !multiView) {
+			auto* triMeshGeomMgr = gvk::current_composition()->element_by_type<triangle_mesh_geometry_manager>();
+			const float margin = mEnableAmbientOcclusion ? mAmbientOcclusionMaxDist * std::sqrt(3.0f) : 0.0f;
+			const glm::vec3 shadowLightDir = mEnableShadows ? mLightDir : glm::vec3{ 0.0f };
+			mNumDirtyPixels = collect_dirty_tiles(mChangedParticleBounds, margin, shadowLightDir, triMeshGeomMgr->scene_bounds(),
+				mQuakeCam.global_transformation_matrix(), glm::radians(mFieldOfViewForRayTracing) * 0.5f, mDirtyTilesResolution, cDirtyTileSize, mDirtyTiles);
+			mDirtyPixelFraction = static_cast<float>(mNumDirtyPixels) / (static_cast<float>(mDirtyTilesResolution.x) * static_cast<float>(mDirtyTilesResolution.y));
+			if (mDirtyTiles.empty()) {
+				// The changed particles are out of view, and so is everything they might affect:
+				mChangedParticleBounds = bounding_box{};
+				++mIdleFrameStatistics.mSkippedFrames;
+				return trace_extent::nothing;
+			}
+			if (mDirtyPixelFraction <= mDirtyTilesMaxFraction) {
+				++mIdleFrameStatistics.mDirtyTileFrames;
+				return trace_extent::dirty_tiles;
+			}
+			mDirtyTiles.clear();
+		}
+
+		++mIdleFrameStatistics.mTracedFrames;
+		return trace_extent::whole_image;
+	}
+
+	// Refinement only changes something if there are shadows or ambient occlusion to be refined. The wavefront mode doesn't
+	// refine, since its secondary rays are traced in fixed directions and the accumulation happens before they are applied.
+	// Neither do multiple views, which would all be accumulated into the same per-pixel sums:
+	const bool refinable = render_mode::shaded == mRenderMode && (mEnableShadows || mEnableAmbientOcclusion)
+		&& static_cast<uint32_t>(secondary_ray_pass::recursive) == aPushConstants.mSecondaryRayPass && aViewTransforms.empty();
+	if (idle_frame_mode::progressive_refinement == mIdleFrameMode && refinable && mRefinementSample < static_cast<uint32_t>(std::max(mMaxRefinementSamples, 1))) {
+		aPushConstants.mRefinementSample = ++mRefinementSample;
+		++mIdleFrameStatistics.mRefinementFrames;
+		return trace_extent::whole_image;
+	}
+
+	++mIdleFrameStatistics.mSkippedFrames;
+	return trace_extent::nothing;
+}
+
+void fluid_nightmare_main::record_reprojection_frame_data(avk::command_buffer_t& aCommandBuffer, size_t aInFlightIndex, bool aAllowReuse, bool aDirtyTilesOnly)
+{
+	// This frame in flight's slot of the readback buffer has last been written when the same in-flight index has been rendered:
+	mReprojectionCountersReadbackBuffer->read(mReprojectionCounters.data(), 0, avk::sync::not_required());
+	const uint32_t retraced = mReprojectionCounters[2 * aInFlightIndex];
+	const uint32_t reused = mReprojectionCounters[2 * aInFlightIndex + 1];
+	mRetracedPixelFraction = retraced + reused > 0u ? static_cast<float>(retraced) / static_cast<float>(retraced + reused) : 1.0f;
+	mRetracedPixelFractionHistory[mRetracedPixelFractionHistoryOffset] = mRetracedPixelFraction;
+	mRetracedPixelFractionHistoryOffset = (mRetracedPixelFractionHistoryOffset + 1) % mRetracedPixelFractionHistory.size();
+
+	const glm::mat4 cameraTransform = mQuakeCam.global_transformation_matrix();
+	const auto renderSettings = get_render_settings();
+	const auto cullMask = get_cull_mask();
+
+	// The camera's motion since the previous frame: translation, and the angle of the relative rotation:
+	const float translation = glm::distance(glm::vec3{ cameraTransform[3] }, glm::vec3{ mPreviousCameraTransform[3] });
+	const glm::mat3 relativeRotation = glm::transpose(glm::mat3{ mPreviousCameraTransform }) * glm::mat3{ cameraTransform };
+	const float cosAngle = glm::clamp((relativeRotation[0][0] + relativeRotation[1][1] + relativeRotation[2][2] - 1.0f) * 0.5f, -1.0f, 1.0f);
+	const bool fastMotion = translation > mReprojectionMaxTranslation || glm::degrees(std::acos(cosAngle)) > mReprojectionMaxRotationDegrees;
+
+	// The previous frame's samples can only be reused if nothing but the camera and the particles has changed. Shading
+	// settings are compared bytewise (render_settings has no padding), and every re-bake of the baked occlusion changes
+	// the shading as well. The heatmaps require every pixel to be traced:
+	auto* occlusionBaker = gvk::current_composition()->element_by_type<static_occlusion_baker>();
+	assert(nullptr != occlusionBaker);
+	const uint64_t occlusionBakes = occlusionBaker->number_of_shadow_bakes() + occlusionBaker->number_of_ambient_occlusion_bakes();
+	const bool unchangedScene = mReprojectionHistoryValid && !mTriangleMeshGeometryChanged && cullMask == mPreviousCullMask
+		&& 0 == std::memcmp(&renderSettings, &mPreviousRenderSettings, sizeof(render_settings)) && occlusionBakes == mPreviousOcclusionBakes;
+	const bool reuse = mEnableReprojection && aAllowReuse && !aDirtyTilesOnly && render_mode::shaded == mRenderMode && unchangedScene && !fastMotion;
+	mReprojectionFellBack = mEnableReprojection && !reuse && !aDirtyTilesOnly;
+
+	reprojection_frame_data frameData{};
+	frameData.mCurrentCameraInverse = glm::inverse(cameraTransform);
+	frameData.mPreviousCameraTransform = mPreviousCameraTransform;
+	frameData.mPreviousCameraInverse = glm::inverse(mPreviousCameraTransform);
+	frameData.mChangedParticlesMin = glm::vec4{ mChangedParticleBounds.mMin, 0.0f };
+	frameData.mChangedParticlesMax = glm::vec4{ mChangedParticleBounds.mMax, 0.0f };
+	frameData.mPreviousCameraHalfFovAngle = glm::radians(mPreviousRenderSettings.mFieldOfView) * 0.5f;
+	frameData.mEnabled = reuse ? VK_TRUE : VK_FALSE;
+	// Dirty tiles update the most recently written layer (which is complete) in place, s.t. it stays complete:
+	frameData.mHistoryParity = (aDirtyTilesOnly ? mReprojectionFrameIndex - 1u : mReprojectionFrameIndex) & 1u;
+	frameData.mParticlesChanged = mChangedParticleBounds.empty() ? VK_FALSE : VK_TRUE;
+	frameData.mRefreshInterval = static_cast<uint32_t>(std::max(mReprojectionRefreshInterval, 1));
+	frameData.mFrameIndex = mReprojectionFrameIndex;
+	frameData.mRetracedPixels = 0u;
+	// The pixels outside of the dirty tiles are not even launched, but reused nonetheless:
+	frameData.mReusedPixels = aDirtyTilesOnly ? static_cast<uint32_t>(static_cast<size_t>(mReprojectionResolution.x) * mReprojectionResolution.y - mNumDirtyPixels) : 0u;
+
+	// The previous frame's shaders and counter copy must be done with the header before it is overwritten, and
+	// the previous frame's history must be visible to this frame's shaders:
+	aCommandBuffer.establish_execution_barrier(
+		avk::pipeline_stage::ray_tracing_shaders | avk::pipeline_stage::transfer, /* -> */ avk::pipeline_stage::transfer
+	);
+	aCommandBuffer.handle().updateBuffer(mReprojectionBuffer->handle(), 0, sizeof(frameData), &frameData);
+	aCommandBuffer.establish_global_memory_barrier(
+		avk::pipeline_stage::transfer | avk::pipeline_stage::ray_tracing_shaders, avk::pipeline_stage::ray_tracing_shaders,
+		avk::memory_access::transfer_write_access | avk::memory_access::shader_buffers_and_images_write_access, avk::memory_access::shader_buffers_and_images_read_access | avk::memory_access::shader_buffers_and_images_write_access
+	);
+
+	// The history which is written in this frame is valid for the next one:
+	mReprojectionHistoryValid = true;
+	mPreviousCameraTransform = cameraTransform;
+	mPreviousRenderSettings = renderSettings;
+	mPreviousCullMask = cullMask;
+	mPreviousOcclusionBakes = occlusionBakes;
+	mTriangleMeshGeometryChanged = false;
+	mChangedParticleBounds = bounding_box{};
+	if (!aDirtyTilesOnly) {
+		++mReprojectionFrameIndex;
+	}
+}
+
+[[nodiscard]] uint32_t fluid_nightmare_main::get_cull_mask() const
+{
+	// Water particles are always visible, triangle mesh geometry instances only if they are enabled in the UI:
+	auto* triMeshGeomMgr = gvk::current_composition()->element_by_type<triangle_mesh_geometry_manager>();
+	assert(nullptr != triMeshGeomMgr);
+	return triMeshGeomMgr->instance_cull_mask() | cParticlesInstanceMask;
+}
+
+int main(int argc, char** argv) // <== Starting point ==
+{
+	try {
+		// Pass "--benchmark <scenario file>" to run a benchmark scenario instead of being driven by user input:
+		// Pass "--record <log file>" to record a replay log, or "--replay <log file>" to replay one:
+		std::optional<std::string> benchmarkScenario;
+		std::optional<std::string> replayLog;
+		auto replayMode = replay_recorder::mode::none;
+		// Pass "--metrics-port <port>" to serve metrics via HTTP, and "--metrics-bind <address>" to bind to another address than localhost:
+		std::optional<uint16_t> metricsPort;
+		// Pass "--load-particles <snapshot file>" to start with the particles of a snapshot:
+		std::optional<std::string> particleSnapshot;
+		// Pass "--play-cache <simulation cache file>" to play back pre-simulated particles:
+		std::optional<std::string> simulationCache;
+		// Pass "--bridge <shared memory name>" to render the particles of an external simulator (see particle_bridge.h):
+		std::optional<std::string> particleBridge;
+		// Pass "--capture <directory>" to start capturing frames into the given directory right away:
+		std::optional<std::string> captureDirectory;
+		std::string metricsBindAddress = "127.0.0.1";
+		for (int i = 1; i + 1 < argc; ++i) {
+			if (std::string(argv[i]) == "--benchmark") {
+				benchmarkScenario = argv[i + 1];
+			}
+			else if (std::string(argv[i]) == "--record") {
+				replayLog = argv[i + 1];
+				replayMode = replay_recorder::mode::record;
+			}
+			else if (std::string(argv[i]) == "--replay") {
+				replayLog = argv[i + 1];
+				replayMode = replay_recorder::mode::replay;
+			}
+			else if (std::string(argv[i]) == "--metrics-port") {
+				// Not a number or out of range => the endpoint stays disabled:
+				const std::string_view value{ argv[i + 1] };
+				uint32_t port = 0;
+				const auto [end, errorCode] = std::from_chars(value.data(), value.data() + value.size(), port);
+				if (std::errc{} != errorCode || value.data() + value.size() != end || port < 1u || port > 65535u) {
+					LOG_ERROR(fmt::format("Invalid metrics port '{}', expected a number in 1..65535. The metrics endpoint is disabled.", value));
+					metricsPort.reset();
+				}
+				else {
+					metricsPort = static_cast<uint16_t>(port);
+				}
+			}
+			else if (std::string(argv[i]) == "--metrics-bind") {
+				metricsBindAddress = argv[i + 1];
+			}
+			else if (std::string(argv[i]) == "--load-particles") {
+				particleSnapshot = argv[i + 1];
+			}
+			else if (std::string(argv[i]) == "--play-cache") {
+				simulationCache = argv[i + 1];
+			}
+			else if (std::string(argv[i]) == "--bridge") {
+				particleBridge = argv[i + 1];
+			}
+			else if (std::string(argv[i]) == "--capture") {
+				captureDirectory = argv[i + 1];
+			}
+		}
+
+		cpu_profiler().set_current_thread_name("main thread");
+
+		// Create a window and open it:
+		auto mainWnd = gvk::context().create_window("Fluid Nightmare - Main Window");
+		mainWnd->set_resolution({ 1920, 1080 });
+		mainWnd->enable_resizing(true);
+		mainWnd->set_presentaton_mode(gvk::presentation_mode::mailbox);
+		mainWnd->set_number_of_concurrent_frames(3u);
+		mainWnd->open();
+
+		// Create one single queue to submit command buffers to:
+		auto& singleQueue = gvk::context().create_queue({}, avk::queue_selection_preference::versatile_queue, mainWnd);
+		mainWnd->add_queue_family_ownership(singleQueue);
+		mainWnd->set_present_queue(singleQueue);
+		// ... pass the queue to the constructors of the invokees:
+		
+		// All invokees are wrapped in profiled_invokee, s.t. the CPU scope profiler records
+		// their initialize(), update(), and render() calls.
+		// Create an instance of our main invokee:
+		auto mainInvokee = profiled_invokee<fluid_nightmare_main>(singleQueue);
+		// Create an instance of the invokee that handles our triangle mesh geometry:
+		auto triMeshGeomMgrInvokee = profiled_invokee<triangle_mesh_geometry_manager>();
+		// Create an instance of the invokee that handles our procedural geometry (the water particles):
+		auto procGeomMgrInvokee = profiled_invokee<procedural_geometry_manager>(singleQueue);
+		if (particleSnapshot.has_value()) {
+			procGeomMgrInvokee.request_snapshot_load(*particleSnapshot);
+		}
+		if (particleBridge.has_value()) {
+			procGeomMgrInvokee.consume_from_bridge(*particleBridge);
+		}
+		// Create another element for drawing the UI with ImGui
+		auto imguiManagerInvokee = profiled_invokee<gvk::imgui_manager>(singleQueue);
+		// Create an instance of the invokee which measures GPU times of all passes:
+		auto gpuProfilerInvokee = profiled_invokee<gpu_timestamp_profiler>(singleQueue);
+		// Create an instance of the invokee which gathers frame time telemetry:
+		auto telemetryInvokee = profiled_invokee<frame_telemetry>();
+		// Create an instance of the invokee which runs a benchmark scenario (if one has been passed):
+		auto benchmarkInvokee = profiled_invokee<benchmark_runner>(benchmarkScenario);
+		// Create an instance of the invokee which records or replays a replay log (if one has been passed):
+		auto replayInvokee = profiled_invokee<replay_recorder>(replayMode, replayLog);
+		// Create an instance of the invokee which serves metrics via HTTP (if a port has been passed):
+		auto metricsInvokee = profiled_invokee<metrics_endpoint>(metricsPort, metricsBindAddress);
+		// Create an instance of the invokee which dumps the last few seconds of frame timings on hitches:
+		auto flightRecorderInvokee = profiled_invokee<flight_recorder>();
+		// Create an instance of the invokee which plays back (and records) simulation caches:
+		auto simulationCacheInvokee = profiled_invokee<simulation_cache_player>(simulationCache);
+		// Create an instance of the invokee which exports particles on a background thread:
+		auto particleExporterInvokee = profiled_invokee<particle_exporter>();
+		// Create an instance of the invokee which counts rays and hits:
+		auto rayStatisticsInvokee = profiled_invokee<ray_statistics>(singleQueue);
+		// Create an instance of the invokee which captures frames without stalling the render thread:
+		auto frameCaptureInvokee = profiled_invokee<frame_capture>(captureDirectory);
+		// Create an instance of the invokee which bakes the occlusion by the static triangle mesh geometry:
+		auto occlusionBakerInvokee = profiled_invokee<static_occlusion_baker>(singleQueue);
+		// Create an instance of the invokee which displays the memory accounting:
+		auto memoryMonitorInvokee = profiled_invokee<memory_monitor>();
+
+		// Launch the render loop in 5.. 4.. 3.. 2.. 1.. 
+		gvk::start(
+			gvk::application_name("Fluid Nightmare"),
+			gvk::required_device_extensions()
+				// We need several extensions for ray tracing:
+				.add_extension(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME)
+				.add_extension(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME)
+				.add_extension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)
+				.add_extension(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME)
+				.add_extension(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME)
+				.add_extension(VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME)
+				// The memory accounting queries the device memory budget:
+				.add_extension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME),
+			[](vk::PhysicalDeviceVulkan12Features& aVulkan12Featues) {
+				// Also this Vulkan 1.2 feature is required for ray tracing:
+				aVulkan12Featues.setBufferDeviceAddress(VK_TRUE);
+				// The GPU profiler resets its timestamp queries from the host:
+				aVulkan12Featues.setHostQueryReset(VK_TRUE);
+			},
+			[](vk::PhysicalDeviceRayTracingPipelineFeaturesKHR& aRayTracingFeatures) {
+				// Enabling the extensions is not enough, we need to activate ray tracing features explicitly here:
+				aRayTracingFeatures.setRayTracingPipeline(VK_TRUE);
+			},
+			[](vk::PhysicalDeviceAccelerationStructureFeaturesKHR& aAccelerationStructureFeatures) {
+				// ...and here:
+				aAccelerationStructureFeatures.setAccelerationStructure(VK_TRUE);
+			},
+			// Pass our main window to render into its frame buffers:
+			mainWnd,
+			// Pass the invokees that shall be invoked every frame:
+			mainInvokee, triMeshGeomMgrInvokee, procGeomMgrInvokee, imguiManagerInvokee, gpuProfilerInvokee, telemetryInvokee, benchmarkInvokee, memoryMonitorInvokee, rayStatisticsInvokee, replayInvokee, metricsInvokee, flightRecorderInvokee, simulationCacheInvokee, particleExporterInvokee, frameCaptureInvokee, occlusionBakerInvokee
+			);
+
+		// If a CPU profile is still being recorded, dump it (while the invokees, which own some of the event names, are still alive):
+		if (cpu_profiler().is_recording()) {
+			cpu_profiler().stop_recording();
+			cpu_profiler().write_chrome_trace("cpu_trace.json");
+		}
+	}
+	catch (gvk::logic_error& e)    { LOG_ERROR(std::string("Caught gvk::logic_error in main(): ")   + e.what()); }
+	catch (gvk::runtime_error& e)  { LOG_ERROR(std::string("Caught gvk::runtime_error in main(): ") + e.what()); }
+	catch (avk::logic_error& e)    { LOG_ERROR(std::string("Caught avk::logic_error in main(): ")   + e.what()); }
+	catch (avk::runtime_error& e)  { LOG_ERROR(std::string("Caught avk::runtime_error in main(): ") + e.what()); }
+}
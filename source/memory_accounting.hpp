@@ -0,0 +1,331 @@
+#pragma once
+
+#include <gvk.hpp>
+#include <imgui.h>
+#include <imgui_internal.h>
+
+#include "preprocessor_defines.hpp"
+#include "cpu_scope_profiler.hpp"
+
+// Categories which every GPU allocation is accounted under:
+enum struct gpu_memory_category : uint32_t
+{
+	blas = 0,
+	tlas,
+	acceleration_structure_scratch,
+	tlas_instances,
+	textures,
+	vertex_data,
+	materials,
+	spawn_buffers,
+	render_targets,
+	readback_buffers,
+	profiling,
+	count
+};
+
+// Human-readable names of the gpu_memory_category entries, in the same order:
+static const char* const gpu_memory_category_names[] = {
+	"BLAS",
+	"TLAS",
+	"AS Scratch",
+	"TLAS Instances",
+	"Textures",
+	"Vertex Data",
+	"Materials",
+	"Spawn Buffers",
+	"Render Targets",
+	"Readback Buffers",
+	"Profiling"
+};
+static_assert(std::size(gpu_memory_category_names) == static_cast<size_t>(gpu_memory_category::count));
+
+// Subsystems which host allocations are accounted under:
+enum struct host_memory_subsystem : uint32_t
+{
+	triangle_meshes = 0,
+	particles,
+	profiling,
+	telemetry,
+	flight_recorder,
+	particle_export,
+	count
+};
+
+// Human-readable names of the host_memory_subsystem entries, in the same order:
+static const char* const host_memory_subsystem_names[] = {
+	"Triangle Meshes",
+	"Particles",
+	"Profiling",
+	"Telemetry",
+	"Flight Recorder",
+	"Particle Export"
+};
+static_assert(std::size(host_memory_subsystem_names) == static_cast<size_t>(host_memory_subsystem::count));
+
+// Live number of bytes and the highest number of bytes ever reached:
+class memory_counter
+{
+public:
+	void add(uint64_t aBytes)
+	{
+		const auto current = mCurrent.fetch_add(aBytes, std::memory_order_relaxed) + aBytes;
+		raise_high_water_mark(current);
+	}
+
+	void remove(uint64_t aBytes)
+	{
+		mCurrent.fetch_sub(aBytes, std::memory_order_relaxed);
+	}
+
+	void set(uint64_t aBytes)
+	{
+		mCurrent.store(aBytes, std::memory_order_relaxed);
+		raise_high_water_mark(aBytes);
+	}
+
+	// Allocations which only live for a short time (e.g., scratch buffers during a build)
+	// are not part of the live total, but they count towards the high-water mark:
+	void record_transient(uint64_t aBytes)
+	{
+		raise_high_water_mark(mCurrent.load(std::memory_order_relaxed) + aBytes);
+	}
+
+	[[nodiscard]] uint64_t current() const { return mCurrent.load(std::memory_order_relaxed); }
+	[[nodiscard]] uint64_t high_water_mark() const { return mHighWaterMark.load(std::memory_order_relaxed); }
+
+private:
+	void raise_high_water_mark(uint64_t aBytes)
+	{
+		auto hwm = mHighWaterMark.load(std::memory_order_relaxed);
+		while (aBytes > hwm && !mHighWaterMark.compare_exchange_weak(hwm, aBytes, std::memory_order_relaxed)) {}
+	}
+
+	std::atomic<uint64_t> mCurrent = 0;
+	std::atomic<uint64_t> mHighWaterMark = 0;
+};
+
+// Keeps track of all the GPU allocations (by category) and host allocations (by subsystem).
+// The owners of the allocations report them; the counters are thread-safe.
+class memory_accountant
+{
+public:
+	[[nodiscard]] memory_counter& gpu(gpu_memory_category aCategory) { return mGpuCounters[static_cast<size_t>(aCategory)]; }
+	[[nodiscard]] const memory_counter& gpu(gpu_memory_category aCategory) const { return mGpuCounters[static_cast<size_t>(aCategory)]; }
+	[[nodiscard]] memory_counter& host(host_memory_subsystem aSubsystem) { return mHostCounters[static_cast<size_t>(aSubsystem)]; }
+	[[nodiscard]] const memory_counter& host(host_memory_subsystem aSubsystem) const { return mHostCounters[static_cast<size_t>(aSubsystem)]; }
+
+	// Convenience functions which determine the sizes of Vulkan resources:
+	void add(gpu_memory_category aCategory, const avk::buffer_t& aBuffer) { gpu(aCategory).add(memory_size_of(aBuffer)); }
+	void add(gpu_memory_category aCategory, const avk::image_t& aImage) { gpu(aCategory).add(memory_size_of(aImage.handle())); }
+	void add(gpu_memory_category aCategory, const avk::image_sampler_t& aImageSampler) { gpu(aCategory).add(memory_size_of(aImageSampler.image_handle())); }
+
+	[[nodiscard]] uint64_t gpu_total() const
+	{
+		uint64_t sum = 0;
+		for (const auto& c : mGpuCounters) { sum += c.current(); }
+		return sum;
+	}
+
+	[[nodiscard]] uint64_t host_total() const
+	{
+		uint64_t sum = 0;
+		for (const auto& c : mHostCounters) { sum += c.current(); }
+		return sum;
+	}
+
+	// Highest value which the sum over all categories has reached at the time of any allocation:
+	[[nodiscard]] uint64_t gpu_total_high_water_mark() const { return mGpuTotalHighWaterMark.high_water_mark(); }
+
+	// To be invoked after a reported change, s.t. the total's high-water mark stays up to date:
+	void update_total_high_water_mark()
+	{
+		mGpuTotalHighWaterMark.set(gpu_total());
+	}
+
+	[[nodiscard]] static uint64_t memory_size_of(const avk::buffer_t& aBuffer)
+	{
+		return static_cast<uint64_t>(gvk::context().device().getBufferMemoryRequirements(aBuffer.handle()).size);
+	}
+
+	[[nodiscard]] static uint64_t memory_size_of(vk::Image aImage)
+	{
+		return static_cast<uint64_t>(gvk::context().device().getImageMemoryRequirements(aImage).size);
+	}
+
+private:
+	std::array<memory_counter, static_cast<size_t>(gpu_memory_category::count)> mGpuCounters;
+	std::array<memory_counter, static_cast<size_t>(host_memory_subsystem::count)> mHostCounters;
+	memory_counter mGpuTotalHighWaterMark;
+};
+
+// Access the one and only memory accountant:
+inline memory_accountant& memory_accounting()
+{
+	static memory_accountant sAccountant;
+	return sAccountant;
+}
+
+// Budget and usage of all device-local heaps, as reported by VK_EXT_memory_budget.
+// (The usage includes allocations of other processes, the budget is what this process may allocate.)
+struct device_memory_budget
+{
+	uint64_t mBudget = 0;
+	uint64_t mUsage = 0;
+
+	[[nodiscard]] uint64_t available() const { return mBudget > mUsage ? mBudget - mUsage : 0; }
+};
+
+// Requires VK_EXT_memory_budget to be enabled:
+inline device_memory_budget query_device_memory_budget()
+{
+	auto chain = gvk::context().physical_device().getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2, vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+	const auto& props = chain.get<vk::PhysicalDeviceMemoryProperties2>().memoryProperties;
+	const auto& budgetProps = chain.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+
+	device_memory_budget result;
+	for (uint32_t i = 0; i < props.memoryHeapCount; ++i) {
+		if (props.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal) {
+			result.mBudget += static_cast<uint64_t>(budgetProps.heapBudget[i]);
+			result.mUsage  += static_cast<uint64_t>(budgetProps.heapUsage[i]);
+		}
+	}
+	return result;
+}
+
+// Device memory which a TLAS with the given maximum number of instances requires: the acceleration
+// structure itself, its instances buffer, and the (transient) scratch buffer for a build.
+inline uint64_t estimate_tlas_memory_requirements(uint32_t aMaxNumInstances)
+{
+	auto geometry = vk::AccelerationStructureGeometryKHR{}
+		.setGeometryType(vk::GeometryTypeKHR::eInstances)
+		.setGeometry(vk::AccelerationStructureGeometryInstancesDataKHR{});
+	auto buildInfo = vk::AccelerationStructureBuildGeometryInfoKHR{}
+		.setType(vk::AccelerationStructureTypeKHR::eTopLevel)
+		.setFlags(vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate)
+		.setMode(vk::BuildAccelerationStructureModeKHR::eBuild)
+		.setGeometryCount(1u)
+		.setPGeometries(&geometry);
+	const auto sizes = gvk::context().device().getAccelerationStructureBuildSizesKHR(
+		vk::AccelerationStructureBuildTypeKHR::eDevice, buildInfo, aMaxNumInstances, gvk::context().dynamic_dispatch()
+	);
+	return static_cast<uint64_t>(sizes.accelerationStructureSize)
+		 + static_cast<uint64_t>(sizes.buildScratchSize)
+		 + static_cast<uint64_t>(aMaxNumInstances) * sizeof(VkAccelerationStructureInstanceKHR);
+}
+
+// Returns the largest number of instances, aMinNumInstances times a power of two, for which a TLAS which additionally
+// contains aNumFixedInstances fits into the given number of bytes (but at least aMinNumInstances):
+inline uint32_t max_tlas_instances_within_budget(uint32_t aNumFixedInstances, uint32_t aMinNumInstances, uint64_t aBudgetBytes)
+{
+	auto asProps = gvk::context().physical_device().getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceAccelerationStructurePropertiesKHR>();
+	const auto maxInstanceCount = asProps.get<vk::PhysicalDeviceAccelerationStructurePropertiesKHR>().maxInstanceCount;
+
+	uint64_t n = aMinNumInstances;
+	while (aNumFixedInstances + 2 * n <= std::min<uint64_t>(maxInstanceCount, std::numeric_limits<uint32_t>::max())
+		&& estimate_tlas_memory_requirements(static_cast<uint32_t>(aNumFixedInstances + 2 * n)) <= aBudgetBytes) {
+		n *= 2;
+	}
+	return static_cast<uint32_t>(n);
+}
+
+// Formats a number of bytes with a suitable unit:
+inline std::string format_bytes(uint64_t aBytes)
+{
+	if (aBytes >= (1ull << 30)) { return fmt::format("{:.2f} GiB", static_cast<double>(aBytes) / static_cast<double>(1ull << 30)); }
+	if (aBytes >= (1ull << 20)) { return fmt::format("{:.2f} MiB", static_cast<double>(aBytes) / static_cast<double>(1ull << 20)); }
+	if (aBytes >= (1ull << 10)) { return fmt::format("{:.2f} KiB", static_cast<double>(aBytes) / static_cast<double>(1ull << 10)); }
+	return fmt::format("{} B", aBytes);
+}
+
+// An invokee which displays the memory accounting in the UI and periodically queries the device's memory budget.
+class memory_monitor : public gvk::invokee
+{
+public: // v== gvk::invokee overrides which will be invoked by the framework ==v
+	memory_monitor()
+		: invokee{ 100 } // Execute after the geometry managers and the main invokee have reported their allocations
+	{}
+
+	void initialize() override
+	{
+		mBudget = query_device_memory_budget();
+
+		auto imguiManager = gvk::current_composition()->element_by_type<gvk::imgui_manager>();
+		if (nullptr != imguiManager) {
+			imguiManager->add_callback([this]() {
+				ImGui::Begin("Memory");
+				ImGui::SetWindowPos(ImVec2(1260.0f, 2.0f), ImGuiCond_FirstUseEver);
+				ImGui::SetWindowSize(ImVec2(420.0f, 400.0f), ImGuiCond_FirstUseEver);
+
+				const auto& acc = memory_accounting();
+				ImGui::Text("%-16s %12s %12s", "GPU", "Live", "High-Water");
+				for (size_t c = 0; c < static_cast<size_t>(gpu_memory_category::count); ++c) {
+					const auto& counter = acc.gpu(static_cast<gpu_memory_category>(c));
+					ImGui::Text("%-16s %12s %12s", gpu_memory_category_names[c], format_bytes(counter.current()).c_str(), format_bytes(counter.high_water_mark()).c_str());
+				}
+				ImGui::Text("%-16s %12s %12s", "Total", format_bytes(acc.gpu_total()).c_str(), format_bytes(acc.gpu_total_high_water_mark()).c_str());
+
+				ImGui::Separator();
+				ImGui::Text("Device-local budget: %s", format_bytes(mBudget.mBudget).c_str());
+				ImGui::Text("Device-local usage:  %s (all processes)", format_bytes(mBudget.mUsage).c_str());
+				if (mBudget.mBudget > 0) {
+					const float fraction = static_cast<float>(static_cast<double>(mBudget.mUsage) / static_cast<double>(mBudget.mBudget));
+					ImGui::ProgressBar(fraction, ImVec2(-1.0f, 0.0f));
+				}
+				if (mProjectedGpuBytes > 0) {
+					const bool exceeds = mProjectedGpuBytes > mBudget.mBudget;
+					ImGui::TextColored(exceeds ? ImVec4(0.9f, 0.3f, 0.0f, 1.0f) : ImVec4(0.0f, 0.9f, 0.3f, 1.0f),
+						"At max. capacity: %s", format_bytes(mProjectedGpuBytes).c_str());
+				}
+
+				ImGui::Separator();
+				ImGui::Text("%-22s %12s %12s", "Host", "Live", "High-Water");
+				for (size_t s = 0; s < static_cast<size_t>(host_memory_subsystem::count); ++s) {
+					const auto& counter = acc.host(static_cast<host_memory_subsystem>(s));
+					ImGui::Text("%-22s %12s %12s", host_memory_subsystem_names[s], format_bytes(counter.current()).c_str(), format_bytes(counter.high_water_mark()).c_str());
+				}
+				ImGui::Text("%-22s %12s", "Total", format_bytes(acc.host_total()).c_str());
+
+				ImGui::End();
+			});
+		}
+	}
+
+	void update() override
+	{
+		// Querying the budget is not free, and it changes slowly => don't do it every frame:
+		if (0 == (mFrameCount++ % cBudgetQueryInterval)) {
+			PROFILE_CPU_SCOPE("query memory budget");
+			mBudget = query_device_memory_budget();
+		}
+		memory_accounting().host(host_memory_subsystem::profiling).set(cpu_profiler().allocated_bytes());
+		memory_accounting().update_total_high_water_mark();
+	}
+
+	// Set the device memory which will be in use if all the preallocated capacities are used up.
+	// Returns false (and logs a warning) if it exceeds the remaining device memory budget.
+	bool check_projected_gpu_memory(const std::string& aWhat, uint64_t aAdditionalBytes)
+	{
+		mBudget = query_device_memory_budget();
+		mProjectedGpuBytes = memory_accounting().gpu_total() + aAdditionalBytes;
+		if (aAdditionalBytes > mBudget.available()) {
+			LOG_WARNING(fmt::format("{} requires {}, but only {} of the device-local memory budget ({}) are available.",
+				aWhat, format_bytes(aAdditionalBytes), format_bytes(mBudget.available()), format_bytes(mBudget.mBudget)));
+			return false;
+		}
+		return true;
+	}
+
+	[[nodiscard]] const device_memory_budget& latest_budget() const { return mBudget; }
+
+private:
+	// Query the memory budget every this many frames:
+	static constexpr uint64_t cBudgetQueryInterval = 30;
+
+	uint64_t mFrameCount = 0;
+	device_memory_budget mBudget;
+
+	// The device memory which is expected to be used at max. capacity:
+	uint64_t mProjectedGpuBytes = 0;
+
+}; // End of memory_monitor
@@ -0,0 +1,326 @@
+#pragma once
+
+#include <gvk.hpp>
+
+#include "preprocessor_defines.hpp"
+#include "cpu_scope_profiler.hpp"
+#include "frame_telemetry.hpp"
+#include "gpu_timestamp_profiler.hpp"
+#include "memory_accounting.hpp"
+#include "ray_statistics.hpp"
+#include "procedural_geometry_manager.hpp"
+
+#if ENABLE_METRICS_ENDPOINT
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#endif
+
+// All the values which are served by the metrics_endpoint. It only contains fixed-size members,
+// s.t. the render thread can fill it without allocating anything.
+struct metrics_snapshot
+{
+	struct metric_summary
+	{
+		uint64_t mCount;
+		float mMean, mP50, mP95, mP99, mMax;
+	};
+
+	uint64_t mFrame = 0;
+	double mUptimeSeconds = 0.0;
+	std::array<metric_summary, static_cast<size_t>(telemetry_metric_id::count)> mTelemetry{};
+	std::array<float, static_cast<size_t>(gpu_pass::count)> mGpuPassMs{};
+	uint64_t mNumParticles = 0;
+	uint64_t mParticleCapacity = 0;
+	std::array<uint64_t, static_cast<size_t>(gpu_memory_category::count)> mGpuMemoryBytes{};
+	std::array<uint64_t, static_cast<size_t>(host_memory_subsystem::count)> mHostMemoryBytes{};
+	uint64_t mDeviceMemoryBudgetBytes = 0;
+	uint64_t mDeviceMemoryUsageBytes = 0;
+	std::array<double, static_cast<size_t>(ray_counter::count)> mRayCountersPerSecond{};
+	float mRetracedPixelFraction = 1.0f;
+};
+
+// Passes snapshots from one writer thread to one reader thread without locks: There are three slots, one
+// which is written, one which is read, and one in between. Publishing and acquiring swap a slot with the
+// one in between, which is a single atomic exchange on either side.
+template <typename T>
+class triple_buffer
+{
+public:
+	// The writer fills this slot, then publishes it:
+	[[nodiscard]] T& write_slot() { return mSlots[mWriteIndex]; }
+
+	void publish()
+	{
+		mWriteIndex = mShared.exchange(mWriteIndex | cFreshBit, std::memory_order_acq_rel) & cIndexMask;
+	}
+
+	// The reader gets the most recently published slot (or the one it already had, if nothing new has been published):
+	[[nodiscard]] const T& acquire()
+	{
+		if (0u != (mShared.load(std::memory_order_relaxed) & cFreshBit)) {
+			mReadIndex = mShared.exchange(mReadIndex, std::memory_order_acq_rel) & cIndexMask;
+		}
+		return mSlots[mReadIndex];
+	}
+
+private:
+	static constexpr uint32_t cIndexMask = 0x3u;
+	static constexpr uint32_t cFreshBit = 0x4u;
+
+	std::array<T, 3> mSlots{};
+	uint32_t mWriteIndex = 0u;
+	std::atomic<uint32_t> mShared = 1u;
+	uint32_t mReadIndex = 2u;
+};
+
+// An invokee which serves the telemetry, particle, memory, and ray statistics in the Prometheus text exposition
+// format via HTTP (GET /metrics), s.t. long-running installations can be monitored from outside. The server runs
+// on a background thread; the render thread only fills and publishes a snapshot per frame, without taking locks.
+// It binds to localhost unless another address is passed. If no port is passed, it does nothing.
+class metrics_endpoint : public gvk::invokee
+{
+public: // v== gvk::invokee overrides which will be invoked by the framework ==v
+	metrics_endpoint(std::optional<uint16_t> aPort, std::string aBindAddress = "127.0.0.1")
+		: invokee{ std::numeric_limits<int>::max() - 2 } // Execute AFTER all the invokees whose values are being published
+		, mPort{ aPort }
+		, mBindAddress{ std::move(aBindAddress) }
+	{}
+
+	void initialize() override
+	{
+#if ENABLE_METRICS_ENDPOINT
+		if (!mPort.has_value()) {
+			disable();
+			return;
+		}
+		mStartTime = std::chrono::steady_clock::now();
+		mServerThread = std::thread([this]() { serve(); });
+#else
+		if (mPort.has_value()) {
+			LOG_WARNING("A metrics port has been passed, but the metrics endpoint has been compiled out (see ENABLE_METRICS_ENDPOINT).");
+		}
+		disable();
+#endif
+	}
+
+	void render() override
+	{
+		auto& s = mSnapshots.write_slot();
+		s.mFrame = ++mFrame;
+		s.mUptimeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - mStartTime).count();
+
+		auto* telemetry = gvk::current_composition()->element_by_type<frame_telemetry>();
+		for (size_t i = 0; nullptr != telemetry && i < s.mTelemetry.size(); ++i) {
+			const auto& m = telemetry->metric(static_cast<telemetry_metric_id>(i));
+			s.mTelemetry[i] = metrics_snapshot::metric_summary{ m.count(), m.mean(), m.p50(), m.p95(), m.p99(), m.max() };
+		}
+		auto* gpuProfiler = gvk::current_composition()->element_by_type<gpu_timestamp_profiler>();
+		if (nullptr != gpuProfiler) {
+			s.mGpuPassMs = gpuProfiler->latest_timings();
+		}
+		auto* procGeomMgr = gvk::current_composition()->element_by_type<procedural_geometry_manager>();
+		if (nullptr != procGeomMgr) {
+			s.mNumParticles = procGeomMgr->number_of_particles();
+			s.mParticleCapacity = procGeomMgr->max_number_of_geometry_instances();
+		}
+		for (size_t c = 0; c < s.mGpuMemoryBytes.size(); ++c) {
+			s.mGpuMemoryBytes[c] = memory_accounting().gpu(static_cast<gpu_memory_category>(c)).current();
+		}
+		for (size_t h = 0; h < s.mHostMemoryBytes.size(); ++h) {
+			s.mHostMemoryBytes[h] = memory_accounting().host(static_cast<host_memory_subsystem>(h)).current();
+		}
+		auto* memoryMonitor = gvk::current_composition()->element_by_type<memory_monitor>();
+		if (nullptr != memoryMonitor) {
+			s.mDeviceMemoryBudgetBytes = memoryMonitor->latest_budget().mBudget;
+			s.mDeviceMemoryUsageBytes = memoryMonitor->latest_budget().mUsage;
+		}
+		auto* rayStatistics = gvk::current_composition()->element_by_type<ray_statistics>();
+		for (size_t r = 0; nullptr != rayStatistics && r < s.mRayCountersPerSecond.size(); ++r) {
+			s.mRayCountersPerSecond[r] = rayStatistics->per_second(static_cast<ray_counter>(r));
+		}
+		auto* mainInvokee = gvk::current_composition()->element_by_type<fluid_nightmare_main>();
+		if (nullptr != mainInvokee) {
+			s.mRetracedPixelFraction = mainInvokee->retraced_pixel_fraction();
+		}
+		mSnapshots.publish();
+	}
+
+	void finalize() override
+	{
+		mStopRequested = true;
+		if (mServerThread.joinable()) {
+			mServerThread.join();
+		}
+	}
+
+	// Formats a snapshot in the Prometheus text exposition format (version 0.0.4):
+	[[nodiscard]] static std::string to_prometheus_text(const metrics_snapshot& aSnapshot)
+	{
+		std::string text;
+		auto out = std::back_inserter(text);
+
+		fmt::format_to(out, "# HELP fluid_nightmare_frames_total Number of rendered frames.\n# TYPE fluid_nightmare_frames_total counter\n");
+		fmt::format_to(out, "fluid_nightmare_frames_total {}\n", aSnapshot.mFrame);
+		fmt::format_to(out, "# HELP fluid_nightmare_uptime_seconds Time since the metrics endpoint has been started.\n# TYPE fluid_nightmare_uptime_seconds gauge\n");
+		fmt::format_to(out, "fluid_nightmare_uptime_seconds {:.3f}\n", aSnapshot.mUptimeSeconds);
+
+		fmt::format_to(out, "# HELP fluid_nightmare_time_milliseconds Frame and pass times, as tracked by the frame telemetry.\n# TYPE fluid_nightmare_time_milliseconds summary\n");
+		for (size_t i = 0; i < aSnapshot.mTelemetry.size(); ++i) {
+			const auto label = to_label_value(telemetry_metric_names[i]);
+			const auto& m = aSnapshot.mTelemetry[i];
+			fmt::format_to(out, "fluid_nightmare_time_milliseconds{{metric=\"{}\",quantile=\"0.5\"}} {:.4f}\n", label, m.mP50);
+			fmt::format_to(out, "fluid_nightmare_time_milliseconds{{metric=\"{}\",quantile=\"0.95\"}} {:.4f}\n", label, m.mP95);
+			fmt::format_to(out, "fluid_nightmare_time_milliseconds{{metric=\"{}\",quantile=\"0.99\"}} {:.4f}\n", label, m.mP99);
+			fmt::format_to(out, "fluid_nightmare_time_milliseconds_sum{{metric=\"{}\"}} {:.4f}\n", label, static_cast<double>(m.mMean) * static_cast<double>(m.mCount));
+			fmt::format_to(out, "fluid_nightmare_time_milliseconds_count{{metric=\"{}\"}} {}\n", label, m.mCount);
+		}
+		fmt::format_to(out, "# HELP fluid_nightmare_time_max_milliseconds Maximum frame and pass times since the telemetry has been reset.\n# TYPE fluid_nightmare_time_max_milliseconds gauge\n");
+		for (size_t i = 0; i < aSnapshot.mTelemetry.size(); ++i) {
+			fmt::format_to(out, "fluid_nightmare_time_max_milliseconds{{metric=\"{}\"}} {:.4f}\n", to_label_value(telemetry_metric_names[i]), aSnapshot.mTelemetry[i].mMax);
+		}
+
+		fmt::format_to(out, "# HELP fluid_nightmare_gpu_pass_milliseconds Most recent GPU time per pass.\n# TYPE fluid_nightmare_gpu_pass_milliseconds gauge\n");
+		for (size_t p = 0; p < aSnapshot.mGpuPassMs.size(); ++p) {
+			fmt::format_to(out, "fluid_nightmare_gpu_pass_milliseconds{{pass=\"{}\"}} {:.4f}\n", to_label_value(gpu_pass_names[p]), aSnapshot.mGpuPassMs[p]);
+		}
+
+		fmt::format_to(out, "# HELP fluid_nightmare_particles Number of water particles.\n# TYPE fluid_nightmare_particles gauge\n");
+		fmt::format_to(out, "fluid_nightmare_particles {}\n", aSnapshot.mNumParticles);
+		fmt::format_to(out, "# HELP fluid_nightmare_particle_capacity Number of particles which fit into the currently allocated buffers.\n# TYPE fluid_nightmare_particle_capacity gauge\n");
+		fmt::format_to(out, "fluid_nightmare_particle_capacity {}\n", aSnapshot.mParticleCapacity);
+
+		fmt::format_to(out, "# HELP fluid_nightmare_gpu_memory_bytes Accounted GPU memory per category.\n# TYPE fluid_nightmare_gpu_memory_bytes gauge\n");
+		for (size_t c = 0; c < aSnapshot.mGpuMemoryBytes.size(); ++c) {
+			fmt::format_to(out, "fluid_nightmare_gpu_memory_bytes{{category=\"{}\"}} {}\n", to_label_value(gpu_memory_category_names[c]), aSnapshot.mGpuMemoryBytes[c]);
+		}
+		fmt::format_to(out, "# HELP fluid_nightmare_host_memory_bytes Accounted host memory per subsystem.\n# TYPE fluid_nightmare_host_memory_bytes gauge\n");
+		for (size_t h = 0; h < aSnapshot.mHostMemoryBytes.size(); ++h) {
+			fmt::format_to(out, "fluid_nightmare_host_memory_bytes{{subsystem=\"{}\"}} {}\n", to_label_value(host_memory_subsystem_names[h]), aSnapshot.mHostMemoryBytes[h]);
+		}
+		fmt::format_to(out, "# HELP fluid_nightmare_device_memory_budget_bytes Device-local memory budget and usage, as reported by the driver.\n# TYPE fluid_nightmare_device_memory_budget_bytes gauge\n");
+		fmt::format_to(out, "fluid_nightmare_device_memory_budget_bytes{{kind=\"budget\"}} {}\n", aSnapshot.mDeviceMemoryBudgetBytes);
+		fmt::format_to(out, "fluid_nightmare_device_memory_budget_bytes{{kind=\"usage\"}} {}\n", aSnapshot.mDeviceMemoryUsageBytes);
+
+		fmt::format_to(out, "# HELP fluid_nightmare_rays_per_second Rays, hits, and intersection tests per second.\n# TYPE fluid_nightmare_rays_per_second gauge\n");
+		for (size_t r = 0; r < aSnapshot.mRayCountersPerSecond.size(); ++r) {
+			fmt::format_to(out, "fluid_nightmare_rays_per_second{{counter=\"{}\"}} {:.1f}\n", to_label_value(ray_counter_names[r]), aSnapshot.mRayCountersPerSecond[r]);
+		}
+		fmt::format_to(out, "# HELP fluid_nightmare_retraced_pixel_fraction Fraction of the pixels whose primary rays have been traced instead of reprojected.\n# TYPE fluid_nightmare_retraced_pixel_fraction gauge\n");
+		fmt::format_to(out, "fluid_nightmare_retraced_pixel_fraction {:.4f}\n", aSnapshot.mRetracedPixelFraction);
+		return text;
+	}
+
+private:
+	// Turns a human-readable name into a label value like "gpu_frame":
+	[[nodiscard]] static std::string to_label_value(const char* aName)
+	{
+		std::string result;
+		for (const char* c = aName; '\0' != *c; ++c) {
+			if (std::isalnum(static_cast<unsigned char>(*c))) {
+				result.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(*c))));
+			}
+			else if (!result.empty() && '_' != result.back()) {
+				result.push_back('_');
+			}
+		}
+		while (!result.empty() && '_' == result.back()) {
+			result.pop_back();
+		}
+		return result;
+	}
+
+#if ENABLE_METRICS_ENDPOINT
+	// The server thread's loop. Requests are handled one after the other, which is plenty for a scraper every few seconds.
+	void serve()
+	{
+		cpu_profiler().set_current_thread_name("metrics endpoint");
+
+		WSADATA wsaData{};
+		if (0 != WSAStartup(MAKEWORD(2, 2), &wsaData)) {
+			LOG_ERROR("Unable to initialize Winsock for the metrics endpoint.");
+			return;
+		}
+
+		SOCKET listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(*mPort);
+		if (INVALID_SOCKET == listenSocket
+			|| 1 != inet_pton(AF_INET, mBindAddress.c_str(), &address.sin_addr)
+			|| SOCKET_ERROR == bind(listenSocket, reinterpret_cast<const sockaddr*>(&address), sizeof(address))
+			|| SOCKET_ERROR == listen(listenSocket, SOMAXCONN)) {
+			LOG_ERROR(fmt::format("Unable to serve metrics on {}:{}.", mBindAddress, *mPort));
+			if (INVALID_SOCKET != listenSocket) { closesocket(listenSocket); }
+			WSACleanup();
+			return;
+		}
+		LOG_INFO(fmt::format("Serving metrics on http://{}:{}/metrics", mBindAddress, *mPort));
+
+		while (!mStopRequested) {
+			// Wait for connections with a timeout, s.t. a stop request is noticed quickly:
+			fd_set readSet;
+			FD_ZERO(&readSet);
+			FD_SET(listenSocket, &readSet);
+			timeval timeout{ 0, 200000 };
+			if (select(0, &readSet, nullptr, nullptr, &timeout) <= 0) {
+				continue;
+			}
+			SOCKET client = accept(listenSocket, nullptr, nullptr);
+			if (INVALID_SOCKET == client) {
+				continue;
+			}
+			handle_request(client);
+			closesocket(client);
+		}
+
+		closesocket(listenSocket);
+		WSACleanup();
+	}
+
+	void handle_request(SOCKET aClient)
+	{
+		// Read until the end of the request header; the body (if any) is of no interest:
+		const DWORD receiveTimeoutMs = 1000;
+		setsockopt(aClient, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&receiveTimeoutMs), sizeof(receiveTimeoutMs));
+		std::string request;
+		std::array<char, 1024> chunk{};
+		while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+			const int received = recv(aClient, chunk.data(), static_cast<int>(chunk.size()), 0);
+			if (received <= 0) {
+				break;
+			}
+			request.append(chunk.data(), static_cast<size_t>(received));
+		}
+
+		std::string response;
+		if (0 == request.rfind("GET /metrics ", 0) || 0 == request.rfind("GET /metrics?", 0)) {
+			const auto body = to_prometheus_text(mSnapshots.acquire());
+			response = fmt::format("HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: {}\r\nConnection: close\r\n\r\n{}", body.size(), body);
+		}
+		else {
+			response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+		}
+		size_t sent = 0;
+		while (sent < response.size()) {
+			const int n = send(aClient, response.data() + sent, static_cast<int>(response.size() - sent), 0);
+			if (n <= 0) {
+				break;
+			}
+			sent += static_cast<size_t>(n);
+		}
+	}
+#endif
+
+	std::optional<uint16_t> mPort;
+	std::string mBindAddress;
+
+	// Written by the render thread, read by the server thread:
+	triple_buffer<metrics_snapshot> mSnapshots;
+	uint64_t mFrame = 0;
+	std::chrono::steady_clock::time_point mStartTime = std::chrono::steady_clock::now();
+
+	std::thread mServerThread;
+	std::atomic<bool> mStopRequested = false;
+
+}; // End of metrics_endpoint
@@ -0,0 +1,212 @@
+#pragma once
+
+/*
+ * A shared-memory bridge which lets an external simulator (the producer) hand particle frames to Fluid Nightmare
+ * (the consumer) without copying them through pipes or sockets. This header is plain C, s.t. it can be used by
+ * simulators written in C, C++, or anything with a C FFI.
+ *
+ * The shared memory consists of a fn_bridge_header, followed by mNumSlots slots. Every slot consists of a
+ * fn_bridge_slot, followed by mMaxParticles particles of 4 floats each: the position (xyz) and the radius (w).
+ *
+ * The protocol is lock-free for one producer and one consumer, and the consumer always gets the newest complete frame:
+ *  - The producer writes a frame into a slot which is neither the published one nor the one the consumer is reading,
+ *    and then publishes it by atomically exchanging mPublished (which holds the frame's sequence number and slot).
+ *  - The consumer claims the published slot by storing it in mReadingSlot, and then checks that mPublished hasn't
+ *    changed in the meantime (otherwise it tries again). The claimed slot is not written until the consumer releases it.
+ * With at least three slots, the producer never has to wait for the consumer, and frames which the consumer is too
+ * slow to pick up are simply overwritten.
+ *
+ * Producer usage:
+ *   fn_bridge bridge;
+ *   fn_bridge_create(&bridge, FN_BRIDGE_DEFAULT_NAME, maxParticles, 3);
+ *   every frame: float* particles = fn_bridge_begin_frame(&bridge); ...write them...; fn_bridge_end_frame(&bridge, count, time);
+ *   fn_bridge_close(&bridge);
+ *
+ * Consumer usage:
+ *   fn_bridge_open(&bridge, FN_BRIDGE_DEFAULT_NAME);
+ *   every frame: const float* particles = fn_bridge_acquire(&bridge, &sequence, &count); ...read them...; fn_bridge_release(&bridge);
+ */
+
+#include <windows.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FN_BRIDGE_MAGIC           0x42504E46u /* "FNPB" */
+#define FN_BRIDGE_VERSION         1u
+#define FN_BRIDGE_DEFAULT_NAME    "Local\\FluidNightmareParticleBridge"
+#define FN_BRIDGE_MIN_SLOTS       3u
+#define FN_BRIDGE_NO_SLOT         (-1)
+
+#define FN_BRIDGE_OK                  0
+#define FN_BRIDGE_ERROR_ARGUMENTS     1
+#define FN_BRIDGE_ERROR_MAPPING       2
+#define FN_BRIDGE_ERROR_INCOMPATIBLE  3
+
+typedef struct fn_bridge_header
+{
+	uint32_t mMagic;
+	uint32_t mVersion;
+	uint32_t mNumSlots;
+	uint32_t mMaxParticles;
+	uint64_t mSlotStride;          /* In bytes, from one fn_bridge_slot to the next */
+	volatile LONG64 mPublished;    /* (sequence << 8) | slot of the newest complete frame; 0 before the first frame */
+	volatile LONG mReadingSlot;    /* The slot which the consumer is currently reading, or FN_BRIDGE_NO_SLOT */
+	uint32_t mReserved[7];         /* Pads the header to 64 bytes */
+} fn_bridge_header;
+
+typedef struct fn_bridge_slot
+{
+	uint64_t mSequence;            /* Starts at 1 and increases with every published frame */
+	uint32_t mNumParticles;
+	uint32_t mReserved0;
+	double mSimulationTime;        /* In seconds, for information only */
+	uint64_t mReserved1[5];        /* Pads the slot header to 64 bytes, s.t. the particles are cache-line aligned */
+} fn_bridge_slot;
+
+/* A handle to the shared memory, for either side: */
+typedef struct fn_bridge
+{
+	HANDLE mMapping;
+	fn_bridge_header* mHeader;
+	uint64_t mSequence;            /* The producer's last published, or the consumer's last acquired sequence number */
+	LONG mSlot;                    /* The producer's slot which is being written, or the consumer's claimed slot */
+} fn_bridge;
+
+static __inline fn_bridge_slot* fn_bridge_slot_at(const fn_bridge* aBridge, LONG aSlot)
+{
+	return (fn_bridge_slot*)((uint8_t*)aBridge->mHeader + sizeof(fn_bridge_header) + (uint64_t)aSlot * aBridge->mHeader->mSlotStride);
+}
+
+static __inline void fn_bridge_close(fn_bridge* aBridge)
+{
+	if (NULL != aBridge->mHeader) { UnmapViewOfFile(aBridge->mHeader); }
+	if (NULL != aBridge->mMapping) { CloseHandle(aBridge->mMapping); }
+	aBridge->mMapping = NULL;
+	aBridge->mHeader = NULL;
+	aBridge->mSequence = 0;
+	aBridge->mSlot = FN_BRIDGE_NO_SLOT;
+}
+
+/* ---------------------------------------------- Producer ---------------------------------------------- */
+
+/* Creates the shared memory for frames of up to aMaxParticles particles. Returns FN_BRIDGE_OK on success. */
+static __inline int fn_bridge_create(fn_bridge* aBridge, const char* aName, uint32_t aMaxParticles, uint32_t aNumSlots)
+{
+	uint64_t slotStride, totalSize;
+	int existed;
+	aBridge->mMapping = NULL;
+	aBridge->mHeader = NULL;
+	fn_bridge_close(aBridge);
+	if (NULL == aName || 0 == aMaxParticles || aNumSlots < FN_BRIDGE_MIN_SLOTS || aNumSlots > 255) {
+		return FN_BRIDGE_ERROR_ARGUMENTS;
+	}
+
+	slotStride = sizeof(fn_bridge_slot) + (uint64_t)aMaxParticles * 4u * sizeof(float);
+	totalSize = sizeof(fn_bridge_header) + slotStride * aNumSlots;
+	aBridge->mMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(totalSize >> 32), (DWORD)(totalSize & 0xFFFFFFFFu), aName);
+	existed = ERROR_ALREADY_EXISTS == GetLastError();
+	aBridge->mHeader = NULL != aBridge->mMapping ? (fn_bridge_header*)MapViewOfFile(aBridge->mMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0) : NULL;
+	if (NULL == aBridge->mHeader) {
+		fn_bridge_close(aBridge);
+		return FN_BRIDGE_ERROR_MAPPING;
+	}
+
+	/* A consumer may still hold the memory of a previous producer, which can only be reused if it has the same layout: */
+	if (existed && (FN_BRIDGE_MAGIC != aBridge->mHeader->mMagic || aBridge->mHeader->mNumSlots != aNumSlots || aBridge->mHeader->mMaxParticles != aMaxParticles)) {
+		fn_bridge_close(aBridge);
+		return FN_BRIDGE_ERROR_INCOMPATIBLE;
+	}
+	aBridge->mHeader->mVersion = FN_BRIDGE_VERSION;
+	aBridge->mHeader->mNumSlots = aNumSlots;
+	aBridge->mHeader->mMaxParticles = aMaxParticles;
+	aBridge->mHeader->mSlotStride = slotStride;
+	InterlockedExchange64(&aBridge->mHeader->mPublished, 0);
+	if (!existed) {
+		InterlockedExchange(&aBridge->mHeader->mReadingSlot, FN_BRIDGE_NO_SLOT);
+	}
+	/* The magic number comes last, s.t. a consumer never sees a half-initialized header: */
+	InterlockedExchange((volatile LONG*)&aBridge->mHeader->mMagic, (LONG)FN_BRIDGE_MAGIC);
+	return FN_BRIDGE_OK;
+}
+
+/* Returns the particles (4 floats each) of a slot which can be written, up to mMaxParticles of them: */
+static __inline float* fn_bridge_begin_frame(fn_bridge* aBridge)
+{
+	const LONG published = (LONG)(InterlockedOr64(&aBridge->mHeader->mPublished, 0) & 0xFF);
+	const LONG reading = InterlockedOr(&aBridge->mHeader->mReadingSlot, 0);
+	LONG slot = (aBridge->mSlot + 1) % (LONG)aBridge->mHeader->mNumSlots;
+	while (slot == reading || (0 != aBridge->mSequence && slot == published)) {
+		slot = (slot + 1) % (LONG)aBridge->mHeader->mNumSlots;
+	}
+	aBridge->mSlot = slot;
+	return (float*)(fn_bridge_slot_at(aBridge, slot) + 1);
+}
+
+/* Publishes the frame which has been written since fn_bridge_begin_frame: */
+static __inline void fn_bridge_end_frame(fn_bridge* aBridge, uint32_t aNumParticles, double aSimulationTime)
+{
+	fn_bridge_slot* slot = fn_bridge_slot_at(aBridge, aBridge->mSlot);
+	slot->mSequence = ++aBridge->mSequence;
+	slot->mNumParticles = aNumParticles < aBridge->mHeader->mMaxParticles ? aNumParticles : aBridge->mHeader->mMaxParticles;
+	slot->mSimulationTime = aSimulationTime;
+	InterlockedExchange64(&aBridge->mHeader->mPublished, (LONG64)((aBridge->mSequence << 8) | (uint64_t)aBridge->mSlot));
+}
+
+/* ---------------------------------------------- Consumer ---------------------------------------------- */
+
+/* Opens the shared memory of a running producer. Returns FN_BRIDGE_OK on success. */
+static __inline int fn_bridge_open(fn_bridge* aBridge, const char* aName)
+{
+	aBridge->mMapping = NULL;
+	aBridge->mHeader = NULL;
+	fn_bridge_close(aBridge);
+	aBridge->mMapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, aName);
+	aBridge->mHeader = NULL != aBridge->mMapping ? (fn_bridge_header*)MapViewOfFile(aBridge->mMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0) : NULL;
+	if (NULL == aBridge->mHeader) {
+		fn_bridge_close(aBridge);
+		return FN_BRIDGE_ERROR_MAPPING;
+	}
+	if (FN_BRIDGE_MAGIC != (uint32_t)InterlockedOr((volatile LONG*)&aBridge->mHeader->mMagic, 0) || FN_BRIDGE_VERSION != aBridge->mHeader->mVersion) {
+		fn_bridge_close(aBridge);
+		return FN_BRIDGE_ERROR_INCOMPATIBLE;
+	}
+	return FN_BRIDGE_OK;
+}
+
+/* Claims the newest complete frame and returns its particles, or NULL if nothing has been published yet.
+ * The particles remain valid until fn_bridge_release is called. */
+static __inline const float* fn_bridge_acquire(fn_bridge* aBridge, uint64_t* aSequence, uint32_t* aNumParticles)
+{
+	LONG64 published = InterlockedOr64(&aBridge->mHeader->mPublished, 0);
+	for (;;) {
+		LONG64 check;
+		if (0 == published) {
+			return NULL;
+		}
+		InterlockedExchange(&aBridge->mHeader->mReadingSlot, (LONG)(published & 0xFF));
+		check = InterlockedOr64(&aBridge->mHeader->mPublished, 0);
+		if (check == published) {
+			break;
+		}
+		published = check; /* A newer frame has been published in the meantime */
+	}
+	aBridge->mSlot = (LONG)(published & 0xFF);
+	aBridge->mSequence = (uint64_t)published >> 8;
+	*aSequence = aBridge->mSequence;
+	*aNumParticles = fn_bridge_slot_at(aBridge, aBridge->mSlot)->mNumParticles;
+	return (const float*)(fn_bridge_slot_at(aBridge, aBridge->mSlot) + 1);
+}
+
+/* Releases the frame which has been claimed by fn_bridge_acquire, s.t. the producer may write it again: */
+static __inline void fn_bridge_release(fn_bridge* aBridge)
+{
+	InterlockedExchange(&aBridge->mHeader->mReadingSlot, FN_BRIDGE_NO_SLOT);
+	aBridge->mSlot = FN_BRIDGE_NO_SLOT;
+}
+
+#ifdef __cplusplus
+}
+#endif
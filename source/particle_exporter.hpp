@@ -0,0 +1,291 @@
+#pragma once
+
+#include <gvk.hpp>
+#include <imgui.h>
+#include <imgui_internal.h>
+#include <filesystem>
+
+#include "preprocessor_defines.hpp"
+#include "cpu_scope_profiler.hpp"
+#include "memory_accounting.hpp"
+#include "procedural_geometry_manager.hpp"
+
+#if ENABLE_VDB_EXPORT
+#include <openvdb/openvdb.h>
+#endif
+
+// The file formats which the particle_exporter can write (bit flags):
+namespace particle_export_format
+{
+	// Binary little-endian PLY with x, y, z, and radius per vertex, which Blender and most DCC tools can import:
+	static constexpr uint32_t ply    = 1u << 0;
+	// A self-describing binary point file modeled after Houdini's geometry files, see write_points():
+	static constexpr uint32_t points = 1u << 1;
+	// An OpenVDB file with a density grid which the particles are splatted into (requires ENABLE_VDB_EXPORT):
+	static constexpr uint32_t vdb    = 1u << 2;
+}
+
+// An invokee which exports the particles of every n-th frame into files on a background writer thread. The render
+// thread only copies the particles into one of a fixed number of preallocated slots (i.e. a memcpy) and publishes
+// it. If all slots are still waiting to be written, the frame is dropped rather than stalling the render thread.
+class particle_exporter : public gvk::invokee
+{
+public: // v== gvk::invokee overrides which will be invoked by the framework ==v
+	particle_exporter()
+		: invokee{ std::numeric_limits<int>::max() - 3 } // Execute AFTER the procedural_geometry_manager has spawned the current frame's particles
+	{}
+
+	void initialize() override
+	{
+		for (uint32_t i = 0; i < cNumSlots; ++i) {
+			mFreeSlots.push_back(i);
+		}
+		mWriterThread = std::thread([this]() { write_exports(); });
+
+		auto imguiManager = gvk::current_composition()->element_by_type<gvk::imgui_manager>();
+		if (nullptr != imguiManager) {
+			imguiManager->add_callback([this]() {
+				ImGui::Begin("Particle Export");
+				ImGui::SetWindowPos(ImVec2(422.0f, 480.0f), ImGuiCond_FirstUseEver);
+				ImGui::SetWindowSize(ImVec2(402.0f, 220.0f), ImGuiCond_FirstUseEver);
+				ImGui::Checkbox("Export", &mExporting);
+				ImGui::InputText("Directory", mDirectory.data(), mDirectory.size());
+				ImGui::SliderInt("Every n-th Frame", &mInterval, 1, 60);
+				ImGui::CheckboxFlags("PLY", &mFormats, particle_export_format::ply);
+				ImGui::SameLine();
+				ImGui::CheckboxFlags("Points", &mFormats, particle_export_format::points);
+#if ENABLE_VDB_EXPORT
+				ImGui::SameLine();
+				ImGui::CheckboxFlags("VDB Density", &mFormats, particle_export_format::vdb);
+				ImGui::SliderFloat("Voxel Size", &mVoxelSize, 0.05f, 2.0f);
+#endif
+				ImGui::Text("%u written, %u dropped, %u pending", mNumWritten.load(std::memory_order_relaxed), mNumDropped, cNumSlots - static_cast<uint32_t>(free_slot_count()));
+				ImGui::End();
+			});
+		}
+	}
+
+	void render() override
+	{
+		const auto frame = mFrame++;
+		if (!mExporting || 0 != frame % static_cast<uint64_t>(std::max(mInterval, 1))) {
+			return;
+		}
+		auto* procGeomMgr = gvk::current_composition()->element_by_type<procedural_geometry_manager>();
+		assert(nullptr != procGeomMgr);
+
+		std::optional<uint32_t> slotIndex;
+		{
+			std::lock_guard<std::mutex> guard(mMutex);
+			if (!mFreeSlots.empty()) {
+				slotIndex = mFreeSlots.front();
+				mFreeSlots.pop_front();
+			}
+		}
+		if (!slotIndex.has_value()) {
+			++mNumDropped;
+			return;
+		}
+
+		PROFILE_CPU_SCOPE("publish particle export");
+		auto& slot = mSlots[*slotIndex];
+		const auto& particles = procGeomMgr->particles();
+		const auto previousCapacity = slot.mParticles.capacity();
+		slot.mParticles.assign(std::begin(particles), std::end(particles)); // Reuses the slot's storage once it is large enough
+		memory_accounting().host(host_memory_subsystem::particle_export).add((slot.mParticles.capacity() - previousCapacity) * sizeof(glm::vec4));
+		slot.mFrame = frame;
+		slot.mFormats = mFormats;
+		slot.mVoxelSize = mVoxelSize;
+		slot.mDirectory = std::string(mDirectory.data());
+		{
+			std::lock_guard<std::mutex> guard(mMutex);
+			mPublishedSlots.push_back(*slotIndex);
+		}
+		mCondition.notify_one();
+	}
+
+	void finalize() override
+	{
+		{
+			std::lock_guard<std::mutex> guard(mMutex);
+			mStopRequested = true;
+		}
+		mCondition.notify_one();
+		if (mWriterThread.joinable()) {
+			mWriterThread.join();
+		}
+		for (const auto& slot : mSlots) {
+			memory_accounting().host(host_memory_subsystem::particle_export).remove(slot.mParticles.capacity() * sizeof(glm::vec4));
+		}
+	}
+
+	void set_exporting(bool aEnabled) { mExporting = aEnabled; }
+
+	// Writes the particles as binary PLY:
+	static void write_ply(const std::string& aFilePath, const std::vector<glm::vec4>& aParticles)
+	{
+		std::ofstream file(aFilePath, std::ios::binary);
+		if (!file.is_open()) {
+			LOG_WARNING(fmt::format("Unable to open '{}' for exporting particles.", aFilePath));
+			return;
+		}
+		file << "ply\nformat binary_little_endian 1.0\ncomment exported by Fluid Nightmare\n"
+			<< "element vertex " << aParticles.size() << "\n"
+			<< "property float x\nproperty float y\nproperty float z\nproperty float radius\nend_header\n";
+		// The vertex layout matches glm::vec4 exactly:
+		file.write(reinterpret_cast<const char*>(aParticles.data()), static_cast<std::streamsize>(aParticles.size() * sizeof(glm::vec4)));
+	}
+
+	// Writes the particles into a binary point file, which consists of:
+	//   char[4]  "FNPT"
+	//   uint32_t version (1)
+	//   uint64_t number of points
+	//   uint32_t number of attributes
+	//   per attribute: char[16] name, uint32_t number of float components
+	//   per attribute: all of its values, point after point
+	// The attributes are named after Houdini's conventions: "P" (position) and "pscale" (radius).
+	static void write_points(const std::string& aFilePath, const std::vector<glm::vec4>& aParticles)
+	{
+		std::ofstream file(aFilePath, std::ios::binary);
+		if (!file.is_open()) {
+			LOG_WARNING(fmt::format("Unable to open '{}' for exporting particles.", aFilePath));
+			return;
+		}
+		struct attribute { char mName[16]; uint32_t mNumComponents; };
+		const attribute attributes[] = { { "P", 3u }, { "pscale", 1u } };
+		const uint32_t version = 1u, numAttributes = static_cast<uint32_t>(std::size(attributes));
+		const uint64_t numPoints = aParticles.size();
+		file.write("FNPT", 4);
+		file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+		file.write(reinterpret_cast<const char*>(&numPoints), sizeof(numPoints));
+		file.write(reinterpret_cast<const char*>(&numAttributes), sizeof(numAttributes));
+		file.write(reinterpret_cast<const char*>(attributes), sizeof(attributes));
+
+		std::vector<float> values(aParticles.size() * 3);
+		for (size_t i = 0; i < aParticles.size(); ++i) {
+			values[3 * i + 0] = aParticles[i].x;
+			values[3 * i + 1] = aParticles[i].y;
+			values[3 * i + 2] = aParticles[i].z;
+		}
+		file.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(float)));
+		values.resize(aParticles.size());
+		for (size_t i = 0; i < aParticles.size(); ++i) {
+			values[i] = aParticles[i].w;
+		}
+		file.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(float)));
+	}
+
+#if ENABLE_VDB_EXPORT
+	// Splats the particles into a sparse density grid (with a linear falloff to the particles' radii) and writes it as OpenVDB file:
+	static void write_vdb(const std::string& aFilePath, const std::vector<glm::vec4>& aParticles, float aVoxelSize)
+	{
+		static std::once_flag sInitialized;
+		std::call_once(sInitialized, []() { openvdb::initialize(); });
+
+		auto grid = openvdb::FloatGrid::create(0.0f);
+		grid->setName("density");
+		grid->setGridClass(openvdb::GRID_FOG_VOLUME);
+		grid->setTransform(openvdb::math::Transform::createLinearTransform(aVoxelSize));
+		auto accessor = grid->getAccessor();
+		for (const auto& p : aParticles) {
+			const glm::ivec3 lo = glm::ivec3(glm::floor((glm::vec3{ p } - p.w) / aVoxelSize));
+			const glm::ivec3 hi = glm::ivec3(glm::ceil((glm::vec3{ p } + p.w) / aVoxelSize));
+			for (int z = lo.z; z <= hi.z; ++z) {
+				for (int y = lo.y; y <= hi.y; ++y) {
+					for (int x = lo.x; x <= hi.x; ++x) {
+						const float d = glm::distance(glm::vec3{ x, y, z } * aVoxelSize, glm::vec3{ p });
+						if (d < p.w) {
+							const openvdb::Coord ijk{ x, y, z };
+							accessor.setValue(ijk, accessor.getValue(ijk) + (1.0f - d / p.w));
+						}
+					}
+				}
+			}
+		}
+		openvdb::io::File file(aFilePath);
+		file.write({ grid });
+		file.close();
+	}
+#endif
+
+private:
+	struct export_slot
+	{
+		std::vector<glm::vec4> mParticles;
+		uint64_t mFrame = 0;
+		uint32_t mFormats = 0u;
+		float mVoxelSize = 0.0f;
+		std::string mDirectory;
+	};
+
+	[[nodiscard]] size_t free_slot_count()
+	{
+		std::lock_guard<std::mutex> guard(mMutex);
+		return mFreeSlots.size();
+	}
+
+	// The writer thread's loop:
+	void write_exports()
+	{
+		cpu_profiler().set_current_thread_name("particle exporter");
+		while (true) {
+			uint32_t slotIndex;
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				mCondition.wait(lock, [this]() { return mStopRequested || !mPublishedSlots.empty(); });
+				if (mPublishedSlots.empty()) {
+					return; // Stop requested, and everything has been written
+				}
+				slotIndex = mPublishedSlots.front();
+				mPublishedSlots.pop_front();
+			}
+
+			{
+				PROFILE_CPU_SCOPE("write particle export");
+				const auto& slot = mSlots[slotIndex];
+				std::error_code error;
+				std::filesystem::create_directories(slot.mDirectory, error);
+				const auto basePath = (std::filesystem::path(slot.mDirectory) / fmt::format("particles_{:06}", slot.mFrame)).string();
+				if (0u != (slot.mFormats & particle_export_format::ply)) {
+					write_ply(basePath + ".ply", slot.mParticles);
+				}
+				if (0u != (slot.mFormats & particle_export_format::points)) {
+					write_points(basePath + ".fnpt", slot.mParticles);
+				}
+#if ENABLE_VDB_EXPORT
+				if (0u != (slot.mFormats & particle_export_format::vdb)) {
+					write_vdb(basePath + ".vdb", slot.mParticles, slot.mVoxelSize);
+				}
+#endif
+			}
+			mNumWritten.fetch_add(1, std::memory_order_relaxed);
+
+			std::lock_guard<std::mutex> guard(mMutex);
+			mFreeSlots.push_back(slotIndex);
+		}
+	}
+
+	// How many frames can wait to be written before frames are dropped:
+	static constexpr uint32_t cNumSlots = 4;
+
+	// Settings:
+	bool mExporting = false;
+	int mInterval = 1;
+	uint32_t mFormats = particle_export_format::ply;
+	float mVoxelSize = 0.25f;
+	std::array<char, 260> mDirectory{ "particle_export" };
+
+	uint64_t mFrame = 0;
+	uint32_t mNumDropped = 0;
+	std::atomic<uint32_t> mNumWritten = 0;
+
+	// The slots, and the queues of their indices, both protected by mMutex:
+	std::array<export_slot, cNumSlots> mSlots;
+	std::deque<uint32_t> mFreeSlots;
+	std::deque<uint32_t> mPublishedSlots;
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	bool mStopRequested = false;
+	std::thread mWriterThread;
+
+}; // End of particle_exporter
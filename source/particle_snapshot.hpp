@@ -0,0 +1,242 @@
+#pragma once
+
+#include <gvk.hpp>
+#include <lz4.h>
+#include <execution>
+
+#include "preprocessor_defines.hpp"
+#include "cpu_scope_profiler.hpp"
+
+// A particle snapshot file consists of:
+//
+//   particle_snapshot_header
+//   particle_snapshot_attribute x mNumAttributes     The attribute layout, i.e. which values are stored per particle
+//   particle_snapshot_chunk     x mNumChunks         Where to find each chunk, s.t. chunks can be decoded independently
+//   chunk payloads
+//
+// A chunk contains up to mParticlesPerChunk particles. Its payload stores every component of every attribute as a
+// separate stream (i.e. x x x ... y y y ... z z z ... r r r ...) whose bytes are transposed (all first bytes, then all
+// second bytes, etc.), which makes the floats compress much better. The payload is compressed with LZ4, unless
+// compression doesn't pay off, in which case it is stored as is (then its compressed size equals its raw size).
+struct particle_snapshot_header
+{
+	char mMagic[4];
+	uint32_t mVersion;
+	uint64_t mNumParticles;
+	uint32_t mParticlesPerChunk;
+	uint32_t mNumChunks;
+	uint32_t mNumAttributes;
+	uint32_t mReserved;
+};
+
+struct particle_snapshot_attribute
+{
+	char mName[16];
+	uint32_t mNumComponents; // All components are 32-bit floats
+	uint32_t mReserved;
+};
+
+struct particle_snapshot_chunk
+{
+	uint64_t mOffset;         // From the beginning of the file
+	uint32_t mCompressedSize; // In bytes
+	uint32_t mNumParticles;
+};
+
+// The attributes of the particles which are stored in snapshots, i.e. the xyz and w of the glm::vec4s:
+static const particle_snapshot_attribute particle_snapshot_attributes[] = {
+	{ "position", 3u, 0u },
+	{ "radius",   1u, 0u }
+};
+
+// Timings and sizes of the most recent save or load:
+struct particle_snapshot_stats
+{
+	size_t mNumParticles = 0;
+	size_t mFileSize = 0;
+	double mSeconds = 0.0;
+};
+
+namespace particle_snapshot_detail
+{
+	static constexpr uint32_t cVersion = 1u;
+	static constexpr uint32_t cParticlesPerChunk = 1u << 16;
+	static constexpr uint32_t cFloatsPerParticle = 4u;
+
+	// Splits the chunk's particles into one byte plane per component byte:
+	inline void shuffle(const glm::vec4* aParticles, uint32_t aNumParticles, uint8_t* aOut)
+	{
+		for (uint32_t c = 0; c < cFloatsPerParticle; ++c) {
+			for (uint32_t b = 0; b < sizeof(float); ++b) {
+				uint8_t* plane = aOut + (static_cast<size_t>(c) * sizeof(float) + b) * aNumParticles;
+				for (uint32_t i = 0; i < aNumParticles; ++i) {
+					plane[i] = reinterpret_cast<const uint8_t*>(&aParticles[i][c])[b];
+				}
+			}
+		}
+	}
+
+	// The inverse of shuffle():
+	inline void unshuffle(const uint8_t* aIn, uint32_t aNumParticles, glm::vec4* aParticles)
+	{
+		for (uint32_t c = 0; c < cFloatsPerParticle; ++c) {
+			for (uint32_t b = 0; b < sizeof(float); ++b) {
+				const uint8_t* plane = aIn + (static_cast<size_t>(c) * sizeof(float) + b) * aNumParticles;
+				for (uint32_t i = 0; i < aNumParticles; ++i) {
+					reinterpret_cast<uint8_t*>(&aParticles[i][c])[b] = plane[i];
+				}
+			}
+		}
+	}
+}
+
+// Writes the particles (position in xyz, radius in w) into a snapshot file. The chunks are compressed in parallel.
+inline particle_snapshot_stats save_particle_snapshot(const std::string& aFilePath, const std::vector<glm::vec4>& aParticles)
+{
+	using namespace particle_snapshot_detail;
+	PROFILE_CPU_SCOPE("save particle snapshot");
+	const auto start = std::chrono::steady_clock::now();
+
+	const auto numChunks = static_cast<uint32_t>((aParticles.size() + cParticlesPerChunk - 1) / cParticlesPerChunk);
+	std::vector<std::vector<char>> payloads(numChunks);
+	std::vector<particle_snapshot_chunk> chunks(numChunks);
+	std::vector<uint32_t> chunkIndices(numChunks);
+	std::iota(std::begin(chunkIndices), std::end(chunkIndices), 0u);
+	std::for_each(std::execution::par, std::begin(chunkIndices), std::end(chunkIndices), [&](uint32_t aChunk) {
+		const size_t first = static_cast<size_t>(aChunk) * cParticlesPerChunk;
+		const auto n = static_cast<uint32_t>(std::min<size_t>(cParticlesPerChunk, aParticles.size() - first));
+		const auto rawSize = static_cast<int>(n * sizeof(glm::vec4));
+		std::vector<char> raw(rawSize);
+		shuffle(aParticles.data() + first, n, reinterpret_cast<uint8_t*>(raw.data()));
+
+		auto& payload = payloads[aChunk];
+		payload.resize(LZ4_compressBound(rawSize));
+		const int compressedSize = LZ4_compress_default(raw.data(), payload.data(), rawSize, static_cast<int>(payload.size()));
+		if (compressedSize <= 0 || compressedSize >= rawSize) {
+			payload = std::move(raw); // Store uncompressed
+		}
+		else {
+			payload.resize(compressedSize);
+		}
+		chunks[aChunk].mCompressedSize = static_cast<uint32_t>(payload.size());
+		chunks[aChunk].mNumParticles = n;
+	});
+
+	// Lay out the chunks one after the other, behind the chunk table:
+	const particle_snapshot_header header{ { 'F', 'N', 'P', 'S' }, cVersion, aParticles.size(), cParticlesPerChunk, numChunks,
+		static_cast<uint32_t>(std::size(particle_snapshot_attributes)), 0u };
+	uint64_t offset = sizeof(header) + sizeof(particle_snapshot_attributes) + numChunks * sizeof(particle_snapshot_chunk);
+	for (auto& c : chunks) {
+		c.mOffset = offset;
+		offset += c.mCompressedSize;
+	}
+
+	std::ofstream file(aFilePath, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		throw gvk::runtime_error(fmt::format("Unable to open '{}' for writing the particle snapshot", aFilePath));
+	}
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(particle_snapshot_attributes), sizeof(particle_snapshot_attributes));
+	file.write(reinterpret_cast<const char*>(chunks.data()), static_cast<std::streamsize>(chunks.size() * sizeof(particle_snapshot_chunk)));
+	for (const auto& payload : payloads) {
+		file.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+	}
+	if (!file) {
+		throw gvk::runtime_error(fmt::format("Unable to write the particle snapshot '{}'", aFilePath));
+	}
+
+	return particle_snapshot_stats{ aParticles.size(), static_cast<size_t>(offset), std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+}
+
+// Reads a snapshot file which has been written by save_particle_snapshot. The whole file is read at once,
+// then the chunks are decompressed in parallel, straight into their places in the returned vector.
+inline std::vector<glm::vec4> load_particle_snapshot(const std::string& aFilePath, particle_snapshot_stats* aStats = nullptr)
+{
+	using namespace particle_snapshot_detail;
+	PROFILE_CPU_SCOPE("load particle snapshot");
+	const auto start = std::chrono::steady_clock::now();
+
+	std::ifstream file(aFilePath, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		throw gvk::runtime_error(fmt::format("Unable to open particle snapshot '{}'", aFilePath));
+	}
+	const auto fileSize = static_cast<size_t>(file.tellg());
+	std::vector<char> data(fileSize);
+	file.seekg(0);
+	file.read(data.data(), static_cast<std::streamsize>(fileSize));
+	if (!file || fileSize < sizeof(particle_snapshot_header)) {
+		throw gvk::runtime_error(fmt::format("Unable to read particle snapshot '{}'", aFilePath));
+	}
+
+	particle_snapshot_header header;
+	std::memcpy(&header, data.data(), sizeof(header));
+	if (0 != std::memcmp(header.mMagic, "FNPS", 4) || cVersion != header.mVersion) {
+		throw gvk::runtime_error(fmt::format("'{}' is not a particle snapshot of version {}", aFilePath, cVersion));
+	}
+	const size_t attributesOffset = sizeof(header);
+	const size_t chunksOffset = attributesOffset + header.mNumAttributes * sizeof(particle_snapshot_attribute);
+	if (chunksOffset + header.mNumChunks * sizeof(particle_snapshot_chunk) > fileSize) {
+		throw gvk::runtime_error(fmt::format("Particle snapshot '{}' is truncated", aFilePath));
+	}
+
+	// Only snapshots with the same attribute layout can be decoded into glm::vec4s directly:
+	const bool sameLayout = std::size(particle_snapshot_attributes) == header.mNumAttributes
+		&& 0 == std::memcmp(data.data() + attributesOffset, particle_snapshot_attributes, sizeof(particle_snapshot_attributes));
+	if (!sameLayout) {
+		throw gvk::runtime_error(fmt::format("Particle snapshot '{}' has an unsupported attribute layout", aFilePath));
+	}
+
+	// The chunks must be laid out as save_particle_snapshot does, i.e. all of them but the last one are full, s.t. a
+	// truncated or malformed snapshot is rejected before anything is allocated for its particles:
+	const uint64_t particlesPerChunk = header.mParticlesPerChunk;
+	if (0u == particlesPerChunk || particlesPerChunk * sizeof(glm::vec4) > static_cast<uint64_t>(LZ4_MAX_INPUT_SIZE)
+		|| (header.mNumParticles + particlesPerChunk - 1u) / particlesPerChunk != header.mNumChunks) {
+		throw gvk::runtime_error(fmt::format("Particle snapshot '{}' has {} chunks of {} particles, which doesn't match its {} particles", aFilePath, header.mNumChunks, header.mParticlesPerChunk, header.mNumParticles));
+	}
+	std::vector<particle_snapshot_chunk> chunks(header.mNumChunks);
+	std::memcpy(chunks.data(), data.data() + chunksOffset, chunks.size() * sizeof(particle_snapshot_chunk));
+	uint64_t numChunkParticles = 0;
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		const auto& c = chunks[i];
+		if (c.mNumParticles != std::min(particlesPerChunk, header.mNumParticles - i * particlesPerChunk) || c.mOffset > fileSize || c.mCompressedSize > fileSize - c.mOffset) {
+			throw gvk::runtime_error(fmt::format("Chunk {} of particle snapshot '{}' is truncated or malformed", i, aFilePath));
+		}
+		numChunkParticles += c.mNumParticles;
+	}
+	if (numChunkParticles != header.mNumParticles) {
+		throw gvk::runtime_error(fmt::format("The chunks of particle snapshot '{}' contain {} instead of {} particles", aFilePath, numChunkParticles, header.mNumParticles));
+	}
+
+	std::vector<glm::vec4> particles(header.mNumParticles);
+	std::vector<uint32_t> chunkIndices(header.mNumChunks);
+	std::iota(std::begin(chunkIndices), std::end(chunkIndices), 0u);
+	std::atomic<bool> corrupt = false;
+	std::for_each(std::execution::par, std::begin(chunkIndices), std::end(chunkIndices), [&](uint32_t aChunk) {
+		const auto& c = chunks[aChunk];
+		const size_t first = static_cast<size_t>(aChunk) * header.mParticlesPerChunk;
+		const auto rawSize = static_cast<int>(c.mNumParticles * sizeof(glm::vec4));
+		if (c.mOffset + c.mCompressedSize > fileSize || first + c.mNumParticles > particles.size()) {
+			corrupt = true;
+			return;
+		}
+		const char* payload = data.data() + c.mOffset;
+		std::vector<char> raw;
+		if (static_cast<int>(c.mCompressedSize) != rawSize) {
+			raw.resize(rawSize);
+			if (LZ4_decompress_safe(payload, raw.data(), static_cast<int>(c.mCompressedSize), rawSize) != rawSize) {
+				corrupt = true;
+				return;
+			}
+			payload = raw.data();
+		}
+		unshuffle(reinterpret_cast<const uint8_t*>(payload), c.mNumParticles, particles.data() + first);
+	});
+	if (corrupt) {
+		throw gvk::runtime_error(fmt::format("Particle snapshot '{}' is corrupt", aFilePath));
+	}
+
+	if (nullptr != aStats) {
+		*aStats = particle_snapshot_stats{ particles.size(), fileSize, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+	}
+	return particles;
+}
@@ -0,0 +1,406 @@
+#pragma once
+
+#include <gvk.hpp>
+#include <bit>
+#include <execution>
+
+// A lossy (quantized), temporally delta-coded codec for sequences of particle frames, i.e. positions (xyz) and radii (w)
+// of particles which keep their indices from frame to frame (new particles are appended).
+//
+// Positions are quantized onto a lattice with a fixed step, radii with another step. Particles which have existed in the
+// previous frame are predicted from their previous position and velocity (i.e. the difference of their previous two
+// positions); new particles, and all particles of keyframes, are predicted from their predecessor in the same block.
+// The residuals are Rice-coded with one parameter per block and component, which suits their Laplacian distribution.
+//
+// Particles with a history are assigned to blocks by the lattice cell of their previous position, new particles by
+// their index. Encoder and decoder derive the same assignment from the previous frame, and all blocks are encoded and
+// decoded in parallel. Keyframes (every mKeyframeInterval frames) don't depend on previous frames and allow seeking.
+struct particle_stream_settings
+{
+	float mQuantizationStep = 1e-3f;
+	float mRadiusStep = 1e-4f;
+	uint32_t mKeyframeInterval = 30;
+};
+
+namespace particle_stream_detail
+{
+	static constexpr uint32_t cNumSpatialBlocks = 256;
+	static constexpr uint32_t cIntraBlockSize = 16384;
+	static constexpr int32_t cCellShift = 10; // Cells are 1024 lattice steps wide
+	static constexpr uint32_t cComponents = 4;
+	static constexpr uint32_t cEscapeLength = 24;
+
+	struct frame_header
+	{
+		uint32_t mNumParticles;
+		uint32_t mNumPredicted; // The first mNumPredicted particles are predicted from the previous frame; 0 for keyframes
+		uint32_t mNumBlocks;
+		uint32_t mKeyframe;
+	};
+
+	struct block_header
+	{
+		uint32_t mByteOffset; // Relative to the end of the block headers
+		uint32_t mByteSize;
+		uint8_t mRiceParameters[cComponents];
+	};
+
+	// Particles on the quantization lattice:
+	struct lattice_particle
+	{
+		glm::ivec3 mPosition;
+		int32_t mRadius;
+	};
+
+	[[nodiscard]] inline uint32_t zigzag(int32_t aValue) { return (static_cast<uint32_t>(aValue) << 1) ^ static_cast<uint32_t>(aValue >> 31); }
+	[[nodiscard]] inline int32_t unzigzag(uint32_t aValue) { return static_cast<int32_t>(aValue >> 1) ^ -static_cast<int32_t>(aValue & 1u); }
+
+	class bit_writer
+	{
+	public:
+		explicit bit_writer(std::vector<uint8_t>& aOut) : mOut{ &aOut } {}
+
+		// Writes up to 32 bits:
+		void write(uint32_t aBits, uint32_t aCount)
+		{
+			mAccumulator |= static_cast<uint64_t>(aBits) << mCount;
+			mCount += aCount;
+			while (mCount >= 8) {
+				mOut->push_back(static_cast<uint8_t>(mAccumulator));
+				mAccumulator >>= 8;
+				mCount -= 8;
+			}
+		}
+
+		void write_rice(uint32_t aValue, uint32_t aK)
+		{
+			const uint32_t q = aValue >> aK;
+			if (q < cEscapeLength) {
+				write((1u << q) - 1u, q + 1u); // q ones, terminated by a zero
+				if (aK > 0) { write(aValue & ((1u << aK) - 1u), aK); }
+			}
+			else {
+				write((1u << cEscapeLength) - 1u, cEscapeLength);
+				write(aValue, 32);
+			}
+		}
+
+		void flush()
+		{
+			if (mCount > 0) {
+				mOut->push_back(static_cast<uint8_t>(mAccumulator));
+			}
+			mAccumulator = 0;
+			mCount = 0;
+		}
+
+	private:
+		std::vector<uint8_t>* mOut;
+		uint64_t mAccumulator = 0;
+		uint32_t mCount = 0;
+	};
+
+	class bit_reader
+	{
+	public:
+		bit_reader(const uint8_t* aData, size_t aSize) : mData{ aData }, mEnd{ aData + aSize } {}
+
+		[[nodiscard]] uint32_t read(uint32_t aCount)
+		{
+			refill();
+			const auto result = static_cast<uint32_t>(mAccumulator & ((1ull << aCount) - 1ull));
+			consume(aCount);
+			return result;
+		}
+
+		[[nodiscard]] uint32_t read_rice(uint32_t aK)
+		{
+			refill();
+			const auto q = static_cast<uint32_t>(std::countr_one(mAccumulator));
+			if (q >= cEscapeLength) {
+				consume(cEscapeLength);
+				return read(32);
+			}
+			consume(q + 1u);
+			return aK > 0 ? (q << aK) | read(aK) : q;
+		}
+
+	private:
+		// Make sure that there are at least 56 bits in the accumulator (zeros beyond the end of the data):
+		void refill()
+		{
+			if (mCount <= 56 && mEnd - mData >= 8) {
+				uint64_t word;
+				std::memcpy(&word, mData, sizeof(word));
+				mAccumulator |= word << mCount;
+				mData += (63u - mCount) >> 3;
+				mCount |= 56u;
+				return;
+			}
+			while (mCount <= 56) {
+				const uint64_t byte = mData < mEnd ? *mData++ : 0u;
+				mAccumulator |= byte << mCount;
+				mCount += 8;
+			}
+		}
+
+		void consume(uint32_t aCount)
+		{
+			mAccumulator >>= aCount;
+			mCount -= aCount;
+		}
+
+		const uint8_t* mData;
+		const uint8_t* mEnd;
+		uint64_t mAccumulator = 0;
+		uint32_t mCount = 0;
+	};
+
+	// Assigns the predicted particles to spatial blocks by the cell of their previous position. Returns the particle
+	// indices sorted by block (and by index within each block), and the first index of every block in that order:
+	inline void assign_spatial_blocks(const std::vector<lattice_particle>& aPrevious, uint32_t aNumPredicted, std::vector<uint32_t>& aOrder, std::vector<uint32_t>& aBlockStarts)
+	{
+		std::vector<uint32_t> blockOfParticle(aNumPredicted);
+		aBlockStarts.assign(cNumSpatialBlocks + 1, 0u);
+		for (uint32_t i = 0; i < aNumPredicted; ++i) {
+			const glm::ivec3 cell = aPrevious[i].mPosition >> cCellShift;
+			const uint32_t hash = (static_cast<uint32_t>(cell.x) * 73856093u) ^ (static_cast<uint32_t>(cell.y) * 19349663u) ^ (static_cast<uint32_t>(cell.z) * 83492791u);
+			blockOfParticle[i] = hash % cNumSpatialBlocks;
+			++aBlockStarts[blockOfParticle[i] + 1];
+		}
+		for (uint32_t b = 0; b < cNumSpatialBlocks; ++b) {
+			aBlockStarts[b + 1] += aBlockStarts[b];
+		}
+		aOrder.resize(aNumPredicted);
+		std::vector<uint32_t> cursor(std::begin(aBlockStarts), std::end(aBlockStarts) - 1);
+		for (uint32_t i = 0; i < aNumPredicted; ++i) {
+			aOrder[cursor[blockOfParticle[i]]++] = i;
+		}
+	}
+
+	// The Rice parameter which suits values with the given mean:
+	[[nodiscard]] inline uint8_t rice_parameter(uint64_t aSum, uint64_t aCount)
+	{
+		if (0 == aCount || aSum < aCount) {
+			return 0;
+		}
+		return static_cast<uint8_t>(std::min(static_cast<int>(std::bit_width(aSum / aCount)) - 1, 30));
+	}
+}
+
+// Keeps the previous two (reconstructed) frames, which are the same for the encoder and the decoder:
+class particle_stream_history
+{
+public:
+	void reset()
+	{
+		mPrevious.clear();
+		mBeforePrevious.clear();
+		mFrame = 0;
+	}
+
+	// Keyframes don't depend on previous frames, and neither do the frames' predictions after them:
+	void begin_keyframe()
+	{
+		mPrevious.clear();
+		mBeforePrevious.clear();
+	}
+
+	void advance(std::vector<particle_stream_detail::lattice_particle>& aCurrent)
+	{
+		std::swap(mBeforePrevious, mPrevious);
+		std::swap(mPrevious, aCurrent);
+		++mFrame;
+	}
+
+	// Predicts the lattice position of a particle which has existed in the previous frame:
+	[[nodiscard]] glm::ivec3 predict_position(uint32_t aIndex) const
+	{
+		const auto& p = mPrevious[aIndex].mPosition;
+		return aIndex < mBeforePrevious.size() ? p + (p - mBeforePrevious[aIndex].mPosition) : p;
+	}
+
+	std::vector<particle_stream_detail::lattice_particle> mPrevious;
+	std::vector<particle_stream_detail::lattice_particle> mBeforePrevious;
+	uint64_t mFrame = 0;
+};
+
+class particle_stream_encoder
+{
+public:
+	explicit particle_stream_encoder(particle_stream_settings aSettings = {}) : mSettings{ aSettings } {}
+
+	void reset() { mHistory.reset(); }
+
+	// Encodes the next frame and appends it to aOut:
+	void encode_frame(const std::vector<glm::vec4>& aParticles, std::vector<uint8_t>& aOut)
+	{
+		using namespace particle_stream_detail;
+		const auto numParticles = static_cast<uint32_t>(aParticles.size());
+		const bool keyframe = 0 == mHistory.mFrame % std::max(mSettings.mKeyframeInterval, 1u);
+		if (keyframe) {
+			mHistory.begin_keyframe();
+		}
+		const uint32_t numPredicted = std::min(numParticles, static_cast<uint32_t>(mHistory.mPrevious.size()));
+
+		// Quantize the current frame:
+		std::vector<lattice_particle> current(numParticles);
+		for (uint32_t i = 0; i < numParticles; ++i) {
+			current[i].mPosition = glm::ivec3{ glm::round(glm::vec3{ aParticles[i] } / mSettings.mQuantizationStep) };
+			current[i].mRadius = static_cast<int32_t>(std::round(aParticles[i].w / mSettings.mRadiusStep));
+		}
+
+		std::vector<uint32_t> order, blockStarts;
+		assign_spatial_blocks(mHistory.mPrevious, numPredicted, order, blockStarts);
+		const uint32_t numIntraBlocks = (numParticles - numPredicted + cIntraBlockSize - 1) / cIntraBlockSize;
+		const uint32_t numBlocks = cNumSpatialBlocks + numIntraBlocks;
+
+		// Compute the residuals and encode every block into its own stream:
+		std::vector<std::vector<uint8_t>> streams(numBlocks);
+		std::vector<block_header> headers(numBlocks);
+		std::vector<uint32_t> blockIndices(numBlocks);
+		std::iota(std::begin(blockIndices), std::end(blockIndices), 0u);
+		std::for_each(std::execution::par, std::begin(blockIndices), std::end(blockIndices), [&](uint32_t aBlock) {
+			std::vector<std::array<uint32_t, cComponents>> residuals;
+			if (aBlock < cNumSpatialBlocks) {
+				for (uint32_t o = blockStarts[aBlock]; o < blockStarts[aBlock + 1]; ++o) {
+					const auto i = order[o];
+					const auto d = current[i].mPosition - mHistory.predict_position(i);
+					residuals.push_back({ zigzag(d.x), zigzag(d.y), zigzag(d.z), zigzag(current[i].mRadius - mHistory.mPrevious[i].mRadius) });
+				}
+			}
+			else {
+				const uint32_t first = numPredicted + (aBlock - cNumSpatialBlocks) * cIntraBlockSize;
+				const uint32_t end = std::min(numParticles, first + cIntraBlockSize);
+				lattice_particle predecessor{ glm::ivec3{ 0 }, 0 };
+				for (uint32_t i = first; i < end; ++i) {
+					const auto d = current[i].mPosition - predecessor.mPosition;
+					residuals.push_back({ zigzag(d.x), zigzag(d.y), zigzag(d.z), zigzag(current[i].mRadius - predecessor.mRadius) });
+					predecessor = current[i];
+				}
+			}
+
+			std::array<uint64_t, cComponents> sums{};
+			for (const auto& r : residuals) {
+				for (uint32_t c = 0; c < cComponents; ++c) {
+					sums[c] += r[c];
+				}
+			}
+			for (uint32_t c = 0; c < cComponents; ++c) {
+				headers[aBlock].mRiceParameters[c] = rice_parameter(sums[c], residuals.size());
+			}
+			bit_writer writer(streams[aBlock]);
+			for (const auto& r : residuals) {
+				for (uint32_t c = 0; c < cComponents; ++c) {
+					writer.write_rice(r[c], headers[aBlock].mRiceParameters[c]);
+				}
+			}
+			writer.flush();
+		});
+
+		// Frame header, block headers, and the blocks' streams:
+		uint32_t offset = 0;
+		for (uint32_t b = 0; b < numBlocks; ++b) {
+			headers[b].mByteOffset = offset;
+			headers[b].mByteSize = static_cast<uint32_t>(streams[b].size());
+			offset += headers[b].mByteSize;
+		}
+		const frame_header header{ numParticles, numPredicted, numBlocks, keyframe ? 1u : 0u };
+		const auto* headerBytes = reinterpret_cast<const uint8_t*>(&header);
+		aOut.insert(std::end(aOut), headerBytes, headerBytes + sizeof(header));
+		const auto* blockHeaderBytes = reinterpret_cast<const uint8_t*>(headers.data());
+		aOut.insert(std::end(aOut), blockHeaderBytes, blockHeaderBytes + headers.size() * sizeof(block_header));
+		for (const auto& s : streams) {
+			aOut.insert(std::end(aOut), std::begin(s), std::end(s));
+		}
+
+		mHistory.advance(current);
+	}
+
+	[[nodiscard]] const particle_stream_settings& settings() const { return mSettings; }
+
+private:
+	particle_stream_settings mSettings;
+	particle_stream_history mHistory;
+};
+
+class particle_stream_decoder
+{
+public:
+	explicit particle_stream_decoder(particle_stream_settings aSettings = {}) : mSettings{ aSettings } {}
+
+	void reset() { mHistory.reset(); }
+
+	// Decodes the next frame. Returns false if the data is corrupt or doesn't follow the previously decoded frame.
+	bool decode_frame(const uint8_t* aData, size_t aSize, std::vector<glm::vec4>& aParticles)
+	{
+		using namespace particle_stream_detail;
+		if (aSize < sizeof(frame_header)) {
+			return false;
+		}
+		frame_header header;
+		std::memcpy(&header, aData, sizeof(header));
+		if (0u != header.mKeyframe) {
+			mHistory.begin_keyframe();
+		}
+		const uint32_t numIntraBlocks = (header.mNumParticles - header.mNumPredicted + cIntraBlockSize - 1) / cIntraBlockSize;
+		if (header.mNumPredicted > mHistory.mPrevious.size() || header.mNumPredicted > header.mNumParticles
+			|| header.mNumBlocks != cNumSpatialBlocks + numIntraBlocks || sizeof(frame_header) + header.mNumBlocks * sizeof(block_header) > aSize) {
+			return false;
+		}
+		std::vector<block_header> headers(header.mNumBlocks);
+		std::memcpy(headers.data(), aData + sizeof(frame_header), headers.size() * sizeof(block_header));
+		const uint8_t* streams = aData + sizeof(frame_header) + headers.size() * sizeof(block_header);
+		const size_t streamsSize = aSize - sizeof(frame_header) - headers.size() * sizeof(block_header);
+		for (const auto& h : headers) {
+			if (static_cast<size_t>(h.mByteOffset) + h.mByteSize > streamsSize) {
+				return false;
+			}
+		}
+
+		std::vector<uint32_t> order, blockStarts;
+		assign_spatial_blocks(mHistory.mPrevious, header.mNumPredicted, order, blockStarts);
+
+		mCurrent.resize(header.mNumParticles);
+		aParticles.resize(header.mNumParticles);
+		const auto dequantize = [this](const lattice_particle& aParticle) {
+			return glm::vec4{ glm::vec3{ aParticle.mPosition } * mSettings.mQuantizationStep, static_cast<float>(aParticle.mRadius) * mSettings.mRadiusStep };
+		};
+		std::vector<uint32_t> blockIndices(header.mNumBlocks);
+		std::iota(std::begin(blockIndices), std::end(blockIndices), 0u);
+		std::for_each(std::execution::par, std::begin(blockIndices), std::end(blockIndices), [&](uint32_t aBlock) {
+			const auto& h = headers[aBlock];
+			bit_reader reader(streams + h.mByteOffset, h.mByteSize);
+			const auto readResidual = [&](uint32_t aComponent) { return unzigzag(reader.read_rice(h.mRiceParameters[aComponent])); };
+			if (aBlock < cNumSpatialBlocks) {
+				for (uint32_t o = blockStarts[aBlock]; o < blockStarts[aBlock + 1]; ++o) {
+					const auto i = order[o];
+					const auto prediction = mHistory.predict_position(i);
+					const int32_t dx = readResidual(0), dy = readResidual(1), dz = readResidual(2), dr = readResidual(3);
+					mCurrent[i] = lattice_particle{ prediction + glm::ivec3{ dx, dy, dz }, mHistory.mPrevious[i].mRadius + dr };
+					aParticles[i] = dequantize(mCurrent[i]);
+				}
+			}
+			else {
+				const uint32_t first = header.mNumPredicted + (aBlock - cNumSpatialBlocks) * cIntraBlockSize;
+				const uint32_t end = std::min(header.mNumParticles, first + cIntraBlockSize);
+				lattice_particle predecessor{ glm::ivec3{ 0 }, 0 };
+				for (uint32_t i = first; i < end; ++i) {
+					const int32_t dx = readResidual(0), dy = readResidual(1), dz = readResidual(2), dr = readResidual(3);
+					predecessor = lattice_particle{ predecessor.mPosition + glm::ivec3{ dx, dy, dz }, predecessor.mRadius + dr };
+					mCurrent[i] = predecessor;
+					aParticles[i] = dequantize(predecessor);
+				}
+			}
+		});
+		mHistory.advance(mCurrent);
+		return true;
+	}
+
+	[[nodiscard]] uint64_t number_of_decoded_frames() const { return mHistory.mFrame; }
+
+private:
+	particle_stream_settings mSettings;
+	particle_stream_history mHistory;
+	std::vector<particle_stream_detail::lattice_particle> mCurrent;
+};
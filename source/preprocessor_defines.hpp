@@ -1,9 +1,23 @@
-#pragma once
-
-// Set this compiler switch to 1 to enable hot reloading of
-// the ray tracing pipeline's shaders. Set to 0 to disable it.
-#define ENABLE_SHADER_HOT_RELOADING_FOR_RAY_TRACING_PIPELINE 1
-
-// Set this compiler switch to 1 to make the window resizable
-// and have the pipeline adapt to it. Set to 0 ti disable it.
-#define ENABLE_RESIZABLE_WINDOW 1
+#pragma once
+
+// Set this compiler switch to 1 to enable hot reloading of
+// the ray tracing pipeline's shaders. Set to 0 to disable it.
+#define ENABLE_SHADER_HOT_RELOADING_FOR_RAY_TRACING_PIPELINE 1
+
+// Set this compiler switch to 1 to make the window resizable
+// and have the pipeline adapt to it. Set to 0 ti disable it.
+#define ENABLE_RESIZABLE_WINDOW 1
+
+// Set this compiler switch to 1 to compile the CPU scope profiler's
+// PROFILE_CPU_SCOPE macros into the code. Set to 0 to remove them.
+// (Recording must still be enabled at runtime via the UI.)
+#define ENABLE_CPU_SCOPE_PROFILER 1
+
+// Set this compiler switch to 1 to compile the HTTP metrics endpoint into
+// the application. Set to 0 to remove it, together with its Winsock dependency.
+// (It must still be enabled at runtime via "--metrics-port <port>".)
+#define ENABLE_METRICS_ENDPOINT 1
+
+// Set this compiler switch to 1 to let the particle exporter write density
+// grids as OpenVDB files. Requires the "vdb" feature of the vcpkg manifest.
+#define ENABLE_VDB_EXPORT 0
@@ -1,276 +1,575 @@
-#pragma once
-
-#include <gvk.hpp>
-#include <imgui.h>
-#include <imgui_internal.h>
-
-#include "preprocessor_defines.hpp"
-#include "cpu_to_gpu_data_types.hpp"
-#include "fluid_nightmare_main.hpp"
-
-// An invokee that handles triangle mesh geometry:
-class procedural_geometry_manager : public gvk::invokee
-{
-public: // v== gvk::invokee overrides which will be invoked by the framework ==v
-	procedural_geometry_manager(avk::queue& aQueue)
-		: invokee{ -10 } // This invokee must execute BEFORE the main invokee
-		, mQueue{ &aQueue }
-	{}
-
-	void initialize() override
-	{
-		// Create a descriptor cache that helps us to conveniently create descriptor sets,
-		// which describe where shaders can find resources like buffers or images:
-		mDescriptorCache = gvk::context().create_descriptor_cache();
-		
-		// For the BLAS, one single AABB is sufficient. Build it:
-		mBlas = gvk::context().create_bottom_level_acceleration_structure({ avk::acceleration_structure_size_requirements::from_aabbs(1u) }, false);
-		mBlas->build({ VkAabbPositionsKHR{ /* min: */ -1.f, -1.f, -1.f,  /* max: */ 1.f,  1.f,  1.f } });
-
-		// Create a buffer to hold a number of spawned particle candidiates, each one represented just by their position:
-		mSpawnedParticlesBuffer = gvk::context().create_buffer(
-			avk::memory_usage::host_coherent, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc,
-			avk::storage_buffer_meta::create_from_size(cNewParticleCandidatesToSpawn * sizeof(glm::vec4))
-		);
-		
-		// Create our ray tracing pipeline which spawns particles:
-		mPipeline = gvk::context().create_ray_tracing_pipeline_for(
-			avk::define_shader_table(
-				avk::ray_generation_shader("shaders/particle_spawner/spawn_particles.rgen"),
-				avk::triangles_hit_group::create_with_rchit_only("shaders/particle_spawner/spawn_particles_triangles.rchit"),
-				avk::procedural_hit_group::create_with_rint_and_rchit("shaders/rt_aabb.rint", "shaders/particle_spawner/spawn_particles_procedural.rchit"),
-				avk::miss_shader("shaders/empty_miss_shader.rmiss")
-			),
-			// We won't need the maximum recursion depth, but why not:
-			gvk::context().get_max_ray_tracing_recursion_depth(),
-			// Define push constants and descriptor bindings:
-			avk::push_constant_binding_data{ avk::shader_type::ray_generation | avk::shader_type::closest_hit, 0, sizeof(push_const_data_particle_spawner) },
-			avk::descriptor_binding<avk::top_level_acceleration_structure>(0, 0, 1),
-			avk::descriptor_binding(0, 1, mSpawnedParticlesBuffer->as_storage_buffer())
-		);
-
-#if ENABLE_SHADER_HOT_RELOADING_FOR_RAY_TRACING_PIPELINE
-		// Create an updater:
-		mUpdater.emplace();
-		mPipeline.enable_shared_ownership(); // The updater needs to hold a reference to it, so we need to enable shared ownership.
-		mUpdater->on(gvk::shader_files_changed_event(mPipeline))
-			.update(mPipeline);
-#endif
-		
-		// Add an "ImGui Manager" which handles the UI specific to the requirements of this invokee:
-		auto imguiManager = gvk::current_composition()->element_by_type<gvk::imgui_manager>();
-		if (nullptr != imguiManager) {
-			imguiManager->add_callback([this]() {
-				ImGui::Begin("Procedural Geometry");
-				ImGui::SetWindowPos(ImVec2(422, 2.0f), ImGuiCond_FirstUseEver);
-				ImGui::SetWindowSize(ImVec2(402.0f, 224.0f), ImGuiCond_FirstUseEver);
-
-				ImGui::Separator();
-				ImGui::Text("Spawn Settings:");
-				ImGui::DragFloat3("Spawn Origin", glm::value_ptr(mSpawnOrigin), 0.1f);
-				ImGui::DragFloat3("Spawn Direction", glm::value_ptr(mSpawnDirection), 0.1f);
-				ImGui::SliderFloat("Spawn Cone Angle (Degrees)", &mSpawnAngle, 10.0f, 80.0f);
-				ImGui::Checkbox("Add Random Offset", &mRandomlyOffsetDirecion);
-				ImGui::SliderFloat("Radius of newly spawned particle", &mRadiusOfNewWaterParticles, 0.0001f, 1.0f);
-
-				ImGui::Separator();
-				ImVec4 particlesStatusTextColor(0.0f, 0.9f, 0.3f, 1.0f);
-				if (mGeometryInstances.size() >= cMaxNumParticles) {
-					mCurrentlySpawningWaterParticles = false; // Can't spawn any more
-					ImGui::PushItemFlag(ImGuiItemFlags_Disabled, true); // Disable the following checkbox
-					particlesStatusTextColor = ImVec4(0.9f, 0.3f, 0.0f, 1.0f);
-				}
-				ImGui::Checkbox("SPAWN NEW WATER PARTICLES!", &mCurrentlySpawningWaterParticles);
-				if (mGeometryInstances.size() >= cMaxNumParticles) {
-					ImGui::PopItemFlag();
-				}
-				auto spawnStatus = fmt::format("{} particles spawned so far.", mGeometryInstances.size());
-				ImGui::TextColored(particlesStatusTextColor, spawnStatus.c_str());
-
-				ImGui::End();
-			});
-		}
-	}
-	
-	// Returns true if a TLAS that uses the geometry of this invokee must be updated because the geometry has changed,
-	// which in this case always means: more particles have been added.
-	[[nodiscard]] bool has_updated_geometry_for_tlas() const
-	{
-		return mTlasUpdateRequired;
-	}
-
-	void reset_update_required_flag()
-	{
-		mTlasUpdateRequired = false;
-	}
-
-	// Return the geometry instances to the caller, who will use it for a TLAS build:
-	[[nodiscard]] const auto& get_geometry_instances_buffer()
-	{
-		return mGeometryInstances;
-	}
-
-	// Invoked by the framework every frame:
-	void update() override
-	{
-		// Tidy up some of the values:
-		mSpawnDirection = glm::normalize(mSpawnDirection);
-		if (glm::any(glm::isnan(mSpawnDirection))) {
-			mSpawnDirection = glm::vec3{ 0.0f, -1.0f, 0.0f };
-		}
-		mSpawnAngleRad = glm::radians(mSpawnAngle);
-
-		if (mCurrentlySpawningWaterParticles && mGeometryInstances.size() <= cMaxNumParticles) {
-
-			// Okay, here's what we're going to do:
-			//  1) We let the GPU trace several rays
-			//  2) We read back the result
-			//  3) We select ONE particle position and add that to our instances
-			
-			auto& commandPool = gvk::context().get_command_pool_for_single_use_command_buffers(*mQueue);
-			auto cmdbfr = commandPool->alloc_command_buffer(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-			cmdbfr->begin_recording();
-
-			// We're using only one TLAS for all frames in flight. Therefore, we need to set up a barrier
-			// affecting the whole queue which waits until all previous ray tracing work has completed:
-			cmdbfr->establish_execution_barrier(
-				avk::pipeline_stage::ray_tracing_shaders, /* -> */ avk::pipeline_stage::acceleration_structure_build
-			);
-
-			auto* mainInvokee = gvk::current_composition()->element_by_type<fluid_nightmare_main>();
-			assert(nullptr != mainInvokee);
-
-			cmdbfr->bind_pipeline(avk::const_referenced(mPipeline));
-			cmdbfr->bind_descriptors(mPipeline->layout(), mDescriptorCache.get_or_create_descriptor_sets({
-				avk::descriptor_binding(0, 0, mainInvokee->get_tlas()),
-				avk::descriptor_binding(0, 1, mSpawnedParticlesBuffer->as_storage_buffer())
-			}));
-
-			// Set the push constants:
-			auto pushConstantsForThisDrawCall = push_const_data_particle_spawner{
-				gvk::matrix_from_transforms(
-					glm::vec3{ mSpawnOrigin },                                 // Location of our spawning point
-					// Build a from-to-rotation quaternion:
-					glm::quat(glm::vec3{0.0f, -1.0f, 0.0f}, mSpawnDirection),  // How our spawning direction will be rotated => Create rotation relative to our default -y direction!
-					glm::vec3{1.0f}                                            // Scale doesn't matter
-				),
-				mSpawnAngleRad,
-				mRadiusOfNewWaterParticles
-			};
-			cmdbfr->handle().pushConstants(mPipeline->layout_handle(), vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eClosestHitKHR, 0, sizeof(pushConstantsForThisDrawCall), &pushConstantsForThisDrawCall);
-
-			// Do it:
-			cmdbfr->trace_rays(
-				vk::Extent3D{ cNewParticleCandidatesToSpawn, 1u, 1u },
-				mPipeline->shader_binding_table(),
-				avk::using_raygen_group_at_index(0),
-				avk::using_miss_group_at_index(0),
-				avk::using_hit_group_at_index(0)
-			);
-
-			// We don't add a barrier here. We'll just wait for completion via the fence.
-
-			cmdbfr->end_recording();
-			auto fen = mQueue->submit_with_fence(avk::referenced(cmdbfr));
-			fen->wait_until_signalled();
-
-			// Read back the data into an array:
-			auto candidates = mSpawnedParticlesBuffer->read<std::array<glm::vec4, cNewParticleCandidatesToSpawn>>(0, avk::sync::wait_idle());
-			// Select the "best" of the candidates. We'll just go for the candidate with minimal y coordinates:
-			glm::vec4 selectedCandidate = candidates[0];
-			for (uint32_t i = 1u; i < cNewParticleCandidatesToSpawn; ++i) {
-				if (candidates[i].y < selectedCandidate.y) {
-					selectedCandidate = candidates[i];
-				}
-			}
-			
-			mGeometryInstances.push_back(
-				gvk::context().create_geometry_instance(mBlas) // Refer to the concrete BLAS; it is the same for each water particle
-					// Handle water particles instance offset of 1; i.e. based on that, the
-					// right (procedural) shaders will be chosen from the shader binding table:
-					.set_instance_offset(1)
-					// Set this instance's transformation matrix (offset by the selected candidate's position, do not rotate, scale according to the current setting):
-				.set_transform_column_major(gvk::to_array(gvk::matrix_from_transforms(glm::vec3{ selectedCandidate }, glm::quat(), glm::vec3{ mRadiusOfNewWaterParticles })))
-			);
-
-			mTlasUpdateRequired = true;
-		}
-		else {
-			std::vector<glm::vec4> candidates(cNewParticleCandidatesToSpawn, glm::vec4{ 0.0f });
-			mSpawnedParticlesBuffer->read(candidates.data(), 0, avk::sync::wait_idle());
-
-			// Select the "best" of the candidates. We'll just go for the candidate with minimal y coordinates:
-			glm::vec4 selectedCandidate = candidates[0];
-			for (uint32_t i = 1u; i < cNewParticleCandidatesToSpawn; ++i) {
-				if (candidates[i].y < selectedCandidate.y) {
-					selectedCandidate = candidates[i];
-				}
-			}
-		}
-	}
-
-	// Some getters that will be used by the main invokee:
-	[[nodiscard]] constexpr uint32_t max_number_of_geometry_instances() const { return cMaxNumParticles; }
-	
-private: // v== Member variables ==v
-
-	// --------------- Some fundamental stuff -----------------
-
-	// Our only queue where we submit command buffers to:
-	avk::queue* mQueue;
-
-	// Our only descriptor cache which stores reusable descriptor sets:
-	avk::descriptor_cache mDescriptorCache;
-
-	// How many new particle candidates shall be spawned at a time
-	const static uint32_t cNewParticleCandidatesToSpawn = 16u * 16u;
-	
-	// A buffer that will contain potential positions of new particles
-	avk::buffer mSpawnedParticlesBuffer;
-	
-	// ------------------- Constants/Settings ----------------------
-
-	const static uint32_t cMaxNumParticles = 524288; // 500k water particles max. The buffer will be sized according to this value.
-	
-	// ---------------- Acceleration Structures --------------------
-
-	// The ray tracing pipeline that spawns new particles:
-	avk::ray_tracing_pipeline mPipeline;
-	
-	// ---------------- Acceleration Structures --------------------
-
-	// A BLAS which represents one single water particle. All other particles are instanced:
-	avk::bottom_level_acceleration_structure mBlas;
-
-	// A buffer which contains all a geometry instance for every single water particle:
-	std::vector<avk::geometry_instance> mGeometryInstances;
-
-	// ------------------- UI settings -----------------------
-
-	// The origin where from spawning rays are sent out (in world space):
-	glm::vec3 mSpawnOrigin = glm::vec3(0.0f, 20.0f, 0.0f);
-
-	// The orientation of the spawning frustum (in world space):
-	glm::vec3 mSpawnDirection = glm::vec3(0.0f, -1.0f, 0.0f);
-
-	// The possible max.  deviation from mSpawnDirection for the spawning rays:
-	float mSpawnAngle = 45.0f;
-	float mSpawnAngleRad;
-
-	// If set to true, a random offset will be added to the spawn direction 
-	bool mRandomlyOffsetDirecion = true;
-	
-	// The water particle's (uniform) scale:
-	float mRadiusOfNewWaterParticles = 0.35f;
-
-	// True if water particles are currently being spawned:
-	bool mCurrentlySpawningWaterParticles = false;
-
-	// True when an TLAS update is immanent:
-	bool mTlasUpdateRequired = true;
-
-	// How often a particle has been spawned. I.e. this number should
-	// represent the total number of water particles in the scene:
-	int mNumberOfSpawnInvocations = 0;
-
-}; // End of procedural_geometry_manager
+#pragma once
+
+#include <gvk.hpp>
+#include <imgui.h>
+#include <imgui_internal.h>
+
+#include "preprocessor_defines.hpp"
+#include "cpu_to_gpu_data_types.hpp"
+#include "fluid_nightmare_main.hpp"
+#include "gpu_timestamp_profiler.hpp"
+#include "cpu_scope_profiler.hpp"
+#include "cpu_kernels.hpp"
+#include "memory_accounting.hpp"
+#include "ray_statistics.hpp"
+#include "particle_snapshot.hpp"
+#include "particle_bridge.h"
+
+// An invokee that handles triangle mesh geometry:
+class procedural_geometry_manager : public gvk::invokee
+{
+public: // v== gvk::invokee overrides which will be invoked by the framework ==v
+	// All the spawn settings which can be changed via the UI (e.g., recorded and replayed by the replay_recorder).
+	// Only 4-byte members, s.t. there is no padding and instances can be compared and serialized bytewise:
+	struct spawn_settings
+	{
+		glm::vec3 mOrigin;
+		glm::vec3 mDirection;
+		float mConeAngle;
+		uint32_t mRandomlyOffsetDirection;
+		float mRadius;
+		uint32_t mSpawning;
+	};
+
+	procedural_geometry_manager(avk::queue& aQueue)
+		: invokee{ -10 } // This invokee must execute BEFORE the main invokee
+		, mQueue{ &aQueue }
+	{}
+
+	void initialize() override
+	{
+		// Create a descriptor cache that helps us to conveniently create descriptor sets,
+		// which describe where shaders can find resources like buffers or images:
+		mDescriptorCache = gvk::context().create_descriptor_cache();
+		
+		// For the BLAS, one single AABB is sufficient. Build it:
+		mBlas = gvk::context().create_bottom_level_acceleration_structure({ avk::acceleration_structure_size_requirements::from_aabbs(1u) }, false);
+		mBlas->build({ VkAabbPositionsKHR{ /* min: */ -1.f, -1.f, -1.f,  /* max: */ 1.f,  1.f,  1.f } });
+		memory_accounting().gpu(gpu_memory_category::blas).add(mBlas->required_acceleration_structure_size());
+
+		// Create a buffer to hold a number of spawned particle candidiates, each one represented just by their position:
+		mSpawnedParticlesBuffer = gvk::context().create_buffer(
+			avk::memory_usage::host_coherent, vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc,
+			avk::storage_buffer_meta::create_from_size(cNewParticleCandidatesToSpawn * sizeof(glm::vec4))
+		);
+		memory_accounting().add(gpu_memory_category::spawn_buffers, *mSpawnedParticlesBuffer);
+
+		// Reserve storage for the initial capacity. It will be grown on demand:
+		mGeometryInstances.reserve(mParticleCapacity);
+		mParticles.reserve(mParticleCapacity);
+		
+		// The ray statistics' counters buffer has been created already, since that invokee has a lower execution order:
+		auto* rayStatistics = gvk::current_composition()->element_by_type<ray_statistics>();
+		assert(nullptr != rayStatistics);
+
+		// Create our ray tracing pipeline which spawns particles:
+		mPipeline = gvk::context().create_ray_tracing_pipeline_for(
+			avk::define_shader_table(
+				avk::ray_generation_shader("shaders/particle_spawner/spawn_particles.rgen"),
+				avk::triangles_hit_group::create_with_rchit_only("shaders/particle_spawner/spawn_particles_triangles.rchit"),
+				avk::procedural_hit_group::create_with_rint_and_rchit("shaders/rt_aabb.rint", "shaders/particle_spawner/spawn_particles_procedural.rchit"),
+				avk::miss_shader("shaders/empty_miss_shader.rmiss")
+			),
+			// We won't need the maximum recursion depth, but why not:
+			gvk::context().get_max_ray_tracing_recursion_depth(),
+			// Define push constants and descriptor bindings:
+			avk::push_constant_binding_data{ avk::shader_type::ray_generation | avk::shader_type::closest_hit, 0, sizeof(push_const_data_particle_spawner) },
+			avk::descriptor_binding<avk::top_level_acceleration_structure>(0, 0, 1),
+			avk::descriptor_binding(0, 1, mSpawnedParticlesBuffer->as_storage_buffer()),
+			avk::descriptor_binding(0, 2, rayStatistics->counters_buffer()->as_storage_buffer())
+		);
+
+#if ENABLE_SHADER_HOT_RELOADING_FOR_RAY_TRACING_PIPELINE
+		// Create an updater:
+		mUpdater.emplace();
+		mPipeline.enable_shared_ownership(); // The updater needs to hold a reference to it, so we need to enable shared ownership.
+		mUpdater->on(gvk::shader_files_changed_event(mPipeline))
+			.update(mPipeline);
+#endif
+		
+		// Add an "ImGui Manager" which handles the UI specific to the requirements of this invokee:
+		auto imguiManager = gvk::current_composition()->element_by_type<gvk::imgui_manager>();
+		if (nullptr != imguiManager) {
+			imguiManager->add_callback([this]() {
+				ImGui::Begin("Procedural Geometry");
+				ImGui::SetWindowPos(ImVec2(422, 2.0f), ImGuiCond_FirstUseEver);
+				ImGui::SetWindowSize(ImVec2(402.0f, 300.0f), ImGuiCond_FirstUseEver);
+
+				ImGui::Separator();
+				ImGui::Text("Spawn Settings:");
+				ImGui::DragFloat3("Spawn Origin", glm::value_ptr(mSpawnOrigin), 0.1f);
+				ImGui::DragFloat3("Spawn Direction", glm::value_ptr(mSpawnDirection), 0.1f);
+				ImGui::SliderFloat("Spawn Cone Angle (Degrees)", &mSpawnAngle, 10.0f, 80.0f);
+				ImGui::Checkbox("Add Random Offset", &mRandomlyOffsetDirecion);
+				ImGui::SliderFloat("Radius of newly spawned particle", &mRadiusOfNewWaterParticles, 0.0001f, 1.0f);
+
+				ImGui::Separator();
+				ImVec4 particlesStatusTextColor(0.0f, 0.9f, 0.3f, 1.0f);
+				if (is_at_particle_capacity_limit()) {
+					mCurrentlySpawningWaterParticles = false; // Can't spawn any more
+					ImGui::PushItemFlag(ImGuiItemFlags_Disabled, true); // Disable the following checkbox
+					particlesStatusTextColor = ImVec4(0.9f, 0.3f, 0.0f, 1.0f);
+				}
+				ImGui::Checkbox("SPAWN NEW WATER PARTICLES!", &mCurrentlySpawningWaterParticles);
+				if (is_at_particle_capacity_limit()) {
+					ImGui::PopItemFlag();
+				}
+				auto spawnStatus = fmt::format("{} particles spawned so far.", mGeometryInstances.size());
+				ImGui::TextColored(particlesStatusTextColor, spawnStatus.c_str());
+				ImGui::Text("Capacity: %u (limit from memory budget: %u)", mParticleCapacity, mParticleCapacityLimit);
+
+				ImGui::Separator();
+				ImGui::Text("Particle Snapshot:");
+				ImGui::InputText("File", mSnapshotPath.data(), mSnapshotPath.size());
+				if (ImGui::Button("Save")) {
+					mPendingSnapshotSave = std::string(mSnapshotPath.data());
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Load")) {
+					mPendingSnapshotLoad = std::string(mSnapshotPath.data());
+				}
+				if (mLastSnapshotStats.mNumParticles > 0) {
+					ImGui::Text("%zu particles, %s in %.1f ms", mLastSnapshotStats.mNumParticles, format_bytes(mLastSnapshotStats.mFileSize).c_str(), mLastSnapshotStats.mSeconds * 1000.0);
+				}
+
+				if (mBridgeName.has_value()) {
+					ImGui::Separator();
+					ImGui::Text("Particle Bridge '%s':", mBridgeName->c_str());
+					if (nullptr != mBridge.mHeader) {
+						ImGui::Text("Frame %llu, %llu consumed, %llu skipped", mBridgeSequence, mBridgeFramesConsumed, mBridgeFramesSkipped);
+					}
+					else {
+						ImGui::TextColored(ImVec4(0.9f, 0.3f, 0.0f, 1.0f), "Waiting for the producer...");
+					}
+				}
+
+				ImGui::End();
+			});
+		}
+	}
+	
+	// Returns true if a TLAS that uses the geometry of this invokee must be updated because the geometry has changed,
+	// which in this case always means: more particles have been added.
+	[[nodiscard]] bool has_updated_geometry_for_tlas() const
+	{
+		return mTlasUpdateRequired;
+	}
+
+	// Returns true if the particle capacity has grown since the last TLAS build, i.e., the TLAS must be reallocated:
+	[[nodiscard]] bool has_grown_particle_capacity() const
+	{
+		return mParticleCapacityGrown;
+	}
+
+	void reset_update_required_flag()
+	{
+		mTlasUpdateRequired = false;
+		mParticleCapacityGrown = false;
+		mChangedParticleBounds = bounding_box{};
+	}
+
+	// Returns the bounds of all the particles which have been added, moved, or removed since the last TLAS build:
+	[[nodiscard]] const bounding_box& changed_particle_bounds() const
+	{
+		return mChangedParticleBounds;
+	}
+
+	// Descriptor sets which refer to a TLAS which is about to be destroyed must not be used anymore:
+	void remove_descriptor_sets_with_tlas(const avk::top_level_acceleration_structure_t& aTlas)
+	{
+		mDescriptorCache.remove_sets_with_handle(aTlas.acceleration_structure_handle());
+	}
+
+	// Return the geometry instances to the caller, who will use it for a TLAS build:
+	[[nodiscard]] const auto& get_geometry_instances_buffer()
+	{
+		return mGeometryInstances;
+	}
+
+	// Invoked by the framework every frame:
+	void update() override
+	{
+		// Tidy up some of the values:
+		mSpawnDirection = glm::normalize(mSpawnDirection);
+		if (glm::any(glm::isnan(mSpawnDirection))) {
+			mSpawnDirection = glm::vec3{ 0.0f, -1.0f, 0.0f };
+		}
+		mSpawnAngleRad = glm::radians(mSpawnAngle);
+
+		// Snapshots which have been requested via the UI (or the command line) are saved and loaded here, not during the UI pass:
+		if (mPendingSnapshotSave.has_value()) {
+			save_snapshot(*mPendingSnapshotSave);
+			mPendingSnapshotSave.reset();
+		}
+		if (mPendingSnapshotLoad.has_value()) {
+			load_snapshot(*mPendingSnapshotLoad);
+			mPendingSnapshotLoad.reset();
+		}
+
+		// In bridge mode, the particles are entirely controlled by the external simulator:
+		if (mBridgeName.has_value()) {
+			consume_bridge_frame();
+		}
+
+		if (mCurrentlySpawningWaterParticles && !is_at_particle_capacity_limit()) {
+
+			// Okay, here's what we're going to do:
+			//  1) We let the GPU trace several rays
+			//  2) We read back the result
+			//  3) We select ONE particle position and add that to our instances
+			
+			auto& commandPool = gvk::context().get_command_pool_for_single_use_command_buffers(*mQueue);
+			auto cmdbfr = commandPool->alloc_command_buffer(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+			cmdbfr->begin_recording();
+
+			// We're using only one TLAS for all frames in flight. Therefore, we need to set up a barrier
+			// affecting the whole queue which waits until all previous ray tracing work has completed:
+			cmdbfr->establish_execution_barrier(
+				avk::pipeline_stage::ray_tracing_shaders, /* -> */ avk::pipeline_stage::acceleration_structure_build
+			);
+
+			auto* mainInvokee = gvk::current_composition()->element_by_type<fluid_nightmare_main>();
+			assert(nullptr != mainInvokee);
+
+			auto* rayStatistics = gvk::current_composition()->element_by_type<ray_statistics>();
+			assert(nullptr != rayStatistics);
+
+			cmdbfr->bind_pipeline(avk::const_referenced(mPipeline));
+			cmdbfr->bind_descriptors(mPipeline->layout(), mDescriptorCache.get_or_create_descriptor_sets({
+				avk::descriptor_binding(0, 0, mainInvokee->get_tlas()),
+				avk::descriptor_binding(0, 1, mSpawnedParticlesBuffer->as_storage_buffer()),
+				avk::descriptor_binding(0, 2, rayStatistics->counters_buffer()->as_storage_buffer())
+			}));
+
+			// Set the push constants:
+			auto pushConstantsForThisDrawCall = push_const_data_particle_spawner{
+				gvk::matrix_from_transforms(
+					glm::vec3{ mSpawnOrigin },                                 // Location of our spawning point
+					// Build a from-to-rotation quaternion:
+					glm::quat(glm::vec3{0.0f, -1.0f, 0.0f}, mSpawnDirection),  // How our spawning direction will be rotated => Create rotation relative to our default -y direction!
+					glm::vec3{1.0f}                                            // Scale doesn't matter
+				),
+				mSpawnAngleRad,
+				mRadiusOfNewWaterParticles,
+				mainInvokee->get_cull_mask()
+			};
+			cmdbfr->handle().pushConstants(mPipeline->layout_handle(), vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eClosestHitKHR, 0, sizeof(pushConstantsForThisDrawCall), &pushConstantsForThisDrawCall);
+
+			// Do it:
+			auto* gpuProfiler = gvk::current_composition()->element_by_type<gpu_timestamp_profiler>();
+			if (nullptr != gpuProfiler) { gpuProfiler->begin_pass(*cmdbfr, gpu_pass::spawn_trace); }
+			cmdbfr->trace_rays(
+				vk::Extent3D{ cNewParticleCandidatesToSpawn, 1u, 1u },
+				mPipeline->shader_binding_table(),
+				avk::using_raygen_group_at_index(0),
+				avk::using_miss_group_at_index(0),
+				avk::using_hit_group_at_index(0)
+			);
+			if (nullptr != gpuProfiler) { gpuProfiler->end_pass(*cmdbfr, gpu_pass::spawn_trace); }
+
+			// We don't add a barrier here. We'll just wait for completion via the fence.
+
+			cmdbfr->end_recording();
+			auto fen = mQueue->submit_with_fence(avk::referenced(cmdbfr));
+			{
+				PROFILE_CPU_SCOPE("wait for spawn trace");
+				fen->wait_until_signalled();
+			}
+
+			PROFILE_CPU_SCOPE("select spawn candidate");
+			// Read back the data into an array:
+			auto candidates = mSpawnedParticlesBuffer->read<std::array<glm::vec4, cNewParticleCandidatesToSpawn>>(0, avk::sync::wait_idle());
+			// Select the "best" of the candidates:
+			const glm::vec4 selectedCandidate = select_spawn_candidate(candidates.data(), candidates.size());
+
+			if (mGeometryInstances.size() >= mParticleCapacity) {
+				grow_particle_capacity();
+			}
+			
+			mGeometryInstances.push_back(
+				gvk::context().create_geometry_instance(mBlas) // Refer to the concrete BLAS; it is the same for each water particle
+					// Handle water particles instance offset of 1; i.e. based on that, the
+					// right (procedural) shaders will be chosen from the shader binding table:
+					.set_instance_offset(1)
+					// All water particles share the same instance mask:
+					.set_mask(cParticlesInstanceMask)
+					// Set this instance's transformation matrix (offset by the selected candidate's position, do not rotate, scale according to the current setting):
+				.set_transform_column_major(particle_transform(glm::vec3{ selectedCandidate }, mRadiusOfNewWaterParticles))
+			);
+			mParticles.emplace_back(glm::vec3{ selectedCandidate }, mRadiusOfNewWaterParticles);
+			mChangedParticleBounds.add(mParticles.back());
+
+			memory_accounting().host(host_memory_subsystem::particles).set(mGeometryInstances.capacity() * sizeof(avk::geometry_instance) + mParticles.capacity() * sizeof(glm::vec4));
+
+			mTlasUpdateRequired = true;
+		}
+	}
+
+	void finalize() override
+	{
+		fn_bridge_close(&mBridge);
+	}
+
+	// Some getters that will be used by the main invokee:
+	[[nodiscard]] uint32_t max_number_of_geometry_instances() const { return mParticleCapacity; }
+	[[nodiscard]] size_t number_of_particles() const { return mGeometryInstances.size(); }
+	// Positions (xyz) and radii (w) of all particles, in the same order as their geometry instances:
+	[[nodiscard]] const std::vector<glm::vec4>& particles() const { return mParticles; }
+	[[nodiscard]] bool is_at_particle_capacity_limit() const { return mGeometryInstances.size() >= mParticleCapacityLimit; }
+
+	// Set the number of particles which the capacity may grow up to (derived from the memory budget by the main invokee):
+	void set_particle_capacity_limit(uint32_t aLimit)
+	{
+		mParticleCapacityLimit = std::max(aLimit, cInitialParticleCapacity);
+	}
+
+	// Setters for the spawn settings, which allow to control spawning without the UI (e.g., by the benchmark_runner):
+	void set_spawning_enabled(bool aEnabled) { mCurrentlySpawningWaterParticles = aEnabled; }
+	void set_spawn_origin(const glm::vec3& aOrigin) { mSpawnOrigin = aOrigin; }
+	void set_spawn_direction(const glm::vec3& aDirection) { mSpawnDirection = aDirection; }
+	void set_spawn_cone_angle(float aAngleDegrees) { mSpawnAngle = aAngleDegrees; }
+	void set_radius_of_new_particles(float aRadius) { mRadiusOfNewWaterParticles = aRadius; }
+
+	// Replaces all particles at once, e.g. with the ones of a snapshot. The capacity is grown in one step, and the
+	// TLAS is rebuilt only once with all of them (instead of once per particle when spawning them one by one).
+	void set_particles(const glm::vec4* aParticles, size_t aNumParticles)
+	{
+		PROFILE_CPU_SCOPE("set particles");
+		if (aNumParticles > mParticleCapacityLimit) {
+			LOG_WARNING(fmt::format("Only {} of {} particles fit into the memory budget.", mParticleCapacityLimit, aNumParticles));
+			aNumParticles = mParticleCapacityLimit;
+		}
+		if (aNumParticles > mParticleCapacity) {
+			uint64_t newCapacity = mParticleCapacity;
+			while (newCapacity < aNumParticles) {
+				newCapacity *= 2;
+			}
+			newCapacity = std::min<uint64_t>(newCapacity, mParticleCapacityLimit);
+			LOG_INFO(fmt::format("Growing the particle capacity from {} to {}.", mParticleCapacity, newCapacity));
+			mParticleCapacity = static_cast<uint32_t>(newCapacity);
+			mParticleCapacityGrown = true;
+		}
+
+		// Both, the old and the new particles have changed:
+		mChangedParticleBounds.add(compute_particle_bounds(mParticles.data(), mParticles.size()));
+		mChangedParticleBounds.add(compute_particle_bounds(aParticles, aNumParticles));
+
+		mParticles.reserve(mParticleCapacity);
+		mParticles.assign(aParticles, aParticles + aNumParticles);
+
+		// All the geometry instances are the same, except for their transforms, which are filled in in parallel:
+		const avk::geometry_instance prototype = gvk::context().create_geometry_instance(mBlas)
+			.set_instance_offset(1)
+			.set_mask(cParticlesInstanceMask);
+		mGeometryInstances.reserve(mParticleCapacity);
+		mGeometryInstances.assign(mParticles.size(), prototype);
+		constexpr size_t cBatchSize = 4096;
+		std::vector<size_t> batches((mParticles.size() + cBatchSize - 1) / cBatchSize);
+		std::iota(std::begin(batches), std::end(batches), size_t{ 0 });
+		std::for_each(std::execution::par, std::begin(batches), std::end(batches), [this](size_t aBatch) {
+			const size_t end = std::min(mParticles.size(), (aBatch + 1) * cBatchSize);
+			for (size_t i = aBatch * cBatchSize; i < end; ++i) {
+				mGeometryInstances[i].set_transform_column_major(particle_transform(glm::vec3{ mParticles[i] }, mParticles[i].w));
+			}
+		});
+
+		memory_accounting().host(host_memory_subsystem::particles).set(mGeometryInstances.capacity() * sizeof(avk::geometry_instance) + mParticles.capacity() * sizeof(glm::vec4));
+		mTlasUpdateRequired = true;
+	}
+
+	void set_particles(const std::vector<glm::vec4>& aParticles)
+	{
+		set_particles(aParticles.data(), aParticles.size());
+	}
+
+	// Replaces the particles with the newest frame of an external simulator in every update(), see particle_bridge.h.
+	// Spawning is disabled in this mode. The producer may be started before or after this application.
+	void consume_from_bridge(std::string aSharedMemoryName)
+	{
+		mBridgeName = std::move(aSharedMemoryName);
+		mCurrentlySpawningWaterParticles = false;
+	}
+
+	// Saves or loads a particle snapshot at the beginning of the next update():
+	void request_snapshot_save(std::string aFilePath) { mPendingSnapshotSave = std::move(aFilePath); }
+	void request_snapshot_load(std::string aFilePath) { mPendingSnapshotLoad = std::move(aFilePath); }
+
+	[[nodiscard]] spawn_settings get_spawn_settings() const
+	{
+		return spawn_settings{ mSpawnOrigin, mSpawnDirection, mSpawnAngle, mRandomlyOffsetDirecion ? 1u : 0u, mRadiusOfNewWaterParticles, mCurrentlySpawningWaterParticles ? 1u : 0u };
+	}
+
+	void set_spawn_settings(const spawn_settings& aSettings)
+	{
+		mSpawnOrigin = aSettings.mOrigin;
+		mSpawnDirection = aSettings.mDirection;
+		mSpawnAngle = aSettings.mConeAngle;
+		mRandomlyOffsetDirecion = 0u != aSettings.mRandomlyOffsetDirection;
+		mRadiusOfNewWaterParticles = aSettings.mRadius;
+		mCurrentlySpawningWaterParticles = 0u != aSettings.mSpawning;
+	}
+	
+private:
+	void save_snapshot(const std::string& aFilePath)
+	{
+		try {
+			mLastSnapshotStats = save_particle_snapshot(aFilePath, mParticles);
+			LOG_INFO(fmt::format("Saved {} particles to '{}' ({}) in {:.1f} ms.", mLastSnapshotStats.mNumParticles, aFilePath, format_bytes(mLastSnapshotStats.mFileSize), mLastSnapshotStats.mSeconds * 1000.0));
+		}
+		catch (gvk::runtime_error& e) {
+			LOG_ERROR(e.what());
+		}
+	}
+
+	void load_snapshot(const std::string& aFilePath)
+	{
+		try {
+			const auto start = std::chrono::steady_clock::now();
+			set_particles(load_particle_snapshot(aFilePath, &mLastSnapshotStats));
+			LOG_INFO(fmt::format("Loaded {} particles from '{}' ({}) in {:.1f} ms, {:.1f} ms including the geometry instances.", mLastSnapshotStats.mNumParticles, aFilePath,
+				format_bytes(mLastSnapshotStats.mFileSize), mLastSnapshotStats.mSeconds * 1000.0, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()));
+		}
+		catch (gvk::runtime_error& e) {
+			LOG_ERROR(e.what());
+		}
+	}
+
+	// Takes the newest complete frame from the particle bridge, if it is a new one. The particles are read straight from
+	// the shared memory into the host-side particles and geometry instances, and the frame is released right after.
+	void consume_bridge_frame()
+	{
+		if (nullptr == mBridge.mHeader) {
+			// The producer might not be running (yet). Try to connect about once per second:
+			if (mBridgeFramesUntilReconnect-- > 0) {
+				return;
+			}
+			mBridgeFramesUntilReconnect = 60;
+			if (FN_BRIDGE_OK != fn_bridge_open(&mBridge, mBridgeName->c_str())) {
+				return;
+			}
+			LOG_INFO(fmt::format("Connected to the particle bridge '{}' (up to {} particles per frame).", *mBridgeName, mBridge.mHeader->mMaxParticles));
+			mBridgeSequence = 0;
+		}
+
+		uint64_t sequence = 0;
+		uint32_t numParticles = 0;
+		const float* particles = fn_bridge_acquire(&mBridge, &sequence, &numParticles);
+		if (nullptr == particles) {
+			return;
+		}
+		if (sequence != mBridgeSequence) {
+			PROFILE_CPU_SCOPE("consume particle bridge frame");
+			// Frames which have been published while we were busy have been overwritten by newer ones:
+			if (0 != mBridgeSequence && sequence > mBridgeSequence + 1) {
+				mBridgeFramesSkipped += sequence - mBridgeSequence - 1;
+			}
+			set_particles(reinterpret_cast<const glm::vec4*>(particles), numParticles);
+			mBridgeSequence = sequence;
+			++mBridgeFramesConsumed;
+		}
+		fn_bridge_release(&mBridge);
+	}
+
+	// Double the capacity (without exceeding the limit) and reallocate the geometry instances' storage. The TLAS
+	// is reallocated by the main invokee before its next build, since it is the one who owns it.
+	void grow_particle_capacity()
+	{
+		PROFILE_CPU_SCOPE("grow particle capacity");
+		const auto newCapacity = static_cast<uint32_t>(std::min<uint64_t>(2ull * mParticleCapacity, mParticleCapacityLimit));
+		LOG_INFO(fmt::format("Growing the particle capacity from {} to {}.", mParticleCapacity, newCapacity));
+		mGeometryInstances.reserve(newCapacity);
+		mParticles.reserve(newCapacity);
+		mParticleCapacity = newCapacity;
+		mParticleCapacityGrown = true;
+	}
+
+private: // v== Member variables ==v
+
+	// --------------- Some fundamental stuff -----------------
+
+	// Our only queue where we submit command buffers to:
+	avk::queue* mQueue;
+
+	// Our only descriptor cache which stores reusable descriptor sets:
+	avk::descriptor_cache mDescriptorCache;
+
+	// How many new particle candidates shall be spawned at a time
+	const static uint32_t cNewParticleCandidatesToSpawn = 16u * 16u;
+	
+	// A buffer that will contain potential positions of new particles
+	avk::buffer mSpawnedParticlesBuffer;
+	
+	// ------------------- Constants/Settings ----------------------
+
+	// The particle capacity starts at this value and doubles whenever it is exhausted:
+	const static uint32_t cInitialParticleCapacity = 4096;
+
+	// The number of particles which the TLAS and the geometry instances are currently sized for:
+	uint32_t mParticleCapacity = cInitialParticleCapacity;
+
+	// The capacity must not grow beyond this value:
+	uint32_t mParticleCapacityLimit = cInitialParticleCapacity;
+
+	// True when the capacity has grown, s.t. the TLAS must be reallocated:
+	bool mParticleCapacityGrown = false;
+	
+	// ---------------- Acceleration Structures --------------------
+
+	// The ray tracing pipeline that spawns new particles:
+	avk::ray_tracing_pipeline mPipeline;
+	
+	// ---------------- Acceleration Structures --------------------
+
+	// A BLAS which represents one single water particle. All other particles are instanced:
+	avk::bottom_level_acceleration_structure mBlas;
+
+	// A buffer which contains all a geometry instance for every single water particle:
+	std::vector<avk::geometry_instance> mGeometryInstances;
+	// ...and the position (xyz) and radius (w) of every single water particle, kept on the host for snapshots and exports:
+	std::vector<glm::vec4> mParticles;
+	// ...and the bounds of the particles which have changed since the last TLAS build:
+	bounding_box mChangedParticleBounds;
+
+	// ------------------- UI settings -----------------------
+
+	// Where particle snapshots are saved to and loaded from, and pending requests to do so:
+	std::array<char, 260> mSnapshotPath{ "particles.fnps" };
+	std::optional<std::string> mPendingSnapshotSave;
+	std::optional<std::string> mPendingSnapshotLoad;
+	particle_snapshot_stats mLastSnapshotStats;
+
+	// The shared memory of an external simulator whose particles are rendered instead of spawned ones, if any:
+	std::optional<std::string> mBridgeName;
+	fn_bridge mBridge{ nullptr, nullptr, 0, FN_BRIDGE_NO_SLOT };
+	uint64_t mBridgeSequence = 0;
+	uint64_t mBridgeFramesConsumed = 0;
+	uint64_t mBridgeFramesSkipped = 0;
+	int mBridgeFramesUntilReconnect = 0;
+
+	// The origin where from spawning rays are sent out (in world space):
+	glm::vec3 mSpawnOrigin = glm::vec3(0.0f, 20.0f, 0.0f);
+
+	// The orientation of the spawning frustum (in world space):
+	glm::vec3 mSpawnDirection = glm::vec3(0.0f, -1.0f, 0.0f);
+
+	// The possible max.  deviation from mSpawnDirection for the spawning rays:
+	float mSpawnAngle = 45.0f;
+	float mSpawnAngleRad;
+
+	// If set to true, a random offset will be added to the spawn direction 
+	bool mRandomlyOffsetDirecion = true;
+	
+	// The water particle's (uniform) scale:
+	float mRadiusOfNewWaterParticles = 0.35f;
+
+	// True if water particles are currently being spawned:
+	bool mCurrentlySpawningWaterParticles = false;
+
+	// True when an TLAS update is immanent:
+	bool mTlasUpdateRequired = true;
+
+	// How often a particle has been spawned. I.e. this number should
+	// represent the total number of water particles in the scene:
+	int mNumberOfSpawnInvocations = 0;
+
+}; // End of procedural_geometry_manager
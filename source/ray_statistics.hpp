@@ -0,0 +1,204 @@
+#pragma once
+
+#include <gvk.hpp>
+#include <imgui.h>
+#include <imgui_internal.h>
+
+#include "preprocessor_defines.hpp"
+#include "memory_accounting.hpp"
+
+// All the counters which the ray tracing shaders increment. They must be in the same order as
+// the members of the RayStatistics buffer which is declared in the shaders:
+enum struct ray_counter : uint32_t
+{
+	primary_rays = 0,
+	shadow_rays,
+	ambient_occlusion_rays,
+	spawn_rays,
+	primary_triangle_hits,
+	primary_particle_hits,
+	shadow_hits,
+	ambient_occlusion_hits,
+	spawn_triangle_hits,
+	spawn_particle_hits,
+	intersection_tests,
+	count
+};
+
+// Human-readable names of the ray_counter entries, in the same order:
+static const char* const ray_counter_names[] = {
+	"Primary Rays",
+	"Shadow Rays",
+	"AO Rays",
+	"Spawn Rays",
+	"Primary Triangle Hits",
+	"Primary Particle Hits",
+	"Shadow Hits",
+	"AO Hits",
+	"Spawn Triangle Hits",
+	"Spawn Particle Hits",
+	"Intersection Tests"
+};
+static_assert(std::size(ray_counter_names) == static_cast<size_t>(ray_counter::count));
+
+// An invokee which owns the buffer the ray tracing shaders count rays, hits, and intersection tests into.
+// The shaders aggregate their increments per subgroup. Every few frames, the counters are copied into
+// a host-visible buffer and cleared; the copy is read back the next time, i.e. without stalling.
+class ray_statistics : public gvk::invokee
+{
+public: // v== gvk::invokee overrides which will be invoked by the framework ==v
+	using counters = std::array<uint32_t, static_cast<size_t>(ray_counter::count)>;
+
+	ray_statistics(avk::queue& aQueue)
+		: invokee{ -20 } // Execute BEFORE the invokees whose pipelines bind the counters buffer
+		, mQueue{ &aQueue }
+	{}
+
+	void initialize() override
+	{
+		// The readback must happen after the GPU has completed the frame which copied the counters:
+		mReadbackInterval = std::max(mReadbackInterval, static_cast<uint32_t>(gvk::context().main_window()->number_of_frames_in_flight()) + 1u);
+
+		mCountersBuffer = gvk::context().create_buffer(
+			avk::memory_usage::device, vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+			avk::storage_buffer_meta::create_from_size(sizeof(counters))
+		);
+		const counters zeros{};
+		mCountersBuffer->fill(zeros.data(), 0, avk::sync::wait_idle());
+		mReadbackBuffer = gvk::context().create_buffer(
+			avk::memory_usage::host_coherent, vk::BufferUsageFlagBits::eTransferDst,
+			avk::generic_buffer_meta::create_from_size(sizeof(counters))
+		);
+		memory_accounting().add(gpu_memory_category::profiling, *mCountersBuffer);
+		memory_accounting().add(gpu_memory_category::readback_buffers, *mReadbackBuffer);
+		mLastCopyTime = std::chrono::steady_clock::now();
+
+		// The shaders use subgroup arithmetic in all ray tracing stages:
+		auto subgroupProps = gvk::context().physical_device().getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceSubgroupProperties>().get<vk::PhysicalDeviceSubgroupProperties>();
+		const auto rtStages = vk::ShaderStageFlagBits::eRaygenKHR | vk::ShaderStageFlagBits::eClosestHitKHR | vk::ShaderStageFlagBits::eIntersectionKHR;
+		if ((subgroupProps.supportedStages & rtStages) != rtStages || !(subgroupProps.supportedOperations & vk::SubgroupFeatureFlagBits::eArithmetic)) {
+			LOG_WARNING("Subgroup arithmetic is not supported in all ray tracing stages, but the ray statistics rely on it.");
+		}
+
+		auto imguiManager = gvk::current_composition()->element_by_type<gvk::imgui_manager>();
+		if (nullptr != imguiManager) {
+			imguiManager->add_callback([this]() {
+				ImGui::Begin("Ray Statistics");
+				ImGui::SetWindowPos(ImVec2(830.0f, 712.0f), ImGuiCond_FirstUseEver);
+				ImGui::SetWindowSize(ImVec2(420.0f, 290.0f), ImGuiCond_FirstUseEver);
+
+				int interval = static_cast<int>(mReadbackInterval);
+				const int minInterval = static_cast<int>(gvk::context().main_window()->number_of_frames_in_flight()) + 1;
+				if (ImGui::SliderInt("Readback Interval (frames)", &interval, minInterval, 120)) {
+					mReadbackInterval = static_cast<uint32_t>(interval);
+				}
+				ImGui::Text("Counted over the last %.1f ms:", mIntervalSeconds * 1000.0);
+
+				ImGui::Text("%-22s %12s %10s", "", "Count", "M/s");
+				for (size_t c = 0; c < mLatest.size(); ++c) {
+					ImGui::Text("%-22s %12u %10.2f", ray_counter_names[c], mLatest[c], per_second(static_cast<ray_counter>(c)) * 1e-6);
+				}
+				ImGui::Separator();
+				ImGui::Text("%-22s %12u", "Primary Misses", primary_misses());
+				ImGui::Text("%-22s %12u", "Shadow Misses", misses(ray_counter::shadow_rays, ray_counter::shadow_hits));
+				ImGui::Text("%-22s %12u", "AO Misses", misses(ray_counter::ambient_occlusion_rays, ray_counter::ambient_occlusion_hits));
+				ImGui::Text("%-22s %12u", "Spawn Misses", spawn_misses());
+				ImGui::Text("%-22s %22.2f", "Total Rays [M/s]", total_rays_per_second() * 1e-6);
+
+				ImGui::End();
+			});
+		}
+	}
+
+	void render() override
+	{
+		if (0 != (++mFrameCount % mReadbackInterval)) {
+			return;
+		}
+
+		// The counters which have been copied the previous time can be read back safely by now:
+		if (mPreviousCopyTime.has_value()) {
+			mReadbackBuffer->read(mLatest.data(), 0, avk::sync::not_required());
+			mIntervalSeconds = std::chrono::duration<double>(mLastCopyTime - *mPreviousCopyTime).count();
+		}
+
+		// Copy the counters which have accumulated since the last copy, then start over:
+		auto& commandPool = gvk::context().get_command_pool_for_single_use_command_buffers(*mQueue);
+		auto cmdbfr = commandPool->alloc_command_buffer(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+		cmdbfr->begin_recording();
+		cmdbfr->establish_global_memory_barrier(
+			avk::pipeline_stage::ray_tracing_shaders, avk::pipeline_stage::transfer,
+			avk::memory_access::shader_buffers_and_images_write_access, avk::memory_access::transfer_read_access
+		);
+		cmdbfr->handle().copyBuffer(mCountersBuffer->handle(), mReadbackBuffer->handle(), vk::BufferCopy{ 0, 0, sizeof(counters) });
+		cmdbfr->establish_global_memory_barrier(
+			avk::pipeline_stage::transfer, avk::pipeline_stage::transfer,
+			avk::memory_access::transfer_read_access, avk::memory_access::transfer_write_access
+		);
+		cmdbfr->handle().fillBuffer(mCountersBuffer->handle(), 0, VK_WHOLE_SIZE, 0u);
+		cmdbfr->establish_global_memory_barrier(
+			avk::pipeline_stage::transfer, avk::pipeline_stage::ray_tracing_shaders | avk::pipeline_stage::host,
+			avk::memory_access::transfer_write_access, avk::memory_access::shader_buffers_and_images_read_access | avk::memory_access::shader_buffers_and_images_write_access | avk::memory_access::host_read_access
+		);
+		cmdbfr->end_recording();
+		mQueue->submit(avk::referenced(cmdbfr));
+		gvk::context().main_window()->handle_lifetime(avk::owned(cmdbfr));
+
+		mPreviousCopyTime = mLastCopyTime;
+		mLastCopyTime = std::chrono::steady_clock::now();
+	}
+
+	// The buffer which is to be bound to the ray tracing pipelines:
+	[[nodiscard]] const avk::buffer& counters_buffer() const { return mCountersBuffer; }
+
+	// The counts of the most recent interval which has been read back:
+	[[nodiscard]] const counters& latest() const { return mLatest; }
+	[[nodiscard]] uint32_t latest(ray_counter aCounter) const { return mLatest[static_cast<size_t>(aCounter)]; }
+	[[nodiscard]] double interval_seconds() const { return mIntervalSeconds; }
+
+	[[nodiscard]] double per_second(ray_counter aCounter) const
+	{
+		return mIntervalSeconds > 0.0 ? static_cast<double>(latest(aCounter)) / mIntervalSeconds : 0.0;
+	}
+
+	[[nodiscard]] double total_rays_per_second() const
+	{
+		return per_second(ray_counter::primary_rays) + per_second(ray_counter::shadow_rays) + per_second(ray_counter::ambient_occlusion_rays) + per_second(ray_counter::spawn_rays);
+	}
+
+	// Misses are not counted, but derived from the numbers of rays and hits:
+	[[nodiscard]] uint32_t misses(ray_counter aRays, ray_counter aHits) const
+	{
+		return latest(aRays) > latest(aHits) ? latest(aRays) - latest(aHits) : 0u;
+	}
+	[[nodiscard]] uint32_t primary_misses() const
+	{
+		const auto hits = latest(ray_counter::primary_triangle_hits) + latest(ray_counter::primary_particle_hits);
+		return latest(ray_counter::primary_rays) > hits ? latest(ray_counter::primary_rays) - hits : 0u;
+	}
+	[[nodiscard]] uint32_t spawn_misses() const
+	{
+		const auto hits = latest(ray_counter::spawn_triangle_hits) + latest(ray_counter::spawn_particle_hits);
+		return latest(ray_counter::spawn_rays) > hits ? latest(ray_counter::spawn_rays) - hits : 0u;
+	}
+
+private:
+	// The queue where the copy commands are submitted to:
+	avk::queue* mQueue;
+
+	// The buffer which the shaders count into, and its host-visible copy:
+	avk::buffer mCountersBuffer;
+	avk::buffer mReadbackBuffer;
+
+	// Copy and clear the counters every this many frames. (The counters are 32 bit, so don't make it too long.)
+	uint32_t mReadbackInterval = 10;
+	uint64_t mFrameCount = 0;
+
+	// The times when the counters have been copied the last two times, which define the latest interval:
+	std::chrono::steady_clock::time_point mLastCopyTime = std::chrono::steady_clock::now();
+	std::optional<std::chrono::steady_clock::time_point> mPreviousCopyTime;
+
+	counters mLatest{};
+	double mIntervalSeconds = 0.0;
+
+}; // End of ray_statistics
@@ -0,0 +1,377 @@
+#pragma once
+
+#include <gvk.hpp>
+#include <imgui.h>
+#include <imgui_internal.h>
+
+#include "preprocessor_defines.hpp"
+#include "fluid_nightmare_main.hpp"
+#include "triangle_mesh_geometry_manager.hpp"
+#include "procedural_geometry_manager.hpp"
+#include "cpu_scope_profiler.hpp"
+#include "frame_telemetry.hpp"
+
+// The binary replay log consists of a replay_log_header, followed by one record per frame:
+//
+//   uint32_t   frame index
+//   float      delta time of the recorded frame in seconds
+//   glm::vec3  camera translation
+//   glm::quat  camera rotation
+//   uint32_t   number of particles after the frame's spawn pass (used to detect diverging replays)
+//   uint32_t   flags (see replay_frame_flags)
+//   [fluid_nightmare_main::render_settings]                 if replay_frame_flags::render_settings is set
+//   [procedural_geometry_manager::spawn_settings]           if replay_frame_flags::spawn_settings is set
+//   [uint8_t x ceil(#geometry instances / 8) visibility]   if replay_frame_flags::instance_visibility is set
+//
+// Settings are only written in frames where they have changed, which keeps a record at 40 bytes most of the time.
+// The camera is recorded instead of the raw keyboard and mouse state, because the camera's movement depends on the
+// frame time, which differs between the recording and the replay.
+namespace replay_frame_flags
+{
+	static constexpr uint32_t render_settings     = 1u << 0;
+	static constexpr uint32_t spawn_settings      = 1u << 1;
+	static constexpr uint32_t instance_visibility = 1u << 2;
+	static constexpr uint32_t marker              = 1u << 3;
+}
+
+struct replay_log_header
+{
+	char mMagic[4];
+	uint32_t mVersion;
+	uint32_t mNumGeometryInstances;
+	uint32_t mRenderSettingsSize;
+	uint32_t mSpawnSettingsSize;
+};
+
+// One frame of a replay log, with all the settings resolved (i.e. not only the changed ones):
+struct replay_frame
+{
+	uint32_t mFrame;
+	float mDeltaTime;
+	glm::vec3 mCameraTranslation;
+	glm::quat mCameraRotation;
+	uint32_t mNumParticles;
+	uint32_t mFlags;
+	fluid_nightmare_main::render_settings mRenderSettings;
+	procedural_geometry_manager::spawn_settings mSpawnSettings;
+	std::vector<uint8_t> mInstanceVisibility;
+};
+
+// An invokee which either records everything that drives the application into a binary log, or replays
+// such a log frame by frame. A replay applies the recorded camera and settings at exactly the same frames,
+// s.t. a performance issue which has been observed once can be reproduced and profiled again and again.
+//
+// Frames can be marked during the recording, either manually with [F9] or automatically when a frame takes
+// much longer than the median. During the replay, the CPU profiler captures a few frames around every marker.
+class replay_recorder : public gvk::invokee
+{
+public: // v== gvk::invokee overrides which will be invoked by the framework ==v
+	enum struct mode { none, record, replay };
+
+	replay_recorder(mode aMode, std::optional<std::string> aLogFilePath)
+		: invokee{ -100 } // This invokee must execute BEFORE the geometry managers and the main invokee, s.t. replayed settings apply to the current frame
+		, mMode{ aLogFilePath.has_value() ? aMode : mode::none }
+		, mLogFilePath{ std::move(aLogFilePath) }
+	{}
+
+	void initialize() override
+	{
+		if (mode::none == mMode) {
+			disable();
+			return;
+		}
+
+		auto* triMeshGeomMgr = gvk::current_composition()->element_by_type<triangle_mesh_geometry_manager>();
+		assert(nullptr != triMeshGeomMgr);
+		mNumGeometryInstances = triMeshGeomMgr->max_number_of_geometry_instances();
+
+		if (mode::record == mMode) {
+			mLogFile.open(*mLogFilePath, std::ios::binary | std::ios::trunc);
+			if (!mLogFile.is_open()) {
+				throw gvk::runtime_error(fmt::format("Unable to open '{}' for recording a replay log.", *mLogFilePath));
+			}
+			const replay_log_header header{ { 'F', 'N', 'R', 'P' }, cVersion, mNumGeometryInstances,
+				static_cast<uint32_t>(sizeof(fluid_nightmare_main::render_settings)), static_cast<uint32_t>(sizeof(procedural_geometry_manager::spawn_settings)) };
+			write_pod(header);
+			LOG_INFO(fmt::format("Recording a replay log to '{}'. Press [F9] to mark a frame.", *mLogFilePath));
+		}
+		else {
+			load_log(*mLogFilePath);
+			LOG_INFO(fmt::format("Replaying {} frames from '{}'.", mFrames.size(), *mLogFilePath));
+
+			// The camera and the UI are entirely controlled by the replay:
+			auto* mainInvokee = gvk::current_composition()->element_by_type<fluid_nightmare_main>();
+			assert(nullptr != mainInvokee);
+			mainInvokee->camera().disable();
+			auto* imguiManager = gvk::current_composition()->element_by_type<gvk::imgui_manager>();
+			if (nullptr != imguiManager) { imguiManager->enable_user_interaction(false); }
+		}
+
+		auto imguiManager = gvk::current_composition()->element_by_type<gvk::imgui_manager>();
+		if (nullptr != imguiManager) {
+			imguiManager->add_callback([this]() {
+				ImGui::Begin("Replay");
+				ImGui::SetWindowPos(ImVec2(1260.0f, 712.0f), ImGuiCond_FirstUseEver);
+				ImGui::SetWindowSize(ImVec2(300.0f, 140.0f), ImGuiCond_FirstUseEver);
+				if (mode::record == mMode) {
+					ImGui::Text("Recording frame %u", mFrame);
+					ImGui::Text("%u markers, %.1f KiB written", mNumMarkers, static_cast<double>(mBytesWritten) / 1024.0);
+					ImGui::Checkbox("Mark Frame Time Spikes", &mAutoMarkSpikes);
+					ImGui::SliderFloat("Spike Factor", &mSpikeFactor, 1.5f, 10.0f, "%.1f x p50");
+				}
+				else {
+					ImGui::Text("Replaying frame %u / %zu", mFrame, mFrames.size());
+					ImGui::Text("%u markers", mNumMarkers);
+					if (mNumDivergedFrames > 0) {
+						ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.2f, 1.0f), "Diverged in %u frames!", mNumDivergedFrames);
+					}
+				}
+				ImGui::End();
+			});
+		}
+	}
+
+	void update() override
+	{
+		if (mode::replay != mMode) {
+			return;
+		}
+		if (mFrame >= mFrames.size()) {
+			LOG_INFO(fmt::format("Replay of '{}' has finished after {} frames, {} of which have diverged.", *mLogFilePath, mFrames.size(), mNumDivergedFrames));
+			gvk::current_composition()->stop();
+			return;
+		}
+
+		auto* mainInvokee = gvk::current_composition()->element_by_type<fluid_nightmare_main>();
+		assert(nullptr != mainInvokee);
+		auto* triMeshGeomMgr = gvk::current_composition()->element_by_type<triangle_mesh_geometry_manager>();
+		assert(nullptr != triMeshGeomMgr);
+		auto* procGeomMgr = gvk::current_composition()->element_by_type<procedural_geometry_manager>();
+		assert(nullptr != procGeomMgr);
+
+		const auto& f = mFrames[mFrame];
+		mainInvokee->camera().set_translation(f.mCameraTranslation);
+		mainInvokee->camera().set_rotation(f.mCameraRotation);
+		if (0u != (f.mFlags & replay_frame_flags::render_settings)) {
+			mainInvokee->set_render_settings(f.mRenderSettings);
+		}
+		if (0u != (f.mFlags & replay_frame_flags::spawn_settings)) {
+			procGeomMgr->set_spawn_settings(f.mSpawnSettings);
+		}
+		if (0u != (f.mFlags & replay_frame_flags::instance_visibility)) {
+			for (uint32_t i = 0; i < mNumGeometryInstances; ++i) {
+				triMeshGeomMgr->set_geometry_instance_visible(i, 0u != (f.mInstanceVisibility[i / 8] & (1u << (i % 8))));
+			}
+		}
+
+		// Capture the frames around the next marker with the CPU profiler:
+		if (mNextMarker < mMarkerFrames.size() && mFrame + cMarkerCaptureFrames >= mMarkerFrames[mNextMarker] && !cpu_profiler().is_recording()) {
+			cpu_profiler().start_recording();
+		}
+	}
+
+	void render() override
+	{
+		// Everything which can change the state of a frame (i.e. the camera, the UI, and the spawn pass) has been updated by now:
+		auto* mainInvokee = gvk::current_composition()->element_by_type<fluid_nightmare_main>();
+		assert(nullptr != mainInvokee);
+		auto* triMeshGeomMgr = gvk::current_composition()->element_by_type<triangle_mesh_geometry_manager>();
+		assert(nullptr != triMeshGeomMgr);
+		auto* procGeomMgr = gvk::current_composition()->element_by_type<procedural_geometry_manager>();
+		assert(nullptr != procGeomMgr);
+
+		if (mode::record == mMode) {
+			record_frame(*mainInvokee, *triMeshGeomMgr, *procGeomMgr);
+		}
+		else if (mFrame < mFrames.size()) {
+			const auto& f = mFrames[mFrame];
+			if (f.mNumParticles != static_cast<uint32_t>(procGeomMgr->number_of_particles())) {
+				if (0u == mNumDivergedFrames++) {
+					LOG_WARNING(fmt::format("Replay diverges in frame {}: {} particles instead of {}.", mFrame, procGeomMgr->number_of_particles(), f.mNumParticles));
+				}
+			}
+			if (0u != (f.mFlags & replay_frame_flags::marker)) {
+				LOG_INFO(fmt::format("Replay reached marker at frame {}: recorded frame time {:.3f} ms, replayed frame time {:.3f} ms.", mFrame, f.mDeltaTime * 1000.0f, gvk::time().delta_time() * 1000.0f));
+			}
+			if (mNextMarker < mMarkerFrames.size() && mFrame == mMarkerFrames[mNextMarker] + cMarkerCaptureFrames) {
+				cpu_profiler().stop_recording();
+				cpu_profiler().write_chrome_trace(fmt::format("replay_marker_{}.json", mMarkerFrames[mNextMarker]));
+				// Markers which have been covered by this capture don't get captures of their own:
+				while (mNextMarker < mMarkerFrames.size() && mMarkerFrames[mNextMarker] + cMarkerCaptureFrames <= mFrame) {
+					++mNextMarker;
+				}
+			}
+		}
+		++mFrame;
+	}
+
+	void finalize() override
+	{
+		if (mLogFile.is_open()) {
+			mLogFile.close();
+			LOG_INFO(fmt::format("Recorded {} frames with {} markers ({} bytes) to '{}'.", mFrame, mNumMarkers, mBytesWritten, *mLogFilePath));
+		}
+	}
+
+	// Marks the current frame during the recording:
+	void mark_frame() { mMarkCurrentFrame = true; }
+
+	[[nodiscard]] bool is_recording() const { return mode::record == mMode; }
+	[[nodiscard]] bool is_replaying() const { return mode::replay == mMode; }
+
+private:
+	template <typename T>
+	void write_pod(const T& aValue)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		mLogFile.write(reinterpret_cast<const char*>(&aValue), sizeof(T));
+		mBytesWritten += sizeof(T);
+	}
+
+	template <typename T>
+	static void read_pod(std::ifstream& aFile, T& aValue)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		aFile.read(reinterpret_cast<char*>(&aValue), sizeof(T));
+	}
+
+	void record_frame(fluid_nightmare_main& aMainInvokee, const triangle_mesh_geometry_manager& aTriMeshGeomMgr, const procedural_geometry_manager& aProcGeomMgr)
+	{
+		const auto deltaTime = gvk::time().delta_time();
+		if (gvk::input().key_pressed(gvk::key_code::f9)) {
+			mMarkCurrentFrame = true;
+		}
+		// Mark frames which take much longer than usual, once there are enough samples for a meaningful median:
+		auto* telemetry = gvk::current_composition()->element_by_type<frame_telemetry>();
+		if (mAutoMarkSpikes && nullptr != telemetry) {
+			const auto& cpuFrame = telemetry->metric(telemetry_metric_id::cpu_frame);
+			if (cpuFrame.count() > 60 && deltaTime * 1000.0f > mSpikeFactor * cpuFrame.p50()) {
+				mMarkCurrentFrame = true;
+			}
+		}
+
+		const auto renderSettings = aMainInvokee.get_render_settings();
+		const auto spawnSettings = aProcGeomMgr.get_spawn_settings();
+		std::vector<uint8_t> visibility((mNumGeometryInstances + 7) / 8, 0u);
+		for (uint32_t i = 0; i < mNumGeometryInstances; ++i) {
+			if (aTriMeshGeomMgr.is_geometry_instance_visible(i)) {
+				visibility[i / 8] |= static_cast<uint8_t>(1u << (i % 8));
+			}
+		}
+
+		// The first frame contains all the settings, subsequent frames only the changed ones:
+		uint32_t flags = 0u;
+		if (0 == mFrame || 0 != std::memcmp(&renderSettings, &mPreviousRenderSettings, sizeof(renderSettings))) {
+			flags |= replay_frame_flags::render_settings;
+		}
+		if (0 == mFrame || 0 != std::memcmp(&spawnSettings, &mPreviousSpawnSettings, sizeof(spawnSettings))) {
+			flags |= replay_frame_flags::spawn_settings;
+		}
+		if (0 == mFrame || visibility != mPreviousInstanceVisibility) {
+			flags |= replay_frame_flags::instance_visibility;
+		}
+		if (mMarkCurrentFrame) {
+			flags |= replay_frame_flags::marker;
+			++mNumMarkers;
+			mMarkCurrentFrame = false;
+		}
+
+		write_pod(mFrame);
+		write_pod(deltaTime);
+		write_pod(aMainInvokee.camera().translation());
+		write_pod(aMainInvokee.camera().rotation());
+		write_pod(static_cast<uint32_t>(aProcGeomMgr.number_of_particles()));
+		write_pod(flags);
+		if (0u != (flags & replay_frame_flags::render_settings)) {
+			write_pod(renderSettings);
+		}
+		if (0u != (flags & replay_frame_flags::spawn_settings)) {
+			write_pod(spawnSettings);
+		}
+		if (0u != (flags & replay_frame_flags::instance_visibility)) {
+			mLogFile.write(reinterpret_cast<const char*>(visibility.data()), static_cast<std::streamsize>(visibility.size()));
+			mBytesWritten += visibility.size();
+		}
+
+		mPreviousRenderSettings = renderSettings;
+		mPreviousSpawnSettings = spawnSettings;
+		mPreviousInstanceVisibility = std::move(visibility);
+	}
+
+	void load_log(const std::string& aFilePath)
+	{
+		std::ifstream file(aFilePath, std::ios::binary);
+		if (!file.is_open()) {
+			throw gvk::runtime_error(fmt::format("Unable to open replay log '{}'", aFilePath));
+		}
+		replay_log_header header{};
+		read_pod(file, header);
+		if (!file || 0 != std::memcmp(header.mMagic, "FNRP", 4) || cVersion != header.mVersion) {
+			throw gvk::runtime_error(fmt::format("'{}' is not a replay log of version {}", aFilePath, cVersion));
+		}
+		if (header.mRenderSettingsSize != sizeof(fluid_nightmare_main::render_settings) || header.mSpawnSettingsSize != sizeof(procedural_geometry_manager::spawn_settings)) {
+			throw gvk::runtime_error(fmt::format("Replay log '{}' has been recorded with a different set of settings", aFilePath));
+		}
+		if (header.mNumGeometryInstances != mNumGeometryInstances) {
+			throw gvk::runtime_error(fmt::format("Replay log '{}' has been recorded with {} geometry instances, but there are {}", aFilePath, header.mNumGeometryInstances, mNumGeometryInstances));
+		}
+
+		replay_frame f{};
+		f.mInstanceVisibility.resize((mNumGeometryInstances + 7) / 8, 0u);
+		while (true) {
+			read_pod(file, f.mFrame);
+			read_pod(file, f.mDeltaTime);
+			read_pod(file, f.mCameraTranslation);
+			read_pod(file, f.mCameraRotation);
+			read_pod(file, f.mNumParticles);
+			read_pod(file, f.mFlags);
+			if (0u != (f.mFlags & replay_frame_flags::render_settings)) {
+				read_pod(file, f.mRenderSettings);
+			}
+			if (0u != (f.mFlags & replay_frame_flags::spawn_settings)) {
+				read_pod(file, f.mSpawnSettings);
+			}
+			if (0u != (f.mFlags & replay_frame_flags::instance_visibility)) {
+				file.read(reinterpret_cast<char*>(f.mInstanceVisibility.data()), static_cast<std::streamsize>(f.mInstanceVisibility.size()));
+			}
+			if (!file) {
+				break; // A truncated last record (e.g. if the recording has crashed) is ignored
+			}
+			if (0u != (f.mFlags & replay_frame_flags::marker)) {
+				mMarkerFrames.push_back(static_cast<uint32_t>(mFrames.size()));
+			}
+			mFrames.push_back(f);
+		}
+		mNumMarkers = static_cast<uint32_t>(mMarkerFrames.size());
+	}
+
+	static constexpr uint32_t cVersion = 2u;
+
+	// How many frames before and after a marker are captured by the CPU profiler during the replay:
+	static constexpr uint32_t cMarkerCaptureFrames = 5u;
+
+	mode mMode;
+	std::optional<std::string> mLogFilePath;
+	uint32_t mNumGeometryInstances = 0;
+
+	// The current frame, counted from the start of the recording or replay:
+	uint32_t mFrame = 0;
+	uint32_t mNumMarkers = 0;
+
+	// Recording state:
+	std::ofstream mLogFile;
+	size_t mBytesWritten = 0;
+	bool mMarkCurrentFrame = false;
+	bool mAutoMarkSpikes = true;
+	float mSpikeFactor = 3.0f;
+	fluid_nightmare_main::render_settings mPreviousRenderSettings{};
+	procedural_geometry_manager::spawn_settings mPreviousSpawnSettings{};
+	std::vector<uint8_t> mPreviousInstanceVisibility;
+
+	// Replay state:
+	std::vector<replay_frame> mFrames;
+	std::vector<uint32_t> mMarkerFrames;
+	size_t mNextMarker = 0;
+	uint32_t mNumDivergedFrames = 0;
+
+}; // End of replay_recorder
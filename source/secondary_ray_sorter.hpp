@@ -0,0 +1,168 @@
+#pragma once
+
+#include <gvk.hpp>
+
+#include "cpu_to_gpu_data_types.hpp"
+#include "cpu_kernels.hpp"
+#include "memory_accounting.hpp"
+
+// The wavefront mode's G-buffer, and the sorting of its secondary rays: Instead of tracing the shadow rays and ambient
+// occlusion rays recursively from first_hit_closest_hit_shader.rchit, the primary rays only write a G-buffer sample per
+// pixel. Then, for every kind of secondary rays, bin_secondary_rays.comp and prefix_sum_secondary_ray_bins.comp sort the
+// rays by their direction's octant and the Morton code of their origin (a counting sort over 32768 bins), and the main
+// invokee traces them in a separate launch, in which neighbouring invocations trace coherent rays.
+// The buffers are owned by this class, but bound to the main invokee's ray tracing pipelines, too.
+class secondary_ray_sorter
+{
+public:
+	// 3 bits for the direction's octant, and 4 bits per axis for the origin's Morton code (see bin_secondary_rays.comp):
+	static constexpr uint32_t cNumBins = 1u << 15;
+	// The maximum number of secondary rays per pixel and kind (the ambient occlusion rays):
+	static constexpr uint32_t cMaxRaysPerPixel = 8;
+
+	// Creates the compute pipelines, and the buffers for the given resolution:
+	void initialize(glm::uvec2 aResolution)
+	{
+		mDescriptorCache = gvk::context().create_descriptor_cache();
+		create_buffers(aResolution);
+
+		mBinPipeline = gvk::context().create_compute_pipeline_for(
+			"shaders/secondary_ray_sorting/bin_secondary_rays.comp",
+			avk::push_constant_binding_data{ avk::shader_type::compute, 0, sizeof(push_const_data_secondary_ray_binning) },
+			avk::descriptor_binding(0, 0, mGBuffer->as_storage_buffer()),
+			avk::descriptor_binding(0, 1, mBinsBuffer->as_storage_buffer()),
+			avk::descriptor_binding(0, 2, mSortedRaysBuffer->as_storage_buffer())
+		);
+		mPrefixSumPipeline = gvk::context().create_compute_pipeline_for(
+			"shaders/secondary_ray_sorting/prefix_sum_secondary_ray_bins.comp",
+			avk::descriptor_binding(0, 0, mBinsBuffer->as_storage_buffer())
+		);
+	}
+
+	// (Re-)creates the G-buffer and the sorted rays for the given resolution. Nothing may use the old ones anymore, and
+	// the caller must remove its descriptor sets which refer to them beforehand:
+	void create_buffers(glm::uvec2 aResolution)
+	{
+		if (glm::uvec2{ 0u, 0u } != mResolution) { // Not for the first time
+			for (const auto* buffer : { &mGBuffer, &mBinsBuffer, &mSortedRaysBuffer }) {
+				mDescriptorCache.remove_sets_with_handle((*buffer)->handle());
+				memory_accounting().gpu(gpu_memory_category::render_targets).remove(memory_accountant::memory_size_of(*(*buffer)));
+			}
+		}
+
+		mResolution = aResolution;
+		const size_t numPixels = static_cast<size_t>(aResolution.x) * aResolution.y;
+		mGBuffer = gvk::context().create_buffer(
+			avk::memory_usage::device, {},
+			avk::storage_buffer_meta::create_from_size(numPixels * sizeof(secondary_ray_gbuffer_sample))
+		);
+		mBinsBuffer = gvk::context().create_buffer(
+			avk::memory_usage::device, vk::BufferUsageFlagBits::eTransferDst,
+			avk::storage_buffer_meta::create_from_size(sizeof(secondary_ray_bins_header) + cNumBins * sizeof(glm::uvec2))
+		);
+		mSortedRaysBuffer = gvk::context().create_buffer(
+			avk::memory_usage::device, {},
+			avk::storage_buffer_meta::create_from_size(numPixels * cMaxRaysPerPixel * sizeof(uint32_t))
+		);
+		for (const auto* buffer : { &mGBuffer, &mBinsBuffer, &mSortedRaysBuffer }) {
+			memory_accounting().add(gpu_memory_category::render_targets, *(*buffer));
+		}
+	}
+
+	// Records the sorting of the G-buffer's secondary rays of the given kind (shadow or ambient_occlusion). Afterwards, the
+	// sorted rays can be traced with a launch of (number of pixels, rays_per_pixel(aRayPass)) by trace_secondary_rays.rgen:
+	void record_sort(avk::command_buffer_t& aCommandBuffer, secondary_ray_pass aRayPass, const glm::vec3& aLightDir, const bounding_box& aSceneBounds)
+	{
+		// The G-buffer has been written, and the previous sorted rays might still be traced => wait for the ray tracing shaders:
+		aCommandBuffer.establish_global_memory_barrier(
+			avk::pipeline_stage::ray_tracing_shaders, /* -> */ avk::pipeline_stage::transfer | avk::pipeline_stage::compute_shader,
+			avk::memory_access::shader_buffers_and_images_write_access, /* -> */ avk::memory_access::transfer_write_access | avk::memory_access::shader_buffers_and_images_read_access
+		);
+		aCommandBuffer.handle().fillBuffer(mBinsBuffer->handle(), 0, VK_WHOLE_SIZE, 0u);
+		aCommandBuffer.establish_global_memory_barrier(
+			avk::pipeline_stage::transfer, /* -> */ avk::pipeline_stage::compute_shader,
+			avk::memory_access::transfer_write_access, /* -> */ avk::memory_access::shader_buffers_and_images_read_access | avk::memory_access::shader_buffers_and_images_write_access
+		);
+
+		const bool emptyScene = aSceneBounds.empty();
+		auto pushConstants = push_const_data_secondary_ray_binning{
+			glm::vec4{ emptyScene ? glm::vec3{ 0.0f } : aSceneBounds.mMin, 0.0f },
+			glm::vec4{ emptyScene ? glm::vec3{ 1.0f } : aSceneBounds.mMax - aSceneBounds.mMin, 0.0f },
+			glm::vec4{ aLightDir, 0.0f },
+			mResolution.x * mResolution.y,
+			static_cast<uint32_t>(aRayPass),
+			0u // count
+		};
+		const uint32_t numWorkgroups = (pushConstants.mNumPixels + 255u) / 256u;
+
+		// Count the rays per bin:
+		aCommandBuffer.bind_pipeline(avk::const_referenced(mBinPipeline));
+		aCommandBuffer.bind_descriptors(mBinPipeline->layout(), mDescriptorCache.get_or_create_descriptor_sets({
+			avk::descriptor_binding(0, 0, mGBuffer->as_storage_buffer()),
+			avk::descriptor_binding(0, 1, mBinsBuffer->as_storage_buffer()),
+			avk::descriptor_binding(0, 2, mSortedRaysBuffer->as_storage_buffer())
+		}));
+		aCommandBuffer.handle().pushConstants(mBinPipeline->layout_handle(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(pushConstants), &pushConstants);
+		aCommandBuffer.handle().dispatch(numWorkgroups, rays_per_pixel(aRayPass), 1u);
+		establish_compute_barrier(aCommandBuffer);
+
+		// Turn the counts into slots:
+		aCommandBuffer.bind_pipeline(avk::const_referenced(mPrefixSumPipeline));
+		aCommandBuffer.bind_descriptors(mPrefixSumPipeline->layout(), mDescriptorCache.get_or_create_descriptor_sets({
+			avk::descriptor_binding(0, 0, mBinsBuffer->as_storage_buffer())
+		}));
+		aCommandBuffer.handle().dispatch(1u, 1u, 1u);
+		establish_compute_barrier(aCommandBuffer);
+
+		// Write every ray into its bin's next slot (the same invocations find the same bins as while counting):
+		pushConstants.mScatter = 1u;
+		aCommandBuffer.bind_pipeline(avk::const_referenced(mBinPipeline));
+		aCommandBuffer.bind_descriptors(mBinPipeline->layout(), mDescriptorCache.get_or_create_descriptor_sets({
+			avk::descriptor_binding(0, 0, mGBuffer->as_storage_buffer()),
+			avk::descriptor_binding(0, 1, mBinsBuffer->as_storage_buffer()),
+			avk::descriptor_binding(0, 2, mSortedRaysBuffer->as_storage_buffer())
+		}));
+		aCommandBuffer.handle().pushConstants(mBinPipeline->layout_handle(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(pushConstants), &pushConstants);
+		aCommandBuffer.handle().dispatch(numWorkgroups, rays_per_pixel(aRayPass), 1u);
+
+		// The sorted rays are traced next:
+		aCommandBuffer.establish_global_memory_barrier(
+			avk::pipeline_stage::compute_shader, /* -> */ avk::pipeline_stage::ray_tracing_shaders,
+			avk::memory_access::shader_buffers_and_images_write_access, /* -> */ avk::memory_access::shader_buffers_and_images_read_access
+		);
+	}
+
+	[[nodiscard]] static uint32_t rays_per_pixel(secondary_ray_pass aRayPass)
+	{
+		return secondary_ray_pass::ambient_occlusion == aRayPass ? cMaxRaysPerPixel : 1u;
+	}
+
+	[[nodiscard]] glm::uvec2 resolution() const { return mResolution; }
+	[[nodiscard]] const avk::buffer& gbuffer() const { return mGBuffer; }
+	[[nodiscard]] const avk::buffer& bins_buffer() const { return mBinsBuffer; }
+	[[nodiscard]] const avk::buffer& sorted_rays_buffer() const { return mSortedRaysBuffer; }
+
+private:
+	static void establish_compute_barrier(avk::command_buffer_t& aCommandBuffer)
+	{
+		aCommandBuffer.establish_global_memory_barrier(
+			avk::pipeline_stage::compute_shader, /* -> */ avk::pipeline_stage::compute_shader,
+			avk::memory_access::shader_buffers_and_images_write_access, /* -> */ avk::memory_access::shader_buffers_and_images_read_access | avk::memory_access::shader_buffers_and_images_write_access
+		);
+	}
+
+	avk::descriptor_cache mDescriptorCache;
+
+	// Counts the rays per bin, or writes them into their bins' slots:
+	avk::compute_pipeline mBinPipeline;
+	// Scans the counts per bin in a single workgroup:
+	avk::compute_pipeline mPrefixSumPipeline;
+
+	// One secondary_ray_gbuffer_sample per pixel:
+	avk::buffer mGBuffer;
+	// secondary_ray_bins_header, followed by the bins:
+	avk::buffer mBinsBuffer;
+	// Up to cMaxRaysPerPixel rays per pixel, as pixel index << 3 | ray index within the pixel:
+	avk::buffer mSortedRaysBuffer;
+	glm::uvec2 mResolution{ 0u, 0u };
+};
@@ -0,0 +1,534 @@
+#pragma once
+
+#include <gvk.hpp>
+#include <imgui.h>
+#include <imgui_internal.h>
+#include <windows.h>
+#include <execution>
+
+#include "preprocessor_defines.hpp"
+#include "cpu_scope_profiler.hpp"
+#include "procedural_geometry_manager.hpp"
+#include "particle_stream_codec.hpp"
+
+// A simulation cache file contains the particles of many frames:
+//
+//   simulation_cache_header
+//   frame payloads, one after the other
+//   simulation_cache_frame x mNumFrames (the index, which is written last, s.t. frames can be appended while recording)
+//
+// The payloads are encoded with one of two codecs:
+//  - bounds_quantized: 4 x uint16_t per particle: the position, quantized relative to the frame's bounding box, and
+//    the radius, quantized relative to the frame's maximum radius. That's 8 bytes per particle instead of 16, and
+//    decoding is a plain linear pass over memory-mapped data. Every frame can be decoded on its own.
+//  - temporal_delta: The particle_stream_codec, which predicts particles from the previous frames. That's much smaller,
+//    but a frame can only be decoded after the previous frames, starting at the last keyframe.
+enum struct simulation_cache_codec : uint32_t
+{
+	bounds_quantized = 0,
+	temporal_delta = 1
+};
+
+struct simulation_cache_header
+{
+	char mMagic[4];
+	uint32_t mVersion;
+	uint32_t mNumFrames;
+	float mFramesPerSecond;
+	uint64_t mIndexOffset;
+	simulation_cache_codec mCodec;
+	uint32_t mKeyframeInterval; // The settings of the temporal_delta codec
+	float mQuantizationStep;
+	float mRadiusStep;
+};
+
+struct simulation_cache_frame
+{
+	uint64_t mOffset;
+	uint32_t mNumParticles;
+	float mMaxRadius;
+	glm::vec3 mBoundsMin;
+	glm::vec3 mBoundsExtent;
+};
+
+namespace simulation_cache_detail
+{
+	static constexpr uint32_t cVersion = 2u;
+	static constexpr uint32_t cComponentsPerParticle = 4u;
+	static constexpr float cQuantizationSteps = 65535.0f;
+}
+
+// A read-only view of a whole file:
+class mapped_file
+{
+public:
+	mapped_file() = default;
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+	~mapped_file() { close(); }
+
+	void open(const std::string& aFilePath)
+	{
+		close();
+		mFile = CreateFileA(aFilePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		LARGE_INTEGER size{};
+		if (INVALID_HANDLE_VALUE == mFile || !GetFileSizeEx(mFile, &size) || 0 == size.QuadPart) {
+			close();
+			throw gvk::runtime_error(fmt::format("Unable to open '{}' for memory mapping", aFilePath));
+		}
+		mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		mData = nullptr != mMapping ? static_cast<const uint8_t*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+		if (nullptr == mData) {
+			close();
+			throw gvk::runtime_error(fmt::format("Unable to memory-map '{}'", aFilePath));
+		}
+		mSize = static_cast<size_t>(size.QuadPart);
+	}
+
+	void close()
+	{
+		if (nullptr != mData) { UnmapViewOfFile(mData); }
+		if (nullptr != mMapping) { CloseHandle(mMapping); }
+		if (INVALID_HANDLE_VALUE != mFile) { CloseHandle(mFile); }
+		mData = nullptr;
+		mMapping = nullptr;
+		mFile = INVALID_HANDLE_VALUE;
+		mSize = 0;
+	}
+
+	[[nodiscard]] bool is_open() const { return nullptr != mData; }
+	[[nodiscard]] const uint8_t* data() const { return mData; }
+	[[nodiscard]] size_t size() const { return mSize; }
+
+private:
+	HANDLE mFile = INVALID_HANDLE_VALUE;
+	HANDLE mMapping = nullptr;
+	const uint8_t* mData = nullptr;
+	size_t mSize = 0;
+};
+
+// Appends frames to a simulation cache file, e.g. to record the particles of the running application:
+class simulation_cache_writer
+{
+public:
+	void open(const std::string& aFilePath, float aFramesPerSecond, simulation_cache_codec aCodec = simulation_cache_codec::bounds_quantized, particle_stream_settings aSettings = {})
+	{
+		mFile.open(aFilePath, std::ios::binary | std::ios::trunc);
+		if (!mFile.is_open()) {
+			throw gvk::runtime_error(fmt::format("Unable to open '{}' for writing a simulation cache", aFilePath));
+		}
+		mHeader = simulation_cache_header{ { 'F', 'N', 'S', 'C' }, simulation_cache_detail::cVersion, 0u, aFramesPerSecond, 0u,
+			aCodec, aSettings.mKeyframeInterval, aSettings.mQuantizationStep, aSettings.mRadiusStep };
+		mFile.write(reinterpret_cast<const char*>(&mHeader), sizeof(mHeader));
+		mOffset = sizeof(mHeader);
+		mRawBytes = 0;
+		mIndex.clear();
+		mEncoder = particle_stream_encoder{ aSettings };
+	}
+
+	void append_frame(const std::vector<glm::vec4>& aParticles)
+	{
+		using namespace simulation_cache_detail;
+		simulation_cache_frame frame{ mOffset, static_cast<uint32_t>(aParticles.size()), 0.0f, glm::vec3{ 0.0f }, glm::vec3{ 0.0f } };
+		mRawBytes += aParticles.size() * sizeof(glm::vec4);
+		mIndex.push_back(frame);
+		if (simulation_cache_codec::temporal_delta == mHeader.mCodec) {
+			mEncoded.clear();
+			mEncoder.encode_frame(aParticles, mEncoded);
+			mFile.write(reinterpret_cast<const char*>(mEncoded.data()), static_cast<std::streamsize>(mEncoded.size()));
+			mOffset += mEncoded.size();
+			return;
+		}
+
+		if (!aParticles.empty()) {
+			glm::vec3 boundsMin{ std::numeric_limits<float>::max() }, boundsMax{ std::numeric_limits<float>::lowest() };
+			for (const auto& p : aParticles) {
+				boundsMin = glm::min(boundsMin, glm::vec3{ p });
+				boundsMax = glm::max(boundsMax, glm::vec3{ p });
+				frame.mMaxRadius = std::max(frame.mMaxRadius, p.w);
+			}
+			frame.mBoundsMin = boundsMin;
+			frame.mBoundsExtent = boundsMax - boundsMin;
+		}
+
+		// Avoid divisions by zero for flat bounding boxes and zero radii:
+		const glm::vec3 scale = cQuantizationSteps / glm::max(frame.mBoundsExtent, glm::vec3{ 1e-20f });
+		const float radiusScale = cQuantizationSteps / std::max(frame.mMaxRadius, 1e-20f);
+		mQuantized.resize(aParticles.size() * cComponentsPerParticle);
+		for (size_t i = 0; i < aParticles.size(); ++i) {
+			const glm::vec3 q = glm::round((glm::vec3{ aParticles[i] } - frame.mBoundsMin) * scale);
+			mQuantized[cComponentsPerParticle * i + 0] = static_cast<uint16_t>(q.x);
+			mQuantized[cComponentsPerParticle * i + 1] = static_cast<uint16_t>(q.y);
+			mQuantized[cComponentsPerParticle * i + 2] = static_cast<uint16_t>(q.z);
+			mQuantized[cComponentsPerParticle * i + 3] = static_cast<uint16_t>(std::round(aParticles[i].w * radiusScale));
+		}
+		mFile.write(reinterpret_cast<const char*>(mQuantized.data()), static_cast<std::streamsize>(mQuantized.size() * sizeof(uint16_t)));
+		mOffset += mQuantized.size() * sizeof(uint16_t);
+		mIndex.back() = frame;
+	}
+
+	// Writes the index and completes the header:
+	void close()
+	{
+		if (!mFile.is_open()) {
+			return;
+		}
+		mHeader.mNumFrames = static_cast<uint32_t>(mIndex.size());
+		mHeader.mIndexOffset = mOffset;
+		mFile.write(reinterpret_cast<const char*>(mIndex.data()), static_cast<std::streamsize>(mIndex.size() * sizeof(simulation_cache_frame)));
+		mFile.seekp(0);
+		mFile.write(reinterpret_cast<const char*>(&mHeader), sizeof(mHeader));
+		mFile.close();
+	}
+
+	[[nodiscard]] bool is_open() const { return mFile.is_open(); }
+	[[nodiscard]] size_t number_of_frames() const { return mIndex.size(); }
+	// The size of the particles (as glm::vec4s) relative to the size of the payloads written so far:
+	[[nodiscard]] double compression_ratio() const { return mOffset > sizeof(mHeader) ? static_cast<double>(mRawBytes) / static_cast<double>(mOffset - sizeof(mHeader)) : 0.0; }
+
+private:
+	std::ofstream mFile;
+	simulation_cache_header mHeader{};
+	uint64_t mOffset = 0;
+	uint64_t mRawBytes = 0;
+	std::vector<simulation_cache_frame> mIndex;
+	std::vector<uint16_t> mQuantized;
+	particle_stream_encoder mEncoder;
+	std::vector<uint8_t> mEncoded;
+};
+
+// A memory-mapped simulation cache. Frames are decoded straight from the mapped memory:
+class simulation_cache
+{
+public:
+	void open(const std::string& aFilePath)
+	{
+		using namespace simulation_cache_detail;
+		mFile.open(aFilePath);
+		if (mFile.size() < sizeof(simulation_cache_header)) {
+			throw gvk::runtime_error(fmt::format("'{}' is not a simulation cache", aFilePath));
+		}
+		std::memcpy(&mHeader, mFile.data(), sizeof(mHeader));
+		if (0 != std::memcmp(mHeader.mMagic, "FNSC", 4) || cVersion != mHeader.mVersion) {
+			throw gvk::runtime_error(fmt::format("'{}' is not a simulation cache of version {}", aFilePath, cVersion));
+		}
+		if (mHeader.mIndexOffset + static_cast<uint64_t>(mHeader.mNumFrames) * sizeof(simulation_cache_frame) > mFile.size()) {
+			throw gvk::runtime_error(fmt::format("Simulation cache '{}' is truncated (has the recording been completed?)", aFilePath));
+		}
+		mIndex.resize(mHeader.mNumFrames);
+		std::memcpy(mIndex.data(), mFile.data() + mHeader.mIndexOffset, mIndex.size() * sizeof(simulation_cache_frame));
+		for (uint32_t f = 0; f < mHeader.mNumFrames; ++f) {
+			if (mIndex[f].mOffset > mHeader.mIndexOffset || mIndex[f].mOffset + frame_size(f) > mHeader.mIndexOffset) {
+				throw gvk::runtime_error(fmt::format("Simulation cache '{}' is corrupt", aFilePath));
+			}
+		}
+		mDecoder = particle_stream_decoder{ particle_stream_settings{ mHeader.mQuantizationStep, mHeader.mRadiusStep, mHeader.mKeyframeInterval } };
+		mLastDecodedFrame = std::numeric_limits<uint32_t>::max();
+	}
+
+	[[nodiscard]] uint32_t number_of_frames() const { return mHeader.mNumFrames; }
+	[[nodiscard]] float frames_per_second() const { return mHeader.mFramesPerSecond; }
+	[[nodiscard]] const simulation_cache_frame& frame(uint32_t aFrame) const { return mIndex[aFrame]; }
+	[[nodiscard]] size_t file_size() const { return mFile.size(); }
+	[[nodiscard]] simulation_cache_codec codec() const { return mHeader.mCodec; }
+
+	// The mapped bytes of a frame's payload:
+	[[nodiscard]] const uint8_t* frame_data(uint32_t aFrame) const { return mFile.data() + mIndex[aFrame].mOffset; }
+	[[nodiscard]] size_t frame_size(uint32_t aFrame) const
+	{
+		if (simulation_cache_codec::temporal_delta == mHeader.mCodec) {
+			const uint64_t end = aFrame + 1 < mIndex.size() ? mIndex[aFrame + 1].mOffset : mHeader.mIndexOffset;
+			return static_cast<size_t>(end - std::min(end, mIndex[aFrame].mOffset));
+		}
+		return static_cast<size_t>(mIndex[aFrame].mNumParticles) * simulation_cache_detail::cComponentsPerParticle * sizeof(uint16_t);
+	}
+
+	// Decodes a frame into positions (xyz) and radii (w). Returns how many particles had to be decoded, which is more
+	// than the frame's particles if the temporal_delta codec has to decode previous frames first (i.e. after seeking).
+	size_t decode_frame(uint32_t aFrame, std::vector<glm::vec4>& aParticles)
+	{
+		if (simulation_cache_codec::temporal_delta != mHeader.mCodec) {
+			dequantize_frame(aFrame, aParticles);
+			return aParticles.size();
+		}
+
+		// Continue after the previously decoded frame if possible, otherwise start over at the frame's keyframe:
+		const uint32_t keyframe = aFrame - aFrame % std::max(mHeader.mKeyframeInterval, 1u);
+		uint32_t first = keyframe;
+		if (std::numeric_limits<uint32_t>::max() != mLastDecodedFrame && mLastDecodedFrame < aFrame && mLastDecodedFrame >= keyframe) {
+			first = mLastDecodedFrame + 1;
+		}
+		else {
+			mDecoder.reset();
+		}
+		size_t numDecoded = 0;
+		for (uint32_t f = first; f <= aFrame; ++f) {
+			if (!mDecoder.decode_frame(frame_data(f), frame_size(f), aParticles)) {
+				mLastDecodedFrame = std::numeric_limits<uint32_t>::max();
+				throw gvk::runtime_error(fmt::format("Frame {} of the simulation cache is corrupt", f));
+			}
+			numDecoded += aParticles.size();
+		}
+		mLastDecodedFrame = aFrame;
+		return numDecoded;
+	}
+
+private:
+	// Dequantizes a frame of the bounds_quantized codec, in parallel batches:
+	void dequantize_frame(uint32_t aFrame, std::vector<glm::vec4>& aParticles) const
+	{
+		using namespace simulation_cache_detail;
+		const auto& f = mIndex[aFrame];
+		const auto* quantized = reinterpret_cast<const uint16_t*>(frame_data(aFrame));
+		const glm::vec3 scale = f.mBoundsExtent / cQuantizationSteps;
+		const float radiusScale = f.mMaxRadius / cQuantizationSteps;
+		aParticles.resize(f.mNumParticles);
+
+		constexpr size_t cBatchSize = 16384;
+		mBatches.resize((aParticles.size() + cBatchSize - 1) / cBatchSize);
+		std::iota(std::begin(mBatches), std::end(mBatches), size_t{ 0 });
+		std::for_each(std::execution::par, std::begin(mBatches), std::end(mBatches), [&](size_t aBatch) {
+			const size_t end = std::min(aParticles.size(), (aBatch + 1) * cBatchSize);
+			for (size_t i = aBatch * cBatchSize; i < end; ++i) {
+				const uint16_t* q = quantized + cComponentsPerParticle * i;
+				aParticles[i] = glm::vec4{ f.mBoundsMin + glm::vec3{ q[0], q[1], q[2] } * scale, static_cast<float>(q[3]) * radiusScale };
+			}
+		});
+	}
+
+	mapped_file mFile;
+	simulation_cache_header mHeader{};
+	std::vector<simulation_cache_frame> mIndex;
+	mutable std::vector<size_t> mBatches;
+	particle_stream_decoder mDecoder;
+	uint32_t mLastDecodedFrame = std::numeric_limits<uint32_t>::max();
+};
+
+// An invokee which plays back a simulation cache: Whenever the current cache frame changes, it is decoded and replaces
+// all particles (which rebuilds the TLAS once). A background thread touches the pages of the upcoming frames, s.t. the
+// render thread doesn't stall on page faults. The playback can be paused, scrubbed, and looped.
+// Furthermore, the current particles can be recorded into a new simulation cache, one cache frame per rendered frame.
+class simulation_cache_player : public gvk::invokee
+{
+public: // v== gvk::invokee overrides which will be invoked by the framework ==v
+	simulation_cache_player(std::optional<std::string> aCacheFilePath)
+		: invokee{ -90 } // Execute BEFORE the procedural_geometry_manager, s.t. the particles of the current frame are set before the TLAS is built
+		, mCacheFilePath{ std::move(aCacheFilePath) }
+	{}
+
+	void initialize() override
+	{
+		if (mCacheFilePath.has_value()) {
+			mCache.open(*mCacheFilePath);
+			LOG_INFO(fmt::format("Playing back simulation cache '{}': {} frames at {} fps, {}{}.", *mCacheFilePath, mCache.number_of_frames(), mCache.frames_per_second(), format_bytes(mCache.file_size()),
+				simulation_cache_codec::temporal_delta == mCache.codec() ? ", delta-coded" : ""));
+			mPlaying = mCache.number_of_frames() > 0;
+			mPrefetchThread = std::thread([this]() { prefetch(); });
+
+			// The particles are entirely controlled by the cache:
+			auto* procGeomMgr = gvk::current_composition()->element_by_type<procedural_geometry_manager>();
+			assert(nullptr != procGeomMgr);
+			procGeomMgr->set_spawning_enabled(false);
+		}
+
+		auto imguiManager = gvk::current_composition()->element_by_type<gvk::imgui_manager>();
+		if (nullptr != imguiManager) {
+			imguiManager->add_callback([this]() {
+				ImGui::Begin("Simulation Cache");
+				ImGui::SetWindowPos(ImVec2(422.0f, 306.0f), ImGuiCond_FirstUseEver);
+				ImGui::SetWindowSize(ImVec2(402.0f, 170.0f), ImGuiCond_FirstUseEver);
+				if (mCache.number_of_frames() > 0) {
+					ImGui::Checkbox("Play", &mPlaying);
+					ImGui::SameLine();
+					ImGui::Checkbox("Loop", &mLooping);
+					ImGui::SameLine();
+					ImGui::SliderFloat("Speed", &mSpeed, 0.1f, 4.0f, "%.1fx");
+					int frame = static_cast<int>(mCurrentFrame);
+					if (ImGui::SliderInt("Frame", &frame, 0, static_cast<int>(mCache.number_of_frames()) - 1)) {
+						seek(static_cast<uint32_t>(frame));
+					}
+					ImGui::Text("%u particles, decoded in %.2f ms (%.1f M particles/s)", mCache.frame(mCurrentFrame).mNumParticles, mLastDecodeMs, mLastDecodeThroughput * 1e-6f);
+				}
+				else {
+					ImGui::Text("No simulation cache is being played back.");
+				}
+				ImGui::Separator();
+				ImGui::InputText("Record To", mRecordPath.data(), mRecordPath.size());
+				bool recording = mWriter.is_open();
+				if (ImGui::Checkbox("Record", &recording)) {
+					if (recording) {
+						try {
+							mWriter.open(std::string(mRecordPath.data()), cRecordingFramesPerSecond, mRecordDeltaCoded ? simulation_cache_codec::temporal_delta : simulation_cache_codec::bounds_quantized);
+						}
+						catch (gvk::runtime_error& e) {
+							LOG_ERROR(e.what());
+						}
+					}
+					else {
+						stop_recording();
+					}
+				}
+				ImGui::SameLine();
+				if (mWriter.is_open()) {
+					ImGui::Text("%zu frames, %.1fx smaller", mWriter.number_of_frames(), mWriter.compression_ratio());
+				}
+				else {
+					ImGui::Checkbox("Delta Coding", &mRecordDeltaCoded);
+				}
+				ImGui::End();
+			});
+		}
+	}
+
+	void update() override
+	{
+		auto* procGeomMgr = gvk::current_composition()->element_by_type<procedural_geometry_manager>();
+		assert(nullptr != procGeomMgr);
+
+		// The particles of the previous frame are complete by now (spawning happens after this invokee's update):
+		if (mWriter.is_open()) {
+			PROFILE_CPU_SCOPE("record simulation cache frame");
+			mWriter.append_frame(procGeomMgr->particles());
+		}
+
+		if (0 == mCache.number_of_frames()) {
+			return;
+		}
+
+		// Advance the playback time, and find the cache frame which belongs to it:
+		if (mPlaying) {
+			const double duration = static_cast<double>(mCache.number_of_frames()) / static_cast<double>(mCache.frames_per_second());
+			mTime += static_cast<double>(gvk::time().delta_time()) * static_cast<double>(mSpeed);
+			if (mTime >= duration) {
+				if (mLooping) {
+					mTime = std::fmod(mTime, duration);
+				}
+				else {
+					mTime = duration;
+					mPlaying = false;
+				}
+			}
+		}
+		const auto frame = std::min(static_cast<uint32_t>(mTime * static_cast<double>(mCache.frames_per_second())), mCache.number_of_frames() - 1);
+		if (frame == mDisplayedFrame) {
+			return;
+		}
+		mCurrentFrame = frame;
+		mPrefetchWraps.store(mLooping, std::memory_order_relaxed);
+		mPrefetchFrom.store(frame + 1, std::memory_order_relaxed);
+		mPrefetchCondition.notify_one();
+
+		PROFILE_CPU_SCOPE("play simulation cache frame");
+		const auto start = std::chrono::steady_clock::now();
+		const auto numDecoded = mCache.decode_frame(frame, mDecoded);
+		const auto decodeSeconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+		procGeomMgr->set_particles(mDecoded.data(), mDecoded.size());
+		mLastDecodeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		mLastDecodeThroughput = decodeSeconds > 0.0f ? static_cast<float>(numDecoded) / decodeSeconds : 0.0f;
+		mDisplayedFrame = frame;
+	}
+
+	void finalize() override
+	{
+		stop_recording();
+		{
+			std::lock_guard<std::mutex> guard(mPrefetchMutex);
+			mStopRequested = true;
+		}
+		mPrefetchCondition.notify_one();
+		if (mPrefetchThread.joinable()) {
+			mPrefetchThread.join();
+		}
+	}
+
+	// Jumps to the given cache frame:
+	void seek(uint32_t aFrame)
+	{
+		mCurrentFrame = std::min(aFrame, std::max(mCache.number_of_frames(), 1u) - 1);
+		mTime = (static_cast<double>(mCurrentFrame) + 0.5) / static_cast<double>(mCache.frames_per_second());
+	}
+
+private:
+	void stop_recording()
+	{
+		if (mWriter.is_open()) {
+			LOG_INFO(fmt::format("Recorded {} frames into the simulation cache, {:.1f}x smaller than the raw particles.", mWriter.number_of_frames(), mWriter.compression_ratio()));
+		}
+		mWriter.close();
+	}
+
+	// The prefetch thread's loop: Touch every page of the next few frames, s.t. they are resident when they are decoded:
+	void prefetch()
+	{
+		cpu_profiler().set_current_thread_name("simulation cache prefetch");
+		constexpr size_t cPageSize = 4096;
+		uint32_t prefetchedUntil = 0;
+		uint32_t lastFrom = std::numeric_limits<uint32_t>::max();
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(mPrefetchMutex);
+				mPrefetchCondition.wait_for(lock, std::chrono::milliseconds(10), [&]() { return mStopRequested || mPrefetchFrom.load(std::memory_order_relaxed) != lastFrom; });
+				if (mStopRequested) {
+					return;
+				}
+			}
+			const auto from = mPrefetchFrom.load(std::memory_order_relaxed);
+			if (from == lastFrom) {
+				continue;
+			}
+			// After a jump, start over at the new position:
+			if (from < lastFrom || from > prefetchedUntil) {
+				prefetchedUntil = from;
+			}
+			lastFrom = from;
+
+			PROFILE_CPU_SCOPE("prefetch simulation cache frames");
+			const auto numFrames = mCache.number_of_frames();
+			for (; prefetchedUntil < from + cPrefetchFrames; ++prefetchedUntil) {
+				const auto f = mPrefetchWraps.load(std::memory_order_relaxed) ? prefetchedUntil % numFrames : prefetchedUntil;
+				if (f >= numFrames) {
+					break;
+				}
+				const auto* data = mCache.frame_data(f);
+				const auto size = mCache.frame_size(f);
+				volatile uint8_t sink = 0;
+				for (size_t offset = 0; offset < size; offset += cPageSize) {
+					sink = sink + data[offset];
+				}
+			}
+		}
+	}
+
+	// How many frames ahead of the current one are prefetched:
+	static constexpr uint32_t cPrefetchFrames = 8;
+	// Recordings are written with one cache frame per rendered frame, played back at this rate:
+	static constexpr float cRecordingFramesPerSecond = 60.0f;
+
+	std::optional<std::string> mCacheFilePath;
+	simulation_cache mCache;
+	std::vector<glm::vec4> mDecoded;
+
+	// Playback state:
+	bool mPlaying = false;
+	bool mLooping = true;
+	float mSpeed = 1.0f;
+	double mTime = 0.0;
+	uint32_t mCurrentFrame = 0;
+	uint32_t mDisplayedFrame = std::numeric_limits<uint32_t>::max();
+	float mLastDecodeMs = 0.0f;
+	float mLastDecodeThroughput = 0.0f;
+
+	// Recording:
+	std::array<char, 260> mRecordPath{ "particles.fnsc" };
+	bool mRecordDeltaCoded = true;
+	simulation_cache_writer mWriter;
+
+	// Prefetching:
+	std::thread mPrefetchThread;
+	std::mutex mPrefetchMutex;
+	std::condition_variable mPrefetchCondition;
+	std::atomic<uint32_t> mPrefetchFrom = 0;
+	std::atomic<bool> mPrefetchWraps = true;
+	bool mStopRequested = false;
+
+}; // End of simulation_cache_player
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <gvk.hpp>
+
+#include "preprocessor_defines.hpp"
+#include "cpu_to_gpu_data_types.hpp"
+#include "memory_accounting.hpp"
+#include "gpu_timestamp_profiler.hpp"
+#include "triangle_mesh_geometry_manager.hpp"
+#include "fluid_nightmare_main.hpp"
+
+// An invokee which bakes the occlusion by the static triangle mesh geometry per vertex: the fraction of the shadow rays
+// towards the (directional) light which are blocked, and the ambient occlusion. With baked occlusion enabled in the main
+// invokee, first_hit_closest_hit_shader.rchit interpolates these values and only traces rays against the particles.
+// The bake is performed on the GPU, in one launch per geometry instance, whenever the baked values are outdated: the
+// shadows when the light changes, the ambient occlusion when its rays' lengths change, and both when the visibility of
+// triangle mesh geometry instances changes.
+class static_occlusion_baker : public gvk::invokee
+{
+public: // v== gvk::invokee overrides which will be invoked by the framework ==v
+	static_occlusion_baker(avk::queue& aQueue)
+		: invokee{ -5 } // This invokee must execute AFTER the triangle_mesh_geometry_manager and BEFORE the main invokee
+		, mQueue{ &aQueue }
+	{}
+
+	void initialize() override
+	{
+		mDescriptorCache = gvk::context().create_descriptor_cache();
+
+		auto* triMeshGeomMgr = gvk::current_composition()->element_by_type<triangle_mesh_geometry_manager>();
+		assert(nullptr != triMeshGeomMgr);
+
+		// The baked occlusion buffer starts with every geometry instance's offset to its vertices:
+		const auto numInstances = triMeshGeomMgr->max_number_of_geometry_instances();
+		std::vector<uint32_t> initialData(numInstances, 0u);
+		uint32_t offset = numInstances;
+		for (uint32_t i = 0; i < numInstances; ++i) {
+			initialData[i] = offset;
+			offset += triMeshGeomMgr->vertex_count(triMeshGeomMgr->buffer_view_index_of_geometry_instance(i));
+		}
+		initialData.resize(offset, 0u);
+
+		mBakedOcclusionBuffer = gvk::context().create_buffer(
+			avk::memory_usage::device, {},
+			avk::storage_buffer_meta::create_from_data(initialData)
+		);
+		mBakedOcclusionBuffer->fill(
+			initialData.data(), 0,
+			avk::sync::with_barriers(gvk::context().main_window()->command_buffer_lifetime_handler())
+		);
+		memory_accounting().add(gpu_memory_category::vertex_data, *mBakedOcclusionBuffer);
+		mNumVertices = offset - numInstances;
+
+		mPipeline = gvk::context().create_ray_tracing_pipeline_for(
+			avk::define_shader_table(
+				avk::ray_generation_shader("shaders/occlusion_baking/bake_static_occlusion.rgen"),
+				avk::triangles_hit_group::create_with_rchit_only("shaders/occlusion_baking/bake_static_occlusion.rchit"),
+				avk::miss_shader("shaders/occlusion_baking/bake_static_occlusion.rmiss")
+			),
+			// Rays are only traced from the ray generation shader:
+			1,
+			avk::push_constant_binding_data{ avk::shader_type::ray_generation, 0, sizeof(push_const_data_occlusion_bake) },
+			avk::descriptor_binding(0, 0, avk::as_uniform_texel_buffer_views(triMeshGeomMgr->position_buffer_views())),
+			avk::descriptor_binding(0, 1, avk::as_uniform_texel_buffer_views(triMeshGeomMgr->normals_buffer_views())),
+			avk::descriptor_binding<avk::top_level_acceleration_structure>(1, 0, 1),
+			avk::descriptor_binding(1, 1, mBakedOcclusionBuffer->as_storage_buffer())
+		);
+
+#if ENABLE_SHADER_HOT_RELOADING_FOR_RAY_TRACING_PIPELINE
+		// Create an updater:
+		mUpdater.emplace();
+		mPipeline.enable_shared_ownership(); // The updater needs to hold a reference to it, so we need to enable shared ownership.
+		mUpdater->on(gvk::shader_files_changed_event(mPipeline))
+			.update(mPipeline);
+#endif
+	}
+
+	// Invoked by the framework every frame, after all update() calls, i.e. after the main invokee has built the TLAS:
+	void render() override
+	{
+		auto* mainInvokee = gvk::current_composition()->element_by_type<fluid_nightmare_main>();
+		assert(nullptr != mainInvokee);
+		auto* triMeshGeomMgr = gvk::current_composition()->element_by_type<triangle_mesh_geometry_manager>();
+		assert(nullptr != triMeshGeomMgr);
+
+		if (!mainInvokee->baked_occlusion_enabled() || 0 == mainInvokee->tlas_version()) {
+			return;
+		}
+
+		// Determine which parts of the baked occlusion are outdated:
+		const auto renderSettings = mainInvokee->get_render_settings();
+		std::vector<bool> visibility(triMeshGeomMgr->max_number_of_geometry_instances());
+		for (size_t i = 0; i < visibility.size(); ++i) {
+			visibility[i] = triMeshGeomMgr->is_geometry_instance_visible(i);
+		}
+		const bool visibilityChanged = !mBakedOnce || visibility != mBakedVisibility;
+		const bool bakeShadows = visibilityChanged || renderSettings.mLightDir != mBakedLightDir || mainInvokee->light_angular_radius() != mBakedLightAngularRadius;
+		const bool bakeAmbientOcclusion = visibilityChanged || renderSettings.mAmbientOcclusionMinDist != mBakedAmbientOcclusionMinDist || renderSettings.mAmbientOcclusionMaxDist != mBakedAmbientOcclusionMaxDist;
+		if (!bakeShadows && !bakeAmbientOcclusion) {
+			return;
+		}
+
+		PROFILE_CPU_SCOPE("record occlusion bake");
+		auto& commandPool = gvk::context().get_command_pool_for_single_use_command_buffers(*mQueue);
+		auto cmdbfr = commandPool->alloc_command_buffer(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+		cmdbfr->begin_recording();
+
+		// The previous frame's shaders might still read the baked values which are about to be overwritten:
+		cmdbfr->establish_execution_barrier(
+			avk::pipeline_stage::ray_tracing_shaders, /* -> */ avk::pipeline_stage::ray_tracing_shaders
+		);
+
+		cmdbfr->bind_pipeline(avk::const_referenced(mPipeline));
+		cmdbfr->bind_descriptors(mPipeline->layout(), mDescriptorCache.get_or_create_descriptor_sets({
+			avk::descriptor_binding(0, 0, avk::as_uniform_texel_buffer_views(triMeshGeomMgr->position_buffer_views())),
+			avk::descriptor_binding(0, 1, avk::as_uniform_texel_buffer_views(triMeshGeomMgr->normals_buffer_views())),
+			avk::descriptor_binding(1, 0, mainInvokee->get_tlas()),
+			avk::descriptor_binding(1, 1, mBakedOcclusionBuffer->as_storage_buffer())
+		}));
+
+		auto* gpuProfiler = gvk::current_composition()->element_by_type<gpu_timestamp_profiler>();
+		if (nullptr != gpuProfiler) { gpuProfiler->begin_pass(*cmdbfr, gpu_pass::occlusion_bake); }
+
+		// One launch per geometry instance, with one invocation per vertex. Invisible geometry instances are baked as well,
+		// s.t. the baked values are complete when they are made visible (which triggers a re-bake anyway):
+		uint32_t offset = triMeshGeomMgr->max_number_of_geometry_instances();
+		for (uint32_t i = 0; i < triMeshGeomMgr->max_number_of_geometry_instances(); ++i) {
+			const auto bufferViewIndex = triMeshGeomMgr->buffer_view_index_of_geometry_instance(i);
+			const auto numVertices = triMeshGeomMgr->vertex_count(bufferViewIndex);
+			auto pushConstantsForThisDrawCall = push_const_data_occlusion_bake{
+				triMeshGeomMgr->transform_of_geometry_instance(i),
+				glm::vec4{ renderSettings.mLightDir, 0.0f },
+				bufferViewIndex,
+				offset,
+				triMeshGeomMgr->instance_cull_mask(), // Only the triangle mesh geometry, i.e. without the particles
+				bakeShadows ? vk::Bool32{ VK_TRUE } : vk::Bool32{ VK_FALSE },
+				bakeAmbientOcclusion ? vk::Bool32{ VK_TRUE } : vk::Bool32{ VK_FALSE },
+				renderSettings.mAmbientOcclusionMinDist,
+				renderSettings.mAmbientOcclusionMaxDist,
+				mainInvokee->light_angular_radius()
+			};
+			cmdbfr->handle().pushConstants(mPipeline->layout_handle(), vk::ShaderStageFlagBits::eRaygenKHR, 0, sizeof(pushConstantsForThisDrawCall), &pushConstantsForThisDrawCall);
+			cmdbfr->trace_rays(
+				vk::Extent3D{ numVertices, 1u, 1u },
+				mPipeline->shader_binding_table(),
+				avk::using_raygen_group_at_index(0),
+				avk::using_miss_group_at_index(0),
+				avk::using_hit_group_at_index(0)
+			);
+			offset += numVertices;
+		}
+
+		if (nullptr != gpuProfiler) { gpuProfiler->end_pass(*cmdbfr, gpu_pass::occlusion_bake); }
+
+		// The main invokee's shaders, which are submitted afterwards, read the baked values:
+		cmdbfr->establish_global_memory_barrier(
+			avk::pipeline_stage::ray_tracing_shaders,                  /* -> */ avk::pipeline_stage::ray_tracing_shaders,
+			avk::memory_access::shader_buffers_and_images_write_access, /* -> */ avk::memory_access::shader_buffers_and_images_read_access
+		);
+
+		cmdbfr->end_recording();
+		mQueue->submit(avk::referenced(cmdbfr));
+		gvk::context().main_window()->handle_lifetime(avk::owned(cmdbfr));
+
+		// Remember what has been baked:
+		mBakedOnce = true;
+		mBakedVisibility = std::move(visibility);
+		mBakedLightDir = renderSettings.mLightDir;
+		mBakedLightAngularRadius = mainInvokee->light_angular_radius();
+		mBakedAmbientOcclusionMinDist = renderSettings.mAmbientOcclusionMinDist;
+		mBakedAmbientOcclusionMaxDist = renderSettings.mAmbientOcclusionMaxDist;
+		if (bakeShadows) { ++mNumShadowBakes; }
+		if (bakeAmbientOcclusion) { ++mNumAmbientOcclusionBakes; }
+	}
+
+	// The buffer which is to be bound to the main invokee's ray tracing pipeline:
+	[[nodiscard]] const avk::buffer& baked_occlusion_buffer() const { return mBakedOcclusionBuffer; }
+
+	// True if the baked occlusion is complete (and up to date, since it is re-baked in the same frame as something changes):
+	[[nodiscard]] bool has_baked_occlusion() const { return mBakedOnce; }
+
+	[[nodiscard]] uint32_t number_of_vertices() const { return mNumVertices; }
+	[[nodiscard]] uint64_t number_of_shadow_bakes() const { return mNumShadowBakes; }
+	[[nodiscard]] uint64_t number_of_ambient_occlusion_bakes() const { return mNumAmbientOcclusionBakes; }
+
+	// The TLAS is about to be destroyed => remove the descriptor sets which refer to it:
+	void remove_descriptor_sets_with_tlas(const avk::top_level_acceleration_structure_t& aTlas)
+	{
+		mDescriptorCache.remove_sets_with_handle(aTlas.acceleration_structure_handle());
+	}
+
+private:
+	// The queue where the bakes are submitted to:
+	avk::queue* mQueue;
+
+	avk::descriptor_cache mDescriptorCache;
+
+	// The ray tracing pipeline which bakes the occlusion of one geometry instance's vertices:
+	avk::ray_tracing_pipeline mPipeline;
+
+	// The geometry instances' offsets, followed by the baked occlusion per vertex, packed as packHalf2x16(shadowed fraction, ambient occlusion):
+	avk::buffer mBakedOcclusionBuffer;
+	uint32_t mNumVertices = 0;
+
+	// Everything the baked occlusion depends on, as of the most recent bake:
+	bool mBakedOnce = false;
+	std::vector<bool> mBakedVisibility;
+	glm::vec3 mBakedLightDir{ 0.0f };
+	float mBakedLightAngularRadius = 0.0f;
+	float mBakedAmbientOcclusionMinDist = 0.0f;
+	float mBakedAmbientOcclusionMaxDist = 0.0f;
+
+	uint64_t mNumShadowBakes = 0;
+	uint64_t mNumAmbientOcclusionBakes = 0;
+
+}; // End of static_occlusion_baker
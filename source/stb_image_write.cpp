@@ -0,0 +1,3 @@
+// The one translation unit which implements stb_image_write (which frame_capture.hpp uses to write PNG files):
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
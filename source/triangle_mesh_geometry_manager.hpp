@@ -1,264 +1,363 @@
-#pragma once
-
-#include <gvk.hpp>
-#include <imgui.h>
-#include <imgui_internal.h>
-
-#include "preprocessor_defines.hpp"
-#include "cpu_to_gpu_data_types.hpp"
-
-// An invokee that handles triangle mesh geometry:
-class triangle_mesh_geometry_manager : public gvk::invokee
-{
-public: // v== gvk::invokee overrides which will be invoked by the framework ==v
-	triangle_mesh_geometry_manager()
-		: invokee{ -10 } // This invokee must execute BEFORE the main invokee
-	{}
-
-	void initialize() override
-	{
-		// Load an ORCA scene from file:
-		auto orca = gvk::orca_scene_t::load_from_file("assets/sponza_and_terrain.fscene", aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
-
-		// Prepare a vector to hold all the material information of all models:
-		std::vector<gvk::material_config> materialData;
-
-		for (auto& model : orca->models()) {
-			auto& nameAndRangeInfo = mBlasNamesAndRanges.emplace_back(
-				model.mName,                                  // We are about to add several entries to mBlas for the model with this name
-				static_cast<int>(mAllGeometryInstances.size()),  // These ^ entries start at this index
-				-1                                            //  ... and we'll figure out the end index as we go.
-			);
-
-			// Get the distinct materials for every (static) mesh and accumulate them in a big array
-			// wich will be transformed and stored in a big buffer, eventually:
-			auto distinctMaterials = model.mLoadedModel->distinct_material_configs();
-			for (const auto& [materialConfig, meshIndices] : distinctMaterials) {
-				materialData.push_back(materialConfig);
-
-				auto selection = gvk::make_models_and_meshes_selection(model.mLoadedModel, meshIndices);
-				// Store all of this data in buffers and buffer views, s.t. we can access it later in ray tracing shaders
-				auto [posBfr, idxBfr] = gvk::create_vertex_and_index_buffers<avk::uniform_texel_buffer_meta, avk::read_only_input_to_acceleration_structure_builds_buffer_meta>(
-					selection,                                          // Select several indices (those with the same material) from a model
-					vk::BufferUsageFlagBits::eShaderDeviceAddressKHR    // Buffers need this additional flag to be made usable with ray tracing
-					);
-				auto nrmBfr = gvk::create_normals_buffer               <avk::uniform_texel_buffer_meta>(selection);
-				auto texBfr = gvk::create_2d_texture_coordinates_buffer<avk::uniform_texel_buffer_meta>(selection);
-
-				// Create a bottom level acceleration structure instance with this geometry.
-				auto blas = gvk::context().create_bottom_level_acceleration_structure(
-					{ avk::acceleration_structure_size_requirements::from_buffers(avk::vertex_index_buffer_pair{ posBfr, idxBfr }) },
-					false // no need to allow updates for static geometry
-				);
-				blas->build({ avk::vertex_index_buffer_pair{ posBfr, idxBfr } });
-
-				// Create a geometry instance entry per instance in the ORCA scene file:
-				for (const auto& inst : model.mInstances) {
-					auto bufferViewIndex = static_cast<uint32_t>(mTexCoordsBufferViews.size());
-
-					// Create a concrete geometry instance:
-					mAllGeometryInstances.push_back(
-						gvk::context().create_geometry_instance(blas) // Refer to the concrete BLAS
-							// Handle triangle meshes with an instance offset of 0:
-							.set_instance_offset(0)
-							// Set this instance's transformation matrix:
-							.set_transform_column_major(gvk::to_array(gvk::matrix_from_transforms(inst.mTranslation, glm::quat(inst.mRotation), inst.mScaling)))
-							// Set this instance's custom index, which is especially important since we'll use it in shaders
-							// to refer to the right material and also vertex data (these two are aligned index-wise):
-							.set_custom_index(bufferViewIndex)
-					);
-
-					// State that this geometry instance shall be included in TLAS generation by default:
-					mGeometryInstanceActive.push_back(true);
-
-					// Generate and store a description for what this geometry instance entry represents:
-					assert(!selection.empty());
-					std::string description = model.mName + " (" + inst.mName + "): "; // ...refers to one specific model, and...
-					for (const auto& tpl : selection) {
-						for (const auto meshIndex : std::get<1>(tpl)) {
-							description += std::get<0>(tpl)->name_of_mesh(meshIndex) + ", "; // ...to one or multiple submeshes.
-						}
-					}
-					mGeometryInstanceDescriptions.push_back(description.substr(0, description.size() - 2));
-				}
-
-				mBlas.push_back(std::move(blas)); // Move this BLAS s.t. we don't have to enable_shared_ownership. We're done with it here.
-
-				// After we have used positions and indices for building the BLAS, still need to create buffer views which allow us to access
-				// the per vertex data in ray tracing shaders, where they will be accessible via samplerBuffer- or usamplerBuffer-type uniforms.
-				mPositionsBufferViews.push_back(gvk::context().create_buffer_view(avk::owned(posBfr))); // owned is equivalent to move
-				mIndexBufferViews.push_back(gvk::context().create_buffer_view(avk::owned(idxBfr)));
-				mNormalsBufferViews.push_back(gvk::context().create_buffer_view(avk::owned(nrmBfr)));
-				mTexCoordsBufferViews.push_back(gvk::context().create_buffer_view(avk::owned(texBfr)));
-			}
-
-			// Set the final range-to index (one after the end, i.e. excluding the last index):
-			std::get<2>(nameAndRangeInfo) = static_cast<int>(mAllGeometryInstances.size());
-		}
-
-		// Set the flag in order to trigger initial TLAS build in our main invokee:
-		mTlasUpdateRequired = true;
-
-		// Convert the materials that were gathered above into a GPU-compatible format and generate and upload images to the GPU:
-		auto [gpuMaterials, imageSamplers] = gvk::convert_for_gpu_usage<gvk::material_gpu_data>(
-			materialData, true /* assume textures in sRGB */, true /* flip textures */,
-			avk::image_usage::general_texture,
-			avk::filter_mode::trilinear // No need for MIP-mapping (which would be activated with trilinear or anisotropic) since we're using ray tracing
-			);
-
-		// Store images in a member variable, otherwise they would get destroyed.
-		mImageSamplers = std::move(imageSamplers);
-
-		// Upload materials in GPU-compatible format into a GPU storage buffer:
-		mMaterialBuffer = gvk::context().create_buffer(
-			avk::memory_usage::host_visible, {},
-			avk::storage_buffer_meta::create_from_data(gpuMaterials)
-		);
-		mMaterialBuffer->fill(
-			gpuMaterials.data(), 0,
-			avk::sync::with_barriers(gvk::context().main_window()->command_buffer_lifetime_handler())
-		);
-
-		// Add an "ImGui Manager" which handles the UI specific to the requirements of this invokee:
-		auto imguiManager = gvk::current_composition()->element_by_type<gvk::imgui_manager>();
-		if (nullptr != imguiManager) {
-			imguiManager->add_callback([this]() {
-
-				ImGui::Begin("Triangle Mesh Geometry Instances");
-				ImGui::SetWindowPos(ImVec2(3.0f, 474.0f), ImGuiCond_FirstUseEver);
-				ImGui::SetWindowSize(ImVec2(410.0f, 606.0f), ImGuiCond_FirstUseEver);
-				
-				ImGui::Text("Specify which geometry instances to included in TLAS:");
-
-				ImGui::TextColored(ImVec4(0.f, .6f, .8f, 1.f), "Supported modifier keys:");
-				ImGui::TextColored(ImVec4(0.f, .6f, .8f, 1.f), " [Shift] + Click ... Enable only the selected item");
-				ImGui::TextColored(ImVec4(0.f, .6f, .8f, 1.f), " [Ctrl]  + Click ... Enable all items except the selected one");
-
-				// Let the user enable/disable some geometry instances w.r.t. includion into the TLAS:
-				assert(mAllGeometryInstances.size() == mGeometryInstanceActive.size());
-				assert(mAllGeometryInstances.size() == mGeometryInstanceDescriptions.size());
-				auto numActive = std::accumulate(std::begin(mGeometryInstanceActive), std::end(mGeometryInstanceActive), 0, [](auto cur, auto nxt) { return cur + (nxt ? 1 : 0); });
-				for (size_t i = 0; i < mAllGeometryInstances.size(); ++i) {
-					bool tmp = mGeometryInstanceActive[i];
-
-					// If there is only one active element left, it may not be disabled:
-					const bool disable = numActive <= 1 && tmp;
-					if (disable) {
-						ImGui::PushItemFlag(ImGuiItemFlags_Disabled, true);
-					}
-
-					auto clicked = ImGui::Checkbox((mGeometryInstanceDescriptions[i] + "##geominst" + std::to_string(i)).c_str(), &tmp);
-					mTlasUpdateRequired = mTlasUpdateRequired || clicked;
-
-					if (clicked && (gvk::input().key_down(gvk::key_code::left_shift) || gvk::input().key_down(gvk::key_code::right_shift))) {
-						for (size_t j = 0; j < mGeometryInstanceActive.size(); ++j) {
-							mGeometryInstanceActive[j] = j == i;
-						}
-					}
-					else if (clicked && (gvk::input().key_down(gvk::key_code::left_control) || gvk::input().key_down(gvk::key_code::right_control))) {
-						for (size_t j = 0; j < mGeometryInstanceActive.size(); ++j) {
-							mGeometryInstanceActive[j] = j != i;
-						}
-					}
-					else { // No modifier keys pressed => no special treatment:
-						mGeometryInstanceActive[i] = tmp;
-					}
-
-					if (disable) {
-						ImGui::PopItemFlag();
-					}
-				}
-
-				ImGui::End();
-			});
-		}
-	}
-
-	// Returns true if a TLAS that uses the geometry of this invokee must be updated because the geometry (selection) has changed.
-	[[nodiscard]] bool has_updated_geometry_for_tlas() const
-	{
-		return mTlasUpdateRequired;
-	}
-
-	void reset_update_required_flag()
-	{
-		mTlasUpdateRequired = false;
-	}
-	
-	// Return the active geometry instances to the caller, who will use it for a TLAS build:
-	[[nodiscard]] std::vector<avk::geometry_instance> get_active_geometry_instances_for_tlas_build()
-	{
-		std::vector<avk::geometry_instance> activeGeometryInstances;
-		for (size_t i = 0; i < mAllGeometryInstances.size(); ++i) {
-			if (mGeometryInstanceActive[i]) {
-				activeGeometryInstances.push_back(mAllGeometryInstances[i]);
-			}
-		}
-		return activeGeometryInstances;
-	}
-
-	// Invoked by the framework every frame:
-	void update() override
-	{
-	}
-
-	// Some getters that will be used by the main invokee:
-	uint32_t max_number_of_geometry_instances() const { return static_cast<uint32_t>(mAllGeometryInstances.size()); }
-	const auto& material_buffer() const { return mMaterialBuffer; }
-	const auto& image_samplers() const { return mImageSamplers; }
-	const auto& index_buffer_views() const { return mIndexBufferViews; }
-	const auto& position_buffer_views() const { return mPositionsBufferViews; }
-	const auto& tex_coords_buffer_views() const { return mTexCoordsBufferViews; }
-	const auto& normals_buffer_views() const { return mNormalsBufferViews; }
-	
-private: // v== Member variables ==v
-
-	// ------------------ Buffers and Buffer Views ------------------
-
-	// A buffer that stores all material data of the loaded models:
-	avk::buffer mMaterialBuffer;
-
-	// Several images(+samplers) which store the material data's images:
-	std::vector<avk::image_sampler> mImageSamplers;
-
-	// Buffer views which provide the indexed geometry's index data:
-	std::vector<avk::buffer_view> mIndexBufferViews;
-
-	// Buffer views which provide the indexed geometry's positions data:
-	std::vector<avk::buffer_view> mPositionsBufferViews;
-
-	// Buffer views which provide the indexed geometry's texture coordinates data:
-	std::vector<avk::buffer_view> mTexCoordsBufferViews;
-
-	// Buffer views which provide the indexed geometry's normals data:
-	std::vector<avk::buffer_view> mNormalsBufferViews;
-	
-	// ---------------- Acceleration Structures --------------------
-
-	// A vector which stores a model name and a range of indices, refering to the mBlas vector.
-	// The indices referred to by the [std:get<1>, std::get<2>) range are the associated submeshes.
-	std::vector<std::tuple<std::string, int, int>> mBlasNamesAndRanges;
-
-	// A vector of multiple bottom-level acceleration structures (BLAS) which store geometry:
-	std::vector<avk::bottom_level_acceleration_structure> mBlas;
-
-	// Geometry instance data which store the instance data per BLAS inststance:
-	//    In our specific setup, this will be perfectly aligned with:
-	//     - mIndexBufferViews
-	//     - mTexCoordBufferViews
-	//     - mNormalsBufferViews
-	std::vector<avk::geometry_instance> mAllGeometryInstances;
-
-	// A description per geometry instance to roughly describe what they refer to:
-	std::vector<std::string> mGeometryInstanceDescriptions;
-
-	// ------------------- UI settings -----------------------
-
-	// One boolean per geometry instance to tell if it shall be included in the
-	// generation of the TLAS or not:
-	std::vector<bool> mGeometryInstanceActive;
-
-	// True when an TLAS update is immanent:
-	bool mTlasUpdateRequired = true;
-
-}; // End of triangle_mesh_geometry_manager
+#pragma once
+
+#include <gvk.hpp>
+#include <imgui.h>
+#include <imgui_internal.h>
+
+#include "preprocessor_defines.hpp"
+#include "cpu_to_gpu_data_types.hpp"
+#include "memory_accounting.hpp"
+#include "cpu_kernels.hpp"
+
+// An invokee that handles triangle mesh geometry:
+class triangle_mesh_geometry_manager : public gvk::invokee
+{
+public: // v== gvk::invokee overrides which will be invoked by the framework ==v
+	triangle_mesh_geometry_manager()
+		: invokee{ -10 } // This invokee must execute BEFORE the main invokee
+	{}
+
+	void initialize() override
+	{
+		// Load an ORCA scene from file:
+		auto orca = gvk::orca_scene_t::load_from_file("assets/sponza_and_terrain.fscene", aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
+
+		// Prepare a vector to hold all the material information of all models:
+		std::vector<gvk::material_config> materialData;
+
+		for (auto& model : orca->models()) {
+			auto& nameAndRangeInfo = mBlasNamesAndRanges.emplace_back(
+				model.mName,                                  // We are about to add several entries to mBlas for the model with this name
+				static_cast<int>(mAllGeometryInstances.size()),  // These ^ entries start at this index
+				-1                                            //  ... and we'll figure out the end index as we go.
+			);
+
+			// Get the distinct materials for every (static) mesh and accumulate them in a big array
+			// wich will be transformed and stored in a big buffer, eventually:
+			auto distinctMaterials = model.mLoadedModel->distinct_material_configs();
+			for (const auto& [materialConfig, meshIndices] : distinctMaterials) {
+				materialData.push_back(materialConfig);
+
+				auto selection = gvk::make_models_and_meshes_selection(model.mLoadedModel, meshIndices);
+				// Store all of this data in buffers and buffer views, s.t. we can access it later in ray tracing shaders
+				auto [posBfr, idxBfr] = gvk::create_vertex_and_index_buffers<avk::uniform_texel_buffer_meta, avk::read_only_input_to_acceleration_structure_builds_buffer_meta>(
+					selection,                                          // Select several indices (those with the same material) from a model
+					vk::BufferUsageFlagBits::eShaderDeviceAddressKHR    // Buffers need this additional flag to be made usable with ray tracing
+					);
+				auto nrmBfr = gvk::create_normals_buffer               <avk::uniform_texel_buffer_meta>(selection);
+				auto texBfr = gvk::create_2d_texture_coordinates_buffer<avk::uniform_texel_buffer_meta>(selection);
+
+				// Bounds of the selected meshes in model space, which are transformed into the scene's bounds per instance below:
+				// The vertices of all selected meshes are concatenated in the buffers => count them, too:
+				bounding_box meshBounds;
+				uint32_t vertexCount = 0;
+				for (const auto meshIndex : meshIndices) {
+					const auto positions = model.mLoadedModel->positions_for_mesh(meshIndex);
+					for (const auto& position : positions) {
+						meshBounds.add(position);
+					}
+					vertexCount += static_cast<uint32_t>(positions.size());
+				}
+				mVertexCounts.push_back(vertexCount);
+				memory_accounting().add(gpu_memory_category::vertex_data, *posBfr);
+				memory_accounting().add(gpu_memory_category::vertex_data, *idxBfr);
+				memory_accounting().add(gpu_memory_category::vertex_data, *nrmBfr);
+				memory_accounting().add(gpu_memory_category::vertex_data, *texBfr);
+
+				// Create a bottom level acceleration structure instance with this geometry.
+				auto blas = gvk::context().create_bottom_level_acceleration_structure(
+					{ avk::acceleration_structure_size_requirements::from_buffers(avk::vertex_index_buffer_pair{ posBfr, idxBfr }) },
+					false // no need to allow updates for static geometry
+				);
+				blas->build({ avk::vertex_index_buffer_pair{ posBfr, idxBfr } });
+				memory_accounting().gpu(gpu_memory_category::blas).add(blas->required_acceleration_structure_size());
+				memory_accounting().gpu(gpu_memory_category::acceleration_structure_scratch).record_transient(blas->required_scratch_buffer_build_size());
+
+				// Create a geometry instance entry per instance in the ORCA scene file:
+				for (const auto& inst : model.mInstances) {
+					auto bufferViewIndex = static_cast<uint32_t>(mTexCoordsBufferViews.size());
+					const auto instanceTransform = gvk::matrix_from_transforms(inst.mTranslation, glm::quat(inst.mRotation), inst.mScaling);
+					for (int i = 0; i < 8; ++i) {
+						const glm::vec3 corner{ (i & 1) ? meshBounds.mMax.x : meshBounds.mMin.x, (i & 2) ? meshBounds.mMax.y : meshBounds.mMin.y, (i & 4) ? meshBounds.mMax.z : meshBounds.mMin.z };
+						mSceneBounds.add(glm::vec3{ instanceTransform * glm::vec4{ corner, 1.0f } });
+					}
+
+					// The first few geometry instances get a mask bit of their own, all the others share one:
+					const auto geomInstIndex = static_cast<uint32_t>(mAllGeometryInstances.size());
+					const auto instanceMask = geomInstIndex < cNumDedicatedInstanceMaskBits ? (1u << geomInstIndex) : cSharedTriangleMeshesInstanceMask;
+
+					// Create a concrete geometry instance:
+					mAllGeometryInstances.push_back(
+						gvk::context().create_geometry_instance(blas) // Refer to the concrete BLAS
+							// Handle triangle meshes with an instance offset of 0:
+							.set_instance_offset(0)
+							// Set this instance's transformation matrix:
+							.set_transform_column_major(gvk::to_array(instanceTransform))
+							// Set this instance's custom index, which is especially important since we'll use it in shaders
+							// to refer to the right material and also vertex data (these two are aligned index-wise):
+							.set_custom_index(bufferViewIndex)
+							// Set this instance's mask, which is tested against the cull mask of every ray:
+							.set_mask(instanceMask)
+					);
+					mInstanceMasks.push_back(instanceMask);
+					mInstanceBufferViewIndices.push_back(bufferViewIndex);
+					mInstanceTransforms.push_back(instanceTransform);
+
+					// State that this geometry instance shall be visible by default:
+					mGeometryInstanceActive.push_back(true);
+
+					// Generate and store a description for what this geometry instance entry represents:
+					assert(!selection.empty());
+					std::string description = model.mName + " (" + inst.mName + "): "; // ...refers to one specific model, and...
+					for (const auto& tpl : selection) {
+						for (const auto meshIndex : std::get<1>(tpl)) {
+							description += std::get<0>(tpl)->name_of_mesh(meshIndex) + ", "; // ...to one or multiple submeshes.
+						}
+					}
+					mGeometryInstanceDescriptions.push_back(description.substr(0, description.size() - 2));
+				}
+
+				mBlas.push_back(std::move(blas)); // Move this BLAS s.t. we don't have to enable_shared_ownership. We're done with it here.
+
+				// After we have used positions and indices for building the BLAS, still need to create buffer views which allow us to access
+				// the per vertex data in ray tracing shaders, where they will be accessible via samplerBuffer- or usamplerBuffer-type uniforms.
+				mPositionsBufferViews.push_back(gvk::context().create_buffer_view(avk::owned(posBfr))); // owned is equivalent to move
+				mIndexBufferViews.push_back(gvk::context().create_buffer_view(avk::owned(idxBfr)));
+				mNormalsBufferViews.push_back(gvk::context().create_buffer_view(avk::owned(nrmBfr)));
+				mTexCoordsBufferViews.push_back(gvk::context().create_buffer_view(avk::owned(texBfr)));
+			}
+
+			// Set the final range-to index (one after the end, i.e. excluding the last index):
+			std::get<2>(nameAndRangeInfo) = static_cast<int>(mAllGeometryInstances.size());
+		}
+
+		// Set the flag in order to trigger initial TLAS build in our main invokee:
+		mTlasUpdateRequired = true;
+
+		// Convert the materials that were gathered above into a GPU-compatible format and generate and upload images to the GPU:
+		auto [gpuMaterials, imageSamplers] = gvk::convert_for_gpu_usage<gvk::material_gpu_data>(
+			materialData, true /* assume textures in sRGB */, true /* flip textures */,
+			avk::image_usage::general_texture,
+			avk::filter_mode::trilinear // No need for MIP-mapping (which would be activated with trilinear or anisotropic) since we're using ray tracing
+			);
+
+		// Store images in a member variable, otherwise they would get destroyed.
+		mImageSamplers = std::move(imageSamplers);
+		for (const auto& imageSampler : mImageSamplers) {
+			memory_accounting().add(gpu_memory_category::textures, *imageSampler);
+		}
+
+		// Upload materials in GPU-compatible format into a GPU storage buffer:
+		mMaterialBuffer = gvk::context().create_buffer(
+			avk::memory_usage::host_visible, {},
+			avk::storage_buffer_meta::create_from_data(gpuMaterials)
+		);
+		mMaterialBuffer->fill(
+			gpuMaterials.data(), 0,
+			avk::sync::with_barriers(gvk::context().main_window()->command_buffer_lifetime_handler())
+		);
+		memory_accounting().add(gpu_memory_category::materials, *mMaterialBuffer);
+
+		// Account for the (static) host-side data which we keep around:
+		uint64_t hostBytes = mAllGeometryInstances.capacity() * sizeof(avk::geometry_instance) + mInstanceMasks.capacity() * sizeof(uint32_t)
+			+ mInstanceBufferViewIndices.capacity() * sizeof(uint32_t) + mInstanceTransforms.capacity() * sizeof(glm::mat4) + mVertexCounts.capacity() * sizeof(uint32_t);
+		for (const auto& description : mGeometryInstanceDescriptions) {
+			hostBytes += sizeof(std::string) + description.capacity();
+		}
+		memory_accounting().host(host_memory_subsystem::triangle_meshes).set(hostBytes);
+
+		// Add an "ImGui Manager" which handles the UI specific to the requirements of this invokee:
+		auto imguiManager = gvk::current_composition()->element_by_type<gvk::imgui_manager>();
+		if (nullptr != imguiManager) {
+			imguiManager->add_callback([this]() {
+
+				ImGui::Begin("Triangle Mesh Geometry Instances");
+				ImGui::SetWindowPos(ImVec2(3.0f, 474.0f), ImGuiCond_FirstUseEver);
+				ImGui::SetWindowSize(ImVec2(410.0f, 606.0f), ImGuiCond_FirstUseEver);
+				
+				ImGui::Text("Specify which geometry instances shall be visible:");
+
+				ImGui::TextColored(ImVec4(0.f, .6f, .8f, 1.f), "Supported modifier keys:");
+				ImGui::TextColored(ImVec4(0.f, .6f, .8f, 1.f), " [Shift] + Click ... Enable only the selected item");
+				ImGui::TextColored(ImVec4(0.f, .6f, .8f, 1.f), " [Ctrl]  + Click ... Enable all items except the selected one");
+
+				// Let the user enable/disable some geometry instances w.r.t. their visibility:
+				assert(mAllGeometryInstances.size() == mGeometryInstanceActive.size());
+				assert(mAllGeometryInstances.size() == mGeometryInstanceDescriptions.size());
+				auto numActive = std::accumulate(std::begin(mGeometryInstanceActive), std::end(mGeometryInstanceActive), 0, [](auto cur, auto nxt) { return cur + (nxt ? 1 : 0); });
+				for (size_t i = 0; i < mAllGeometryInstances.size(); ++i) {
+					bool tmp = mGeometryInstanceActive[i];
+
+					// If there is only one active element left, it may not be disabled:
+					const bool disable = numActive <= 1 && tmp;
+					if (disable) {
+						ImGui::PushItemFlag(ImGuiItemFlags_Disabled, true);
+					}
+
+					// Visibility changes are applied in update(), either via the cull mask or via the instance masks:
+					auto clicked = ImGui::Checkbox((mGeometryInstanceDescriptions[i] + "##geominst" + std::to_string(i)).c_str(), &tmp);
+
+					if (clicked && (gvk::input().key_down(gvk::key_code::left_shift) || gvk::input().key_down(gvk::key_code::right_shift))) {
+						for (size_t j = 0; j < mGeometryInstanceActive.size(); ++j) {
+							mGeometryInstanceActive[j] = j == i;
+						}
+					}
+					else if (clicked && (gvk::input().key_down(gvk::key_code::left_control) || gvk::input().key_down(gvk::key_code::right_control))) {
+						for (size_t j = 0; j < mGeometryInstanceActive.size(); ++j) {
+							mGeometryInstanceActive[j] = j != i;
+						}
+					}
+					else { // No modifier keys pressed => no special treatment:
+						mGeometryInstanceActive[i] = tmp;
+					}
+
+					if (disable) {
+						ImGui::PopItemFlag();
+					}
+				}
+
+				ImGui::End();
+			});
+		}
+	}
+
+	// Returns true if a TLAS that uses the geometry of this invokee must be rebuilt because the geometry has changed.
+	// (Visibility changes do not require a rebuild. They are handled via cull mask and instance masks.)
+	[[nodiscard]] bool has_updated_geometry_for_tlas() const
+	{
+		return mTlasUpdateRequired;
+	}
+
+	// Returns true if a TLAS that uses the geometry of this invokee must be refitted (i.e., update-only build) because
+	// the instance mask of at least one geometry instance without a dedicated mask bit has changed.
+	[[nodiscard]] bool has_updated_instance_masks_for_tlas() const
+	{
+		return mTlasRefitRequired;
+	}
+
+	void reset_update_required_flag()
+	{
+		mTlasUpdateRequired = false;
+		mTlasRefitRequired = false;
+	}
+	
+	// Return all the geometry instances (with their current instance masks) to the caller, who will use it for a TLAS build.
+	// Invisible geometry instances are included as well. They are either culled via the cull mask or have an instance mask of 0.
+	[[nodiscard]] const std::vector<avk::geometry_instance>& get_geometry_instances_for_tlas_build() const
+	{
+		return mAllGeometryInstances;
+	}
+
+	// Returns the cull mask bits which make all the currently visible geometry instances visible to rays:
+	[[nodiscard]] uint32_t instance_cull_mask() const
+	{
+		uint32_t cullMask = cSharedTriangleMeshesInstanceMask; // The instance masks handle visibility of these
+		const auto numDedicated = std::min(mGeometryInstanceActive.size(), static_cast<size_t>(cNumDedicatedInstanceMaskBits));
+		for (size_t i = 0; i < numDedicated; ++i) {
+			if (mGeometryInstanceActive[i]) {
+				cullMask |= (1u << i);
+			}
+		}
+		return cullMask;
+	}
+
+	// Invoked by the framework every frame:
+	void update() override
+	{
+		// Geometry instances with a dedicated mask bit are handled entirely via the cull mask. For the others,
+		// we have to change their instance masks, which requires an update-only build of the TLAS:
+		for (size_t i = cNumDedicatedInstanceMaskBits; i < mAllGeometryInstances.size(); ++i) {
+			const auto instanceMask = mGeometryInstanceActive[i] ? cSharedTriangleMeshesInstanceMask : 0u;
+			if (instanceMask != mInstanceMasks[i]) {
+				mAllGeometryInstances[i].set_mask(instanceMask);
+				mInstanceMasks[i] = instanceMask;
+				mTlasRefitRequired = true;
+			}
+		}
+	}
+
+	// Some getters that will be used by the main invokee:
+	uint32_t max_number_of_geometry_instances() const { return static_cast<uint32_t>(mAllGeometryInstances.size()); }
+	bool is_geometry_instance_visible(size_t aIndex) const { return mGeometryInstanceActive[aIndex]; }
+	// Changes the visibility like the UI does (e.g., used by the benchmark_runner):
+	void set_geometry_instance_visible(size_t aIndex, bool aVisible) { mGeometryInstanceActive[aIndex] = aVisible; }
+	const auto& material_buffer() const { return mMaterialBuffer; }
+	const auto& image_samplers() const { return mImageSamplers; }
+	const auto& index_buffer_views() const { return mIndexBufferViews; }
+	const auto& position_buffer_views() const { return mPositionsBufferViews; }
+	const auto& tex_coords_buffer_views() const { return mTexCoordsBufferViews; }
+	const auto& normals_buffer_views() const { return mNormalsBufferViews; }
+	// Number of vertices per buffer view:
+	uint32_t vertex_count(size_t aBufferViewIndex) const { return mVertexCounts[aBufferViewIndex]; }
+	// The buffer views (i.e., the custom index) and the transformation matrix of a geometry instance:
+	uint32_t buffer_view_index_of_geometry_instance(size_t aIndex) const { return mInstanceBufferViewIndices[aIndex]; }
+	const glm::mat4& transform_of_geometry_instance(size_t aIndex) const { return mInstanceTransforms[aIndex]; }
+	// World space bounds of all geometry instances (visible or not):
+	const bounding_box& scene_bounds() const { return mSceneBounds; }
+	
+private: // v== Member variables ==v
+
+	// ------------------ Buffers and Buffer Views ------------------
+
+	// A buffer that stores all material data of the loaded models:
+	avk::buffer mMaterialBuffer;
+
+	// Several images(+samplers) which store the material data's images:
+	std::vector<avk::image_sampler> mImageSamplers;
+
+	// Buffer views which provide the indexed geometry's index data:
+	std::vector<avk::buffer_view> mIndexBufferViews;
+
+	// Buffer views which provide the indexed geometry's positions data:
+	std::vector<avk::buffer_view> mPositionsBufferViews;
+
+	// Buffer views which provide the indexed geometry's texture coordinates data:
+	std::vector<avk::buffer_view> mTexCoordsBufferViews;
+
+	// Buffer views which provide the indexed geometry's normals data:
+	std::vector<avk::buffer_view> mNormalsBufferViews;
+
+	// Number of vertices in each of the buffer views above:
+	std::vector<uint32_t> mVertexCounts;
+
+	// World space bounds of all geometry instances:
+	bounding_box mSceneBounds;
+	
+	// ---------------- Acceleration Structures --------------------
+
+	// A vector which stores a model name and a range of indices, refering to the mBlas vector.
+	// The indices referred to by the [std:get<1>, std::get<2>) range are the associated submeshes.
+	std::vector<std::tuple<std::string, int, int>> mBlasNamesAndRanges;
+
+	// A vector of multiple bottom-level acceleration structures (BLAS) which store geometry:
+	std::vector<avk::bottom_level_acceleration_structure> mBlas;
+
+	// Geometry instance data which store the instance data per BLAS inststance:
+	//    In our specific setup, this will be perfectly aligned with:
+	//     - mIndexBufferViews
+	//     - mTexCoordBufferViews
+	//     - mNormalsBufferViews
+	std::vector<avk::geometry_instance> mAllGeometryInstances;
+
+	// A description per geometry instance to roughly describe what they refer to:
+	std::vector<std::string> mGeometryInstanceDescriptions;
+
+	// The instance mask which is currently set for each geometry instance:
+	std::vector<uint32_t> mInstanceMasks;
+
+	// The buffer view index (= custom index) and the transformation matrix of each geometry instance:
+	std::vector<uint32_t> mInstanceBufferViewIndices;
+	std::vector<glm::mat4> mInstanceTransforms;
+
+	// ------------------- UI settings -----------------------
+
+	// One boolean per geometry instance to tell if it shall be visible or not:
+	std::vector<bool> mGeometryInstanceActive;
+
+	// True when an TLAS update is immanent:
+	bool mTlasUpdateRequired = true;
+
+	// True when an update-only build of the TLAS is required due to changed instance masks:
+	bool mTlasRefitRequired = false;
+
+}; // End of triangle_mesh_geometry_manager